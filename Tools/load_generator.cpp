@@ -0,0 +1,352 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fdms/host_switch.h>
+#include <diners/latency_histogram.h>
+#include "traffic_mix.h"
+
+// Drives HostSwitch the way the payment application does (PreConnect,
+// WaitForConnection, operation, Disconnect) with a configurable mix of
+// operations and hosts, and reports throughput, latency percentiles and
+// failures per host and operation.
+//
+//   load_generator [--hosts=fdms:0=1,amex:1=1,diners:2=1]
+//                  [--mix=sale=70,void=10,refund=5,reversal=5,tip_adjust=5,
+//                         batch_upload=3,settlement=2]
+//                  [--concurrency=N] [--rate=TPS] [--duration=S]
+//                  [--batch-size=N] [--seed=N]
+//
+// Host indexes refer to the host definitions of the terminal settings;
+// point their comms host names at local stand-ins (diners_host/Tools
+// diners_simulator for Diners).
+//
+// Each of the --concurrency workers owns a HostSwitch and runs one
+// operation at a time (closed loop). With --rate, workers start operations
+// on a fixed schedule instead and latency is measured from the scheduled
+// start, so a slow host is not hidden by the generator slowing down.
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+enum Outcome {
+  COMPLETED,
+  TRANSIENT_FAILURE,
+  PERM_FAILURE,
+  CONNECT_FAILED,
+  kOutcomeCount
+};
+
+const char* const kOutcomeNames[kOutcomeCount] = { "completed", "transient",
+    "perm", "connect" };
+
+struct Config {
+  Config()
+      : concurrency(4),
+        rate(0),
+        duration(30),
+        batch_size(10),
+        seed(1) {
+  }
+
+  loadgen::TrafficMix mix;
+  unsigned int concurrency;
+  double rate;
+  unsigned int duration;
+  unsigned int batch_size;
+  unsigned int seed;
+};
+
+// Results of one host/operation pair
+struct Cell {
+  Cell() {
+    for (int i = 0; i < kOutcomeCount; i++) {
+      outcomes[i] = 0;
+    }
+  }
+
+  diners::LatencyHistogram latency;
+  std::uint64_t outcomes[kOutcomeCount];
+};
+
+typedef std::vector<Cell> Results;  // host * kOperationCount + operation
+
+// DE 11 is six digits and 000000 is not a valid STAN; every worker draws
+// from the same counter so that no two requests in flight share one.
+unsigned int NextStan(std::atomic<unsigned int>& counter) {
+  const unsigned int kStanCount = 999999;
+  return counter.fetch_add(1, std::memory_order_relaxed) % kStanCount + 1;
+}
+
+fdms::Transaction MakeTransaction(unsigned int stan) {
+  fdms::Transaction tx;
+
+  tx.amount = types::Amount("SGD", 12550);
+  tx.stan = stan;
+  tx.nii = 1;
+  tx.tid = "10000001";
+  tx.mid = "000000000000001";
+  tx.tpdu = "6000010000";
+  tx.invoice_num = stan;
+  tx.batch_num = 1;
+  tx.tx_datetime = time(NULL);
+  tx.pos_entry_mode = types::PosEntryMode::CHIP;
+  tx.icc_data = std::vector<std::uint8_t>(180, 0x9F);
+  tx.rrn = "000000000001";
+  tx.auth_id_response = "A1B2C3";
+
+  return tx;
+}
+
+Outcome ToOutcome(fdms::HostSwitch::Status status) {
+  switch (status) {
+    case fdms::HostSwitch::Status::COMPLETED:
+      return COMPLETED;
+    case fdms::HostSwitch::Status::TRANSIENT_FAILURE:
+      return TRANSIENT_FAILURE;
+    default:
+      return PERM_FAILURE;
+  }
+}
+
+Outcome Execute(fdms::HostSwitch& host_switch, unsigned int host_index,
+                loadgen::Operation operation, unsigned int stan,
+                unsigned int batch_size) {
+  if (!host_switch.PreConnect(host_index)
+      || !host_switch.WaitForConnection()) {
+    host_switch.Disconnect();
+    return CONNECT_FAILED;
+  }
+
+  fdms::Transaction tx = MakeTransaction(stan);
+  fdms::HostSwitch::Status status;
+  switch (operation) {
+    case loadgen::SALE:
+      status = host_switch.AuthorizeSale(tx);
+      break;
+    case loadgen::VOID:
+      status = host_switch.PerformVoid(tx);
+      break;
+    case loadgen::REFUND:
+      status = host_switch.AuthorizeRefund(tx);
+      break;
+    case loadgen::REVERSAL:
+      status = host_switch.SendReversal(tx);
+      break;
+    case loadgen::TIP_ADJUST:
+      status = host_switch.PerformTipAdjust(tx);
+      break;
+    case loadgen::BATCH_UPLOAD: {
+      std::vector<fdms::Transaction> batch(batch_size, tx);
+      status = host_switch.PerformBatchUpload(batch);
+      break;
+    }
+    case loadgen::SETTLEMENT:
+    default: {
+      fdms::SettlementData settle_msg;
+      settle_msg.stan = stan;
+      settle_msg.nii = tx.nii;
+      settle_msg.tid = tx.tid;
+      settle_msg.mid = tx.mid;
+      settle_msg.tpdu = tx.tpdu;
+      settle_msg.batch_number = tx.batch_num;
+      status = host_switch.PerformSettlement(settle_msg, false);
+      break;
+    }
+  }
+
+  host_switch.Disconnect();
+  return ToOutcome(status);
+}
+
+void RunWorker(const Config& config, unsigned int worker,
+               fdms::ApplicationSettings& settings,
+               std::atomic<unsigned int>& stans, Clock::time_point end,
+               Results& results) {
+  fdms::HostSwitch host_switch(settings);
+  std::mt19937 random(config.seed + worker);
+
+  Clock::duration interval = Clock::duration::zero();
+  Clock::time_point next_start = Clock::now();
+  if (config.rate > 0) {
+    interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(config.concurrency / config.rate));
+    // spread the workers over one interval
+    next_start += interval * worker / config.concurrency;
+  }
+
+  while (next_start < end && Clock::now() < end) {
+    Clock::time_point start = Clock::now();
+    if (config.rate > 0) {
+      std::this_thread::sleep_until(next_start);
+      start = next_start;
+      next_start += interval;
+    }
+
+    loadgen::Operation operation = config.mix.PickOperation(random);
+    std::size_t host = config.mix.PickHost(random);
+    Outcome outcome = Execute(host_switch,
+                              config.mix.hosts()[host].host_index, operation,
+                              NextStan(stans), config.batch_size);
+
+    std::uint64_t micros = std::chrono::duration_cast<
+        std::chrono::microseconds>(Clock::now() - start).count();
+    Cell& cell = results[host * loadgen::kOperationCount + operation];
+    cell.latency.Record(micros);
+    cell.outcomes[outcome]++;
+  }
+}
+
+void PrintCell(const std::string& host, const std::string& operation,
+               const Cell& cell, double seconds) {
+  if (!cell.latency.Count())
+    return;
+
+  std::printf("%-8s %-13s %8llu %9.1f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f",
+              host.c_str(), operation.c_str(),
+              (unsigned long long) cell.latency.Count(),
+              cell.latency.Count() / seconds, cell.latency.Mean() / 1000,
+              cell.latency.Percentile(50) / 1000.0,
+              cell.latency.Percentile(90) / 1000.0,
+              cell.latency.Percentile(99) / 1000.0,
+              cell.latency.Percentile(99.9) / 1000.0,
+              cell.latency.Max() / 1000.0);
+  for (int i = TRANSIENT_FAILURE; i < kOutcomeCount; i++) {
+    std::printf(" %9llu", (unsigned long long) cell.outcomes[i]);
+  }
+  std::printf("\n");
+}
+
+void Report(const Config& config, const Results& results, double seconds) {
+  std::printf("%-8s %-13s %8s %9s %9s %9s %9s %9s %9s %9s", "host",
+              "operation", "count", "tps", "mean_ms", "p50_ms", "p90_ms",
+              "p99_ms", "p999_ms", "max_ms");
+  for (int i = TRANSIENT_FAILURE; i < kOutcomeCount; i++) {
+    std::printf(" %9s", kOutcomeNames[i]);
+  }
+  std::printf("\n");
+
+  Cell total;
+  for (std::size_t host = 0; host < config.mix.hosts().size(); host++) {
+    for (int operation = 0; operation < loadgen::kOperationCount;
+        operation++) {
+      const Cell& cell = results[host * loadgen::kOperationCount + operation];
+      PrintCell(config.mix.hosts()[host].name,
+                loadgen::OperationName(loadgen::Operation(operation)), cell,
+                seconds);
+      total.latency.Merge(cell.latency);
+      for (int i = 0; i < kOutcomeCount; i++) {
+        total.outcomes[i] += cell.outcomes[i];
+      }
+    }
+  }
+  PrintCell("all", "all", total, seconds);
+}
+
+bool ReadOption(const char* arg, const char* name, std::string& value) {
+  std::size_t length = std::strlen(name);
+  if (std::strncmp(arg, name, length) != 0 || arg[length] != '=')
+    return false;
+  value = arg + length + 1;
+  return true;
+}
+
+bool ParseArguments(int argc, char* argv[], Config& config) {
+  std::string hosts = "fdms:0,amex:1,diners:2";
+  std::string mix = "sale=70,void=10,refund=5,reversal=5,tip_adjust=5,"
+      "batch_upload=3,settlement=2";
+
+  for (int i = 1; i < argc; i++) {
+    std::string value;
+    if (ReadOption(argv[i], "--hosts", value)) {
+      hosts = value;
+    } else if (ReadOption(argv[i], "--mix", value)) {
+      mix = value;
+    } else if (ReadOption(argv[i], "--concurrency", value)) {
+      config.concurrency = std::strtoul(value.c_str(), NULL, 10);
+    } else if (ReadOption(argv[i], "--rate", value)) {
+      config.rate = std::strtod(value.c_str(), NULL);
+    } else if (ReadOption(argv[i], "--duration", value)) {
+      config.duration = std::strtoul(value.c_str(), NULL, 10);
+    } else if (ReadOption(argv[i], "--batch-size", value)) {
+      config.batch_size = std::strtoul(value.c_str(), NULL, 10);
+    } else if (ReadOption(argv[i], "--seed", value)) {
+      config.seed = std::strtoul(value.c_str(), NULL, 10);
+    } else {
+      std::cerr << "bad option " << argv[i] << std::endl;
+      return false;
+    }
+  }
+
+  if (!config.mix.ParseHosts(hosts)) {
+    std::cerr << "bad --hosts " << hosts << std::endl;
+    return false;
+  }
+  if (!config.mix.ParseOperations(mix)) {
+    std::cerr << "bad --mix " << mix << std::endl;
+    return false;
+  }
+  return config.concurrency > 0;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  Config config;
+  if (!ParseArguments(argc, argv, config))
+    return 2;
+
+  fdms::ApplicationSettings settings;
+
+  std::vector<Results> results(config.concurrency,
+      Results(config.mix.hosts().size() * loadgen::kOperationCount));
+  Clock::time_point start = Clock::now();
+  Clock::time_point end = start + std::chrono::seconds(config.duration);
+  std::atomic<unsigned int> stans(0);
+
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < config.concurrency; i++) {
+    workers.push_back(std::thread(RunWorker, std::cref(config), i,
+                                  std::ref(settings), std::ref(stans), end,
+                                  std::ref(results[i])));
+  }
+  for (std::size_t i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  Results merged(results[0].size());
+  for (std::size_t worker = 0; worker < results.size(); worker++) {
+    for (std::size_t i = 0; i < merged.size(); i++) {
+      merged[i].latency.Merge(results[worker][i].latency);
+      for (int outcome = 0; outcome < kOutcomeCount; outcome++) {
+        merged[i].outcomes[outcome] += results[worker][i].outcomes[outcome];
+      }
+    }
+  }
+
+  Report(config, merged, seconds);
+  return 0;
+}
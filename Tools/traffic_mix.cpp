@@ -0,0 +1,116 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "traffic_mix.h"
+#include <cstdlib>
+#include <sstream>
+
+namespace loadgen {
+
+namespace {
+const char* const kOperationNames[kOperationCount] = { "sale", "void",
+    "refund", "reversal", "tip_adjust", "batch_upload", "settlement" };
+
+// "name=weight" (weight 1 if omitted)
+bool SplitWeight(const std::string& item, std::string& name, double& weight) {
+  std::size_t equal = item.find('=');
+  name = item.substr(0, equal);
+  weight = 1;
+  if (equal != std::string::npos)
+    weight = std::strtod(item.c_str() + equal + 1, NULL);
+  return !name.empty() && weight >= 0;
+}
+
+std::vector<std::string> SplitList(const std::string& spec) {
+  std::vector<std::string> output;
+  std::istringstream input(spec);
+  std::string item;
+  while (std::getline(input, item, ',')) {
+    if (!item.empty())
+      output.push_back(item);
+  }
+  return output;
+}
+
+template<typename Weights>
+std::size_t PickWeighted(const Weights& weights, std::mt19937& random) {
+  std::discrete_distribution<std::size_t> pick(weights.begin(),
+                                               weights.end());
+  return pick(random);
+}
+}
+
+const char* OperationName(Operation operation) {
+  return operation < kOperationCount ? kOperationNames[operation] : "";
+}
+
+bool TrafficMix::ParseOperations(const std::string& spec) {
+  operation_weights_.assign(kOperationCount, 0);
+
+  std::vector<std::string> items = SplitList(spec);
+  for (std::size_t i = 0; i < items.size(); i++) {
+    std::string name;
+    double weight;
+    if (!SplitWeight(items[i], name, weight))
+      return false;
+
+    int operation = 0;
+    while (operation < kOperationCount && name != kOperationNames[operation])
+      operation++;
+    if (operation == kOperationCount)
+      return false;
+    operation_weights_[operation] = weight;
+  }
+
+  double total = 0;
+  for (std::size_t i = 0; i < operation_weights_.size(); i++) {
+    total += operation_weights_[i];
+  }
+  return total > 0;
+}
+
+bool TrafficMix::ParseHosts(const std::string& spec) {
+  hosts_.clear();
+  host_weights_.clear();
+
+  std::vector<std::string> items = SplitList(spec);
+  for (std::size_t i = 0; i < items.size(); i++) {
+    std::string name;
+    double weight;
+    if (!SplitWeight(items[i], name, weight))
+      return false;
+
+    std::size_t colon = name.find(':');
+    if (colon == std::string::npos)
+      return false;
+
+    TargetHost host;
+    host.name = name.substr(0, colon);
+    host.host_index = std::strtoul(name.c_str() + colon + 1, NULL, 10);
+    hosts_.push_back(host);
+    host_weights_.push_back(weight);
+  }
+  return !hosts_.empty();
+}
+
+Operation TrafficMix::PickOperation(std::mt19937& random) const {
+  return Operation(PickWeighted(operation_weights_, random));
+}
+
+std::size_t TrafficMix::PickHost(std::mt19937& random) const {
+  return PickWeighted(host_weights_, random);
+}
+
+}
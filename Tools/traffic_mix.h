@@ -0,0 +1,68 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef LOADGEN__TRAFFIC_MIX_H_
+#define LOADGEN__TRAFFIC_MIX_H_
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace loadgen {
+
+enum Operation {
+  SALE,
+  VOID,
+  REFUND,
+  REVERSAL,
+  TIP_ADJUST,
+  BATCH_UPLOAD,
+  SETTLEMENT,
+  kOperationCount
+};
+
+const char* OperationName(Operation operation);
+
+// Host definition to route to, by index in the terminal settings
+struct TargetHost {
+  std::string name;
+  unsigned int host_index;
+};
+
+// Weighted choice among operations and hosts, e.g.
+//   operations "sale=70,void=10,refund=5,reversal=5,tip_adjust=5,
+//               batch_upload=3,settlement=2"
+//   hosts      "fdms:0=50,amex:1=25,diners:2=25"
+class TrafficMix {
+ public:
+  bool ParseOperations(const std::string& spec);
+  bool ParseHosts(const std::string& spec);
+
+  const std::vector<TargetHost>& hosts() const {
+    return hosts_;
+  }
+
+  Operation PickOperation(std::mt19937& random) const;
+  std::size_t PickHost(std::mt19937& random) const;
+
+ private:
+  std::vector<double> operation_weights_;
+  std::vector<TargetHost> hosts_;
+  std::vector<double> host_weights_;
+};
+
+}
+
+#endif
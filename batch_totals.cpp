@@ -0,0 +1,169 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "batch_totals.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <diners/advice_queue.h>
+
+namespace fdms {
+
+namespace {
+
+std::atomic<diners::BatchTotalsLedger*> ledger(nullptr);
+
+// Batches settling by currency, by terminal and batch number, with the
+// number of currencies not settled yet
+typedef std::pair<std::uint64_t, std::uint32_t> SettlingBatch;
+std::mutex currency_settlement_mutex;
+std::map<SettlingBatch, unsigned int> currency_settlements;
+
+SettlingBatch SettlingBatchOf(const SettlementData& settle_data) {
+  return SettlingBatch(diners::TerminalKey(settle_data.tid),
+                       settle_data.batch_number);
+}
+
+bool IsSettlingByCurrency(const SettlementData& settle_data) {
+  std::lock_guard<std::mutex> lock(currency_settlement_mutex);
+  return currency_settlements.count(SettlingBatchOf(settle_data)) != 0;
+}
+
+std::int64_t ValueOf(const stdx::optional<types::Amount>& amount) {
+  return amount ? std::int64_t(amount->GetValue()) : 0;
+}
+
+// Amount the transaction counts for in the totals, tip included
+std::int64_t TotalOf(const Transaction& tx) {
+  return ValueOf(tx.amount) + ValueOf(tx.secondary_amount);
+}
+
+// The tip is in the currency of the amount
+std::uint32_t CurrencyOf(const Transaction& tx) {
+  return tx.amount ? diners::CurrencyKey(tx.amount->GetCurrency()) : 0;
+}
+
+diners::BatchKey KeyOf(MetricsHost host, const std::string& tid,
+                       std::uint32_t batch, std::uint32_t currency = 0) {
+  return diners::BatchKey(host, diners::TerminalKey(tid), batch, currency);
+}
+
+}
+
+void SetBatchTotalsLedger(diners::BatchTotalsLedger* totals_ledger) {
+  ledger = totals_ledger;
+}
+
+void UpdateBatchTotals(MetricsHost host, MetricsOperation operation,
+                       const Transaction& tx) {
+  diners::BatchTotalsLedger* totals = ledger;
+  if (!totals)
+    return;
+
+  bool is_refund = tx.transaction_type == TransactionType::REFUND;
+  diners::TotalsEvent event;
+  std::int64_t amount = TotalOf(tx);
+  switch (operation) {
+    case OP_SALE:
+    case OP_OFFLINE_SALE:
+    case OP_PREAUTH_COMPLETION:
+    case OP_QUASI_CASH:
+    case OP_INSTALMENT_SALE:
+      event = diners::TOTALS_SALE;
+      break;
+
+    case OP_REFUND:
+      event = diners::TOTALS_REFUND;
+      break;
+
+    case OP_VOID:
+      event = is_refund ? diners::TOTALS_REFUND_CANCELLED
+                        : diners::TOTALS_SALE_CANCELLED;
+      break;
+
+    case OP_REVERSAL:
+      // Only a transaction the host approved was counted
+      if (tx.previous_transaction_status != TransactionStatus::APPROVED)
+        return;
+      event = is_refund ? diners::TOTALS_REFUND_CANCELLED
+                        : diners::TOTALS_SALE_CANCELLED;
+      break;
+
+    case OP_TIP_ADJUST:
+      event = diners::TOTALS_SALE_ADJUSTED;
+      amount = ValueOf(tx.secondary_amount) - ValueOf(tx.original_secondary_amount);
+      break;
+
+    default:
+      return;
+  }
+
+  totals->Record(KeyOf(host, tx.tid, tx.batch_num, CurrencyOf(tx)), event, amount);
+}
+
+bool FillBatchSummary(MetricsHost host, SettlementData& settle_data) {
+  diners::BatchTotalsLedger* totals = ledger;
+  if (!totals || IsSettlingByCurrency(settle_data))
+    return false;
+
+  // A batch of several currencies settles each on its own, see
+  // BeginCurrencySettlement()
+  std::vector<std::pair<diners::BatchKey, diners::RunningTotals>> currencies =
+      totals->Currencies(KeyOf(host, settle_data.tid, settle_data.batch_number));
+  if (currencies.size() > 1)
+    return false;
+
+  diners::RunningTotals running;
+  if (!currencies.empty())
+    running = currencies.front().second;
+  settle_data.batch_summary.sales_total.count = running.sales_total.count;
+  settle_data.batch_summary.sales_total.total = running.sales_total.total;
+  settle_data.batch_summary.refunds_total.count = running.refunds_total.count;
+  settle_data.batch_summary.refunds_total.total = running.refunds_total.total;
+  return true;
+}
+
+void CloseBatchTotals(MetricsHost host, const SettlementData& settle_data) {
+  {
+    std::lock_guard<std::mutex> lock(currency_settlement_mutex);
+    auto settling = currency_settlements.find(SettlingBatchOf(settle_data));
+    if (settling != currency_settlements.end()) {
+      if (settling->second > 1) {
+        settling->second--;
+        return;
+      }
+      currency_settlements.erase(settling);
+    }
+  }
+
+  diners::BatchTotalsLedger* totals = ledger;
+  if (totals)
+    totals->CloseBatch(KeyOf(host, settle_data.tid, settle_data.batch_number));
+}
+
+void BeginCurrencySettlement(const SettlementData& settle_data,
+                             unsigned int currencies) {
+  std::lock_guard<std::mutex> lock(currency_settlement_mutex);
+  currency_settlements[SettlingBatchOf(settle_data)] = currencies;
+}
+
+void EndCurrencySettlement(const SettlementData& settle_data) {
+  std::lock_guard<std::mutex> lock(currency_settlement_mutex);
+  currency_settlements.erase(SettlingBatchOf(settle_data));
+}
+
+}
@@ -0,0 +1,57 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef FDMS__BATCH_TOTALS_H_
+#define FDMS__BATCH_TOTALS_H_
+
+#include <fdms/host_switch.h>
+#include <diners/batch_totals.h>
+#include "host_metrics.h"
+
+namespace fdms {
+
+// Ledger HostSwitch keeps the running batch totals in, none by default. Not
+// owned.
+void SetBatchTotalsLedger(diners::BatchTotalsLedger* ledger);
+
+// Records what a completed and not declined operation changes in the
+// totals of the batch of 'tx', in the currency of its amount
+void UpdateBatchTotals(MetricsHost host, MetricsOperation operation,
+                       const Transaction& tx);
+
+// Sets the batch summary of 'settle_data' from the ledger. Without a ledger,
+// while the batch settles by currency, or if the ledger has totals in more
+// than one currency for it, it is left as the caller computed it, and false
+// is returned.
+bool FillBatchSummary(MetricsHost host, SettlementData& settle_data);
+
+// Forgets the totals of a settled batch, in every currency. While the batch
+// settles by currency, only once every currency settled.
+void CloseBatchTotals(MetricsHost host, const SettlementData& settle_data);
+
+// The batch of 'settle_data' settles in 'currencies' settlements of one
+// currency each, with summaries the caller computed per currency (see
+// SettlementJob). The settlement data does not say which currency it
+// settles, so the ledger neither fills those summaries nor closes the batch
+// before the last one.
+void BeginCurrencySettlement(const SettlementData& settle_data,
+                             unsigned int currencies);
+
+// Ends it. The ledger keeps the totals if a currency did not settle.
+void EndCurrencySettlement(const SettlementData& settle_data);
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "bench.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts every allocation of the benchmark process. Linked only into the
+// benchmark binary.
+
+namespace {
+std::atomic<std::uint64_t> alloc_count(0);
+std::atomic<std::uint64_t> alloc_bytes(0);
+
+void* CountedAlloc(std::size_t size) {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  void* output = std::malloc(size ? size : 1);
+  if (!output)
+    throw std::bad_alloc();
+  return output;
+}
+}
+
+void* operator new(std::size_t size) {
+  return CountedAlloc(size);
+}
+
+void* operator new[](std::size_t size) {
+  return CountedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  std::free(ptr);
+}
+
+namespace bench {
+
+AllocStats GetAllocStats() {
+  AllocStats output = { alloc_count.load(std::memory_order_relaxed),
+      alloc_bytes.load(std::memory_order_relaxed) };
+  return output;
+}
+
+}
@@ -0,0 +1,37 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "app_counter.h"
+
+// The application counters are terminal state kept by the payment
+// application. The benchmark links these instead, so that it runs without
+// the application and never advances the real STAN or invoice number.
+
+namespace {
+const unsigned int kCounterMax = 999999;
+
+unsigned int stan_counter = 0;
+unsigned int invoice_counter = 0;
+}
+
+unsigned int GetNextStanNo() {
+  stan_counter = stan_counter % kCounterMax + 1;
+  return stan_counter;
+}
+
+unsigned int GetNextInvoiceNo() {
+  invoice_counter = invoice_counter % kCounterMax + 1;
+  return invoice_counter;
+}
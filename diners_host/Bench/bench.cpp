@@ -0,0 +1,190 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "bench.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <sstream>
+
+namespace bench {
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+const std::uint64_t kCalibrationNs = 10 * 1000 * 1000;
+
+struct Sample {
+  double ns_per_op;
+  double allocs_per_op;
+  double bytes_per_op;
+};
+
+Sample RunIterations(const Suite::Body& body, std::uint64_t iterations) {
+  AllocStats before = GetAllocStats();
+  Clock::time_point start = Clock::now();
+  for (std::uint64_t i = 0; i < iterations; i++) {
+    body();
+  }
+  Clock::time_point end = Clock::now();
+  AllocStats after = GetAllocStats();
+
+  Sample sample;
+  double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end - start).count();
+  sample.ns_per_op = ns / iterations;
+  sample.allocs_per_op = double(after.count - before.count) / iterations;
+  sample.bytes_per_op = double(after.bytes - before.bytes) / iterations;
+  return sample;
+}
+
+// Enough iterations for one repetition to last min_time_ms
+std::uint64_t Calibrate(const Suite::Body& body, unsigned int min_time_ms) {
+  std::uint64_t iterations = 1;
+  Sample sample = RunIterations(body, iterations);
+  while (sample.ns_per_op * iterations < kCalibrationNs) {
+    iterations *= 2;
+    sample = RunIterations(body, iterations);
+  }
+
+  double target_ns = min_time_ms * 1e6;
+  std::uint64_t output = std::uint64_t(target_ns / sample.ns_per_op);
+  return std::max<std::uint64_t>(output, 1);
+}
+
+bool ByName(const Result& lhs, const Result& rhs) {
+  return lhs.name < rhs.name;
+}
+}
+
+void DoNotOptimize(const void* value) {
+  __asm__ __volatile__("" : : "g"(value) : "memory");
+}
+
+void Suite::Add(const std::string& name, const Body& body) {
+  Benchmark benchmark = { name, body };
+  benchmarks_.push_back(benchmark);
+}
+
+std::vector<Result> Suite::Run(const Options& options) const {
+  std::vector<Result> results;
+
+  for (std::vector<Benchmark>::const_iterator it = benchmarks_.begin();
+      it != benchmarks_.end(); ++it) {
+    if (it->name.find(options.filter) == std::string::npos)
+      continue;
+
+    std::uint64_t iterations = Calibrate(it->body, options.min_time_ms);
+
+    // median of the repetitions; allocation counts do not vary between them
+    std::vector<double> ns_per_op;
+    Sample sample = Sample();
+    for (unsigned int i = 0; i < std::max(options.repetitions, 1u); i++) {
+      sample = RunIterations(it->body, iterations);
+      ns_per_op.push_back(sample.ns_per_op);
+    }
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+
+    Result result = { it->name, ns_per_op[ns_per_op.size() / 2],
+        sample.allocs_per_op, sample.bytes_per_op };
+    results.push_back(result);
+  }
+
+  std::sort(results.begin(), results.end(), ByName);
+  return results;
+}
+
+void WriteCsv(const std::vector<Result>& results, std::ostream& output) {
+  output << "benchmark,ns_per_op,allocs_per_op,bytes_per_op\n";
+  for (std::vector<Result>::const_iterator it = results.begin();
+      it != results.end(); ++it) {
+    char line[256];
+    std::snprintf(line, sizeof(line), "%s,%.1f,%.2f,%.1f\n", it->name.c_str(),
+                  it->ns_per_op, it->allocs_per_op, it->bytes_per_op);
+    output << line;
+  }
+}
+
+std::vector<Result> ReadCsv(std::istream& input) {
+  std::vector<Result> results;
+
+  std::string line;
+  std::getline(input, line);  // header
+  while (std::getline(input, line)) {
+    std::istringstream fields(line);
+    Result result;
+    std::string value;
+    if (!std::getline(fields, result.name, ','))
+      continue;
+    std::getline(fields, value, ',');
+    result.ns_per_op = std::strtod(value.c_str(), NULL);
+    std::getline(fields, value, ',');
+    result.allocs_per_op = std::strtod(value.c_str(), NULL);
+    std::getline(fields, value, ',');
+    result.bytes_per_op = std::strtod(value.c_str(), NULL);
+    results.push_back(result);
+  }
+
+  return results;
+}
+
+unsigned int CompareWithBaseline(const std::vector<Result>& results,
+                                 const std::vector<Result>& baseline,
+                                 double threshold_percent,
+                                 std::ostream& output) {
+  std::map<std::string, Result> baseline_by_name;
+  for (std::vector<Result>::const_iterator it = baseline.begin();
+      it != baseline.end(); ++it) {
+    baseline_by_name[it->name] = *it;
+  }
+
+  unsigned int regressions = 0;
+  for (std::vector<Result>::const_iterator it = results.begin();
+      it != results.end(); ++it) {
+    std::map<std::string, Result>::const_iterator before =
+        baseline_by_name.find(it->name);
+    if (before == baseline_by_name.end())
+      continue;
+
+    double delta_percent = 0;
+    if (before->second.ns_per_op > 0) {
+      delta_percent = (it->ns_per_op - before->second.ns_per_op) * 100
+          / before->second.ns_per_op;
+    }
+
+    bool slower = delta_percent > threshold_percent;
+    bool allocates_more = it->allocs_per_op > before->second.allocs_per_op;
+    if (!slower && !allocates_more)
+      continue;
+
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "REGRESSION %s: %.1f -> %.1f ns/op (%+.1f%%), "
+                  "%.2f -> %.2f allocs/op\n",
+                  it->name.c_str(), before->second.ns_per_op, it->ns_per_op,
+                  delta_percent, before->second.allocs_per_op,
+                  it->allocs_per_op);
+    output << line;
+    regressions++;
+  }
+
+  return regressions;
+}
+
+}
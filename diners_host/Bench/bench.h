@@ -0,0 +1,92 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS_BENCH__BENCH_H_
+#define DINERS_BENCH__BENCH_H_
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+struct Result {
+  std::string name;
+  double ns_per_op;
+  double allocs_per_op;
+  double bytes_per_op;
+};
+
+struct Options {
+  Options()
+      : min_time_ms(100),
+        repetitions(5) {
+  }
+
+  std::string filter;
+  unsigned int min_time_ms;
+  unsigned int repetitions;
+};
+
+// Heap allocations made by the process so far (see alloc_counter.cpp)
+struct AllocStats {
+  std::uint64_t count;
+  std::uint64_t bytes;
+};
+
+AllocStats GetAllocStats();
+
+// Keeps the compiler from dropping a result nobody reads
+void DoNotOptimize(const void* value);
+
+template<typename T>
+void DoNotOptimize(const T& value) {
+  DoNotOptimize(static_cast<const void*>(&value));
+}
+
+// A benchmark body runs one operation per call
+class Suite {
+ public:
+  typedef std::function<void()> Body;
+
+  void Add(const std::string& name, const Body& body);
+
+  // Results sorted by name, so that runs of different commits line up
+  std::vector<Result> Run(const Options& options) const;
+
+ private:
+  struct Benchmark {
+    std::string name;
+    Body body;
+  };
+
+  std::vector<Benchmark> benchmarks_;
+};
+
+void WriteCsv(const std::vector<Result>& results, std::ostream& output);
+std::vector<Result> ReadCsv(std::istream& input);
+
+// Reports benchmarks slower than the baseline by more than
+// threshold_percent, or allocating more. Returns the number of regressions.
+unsigned int CompareWithBaseline(const std::vector<Result>& results,
+                                 const std::vector<Result>& baseline,
+                                 double threshold_percent,
+                                 std::ostream& output);
+
+}
+
+#endif
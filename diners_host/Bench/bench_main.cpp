@@ -0,0 +1,102 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "bench.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Host-side benchmark of the Diners messages and of the per-call work of
+// the FDMS host and HostSwitch, built with the Makefile of this directory.
+//
+//   diners_bench [--filter=SUBSTR] [--min-time-ms=N] [--repetitions=N]
+//                [--out=FILE] [--baseline=FILE] [--threshold=PERCENT]
+//
+// Results are written as CSV (stdout or --out), one line per benchmark,
+// sorted by name. With --baseline, the run is compared with a CSV of an
+// earlier commit: benchmarks slower by more than --threshold percent
+// (default 10) or allocating more are listed and the exit code is 1.
+
+namespace bench {
+void AddMessageBenchmarks(Suite& suite);
+void AddHostBenchmarks(Suite& suite);
+void AddSwitchBenchmarks(Suite& suite);
+}
+
+namespace {
+bool ReadOption(const char* arg, const char* name, std::string& value) {
+  std::size_t length = std::strlen(name);
+  if (std::strncmp(arg, name, length) != 0 || arg[length] != '=')
+    return false;
+  value = arg + length + 1;
+  return true;
+}
+}
+
+int main(int argc, char* argv[]) {
+  bench::Options options;
+  std::string out_file;
+  std::string baseline_file;
+  double threshold_percent = 10;
+
+  for (int i = 1; i < argc; i++) {
+    std::string value;
+    if (ReadOption(argv[i], "--filter", value)) {
+      options.filter = value;
+    } else if (ReadOption(argv[i], "--min-time-ms", value)) {
+      options.min_time_ms = std::strtoul(value.c_str(), NULL, 10);
+    } else if (ReadOption(argv[i], "--repetitions", value)) {
+      options.repetitions = std::strtoul(value.c_str(), NULL, 10);
+    } else if (ReadOption(argv[i], "--out", value)) {
+      out_file = value;
+    } else if (ReadOption(argv[i], "--baseline", value)) {
+      baseline_file = value;
+    } else if (ReadOption(argv[i], "--threshold", value)) {
+      threshold_percent = std::strtod(value.c_str(), NULL);
+    } else {
+      std::cerr << "unknown option " << argv[i] << std::endl;
+      return 2;
+    }
+  }
+
+  bench::Suite suite;
+  bench::AddMessageBenchmarks(suite);
+  bench::AddHostBenchmarks(suite);
+  bench::AddSwitchBenchmarks(suite);
+
+  std::vector<bench::Result> results = suite.Run(options);
+
+  if (out_file.empty()) {
+    bench::WriteCsv(results, std::cout);
+  } else {
+    std::ofstream output(out_file.c_str());
+    bench::WriteCsv(results, output);
+  }
+
+  if (baseline_file.empty())
+    return 0;
+
+  std::ifstream baseline_input(baseline_file.c_str());
+  if (!baseline_input) {
+    std::cerr << "cannot read " << baseline_file << std::endl;
+    return 2;
+  }
+  std::vector<bench::Result> baseline = bench::ReadCsv(baseline_input);
+  unsigned int regressions = bench::CompareWithBaseline(results, baseline,
+                                                        threshold_percent,
+                                                        std::cerr);
+  return regressions ? 1 : 0;
+}
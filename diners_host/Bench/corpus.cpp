@@ -0,0 +1,217 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "corpus.h"
+#include <protocol.h>
+
+namespace bench {
+
+namespace {
+const char kTid[] = "10000001";
+const char kMid[] = "000000000000001";
+const char kTpdu[] = "6000010000";
+const unsigned int kNii = 1;
+
+// 9F26 cryptogram, 9F27, 9F10, 9F37, 9F36, 95, 9A, 9C, 5F2A, 82, 9F1A,
+// 9F03, 9F33, 9F34, 9F35, 84 as sent by a typical kernel
+const std::uint8_t kIccData[] = {
+    0x9F, 0x26, 0x08, 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0,
+    0x9F, 0x27, 0x01, 0x80,
+    0x9F, 0x10, 0x12, 0x01, 0x10, 0xA0, 0x00, 0x03, 0x22, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF,
+    0x9F, 0x37, 0x04, 0x1A, 0x2B, 0x3C, 0x4D,
+    0x9F, 0x36, 0x02, 0x00, 0x2A,
+    0x95, 0x05, 0x00, 0x00, 0x00, 0x80, 0x00,
+    0x9A, 0x03, 0x17, 0x07, 0x25,
+    0x9C, 0x01, 0x00,
+    0x5F, 0x2A, 0x02, 0x07, 0x02,
+    0x82, 0x02, 0x19, 0x80,
+    0x9F, 0x1A, 0x02, 0x07, 0x02,
+    0x9F, 0x03, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x9F, 0x33, 0x03, 0xE0, 0xF8, 0xC8,
+    0x9F, 0x34, 0x03, 0x42, 0x03, 0x00,
+    0x9F, 0x35, 0x01, 0x22,
+    0x84, 0x07, 0xA0, 0x00, 0x00, 0x01, 0x52, 0x30, 0x10 };
+
+// 91 issuer authentication data, 8A authorisation response code
+const std::uint8_t kIssuerData[] = {
+    0x91, 0x0A, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x30, 0x30,
+    0x8A, 0x02, 0x30, 0x30 };
+
+const std::uint8_t kTrack2[] = {
+    0x36, 0x12, 0x34, 0x56, 0x78, 0x90, 0x14, 0xD2, 0x51, 0x22, 0x01, 0x12,
+    0x34, 0x56, 0x78, 0x9F };
+
+const std::uint8_t kPinBlock[] = {
+    0x4F, 0x1A, 0x7C, 0x22, 0x90, 0xB3, 0x5E, 0x01 };
+
+std::vector<std::uint8_t> ToBytes(const std::uint8_t* data, std::size_t size) {
+  return std::vector<std::uint8_t>(data, data + size);
+}
+
+template<std::size_t N>
+std::vector<std::uint8_t> ToBytes(const std::uint8_t (&data)[N]) {
+  return ToBytes(data, N);
+}
+
+void CopyField(const iso8583::Apdu& request, int field,
+               iso8583::Apdu& response) {
+  if (request.HasField(field))
+    response.SetField(field, request.GetFieldAsBytes(field));
+}
+}
+
+const char* CardInputName(CardInput input) {
+  switch (input) {
+    case CHIP:
+      return "chip";
+    case MAGSTRIPE:
+      return "magstripe";
+    case MANUAL:
+      return "manual";
+  }
+  return "";
+}
+
+diners::DinersTransaction MakeDinersTransaction(CardInput input) {
+  diners::DinersTransaction tx;
+
+  tx.amount = types::Amount("SGD", 12550);
+  tx.stan = 1234;
+  tx.nii = kNii;
+  tx.tid = kTid;
+  tx.mid = kMid;
+  tx.tpdu = kTpdu;
+  tx.invoice_number = 42;
+  tx.batch_number = 7;
+  tx.tx_datetime = 1500973200;
+  tx.transaction_type = diners::SALE;
+  tx.transaction_status = diners::APPROVED;
+  tx.previous_transaction_status = diners::APPROVED;
+  tx.in_progress_status = diners::IN_PROGRESS_NONE;
+  tx.pos_condition_code = types::PosConditionCode::NORMAL;
+  tx.is_preauth_completed = false;
+  tx.is_adjusted = false;
+  tx.rrn = "000000001234";
+  tx.auth_id_response = "A1B2C3";
+  tx.response_code = "00";
+  tx.icc_data = std::vector<std::uint8_t>();
+
+  switch (input) {
+    case CHIP:
+      tx.pos_entry_mode = types::PosEntryMode::CHIP;
+      tx.track2 = ToBytes(kTrack2);
+      tx.pan_sequence_number = 1;
+      tx.icc_data = ToBytes(kIccData);
+      tx.pin_block = ToBytes(kPinBlock);
+      break;
+    case MAGSTRIPE:
+      tx.pos_entry_mode = types::PosEntryMode::MAGSTRIPE;
+      tx.track2 = ToBytes(kTrack2);
+      tx.track1_data = "B36123456789014^CARDHOLDER/TEST^2512201123456789";
+      break;
+    case MANUAL:
+      tx.pos_entry_mode = types::PosEntryMode::MANUAL;
+      tx.pan = types::Pan("36123456789014");
+      tx.expiration_date = "2512";
+      tx.cvv = "123";
+      break;
+  }
+
+  return tx;
+}
+
+diners::DinersSettlementData MakeDinersSettlementData() {
+  diners::DinersSettlementData settle_msg;
+
+  settle_msg.stan = 1240;
+  settle_msg.tx_datetime = 1500973200;
+  settle_msg.tpdu = kTpdu;
+  settle_msg.nii = kNii;
+  settle_msg.tid = kTid;
+  settle_msg.mid = kMid;
+  settle_msg.batch_number = 7;
+  settle_msg.invoice_num = 42;
+  settle_msg.batch_summary.sales_total = diners::BatchTotal(25, 312500);
+  settle_msg.batch_summary.refunds_total = diners::BatchTotal(2, 15000);
+
+  return settle_msg;
+}
+
+diners::TestTransaction MakeTestTransaction() {
+  diners::TestTransaction tx;
+
+  tx.host_datetime = 0;
+  tx.tpdu = kTpdu;
+  tx.stan = 1241;
+  tx.nii = kNii;
+  tx.tid = kTid;
+  tx.mid = kMid;
+
+  return tx;
+}
+
+diners::KeyExchange MakeKeyExchange() {
+  diners::KeyExchange key_exchange;
+
+  key_exchange.stan = 1242;
+  key_exchange.tx_datetime = 0;
+  key_exchange.tpdu = kTpdu;
+  key_exchange.nii = kNii;
+  key_exchange.tid = kTid;
+  key_exchange.mid = kMid;
+
+  return key_exchange;
+}
+
+std::vector<std::uint8_t> MakeResponse(const iso8583::Apdu& request) {
+  using namespace diners;
+
+  iso8583::Apdu response(GetProtocolSpec());
+  int mti = request.GetMti();
+  response.SetMti(mti + 10);
+
+  CopyField(request, kFieldProcessingCode, response);
+  CopyField(request, kFieldAmount, response);
+  CopyField(request, kFieldStan, response);
+  CopyField(request, kFieldNii, response);
+  CopyField(request, kFieldCardAcceptorTerminalId, response);
+
+  response.SetField(kFieldTimeLocalTransaction, 103000);
+  response.SetField(kFieldDateLocalTransaction, 725);
+  response.SetField(kFieldRrn, "720610001234");
+  response.SetField(kFieldAuthorizationId, "A1B2C3");
+  response.SetField(kFieldResponseCode, "00");
+
+  if (request.HasField(kFieldIccData))
+    response.SetField(kFieldIccData, ToBytes(kIssuerData));
+
+  if (mti == 800) {
+    // TMK for the key download, KP table (PIN key + TLE key) for the key
+    // exchange
+    response.SetField(kField62, "0123456789ABCDEF0123456789ABCDEF");
+    std::vector<std::uint8_t> key_table;
+    key_table.push_back(0x00);
+    key_table.push_back(0x34);
+    key_table.push_back('K');
+    key_table.push_back('P');
+    key_table.insert(key_table.end(), 32, 0x5A);
+    response.SetField(kField63, key_table);
+  }
+
+  return response.text;
+}
+
+}
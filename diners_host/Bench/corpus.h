@@ -0,0 +1,52 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS_BENCH__CORPUS_H_
+#define DINERS_BENCH__CORPUS_H_
+
+#include <cstdint>
+#include <vector>
+#include <iso8583/apdu.h>
+#include <diners/diners_transaction.h>
+#include <diners/test_transaction.h>
+#include <diners/key_exchange.h>
+
+namespace bench {
+
+// Representative transactions, one per card input. Values are fixed so
+// that every run encodes the same bytes.
+enum CardInput {
+  CHIP,
+  MAGSTRIPE,
+  MANUAL
+};
+
+const CardInput kCardInputs[] = { CHIP, MAGSTRIPE, MANUAL };
+
+const char* CardInputName(CardInput input);
+
+diners::DinersTransaction MakeDinersTransaction(CardInput input);
+diners::DinersSettlementData MakeDinersSettlementData();
+diners::TestTransaction MakeTestTransaction();
+diners::KeyExchange MakeKeyExchange();
+
+// Approved host answer to an encoded request: MTI + 10, DE 3, 11, 24 and 41
+// echoed, DE 12, 13, 37, 38 and 39 generated, plus the data the readers of
+// that MTI expect (issuer data, TMK, key table).
+std::vector<std::uint8_t> MakeResponse(const iso8583::Apdu& request);
+
+}
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "bench.h"
+#include "corpus.h"
+#include <apdu_utils.h>
+#include <correlation_key.h>
+#include <datetime_codec.h>
+#include <field63_tables.h>
+#include <sale_message.h>
+#include <Key_exchange_message.h>
+#include <iso8583/printer.h>
+#include <utils/converter.h>
+
+// What the FDMS host (host.cpp) does per call. Its key exchange builder
+// and reader are the ones in this tree; the others come with the FDMS
+// library. Host::PerformOnline() also dumps every request and prefixes the
+// TPDU. The helpers below run on every request and response: correlation,
+// DE 12/13 and DE 63 handling.
+
+namespace bench {
+
+namespace {
+void AddKeyExchange(Suite& suite) {
+  const diners::KeyExchange corpus = MakeKeyExchange();
+
+  suite.Add("fdms/key_exchange/build", [corpus]() {
+    iso8583::Apdu request = diners::BuildKeyExchangeRequest(corpus);
+    DoNotOptimize(request);
+  });
+
+  iso8583::Apdu request = diners::BuildKeyExchangeRequest(corpus);
+  std::vector<std::uint8_t> response = MakeResponse(request);
+  diners::KeyExchange read_tx = corpus;
+  suite.Add("fdms/key_exchange/read", [request, response, read_tx]() mutable {
+    bool valid = diners::ReadAndValidateKeyExchangeResponse(request, response,
+                                                            read_tx);
+    DoNotOptimize(valid);
+  });
+
+  suite.Add("fdms/key_exchange/frame", [request, corpus]() {
+    std::string dump = iso8583::Print(request);
+    std::vector<std::uint8_t> frame = utils::HexStringToBytes(corpus.tpdu);
+    frame.insert(frame.end(), request.text.begin(), request.text.end());
+    DoNotOptimize(dump);
+    DoNotOptimize(frame);
+  });
+}
+}
+
+void AddHostBenchmarks(Suite& suite) {
+  AddKeyExchange(suite);
+
+  diners::DinersTransaction tx = MakeDinersTransaction(CHIP);
+  const iso8583::Apdu request = diners::BuildSaleRequest(tx);
+  const std::vector<std::uint8_t> response_data = MakeResponse(request);
+  const iso8583::Apdu response(diners::GetProtocolSpec(), response_data.data(),
+                               response_data.size());
+
+  suite.Add("fdms/validate_basic_fields", [request, response]() {
+    bool valid = diners::ValidateBasicFields(request, response);
+    DoNotOptimize(valid);
+  });
+
+  suite.Add("fdms/correlation_key", [response_data]() {
+    auto key = diners::ReadCorrelationKey(response_data);
+    DoNotOptimize(key);
+  });
+
+  suite.Add("fdms/get_host_datetime", [response]() {
+    auto host_datetime = diners::GetHostDatetime(response);
+    DoNotOptimize(host_datetime);
+  });
+
+  time_t now = time(NULL);
+  suite.Add("fdms/encode_datetime", [now]() {
+    diners::IsoDateTime iso_datetime = diners::ToIsoDateTime(now);
+    DoNotOptimize(iso_datetime);
+  });
+
+  const std::vector<std::uint8_t> table(40, 0x20);
+  suite.Add("fdms/field63_build", [table]() {
+    iso8583::Apdu apdu(diners::GetProtocolSpec());
+    diners::Field63Builder field63;
+    field63.AddTable("16", table.data(), 3);
+    field63.AddTable("29", table.data(), table.size());
+    field63.AddTable("IN", table.data(), 24);
+    field63.Commit(apdu);
+    DoNotOptimize(apdu);
+  });
+
+  std::vector<std::uint8_t> field63_data;
+  {
+    diners::Field63Builder field63;
+    field63.AddTable("16", table.data(), 3);
+    field63.AddTable("29", table.data(), table.size());
+    field63.AddTable("KP", table.data(), 32);
+    iso8583::Apdu apdu(diners::GetProtocolSpec());
+    field63.Commit(apdu);
+    field63_data = apdu.GetFieldAsBytes(diners::kField63);
+  }
+  suite.Add("fdms/field63_find", [field63_data]() {
+    auto keys = diners::FindField63Table(field63_data, "KP");
+    DoNotOptimize(keys);
+  });
+}
+
+}
@@ -0,0 +1,121 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "bench.h"
+#include "corpus.h"
+#include <sale_message.h>
+#include <void_message.h>
+#include <refund_message.h>
+#include <preauth_message.h>
+#include <sale_completion_message.h>
+#include <tip_adjust_message.h>
+#include <reversal_message.h>
+#include <offline_sale_message.h>
+#include <tc_upload_message.h>
+#include <batch_upload_message.h>
+#include <settlement_message.h>
+#include <key_request_message.h>
+#include <test_transaction_message.h>
+
+// Build*/Read* pair of every Diners message, for each card input where the
+// message carries card data. Names read <message>/<input>/<build|read>.
+
+namespace bench {
+
+namespace {
+template<typename T>
+struct MessagePair {
+  typedef iso8583::Apdu (*BuildFunc)(T& tx);
+  typedef bool (*ReadFunc)(const std::vector<std::uint8_t>& data, T& tx);
+
+  const char* name;
+  BuildFunc build;
+  ReadFunc read;
+};
+
+iso8583::Apdu BuildBatchUpload(diners::DinersTransaction& tx) {
+  return diners::BuildBatchUploadRequest(tx, tx.stan + 1);
+}
+
+iso8583::Apdu BuildSettlement(diners::DinersSettlementData& settle_msg) {
+  return diners::BuildSettlementRequest(settle_msg, false);
+}
+
+const MessagePair<diners::DinersTransaction> kCardMessages[] = {
+    { "sale", &diners::BuildSaleRequest, &diners::ReadSaleResponse },
+    { "void", &diners::BuildVoidRequest, &diners::ReadVoidResponse },
+    { "refund", &diners::BuildRefundRequest, &diners::ReadRefundResponse },
+    { "preauth", &diners::BuildPreAuthRequest, &diners::ReadPreAuthResponse },
+    { "sale_completion", &diners::BuildSaleCompletionRequest,
+        &diners::ReadSaleCompletionResponse },
+    { "tip_adjust", &diners::BuildTipAdjustRequest,
+        &diners::ReadTipAdjustResponse },
+    { "reversal", &diners::BuildReversalRequest,
+        &diners::ReadReversalResponse },
+    { "offline_sale", &diners::BuildOfflineSaleRequest,
+        &diners::ReadOfflineSaleResponse },
+    { "tc_upload", &diners::BuildTcUploadRequest,
+        &diners::ReadTcUploadResponse },
+    { "batch_upload", &BuildBatchUpload, &diners::ReadBatchUploadResponse },
+};
+
+template<typename T>
+void AddPair(Suite& suite, const std::string& name, const T& corpus,
+             const MessagePair<T>& pair) {
+  typename MessagePair<T>::BuildFunc build = pair.build;
+  typename MessagePair<T>::ReadFunc read = pair.read;
+
+  T build_tx = corpus;
+  suite.Add(name + "/build", [build, build_tx]() mutable {
+    iso8583::Apdu request = build(build_tx);
+    DoNotOptimize(request);
+  });
+
+  T read_tx = corpus;
+  std::vector<std::uint8_t> response = MakeResponse(build(read_tx));
+  suite.Add(name + "/read", [read, read_tx, response]() mutable {
+    bool valid = read(response, read_tx);
+    DoNotOptimize(valid);
+  });
+}
+}
+
+void AddMessageBenchmarks(Suite& suite) {
+  for (std::size_t i = 0; i < sizeof(kCardMessages) / sizeof(kCardMessages[0]);
+      i++) {
+    for (std::size_t j = 0; j < sizeof(kCardInputs) / sizeof(kCardInputs[0]);
+        j++) {
+      std::string name = std::string(kCardMessages[i].name) + "/"
+          + CardInputName(kCardInputs[j]);
+      AddPair(suite, name, MakeDinersTransaction(kCardInputs[j]),
+              kCardMessages[i]);
+    }
+  }
+
+  MessagePair<diners::DinersTransaction> key_download = { "key_download",
+      &diners::BuildKeyDownloadRequest, &diners::ReadKeyDownloadResponse };
+  AddPair(suite, "key_download/none", MakeDinersTransaction(CHIP),
+          key_download);
+
+  MessagePair<diners::DinersSettlementData> settlement = { "settlement",
+      &BuildSettlement, &diners::ReadSettlementResponse };
+  AddPair(suite, "settlement/none", MakeDinersSettlementData(), settlement);
+
+  MessagePair<diners::TestTransaction> echo_test = { "echo_test",
+      &diners::BuildEchoTestRequest, &diners::ReadEchoTestResponse };
+  AddPair(suite, "echo_test/none", MakeTestTransaction(), echo_test);
+}
+
+}
@@ -0,0 +1,96 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "bench.h"
+#include <transaction_adapters.h>
+
+// Per-call conversion work HostSwitch does before reaching the Amex and
+// Diners hosts: the transaction adapters and the settlement converters.
+// The settlement converters take an invoice number from the application
+// counter, which the benchmark replaces (app_counter_stub.cpp).
+
+namespace bench {
+
+namespace {
+fdms::Transaction MakeSwitchTransaction(bool chip) {
+  fdms::Transaction tx;
+
+  tx.amount = types::Amount("SGD", 12550);
+  tx.stan = 1234;
+  tx.nii = 1;
+  tx.tid = "10000001";
+  tx.mid = "000000000000001";
+  tx.tpdu = "6000010000";
+  tx.invoice_num = 42;
+  tx.batch_num = 7;
+  tx.tx_datetime = 1500973200;
+
+  if (chip) {
+    tx.pos_entry_mode = types::PosEntryMode::CHIP;
+    tx.icc_data = std::vector<std::uint8_t>(180, 0x9F);
+    tx.pin_data = std::vector<std::uint8_t>(8, 0x4F);
+  } else {
+    tx.pos_entry_mode = types::PosEntryMode::MANUAL;
+    tx.pan = types::Pan("36123456789014");
+    tx.expiration_date = "2512";
+    tx.cvv = "123";
+  }
+
+  return tx;
+}
+}
+
+void AddSwitchBenchmarks(Suite& suite) {
+  const bool kChip[] = { true, false };
+  for (std::size_t i = 0; i < 2; i++) {
+    std::string input = kChip[i] ? "chip" : "manual";
+    fdms::Transaction tx = MakeSwitchTransaction(kChip[i]);
+
+    suite.Add("switch/amex_adapter/" + input, [tx]() mutable {
+      fdms::AmexTransactionAdapter amex_tx(tx);
+      DoNotOptimize(amex_tx.get());
+    });
+
+    suite.Add("switch/diners_adapter/" + input, [tx]() mutable {
+      fdms::DinersTransactionAdapter diners_tx(tx);
+      DoNotOptimize(diners_tx.get());
+    });
+  }
+
+  fdms::SettlementData settle_msg;
+  settle_msg.stan = 1240;
+  settle_msg.nii = 1;
+  settle_msg.tid = "10000001";
+  settle_msg.mid = "000000000000001";
+  settle_msg.batch_number = 7;
+
+  suite.Add("switch/diners_settlement_data", [settle_msg]() mutable {
+    diners::DinersSettlementData diners_settle_msg =
+        fdms::BuildDinersSettlementData(settle_msg);
+    fdms::FillSettlementDataWithDinersSettlementData(settle_msg,
+                                                     diners_settle_msg);
+    DoNotOptimize(settle_msg);
+  });
+
+  suite.Add("switch/amex_settlement_data", [settle_msg]() mutable {
+    amex::AmexSettlementData amex_settle_msg =
+        fdms::BuildAmexSettlementData(settle_msg);
+    fdms::FillSettlementDataWithAmexSettlementData(settle_msg,
+                                                   amex_settle_msg);
+    DoNotOptimize(settle_msg);
+  });
+}
+
+}
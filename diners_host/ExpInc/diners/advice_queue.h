@@ -0,0 +1,183 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__ADVICE_QUEUE_H_
+#define DINERS__ADVICE_QUEUE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace diners {
+
+class MappedLog;
+
+enum AdviceResult {
+  ADVICE_DELIVERED,
+  ADVICE_REJECTED,  // answered with a response code other than 00
+  ADVICE_RETRY  // not answered, or not with a usable response
+};
+
+// Message an advice is sent as
+enum AdviceType {
+  ADVICE_OFFLINE_SALE,
+  ADVICE_TIP_ADJUST,
+  ADVICE_TC_UPLOAD,
+  ADVICE_REVERSAL
+};
+
+struct Advice {
+  std::uint64_t sequence;
+  std::uint64_t terminal;  // TID, its 8 ASCII bytes packed
+  AdviceType type;
+  std::vector<std::uint8_t> record;  // transaction record, see below
+};
+
+// Advice::terminal of the advices of 'tid'
+std::uint64_t TerminalKey(const std::string& tid);
+
+// Persistent store-and-forward queue of advices (offline sales, TC uploads,
+// tip adjusts), in a MappedLog. An advice is kept as a transaction record
+// (transaction_record.h) without card data, the PAN being kept as a token
+// of a PanVault; the message is built from it when the advice is sent.
+// Enqueue() returns once the advice is on disk, so an advice is never lost
+// once accepted. An advice stays queued until the host acknowledged it: if
+// the power goes between the host answer and the removal, it is sent again
+// with the same STAN, which the host treats as a repeat.
+//
+// The same queue serves as reversal journal: the reversal of a request is
+// held before the request is sent, removed once the host answered it, and
+// released to the drainer otherwise. Held reversals found when the queue is
+// opened are released, as their request may have reached the host.
+class AdviceQueue {
+ public:
+  static const std::size_t kDefaultCapacity = 256 * 1024;
+
+  // nullptr if the queue file cannot be used
+  static std::unique_ptr<AdviceQueue> Open(const std::string& path,
+                                           std::size_t capacity = kDefaultCapacity);
+
+  ~AdviceQueue();
+
+  // False if the queue is full, the disk failed or 'record' is not a
+  // transaction record
+  bool Enqueue(AdviceType type, const std::vector<std::uint8_t>& record);
+
+  // Like Enqueue(), but Peek() skips the advice until it is released.
+  // Sequence of the advice, 0 on failure.
+  std::uint64_t Hold(AdviceType type, const std::vector<std::uint8_t>& record);
+  void Release(std::uint64_t sequence);
+
+  // Up to 'max_count' advices not held, oldest first
+  std::vector<Advice> Peek(std::size_t max_count) const;
+  std::vector<Advice> Peek(std::uint64_t terminal, std::size_t max_count) const;
+
+  bool Remove(std::uint64_t sequence);
+
+  // Held advices included
+  std::size_t Size() const;
+
+  // True once the queue is not empty, false on timeout or Wake()
+  bool WaitNotEmpty(std::chrono::milliseconds timeout);
+  void Wake();
+
+  // Locked by whoever sends advices from the queue, so that the advices of
+  // a terminal never go out over two connections at once and out of order
+  std::mutex& delivery_mutex() {
+    return delivery_mutex_;
+  }
+
+ private:
+  explicit AdviceQueue(std::unique_ptr<MappedLog> log);
+  AdviceQueue(const AdviceQueue&);
+  AdviceQueue& operator=(const AdviceQueue&);
+
+  std::uint64_t Store(AdviceType type, const std::vector<std::uint8_t>& record,
+                      std::uint8_t state);
+  bool HasDue() const;
+
+  std::unique_ptr<MappedLog> log_;
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::set<std::uint64_t> held_;  // kept to count the held records
+  bool woken_;
+  std::mutex delivery_mutex_;
+};
+
+// Connection the drainer delivers advices over
+class AdviceChannel {
+ public:
+  virtual ~AdviceChannel() {
+  }
+
+  virtual bool Connect() = 0;
+  virtual AdviceResult Deliver(const Advice& advice) = 0;
+  virtual void Disconnect() = 0;
+};
+
+struct AdviceDrainerConfig {
+  AdviceDrainerConfig()
+      : batch_size(16),
+        retry_delay(1000),
+        max_retry_delay(60000) {
+  }
+
+  std::size_t batch_size;  // advices sent per connection
+  std::chrono::milliseconds retry_delay;  // doubled after each failed pass
+  std::chrono::milliseconds max_retry_delay;
+};
+
+// Background thread sending the queued advices in batches, one connection
+// per batch. Advices of one terminal are delivered in the order they were
+// queued: once one has to be retried, the following ones of that terminal
+// wait for the next pass. Rejected advices are logged and dropped.
+class AdviceDrainer {
+ public:
+  AdviceDrainer(AdviceQueue& queue, AdviceChannel& channel,
+                const AdviceDrainerConfig& config = AdviceDrainerConfig());
+  ~AdviceDrainer();
+
+  void Start();
+  void Stop();
+
+  // One batch, on the calling thread. False if an advice has to be retried.
+  bool DrainOnce();
+
+ private:
+  AdviceDrainer(const AdviceDrainer&);
+  AdviceDrainer& operator=(const AdviceDrainer&);
+
+  void Run();
+
+  AdviceQueue& queue_;
+  AdviceChannel& channel_;
+  AdviceDrainerConfig config_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable stopped_;
+};
+
+}
+
+#endif
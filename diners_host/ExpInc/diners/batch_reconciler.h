@@ -0,0 +1,73 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__BATCH_RECONCILER_H_
+#define DINERS__BATCH_RECONCILER_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdx/optional>
+#include <diners/batch_store.h>
+
+namespace diners {
+
+// DE 39 of a settlement the host could not reconcile with its own totals
+extern const char kReconcileErrorResponseCode[];
+
+// How much of the batch to upload after a settlement mismatch. Each stage
+// uploads a superset of the previous one; the last is the whole batch.
+enum ReconcileStage {
+  RECONCILE_SUSPECTS,        // records the host may have missed
+  RECONCILE_MISMATCHED,      // every record of the totals that disagree
+  RECONCILE_ALL
+};
+
+// Narrows a settlement mismatch down to the records to upload. The host
+// only answers 95 to a settlement it cannot reconcile, so the suspects are
+// the records it learned of through an advice (offline sales, adjusted and
+// to-advise records) plus those marked by the caller, e.g. from advices
+// still queued or rejected. When the host returns its totals in DE 63,
+// records of a category whose totals agree are left out.
+class BatchReconciler {
+ public:
+  explicit BatchReconciler(const BatchStore& batch);
+
+  // Through the indexes of the store. False if no record has the key
+  bool MarkSuspectStan(unsigned int stan);
+  bool MarkSuspectInvoice(unsigned int invoice_number);
+  bool MarkSuspectRrn(const std::string& rrn);
+
+  // Records of 'stage' not uploaded yet, in batch order. 'host_totals' are
+  // the host's totals from the settlement response, if it sent them.
+  std::vector<std::size_t> UploadSet(
+      ReconcileStage stage,
+      const stdx::optional<BatchTotalsForDinersHost>& host_totals) const;
+
+  void MarkUploaded(std::size_t index);
+
+ private:
+  bool MarkSuspect(const stdx::optional<std::size_t>& index);
+  bool IsSuspect(std::size_t index) const;
+
+  const BatchStore& batch_;
+  std::vector<bool> suspects_;
+  std::vector<bool> uploaded_;
+};
+
+}
+
+#endif
@@ -0,0 +1,223 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__BATCH_STORE_H_
+#define DINERS__BATCH_STORE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdx/optional>
+#include <diners/diners_transaction.h>
+#include <diners/transaction_record.h>
+
+namespace diners {
+
+// Values shared by every record of a batch
+struct BatchInfo {
+  BatchInfo()
+      : nii(0),
+        batch_number(0) {
+  }
+
+  std::string tid;
+  std::string mid;
+  std::string tpdu;
+  std::string currency;  // ISO 4217 alpha code the batch settles in
+  unsigned int nii;
+  unsigned int batch_number;
+};
+
+const std::size_t kDinersTransactionTypeCount = TC_UPLOAD + 1;
+
+// Settled records of one currency of a batch
+struct CurrencyTotals {
+  std::string currency;
+  BatchTotal sales_total;
+  BatchTotal refunds_total;
+  BatchTotal type_totals[kDinersTransactionTypeCount];  // by DinersTransactionType
+};
+
+// Protected storage for the PANs of a batch, e.g. the terminal's secure
+// element. A batch file holds the token Protect() returns and the last four
+// digits, never the PAN.
+class PanVault {
+ public:
+  virtual ~PanVault() {
+  }
+
+  // Token to Reveal() the PAN with, empty if it cannot be stored
+  virtual std::string Protect(const std::string& pan) = 0;
+
+  // PAN of 'token', empty if unknown
+  virtual std::string Reveal(const std::string& token) const = 0;
+};
+
+// Transactions of one batch in a memory-mapped file, by column: amounts,
+// currency, STAN, invoice number, datetime, type, status and entry data each are a
+// contiguous array indexed by record, so totals and searches scan arrays
+// of integers. Each transaction is also kept whole in a side area, as a
+// transaction record (transaction_record.h) without card data that
+// carries the last four PAN digits and the PAN token; Load() and the
+// indexes read it in place.
+//
+// Lookups by invoice number, STAN, RRN, authorization code and last four
+// PAN digits go through hash indexes kept in memory. Append() adds to them
+// and Open() rebuilds them from the file, which is what persists them.
+//
+// A record is on disk once Append() returns; the record count is written
+// last, so a record torn by a crash is not part of the batch. The PAN,
+// track data, PIN block and CVV are never stored. The file uses the byte order of the
+// machine writing it. One thread at a time may use a store.
+class BatchStore {
+ public:
+  enum Flag {
+    HAS_AMOUNT = 0x01,
+    HAS_ADDITIONAL_AMOUNT = 0x02,
+    HAS_PREAUTH_AMOUNT = 0x04,
+    HAS_PAN_SEQUENCE_NUMBER = 0x08,
+    IS_ADJUSTED = 0x10,
+    IS_PREAUTH_COMPLETED = 0x20
+  };
+
+  // Totals a record counts toward at settlement
+  enum Category {
+    NOT_SETTLED,
+    SETTLED_SALE,
+    SETTLED_REFUND
+  };
+
+  static Category CategoryOf(std::uint8_t type, std::uint8_t status);
+
+  static const std::size_t kDefaultCapacity = 16384;
+  static const std::size_t kDefaultSideSize = 8 * 1024 * 1024;
+
+  // nullptr if the file cannot be created
+  static std::unique_ptr<BatchStore> Create(
+      const std::string& path, const BatchInfo& info,
+      std::size_t capacity = kDefaultCapacity,
+      std::size_t side_size = kDefaultSideSize);
+
+  // nullptr if the file is not a batch
+  static std::unique_ptr<BatchStore> Open(const std::string& path);
+
+  ~BatchStore();
+
+  const BatchInfo& info() const {
+    return info_;
+  }
+
+  std::size_t Size() const {
+    return size_;
+  }
+
+  // Where Append() puts PANs and Load() takes them from. Without one, only
+  // the last four digits are kept and Load() gives no PAN, so the records
+  // cannot be batch uploaded. Not owned.
+  void SetPanVault(PanVault* vault) {
+    pan_vault_ = vault;
+  }
+
+  // Index of the record, nullopt if the batch is full, the disk failed or
+  // the vault did not take the PAN.
+  // The amounts are in info().currency unless 'currency' is given, e.g. for
+  // a DCC sale in the cardholder currency.
+  stdx::optional<std::size_t> Append(const DinersTransaction& tx);
+  stdx::optional<std::size_t> Append(const DinersTransaction& tx,
+                                     const std::string& currency);
+
+  // The record as a transaction, with the values of info() and the status
+  // and additional amount of the columns. The AID, which is not stored, is
+  // left as it is.
+  void Load(std::size_t index, DinersTransaction& tx) const;
+
+  // The transaction record as appended, read in place, e.g. to hand it to
+  // another process. Status and additional amount may have changed since.
+  TransactionView View(std::size_t index) const;
+
+  // Durable on return
+  bool SetStatus(std::size_t index, DinersTransactionStatus status);
+  bool SetAdditionalAmount(std::size_t index, std::uint64_t amount);
+
+  // Index of the first record with the key, nullopt if none
+  stdx::optional<std::size_t> FindInvoice(unsigned int invoice_number) const;
+  stdx::optional<std::size_t> FindStan(unsigned int stan) const;
+  stdx::optional<std::size_t> FindRrn(const std::string& rrn) const;
+
+  // Every record with the key, in batch order. An authorization code or the
+  // last four digits of a PAN (e.g. "1234") may be shared by several cards.
+  std::vector<std::size_t> FindAuthCode(const std::string& auth_id_response) const;
+  std::vector<std::size_t> FindPanLast4(const std::string& last4) const;
+
+  // Approved sales and refunds in info().currency, counted from the columns
+  BatchTotalsForDinersHost ComputeTotals() const;
+
+  // The same per currency and per type, info().currency first, then in
+  // order of first appearance. Settle each currency separately.
+  std::vector<CurrencyTotals> ComputeCurrencyTotals() const;
+
+  // Columns, Size() entries each. Amounts without their flag are 0.
+  const std::uint64_t* amounts() const;
+  const std::uint64_t* additional_amounts() const;
+  const std::uint64_t* preauth_amounts() const;
+  const std::uint32_t* currencies() const;  // alpha code, one byte per letter
+  const std::uint32_t* stans() const;
+  const std::uint32_t* invoice_numbers() const;
+  const std::int64_t* datetimes() const;
+  const std::uint8_t* types() const;
+  const std::uint8_t* statuses() const;
+  const std::uint8_t* flags() const;
+
+ private:
+  struct Layout;
+  struct Index;
+
+  BatchStore(const std::string& path, int fd, std::uint8_t* map,
+             std::size_t map_size, std::size_t capacity,
+             std::size_t side_size);
+  BatchStore(const BatchStore&);
+  BatchStore& operator=(const BatchStore&);
+
+  bool ReadHeader();
+  bool Commit(std::size_t size, std::size_t side_used);
+  bool SyncColumns();
+  void AddToIndex(std::size_t index);
+  CurrencyTotals TotalsOf(std::uint32_t currency) const;
+
+  template<typename T>
+  T* Column(std::size_t offset) const {
+    return reinterpret_cast<T*>(map_ + offset);
+  }
+
+  std::string path_;
+  int fd_;
+  std::uint8_t* map_;
+  std::size_t map_size_;
+  std::size_t capacity_;
+  std::size_t side_size_;
+  std::unique_ptr<Layout> layout_;
+  std::unique_ptr<Index> index_;
+  BatchInfo info_;
+  std::size_t size_;
+  std::size_t side_used_;
+  PanVault* pan_vault_;
+};
+
+}
+
+#endif
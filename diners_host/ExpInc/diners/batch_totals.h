@@ -0,0 +1,128 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__BATCH_TOTALS_H_
+#define DINERS__BATCH_TOTALS_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <diners/diners_transaction.h>
+
+namespace diners {
+
+class MappedLog;
+
+// The totals of one currency of an open batch: host (as numbered by the
+// caller), terminal (see TerminalKey()), batch number and currency (see
+// CurrencyKey())
+struct BatchKey {
+  BatchKey()
+      : host(0),
+        terminal(0),
+        batch(0),
+        currency(0) {
+  }
+
+  BatchKey(std::uint32_t host_, std::uint64_t terminal_, std::uint32_t batch_,
+           std::uint32_t currency_ = 0)
+      : host(host_),
+        terminal(terminal_),
+        batch(batch_),
+        currency(currency_) {
+  }
+
+  std::uint32_t host;
+  std::uint64_t terminal;
+  std::uint32_t batch;
+  std::uint32_t currency;
+};
+
+// BatchKey::currency of an ISO 4217 alpha code, 0 for an unknown currency
+std::uint32_t CurrencyKey(const std::string& currency);
+
+bool operator<(const BatchKey& lhs, const BatchKey& rhs);
+
+struct RunningTotals {
+  BatchTotal sales_total;
+  BatchTotal refunds_total;
+};
+
+// What a completed operation does to the totals of its batch
+enum TotalsEvent {
+  TOTALS_SALE,  // approved sale, offline sale or completion
+  TOTALS_REFUND,
+  TOTALS_SALE_CANCELLED,  // voided or reversed after approval
+  TOTALS_REFUND_CANCELLED,
+  TOTALS_SALE_ADJUSTED  // tip changed, amount is the difference
+};
+
+// Totals of every open batch, kept up to date as transactions complete so
+// that settlement does not have to scan the batch. Each update is on disk
+// when Record() returns: the new totals of the batch are appended to a
+// MappedLog and the previous record retired, so after a crash the batch has
+// either its old or its new totals.
+class BatchTotalsLedger {
+ public:
+  static const std::size_t kDefaultCapacity = 64 * 1024;
+
+  // nullptr if the ledger file cannot be used
+  static std::unique_ptr<BatchTotalsLedger> Open(
+      const std::string& path, std::size_t capacity = kDefaultCapacity);
+
+  ~BatchTotalsLedger();
+
+  // 'amount' in minor units; only TOTALS_SALE_ADJUSTED takes a negative one
+  bool Record(const BatchKey& key, TotalsEvent event, std::int64_t amount);
+
+  // Zero for a batch with nothing recorded
+  RunningTotals Get(const BatchKey& key) const;
+
+  std::vector<std::pair<BatchKey, RunningTotals>> All() const;
+
+  // Totals of each currency of the batch of 'key', whatever its currency
+  std::vector<std::pair<BatchKey, RunningTotals>> Currencies(const BatchKey& key) const;
+
+  // Forgets the totals of one currency of a batch once it is settled
+  bool Close(const BatchKey& key);
+
+  // Same for every currency of the batch
+  bool CloseBatch(const BatchKey& key);
+
+ private:
+  struct Entry {
+    std::uint64_t sequence;
+    RunningTotals totals;
+  };
+
+  explicit BatchTotalsLedger(std::unique_ptr<MappedLog> log);
+  BatchTotalsLedger(const BatchTotalsLedger&);
+  BatchTotalsLedger& operator=(const BatchTotalsLedger&);
+
+  bool Recover();
+
+  std::unique_ptr<MappedLog> log_;
+  mutable std::mutex mutex_;
+  std::map<BatchKey, Entry> batches_;
+};
+
+}
+
+#endif
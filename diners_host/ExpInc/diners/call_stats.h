@@ -0,0 +1,59 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__CALL_STATS_H_
+#define DINERS__CALL_STATS_H_
+
+#include <cstdint>
+
+namespace diners {
+
+// Why a host call failed. The first five are transient (the exchange did
+// not complete), the others permanent (the host answered, but not
+// acceptably: FAILURE_RESPONSE_CODE when it declined a batch upload, key
+// download or key exchange, DE 39 not "00"; a declined authorization is a
+// completed call).
+enum FailureCause {
+  FAILURE_NONE,
+  FAILURE_CONNECT,
+  FAILURE_SEND_ERROR,
+  FAILURE_PARTIAL_SEND,
+  FAILURE_RECEIVE_ERROR,
+  FAILURE_SHORT_FRAME,
+  FAILURE_MALFORMED,
+  FAILURE_INVALID_MTI,
+  FAILURE_CORRELATION_MISMATCH,
+  FAILURE_MISSING_FIELD,
+  FAILURE_RESPONSE_CODE,
+  kFailureCauseCount
+};
+
+// What a host saw since its stats were last taken: the cause of the last
+// failure and the bytes exchanged, TPDU included.
+struct CallStats {
+  CallStats()
+      : failure(FAILURE_NONE),
+        bytes_sent(0),
+        bytes_received(0) {
+  }
+
+  FailureCause failure;
+  std::uint64_t bytes_sent;
+  std::uint64_t bytes_received;
+};
+
+}
+
+#endif
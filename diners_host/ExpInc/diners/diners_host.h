@@ -16,13 +16,22 @@
 #ifndef DINERS__DINERS_HOST_H_
 #define DINERS__DINERS_HOST_H_
 
+#include <chrono>
 #include <comms/client.h>
+#include <diners/advice_queue.h>
+#include <diners/call_stats.h>
 #include <diners/diners_transaction.h>
+#include <diners/online_trace.h>
 #include <diners/test_transaction.h>
 #include <iso8583/apdu.h>
+#include <stdx/optional>
 
 namespace diners {
 
+class BatchReconciler;
+class BatchStore;
+class PanVault;
+
 template<typename T>
 using BuildRequestFunc = iso8583::Apdu (*)(T& tx);
 
@@ -39,7 +48,12 @@ class DinersHost {
 
  public:
   DinersHost()
-      : comms_(""){
+      : comms_(""),
+        advice_queue_(NULL),
+        piggyback_slice_(kDefaultPiggybackSlice),
+        reversal_journal_(NULL),
+        pan_vault_(NULL),
+        request_sent_(false) {
   }
 
   ~DinersHost() {
@@ -61,9 +75,22 @@ class DinersHost {
   Status PerformBatchUpload(DinersTransaction& tx,
                             unsigned int batch_upload_stan);
 
+  // Uploads record 'index' of 'batch', loaded into a transaction reused
+  // across calls
+  Status PerformBatchUpload(const BatchStore& batch, std::size_t index,
+                            unsigned int batch_upload_stan);
+
   Status PerformSettlement(DinersSettlementData& settle_msg,
                            bool after_batch_upload);
 
+  // Settlement of 'batch'. On a mismatch, uploads the records of each
+  // ReconcileStage in turn and settles again after each, until the host
+  // agrees. 'next_stan' numbers the uploads and the later settlements.
+  Status PerformReconciledSettlement(DinersSettlementData& settle_msg,
+                                     const BatchStore& batch,
+                                     BatchReconciler& reconciler,
+                                     unsigned int (*next_stan)());
+
   Status SendReversal(DinersTransaction& tx);
 
   Status AuthorizeRefund(DinersTransaction& tx);
@@ -81,11 +108,82 @@ class DinersHost {
   bool WaitForConnection(uint32_t timeout);
   bool Disconnect();
 
+  // Stats since the previous call, then starts over
+  CallStats TakeCallStats();
+
+  // With a queue, offline sales, TC uploads and tip adjusts are queued and
+  // COMPLETED once on disk, with is_advice_queued set and the response code
+  // left as it was; an AdviceDrainer sends them later. Needs a PAN vault.
+  void SetAdviceQueue(AdviceQueue* queue) {
+    advice_queue_ = queue;
+  }
+
+  // After an authorization, Disconnect() first sends the queued advices of
+  // its TID over the connection still open, starting new ones for at most
+  // 'slice'. Zero turns it off. These exchanges are left out of
+  // TakeCallStats(), as are those of the drainer.
+  void SetAdvicePiggybackSlice(std::chrono::milliseconds slice) {
+    piggyback_slice_ = slice;
+  }
+
+  // With a journal, the reversal of each sale, refund, pre-auth, completion
+  // and void is journaled before the request is sent and dropped once the
+  // host answered; otherwise an AdviceDrainer on the journal sends it.
+  // Needs a PAN vault.
+  void SetReversalJournal(AdviceQueue* journal) {
+    reversal_journal_ = journal;
+  }
+
+  // Keeps the PAN of the queued advices and journaled reversals, which
+  // hold a token instead. Not owned.
+  void SetPanVault(PanVault* vault) {
+    pan_vault_ = vault;
+  }
+
+  // Advice queue, piggyback slice, reversal journal and PAN vault of
+  // 'other', for hosts of one switch that share the same queues
+  void CopySettings(const DinersHost& other) {
+    advice_queue_ = other.advice_queue_;
+    piggyback_slice_ = other.piggyback_slice_;
+    reversal_journal_ = other.reversal_journal_;
+    pan_vault_ = other.pan_vault_;
+  }
+
+  // Builds the message of one queued advice and sends it over the open
+  // connection
+  AdviceResult DeliverAdvice(const Advice& advice);
+
  private:
   comms::Client comms_;
-
-  Status SendMessage(const std::vector<std::uint8_t>& msg, const std::string tpdu);
-  Status ReceiveMessage(std::vector<std::uint8_t>& msg);
+  CallStats call_stats_;
+  static const std::chrono::milliseconds kDefaultPiggybackSlice;
+
+  AdviceQueue* advice_queue_;
+  std::chrono::milliseconds piggyback_slice_;
+  stdx::optional<std::uint64_t> piggyback_terminal_;
+  AdviceQueue* reversal_journal_;
+  PanVault* pan_vault_;
+  DinersTransaction batch_upload_tx_;
+  bool request_sent_;  // whether any byte of the last Exchange() request went out
+
+  Status SendMessage(const std::vector<std::uint8_t>& frame);
+  Status ReceiveMessage(std::vector<std::uint8_t>& msg, OnlineTrace& trace);
+
+  // Connection wait, send, receive and correlation check of one frame.
+  // Sets request_sent_.
+  Status Exchange(const std::vector<std::uint8_t>& frame,
+                  std::vector<std::uint8_t>& response, OnlineTrace& trace);
+
+  // 'tx' as a record without card data, its PAN in the vault. False if it
+  // cannot be kept so.
+  bool EncodeQueued(const DinersTransaction& tx,
+                    std::vector<std::uint8_t>& record) const;
+  Status QueueAdvice(AdviceType type, DinersTransaction& tx);
+  void DeliverQueuedAdvices(std::uint64_t terminal);
+
+  Status PerformAuthorization(BuildRequestFunc<DinersTransaction> request_func,
+                              ReadAndValidateResponseFunc<DinersTransaction> response_func,
+                              DinersTransaction& tx);
 
   template<typename T>
   DinersHost::Status PerformOnline(BuildRequestFunc<T> request_func,
@@ -96,6 +194,33 @@ class DinersHost {
   DinersHost::Status PerformOnline(iso8583::Apdu request,
                                  ReadAndValidateResponseFunc<T> response_func,
                                  T& tx);
+
+  template<typename T>
+  DinersHost::Status PerformOnline(const iso8583::Apdu& request,
+                                 ReadAndValidateResponseFunc<T> response_func,
+                                 T& tx, OnlineTrace& trace);
+};
+
+// AdviceChannel with a connection of its own to 'host_name', for an
+// AdviceDrainer on an advice queue or a reversal journal
+class DinersAdviceChannel : public AdviceChannel {
+ public:
+  explicit DinersAdviceChannel(const std::string& host_name)
+      : host_name_(host_name) {
+  }
+
+  // The vault the queued PANs are in. Not owned.
+  void SetPanVault(PanVault* vault) {
+    host_.SetPanVault(vault);
+  }
+
+  virtual bool Connect();
+  virtual AdviceResult Deliver(const Advice& advice);
+  virtual void Disconnect();
+
+ private:
+  std::string host_name_;
+  DinersHost host_;
 };
 
 }
@@ -17,6 +17,7 @@
 #define DINERS__DINERS_TRANSACTION_H_
 
 #include <stdx/optional>
+#include <diners/fixed_string.h>
 #include <types/amount.h>
 #include <types/pan.h>
 #include <types/aid.h>
@@ -57,53 +58,66 @@ enum DinersTransactionStatus {
 	UNKNOWN_ERROR
 };
 
+// Fields are grouped by access: the header used by batch totals and
+// lookups first, then the host data of every message, then the card data
+// that is only read to build a request. Protocol fields are inline
+// fixed-capacity strings sized from protocol.cpp, so a record carries no
+// heap allocation besides the ICC data and the issuer EMV response.
 struct DinersTransaction {
   DinersTransaction()
-  : stan(0),
-    nii(0),
+  : transaction_type(SALE),
+    transaction_status(IN_PROGRESS),
+    previous_transaction_status(IN_PROGRESS),
+    in_progress_status(IN_PROGRESS_NONE),
+    stan(0),
     invoice_number(0),
+    batch_number(0),
+    nii(0),
+    is_preauth_completed(false),
+    is_adjusted(false),
+    is_advice_queued(false),
     tx_datetime(0) {
   }
 
-  stdx::optional<types::Pan> pan;
-  std::string processing_code;
-  std::string orig_pos_entry_mode; //TODO: find a way to also save this to batch
-  stdx::optional<types::Amount> amount;
-  stdx::optional<types::Amount> preauth_amount;  //amount, pre-authorization
-
-  bool is_preauth_completed;
-  bool is_adjusted;
-
-  unsigned int stan;
-  std::string expiration_date;
-  types::PosEntryMode pos_entry_mode;
-  stdx::optional<unsigned int> pan_sequence_number;
-  unsigned int nii;
-  types::PosConditionCode pos_condition_code;
-  stdx::optional<std::vector<uint8_t>> track2;
-  std::string tid;
-  std::string mid;
-  std::string cvv;
-  stdx::optional<std::vector<uint8_t>> pin_block;
-  stdx::optional<types::Amount> additional_amount;
-  stdx::optional<types::Amount> original_additional_amount;
-  stdx::optional<std::vector<uint8_t>> icc_data;
-  stdx::optional<types::Aid> aid;
   DinersTransactionType transaction_type;
   DinersTransactionStatus transaction_status;
-  DinersInProgressStatus in_progress_status;
   DinersTransactionStatus previous_transaction_status;
-  std::string tpdu;
+  DinersInProgressStatus in_progress_status;
+  unsigned int stan;
   unsigned int invoice_number;
   unsigned int batch_number;
-
+  unsigned int nii;
+  bool is_preauth_completed;
+  bool is_adjusted;
+  bool is_advice_queued;  // accepted into the advice queue, not sent yet
   time_t tx_datetime;
-  std::string rrn;
-  std::string auth_id_response;
-  std::string response_code;
+  stdx::optional<types::Amount> amount;
+  stdx::optional<types::Amount> additional_amount;
+  stdx::optional<types::Amount> original_additional_amount;
+  stdx::optional<types::Amount> preauth_amount;  //amount, pre-authorization
+
+  FixedString<12> rrn;
+  FixedString<6> auth_id_response;
+  FixedString<2> response_code;
+  FixedString<6> processing_code;
+  FixedString<8> tid;
+  FixedString<15> mid;
+  FixedString<10> tpdu;  // hex
+  types::PosEntryMode pos_entry_mode;
+  types::PosConditionCode pos_condition_code;
+  FixedString<4> orig_pos_entry_mode; //TODO: find a way to also save this to batch
+
+  stdx::optional<types::Pan> pan;
+  FixedString<4> expiration_date;
+  stdx::optional<unsigned int> pan_sequence_number;
+  stdx::optional<types::Aid> aid;
+  FixedString<4> cvv;
+  FixedBytes<8> pin_block;
+  FixedBytes<99> track2;
+  FixedString<77> track1_data;
+  FixedString<26> cardholder_name;  // track 1 name, ISO/IEC 7813 maximum
+  stdx::optional<std::vector<uint8_t>> icc_data;
   std::vector<uint8_t> issuer_emv_response;
-  std::string track1_data;
-  std::string cardholder_name;
 
   stdx::optional<types::Amount> GetTotalAmount() const;
   stdx::optional<types::Amount> GetTotalPreauthAmount() const;
@@ -151,6 +165,7 @@ struct DinersSettlementData {
   std::string response_code;
   uint32_t batch_number;
   BatchTotalsForDinersHost batch_summary;
+  stdx::optional<BatchTotalsForDinersHost> host_batch_summary;  // DE 63 of the response, if the host sent its totals
   std::string response_msg;
   uint32_t invoice_num;
 };
@@ -0,0 +1,235 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__FIXED_STRING_H_
+#define DINERS__FIXED_STRING_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <utils/converter.h>
+#include <utils/logger.h>
+
+namespace diners {
+
+inline void LogValueTooLong(std::size_t size, std::size_t capacity) {
+  logger::error(("DINERS - Value of " + utils::ToString(size)
+      + " bytes rejected, field holds " + utils::ToString(capacity)).c_str());
+}
+
+// String of at most N characters stored inline, for fields whose maximum
+// length is fixed by the protocol spec (see protocol.cpp) or the card
+// format. It converts to std::string so it can be handed to the message
+// builders unchanged. Input longer than N is logged and rejected, leaving
+// the string empty, rather than truncated into a different valid-looking
+// value; Assign() tells the caller.
+template<std::size_t N>
+class FixedString {
+  static_assert(N < 256, "FixedString keeps its length in one byte");
+
+ public:
+  FixedString()
+      : size_(0) {
+    data_[0] = '\0';
+  }
+
+  FixedString(const std::string& value) {
+    Assign(value.data(), value.size());
+  }
+
+  FixedString(const char* value) {
+    Assign(value, std::strlen(value));
+  }
+
+  FixedString& operator=(const std::string& value) {
+    Assign(value.data(), value.size());
+    return *this;
+  }
+
+  FixedString& operator=(const char* value) {
+    Assign(value, std::strlen(value));
+    return *this;
+  }
+
+  // False, leaving the string empty, if 'value' is longer than N
+  bool Assign(const std::string& value) {
+    return Assign(value.data(), value.size());
+  }
+
+  operator std::string() const {
+    return str();
+  }
+
+  std::string str() const {
+    return std::string(data_, size_);
+  }
+
+  const char* c_str() const {
+    return data_;
+  }
+
+  const char* data() const {
+    return data_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  std::size_t length() const {
+    return size_;
+  }
+
+  static std::size_t capacity() {
+    return N;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  void clear() {
+    size_ = 0;
+    data_[0] = '\0';
+  }
+
+  bool operator==(const FixedString& rhs) const {
+    return size_ == rhs.size_ && std::memcmp(data_, rhs.data_, size_) == 0;
+  }
+
+  bool operator==(const std::string& rhs) const {
+    return size_ == rhs.size() && std::memcmp(data_, rhs.data(), size_) == 0;
+  }
+
+  bool operator==(const char* rhs) const {
+    return size_ == std::strlen(rhs) && std::memcmp(data_, rhs, size_) == 0;
+  }
+
+  template<typename T>
+  bool operator!=(const T& rhs) const {
+    return !(*this == rhs);
+  }
+
+ private:
+  bool Assign(const char* value, std::size_t size) {
+    if (size > N) {
+      LogValueTooLong(size, N);
+      clear();
+      return false;
+    }
+    size_ = static_cast<std::uint8_t>(size);
+    std::memcpy(data_, value, size_);
+    data_[size_] = '\0';
+    return true;
+  }
+
+  std::uint8_t size_;
+  char data_[N + 1];
+};
+
+template<std::size_t N>
+bool operator==(const std::string& lhs, const FixedString<N>& rhs) {
+  return rhs == lhs;
+}
+
+template<std::size_t N>
+bool operator!=(const std::string& lhs, const FixedString<N>& rhs) {
+  return !(rhs == lhs);
+}
+
+// Byte array of at most N bytes stored inline, the binary counterpart of
+// FixedString for the PIN block and track 2. Empty means absent, which is
+// also what longer input leaves.
+template<std::size_t N>
+class FixedBytes {
+  static_assert(N < 256, "FixedBytes keeps its length in one byte");
+
+ public:
+  FixedBytes()
+      : size_(0) {
+  }
+
+  FixedBytes(const std::vector<std::uint8_t>& value) {
+    Assign(value.data(), value.size());
+  }
+
+  FixedBytes& operator=(const std::vector<std::uint8_t>& value) {
+    Assign(value.data(), value.size());
+    return *this;
+  }
+
+  // False, leaving the array empty, if 'value' is longer than N
+  bool Assign(const std::vector<std::uint8_t>& value) {
+    return Assign(value.data(), value.size());
+  }
+
+  operator std::vector<std::uint8_t>() const {
+    return bytes();
+  }
+
+  std::vector<std::uint8_t> bytes() const {
+    return std::vector<std::uint8_t>(data_, data_ + size_);
+  }
+
+  const std::uint8_t* data() const {
+    return data_;
+  }
+
+  const std::uint8_t* begin() const {
+    return data_;
+  }
+
+  const std::uint8_t* end() const {
+    return data_ + size_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  static std::size_t capacity() {
+    return N;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  void clear() {
+    size_ = 0;
+  }
+
+ private:
+  bool Assign(const std::uint8_t* value, std::size_t size) {
+    if (size > N) {
+      LogValueTooLong(size, N);
+      clear();
+      return false;
+    }
+    size_ = static_cast<std::uint8_t>(size);
+    if (size_ > 0)
+      std::memcpy(data_, value, size_);
+    return true;
+  }
+
+  std::uint8_t size_;
+  std::uint8_t data_[N];
+};
+
+}
+
+#endif
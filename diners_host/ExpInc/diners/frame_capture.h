@@ -0,0 +1,67 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__FRAME_CAPTURE_H_
+#define DINERS__FRAME_CAPTURE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <diners/online_trace.h>
+
+namespace diners {
+
+enum CaptureDirection {
+  CAPTURE_SENT,
+  CAPTURE_RECEIVED
+};
+
+// Records a raw frame in the capture ring: 'header_size' bytes of TPDU
+// followed by the message. PAN (DE 2) keeps its first 6 and last 4 digits;
+// track 2 (DE 35), track 1 (DE 45), PIN block (DE 52) and the card tags of
+// the ICC data (DE 55) are zeroed, as is everything from a field that
+// cannot be scanned, or past the last field, to the end. Frames of other
+// hosts, whose field encodings are not known here, keep their MTI and
+// bitmaps only.
+//
+// The ring holds the last 128 frames, up to 1024 bytes each. Writers never
+// block or allocate: a frame whose slot is still being written by another
+// thread is dropped.
+void CaptureFrame(OnlineHost host, CaptureDirection direction,
+                  const std::uint8_t* frame, std::size_t size,
+                  std::size_t header_size);
+
+// Frames not recorded because their slot was busy
+std::uint64_t DroppedCapturedFrames();
+
+// Writes the frames in the ring, oldest first, to a file read by the
+// frame_capture_decoder tool. The file starts with "FCAP", a 16-bit version
+// and 16 reserved bits; each record is
+//   uint64 sequence, int64 time (us since the epoch), uint8 host,
+//   uint8 direction, uint16 header size, uint32 frame size,
+//   uint32 captured size, then the captured bytes,
+// all little endian. Frames longer than the slot are cut to its size.
+bool WriteFrameCapture(const std::string& path);
+
+// Same, to an open file descriptor. Async-signal-safe.
+bool WriteFrameCapture(int fd);
+
+// Writes the ring to 'path' when the process gets SIGSEGV, SIGBUS, SIGILL,
+// SIGFPE or SIGABRT, then lets the signal take its default action.
+void InstallFrameCaptureCrashHandler(const char* path);
+
+}
+
+#endif
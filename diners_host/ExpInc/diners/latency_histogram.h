@@ -0,0 +1,71 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__LATENCY_HISTOGRAM_H_
+#define DINERS__LATENCY_HISTOGRAM_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace diners {
+
+// Fixed-size log-linear histogram of durations in microseconds, 16 buckets
+// per power of two (about 6% resolution) up to 2^32 us. Recording is a few
+// integer operations, with no allocation and no lock: counters are relaxed
+// atomics, so any thread may record while another reads. A read concurrent
+// with recording sees a mix of before and after, which is fine for
+// percentiles.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+  LatencyHistogram(const LatencyHistogram& other);
+  LatencyHistogram& operator=(const LatencyHistogram& other);
+
+  void Record(std::uint64_t micros);
+  void Merge(const LatencyHistogram& other);
+  void Reset();
+
+  std::uint64_t Count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  std::uint64_t Max() const {
+    return max_.load(std::memory_order_relaxed);
+  }
+
+  double Mean() const;
+
+  // Upper bound of the bucket holding the percentile (0-100)
+  std::uint64_t Percentile(double percentile) const;
+
+ private:
+  static const unsigned int kSubBucketBits = 4;
+  static const unsigned int kMaxBits = 32;
+  static const std::size_t kBucketCount = (kMaxBits - kSubBucketBits + 1)
+      << kSubBucketBits;
+
+  static std::size_t BucketOf(std::uint64_t micros);
+  static std::uint64_t BucketUpperBound(std::size_t bucket);
+
+  std::atomic<std::uint32_t> buckets_[kBucketCount];
+  std::atomic<std::uint64_t> count_;
+  std::atomic<std::uint64_t> sum_;
+  std::atomic<std::uint64_t> max_;
+};
+
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__ONLINE_TRACE_H_
+#define DINERS__ONLINE_TRACE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <diners/latency_histogram.h>
+
+namespace diners {
+
+enum OnlineHost {
+  ONLINE_HOST_FDMS,
+  ONLINE_HOST_DINERS,
+  kOnlineHostCount
+};
+
+// Stages of one PerformOnline() call. SERVER_WAIT runs from the end of the
+// send until comms returns the response frame; RECEIVE is our handling of
+// that frame.
+enum OnlineStage {
+  STAGE_BUILD,
+  STAGE_CONNECT_WAIT,
+  STAGE_SEND,
+  STAGE_SERVER_WAIT,
+  STAGE_RECEIVE,
+  STAGE_PARSE,
+  kOnlineStageCount
+};
+
+const char* OnlineHostName(OnlineHost host);
+const char* OnlineStageName(OnlineStage stage);
+
+// Times the stages of one PerformOnline() call. Each Mark() charges the
+// time since the previous mark to a stage; the stages reached are recorded
+// in the host / message type histograms when the trace goes out of scope,
+// so early returns are accounted for. Traces of concurrent calls record into
+// the same histograms, which take that without a lock.
+class OnlineTrace {
+ public:
+  explicit OnlineTrace(OnlineHost host);
+  ~OnlineTrace();
+
+  // Request MTI, e.g. 200
+  void SetMessageType(int mti) {
+    mti_ = mti;
+  }
+
+  void Mark(OnlineStage stage);
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  OnlineTrace(const OnlineTrace&);
+  OnlineTrace& operator=(const OnlineTrace&);
+
+  OnlineHost host_;
+  int mti_;
+  Clock::time_point last_;
+  std::uint32_t micros_[kOnlineStageCount];
+  bool reached_[kOnlineStageCount];
+};
+
+// Histogram of a stage for a host and a request MTI. MTIs other than 0100,
+// 0200, 0220, 0320, 0400, 0500 and 0800 share one histogram.
+const LatencyHistogram& GetOnlineLatency(OnlineHost host, int mti,
+                                         OnlineStage stage);
+
+// One line per host / message type / stage with samples:
+//   DINERS 0200 server_wait count=812 p50=41215 p90=52223 p99=90111 max=120873
+// (microseconds)
+std::string DumpOnlineLatency();
+
+void ResetOnlineLatency();
+
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__PREAUTH_LEDGER_H_
+#define DINERS__PREAUTH_LEDGER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdx/optional>
+
+namespace diners {
+
+class MappedLog;
+
+// A pre-authorization still holding funds on a card
+struct PreauthHold {
+  PreauthHold()
+      : id(0),
+        authorized(0),
+        completed(0),
+        expires_at(0),
+        invoice_number(0),
+        expiring(false) {
+  }
+
+  std::uint64_t id;  // set by the ledger
+  std::string card_token;  // up to 64 bytes, never the PAN itself
+  std::string auth_id_response;
+  std::uint64_t authorized;  // minor units, top-ups included
+  std::uint64_t completed;   // minor units completed so far
+  std::time_t expires_at;
+  unsigned int invoice_number;
+  bool expiring;  // set by the sweeper while the host cancellation runs
+
+  std::uint64_t Remaining() const {
+    return authorized > completed ? authorized - completed : 0;
+  }
+};
+
+// Open pre-authorizations, from approval until completed, released or
+// expired. Holds are indexed by card token and authorization code for
+// completion matching, and ordered by expiry so that expired holds are
+// found without a scan. Like BatchTotalsLedger, each change is on disk when
+// it returns: the new state of the hold is appended to a MappedLog and the
+// previous record retired.
+class PreauthLedger {
+ public:
+  static const std::size_t kDefaultCapacity = 4 * 1024 * 1024;
+
+  // nullptr if the ledger file cannot be used
+  static std::unique_ptr<PreauthLedger> Open(
+      const std::string& path, std::size_t capacity = kDefaultCapacity);
+
+  ~PreauthLedger();
+
+  // Id of the new hold, 0 if it could not be stored
+  std::uint64_t Add(const PreauthHold& hold);
+
+  // Incremental authorization: adds 'amount' and moves the expiry to
+  // 'expires_at' if that is later
+  bool TopUp(std::uint64_t id, std::uint64_t amount, std::time_t expires_at);
+
+  // Completes 'amount' of the hold. The hold is closed once nothing
+  // remains, or at once if 'final' (the rest of the funds are released).
+  // False if 'amount' is more than the hold has remaining. Neither this nor
+  // TopUp() changes a hold that is expiring.
+  bool Complete(std::uint64_t id, std::uint64_t amount, bool final);
+
+  // Cancelled or expired on the host
+  bool Release(std::uint64_t id);
+
+  // Marks the hold expiring, on disk, if it is still expired at 'now',
+  // checked under the same lock as TopUp() and Complete(). A hold already
+  // expiring, left so by a crash, is given again. The hold as marked,
+  // nullopt if it was not.
+  stdx::optional<PreauthHold> MarkExpiring(std::uint64_t id, std::time_t now);
+
+  stdx::optional<PreauthHold> Get(std::uint64_t id) const;
+
+  // Open holds with the key, oldest first
+  std::vector<PreauthHold> FindByToken(const std::string& card_token) const;
+  std::vector<PreauthHold> FindByAuthCode(const std::string& auth_id_response) const;
+
+  // The hold a completion of this card and authorization code refers to
+  stdx::optional<PreauthHold> Match(const std::string& card_token,
+                                    const std::string& auth_id_response) const;
+
+  // Open holds expired at 'now', soonest first, at most 'max_count'
+  std::vector<PreauthHold> Expired(std::time_t now,
+                                   std::size_t max_count = std::size_t(-1)) const;
+
+  // Expiry of the hold expiring first, nullopt if none is open
+  stdx::optional<std::time_t> NextExpiry() const;
+
+  std::size_t Size() const;
+
+ private:
+  struct Entry {
+    std::uint64_t sequence;
+    PreauthHold hold;
+  };
+
+  typedef std::unordered_multimap<std::string, std::uint64_t> KeyIndex;
+
+  explicit PreauthLedger(std::unique_ptr<MappedLog> log);
+  PreauthLedger(const PreauthLedger&);
+  PreauthLedger& operator=(const PreauthLedger&);
+
+  bool Recover();
+  void Insert(std::uint64_t sequence, const PreauthHold& hold);
+  void Erase(std::map<std::uint64_t, Entry>::iterator entry);
+  bool Commit(std::unique_lock<std::mutex>& lock, const PreauthHold& hold,
+              bool close);
+  std::vector<PreauthHold> Find(const KeyIndex& index,
+                                const std::string& key) const;
+
+  std::unique_ptr<MappedLog> log_;
+  mutable std::mutex mutex_;
+  std::map<std::uint64_t, Entry> holds_;  // by id
+  KeyIndex tokens_;
+  KeyIndex auth_codes_;
+  std::set<std::pair<std::time_t, std::uint64_t>> expiries_;
+  std::uint64_t next_id_;
+};
+
+// What to do with a hold the sweeper releases as expired, e.g. send a
+// cancellation on hosts that support one. Called while the hold is marked
+// expiring, before it is released, so that a crash in between calls it
+// again for the same hold after a restart: it must cope with being called
+// twice.
+class PreauthExpiryHandler {
+ public:
+  virtual ~PreauthExpiryHandler() {
+  }
+
+  virtual void Expired(const PreauthHold& hold) = 0;
+};
+
+// Background thread releasing expired holds. It wakes up at the next
+// expiry, or after 'max_interval' to pick up holds added meanwhile.
+class PreauthSweeper {
+ public:
+  PreauthSweeper(PreauthLedger& ledger, PreauthExpiryHandler& handler,
+                 std::chrono::seconds max_interval = std::chrono::seconds(60));
+  ~PreauthSweeper();
+
+  void Start();
+  void Stop();
+
+  // Releases what is expired at 'now', on the calling thread. Returns the
+  // number of holds released.
+  std::size_t SweepOnce(std::time_t now);
+
+ private:
+  PreauthSweeper(const PreauthSweeper&);
+  PreauthSweeper& operator=(const PreauthSweeper&);
+
+  void Run();
+
+  PreauthLedger& ledger_;
+  PreauthExpiryHandler& handler_;
+  std::chrono::seconds max_interval_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable stopped_;
+};
+
+}
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__TRANSACTION_RECORD_H_
+#define DINERS__TRANSACTION_RECORD_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <stdx/optional>
+#include <diners/diners_transaction.h>
+
+namespace diners {
+
+// Flat binary form of DinersTransaction, shared by the POS application and the host process, and the unit written to a
+// MappedLog or a shared memory segment. BatchStore keeps each transaction of
+// a batch as one. A record is read in place through a
+// view: the view only checks the header, and each accessor reads its field
+// at a fixed offset, so reading the STAN of a record costs what reading a
+// struct member does and nothing is copied until the caller asks for a
+// std::string.
+//
+// A record is a 16-byte header (magic, version, compatible version, fixed
+// part size, flags, record size), a fixed part of little-endian scalars and
+// of (offset, size) slots, and the variable fields the slots point to. There
+// are no alignment requirements.
+//
+// Schema evolution: fields are only ever appended to the fixed part, with
+// kRecordVersion bumped. A reader gives the default value for a field past
+// the fixed part size a record was written with, and ignores fields it does
+// not know, so old and new writers and readers can share a file. A change
+// that old readers must not read bumps the compatible version, and views
+// reject records whose compatible version is newer than theirs.
+//
+// Version 2 added the PAN token.
+const std::uint16_t kRecordVersion = 2;
+
+// Which card data EncodeTransaction() writes. The full PAN, expiry date,
+// cardholder name, CVV, PIN block and track data are only for handing a
+// transaction over for authorization, never for a record that is kept,
+// which gets the last four PAN digits and ICC data without the card tags
+// (IsIccCardTag() in diners_utils.h).
+enum CardDataPolicy {
+  OMIT_CARD_DATA,
+  INCLUDE_CARD_DATA
+};
+
+// A variable field of a record, pointing into the record
+struct FieldRef {
+  FieldRef()
+      : data(NULL),
+        size(0) {
+  }
+
+  FieldRef(const std::uint8_t* data_, std::size_t size_)
+      : data(data_),
+        size(size_) {
+  }
+
+  bool empty() const {
+    return size == 0;
+  }
+
+  std::string str() const {
+    return std::string(reinterpret_cast<const char*>(data), size);
+  }
+
+  std::vector<std::uint8_t> bytes() const {
+    return std::vector<std::uint8_t>(data, data + size);
+  }
+
+  const std::uint8_t* data;
+  std::size_t size;
+};
+
+// Header and field access common to both record types
+class RecordView {
+ public:
+  // False if the buffer does not hold a record of this type this code can read
+  bool valid() const {
+    return data_ != NULL;
+  }
+
+  std::uint16_t version() const;
+
+  // Bytes of the record, the next record of a buffer starts there
+  std::size_t size() const {
+    return size_;
+  }
+
+  const std::uint8_t* data() const {
+    return data_;
+  }
+
+ protected:
+  RecordView(const std::uint8_t* data, std::size_t size, const char* magic);
+
+  bool HasFlag(std::uint16_t flag) const;
+  std::uint8_t Read8(std::size_t offset) const;
+  std::uint16_t Read16(std::size_t offset) const;
+  std::uint32_t Read32(std::size_t offset) const;
+  std::uint64_t Read64(std::size_t offset) const;
+  FieldRef Field(std::size_t slot) const;
+
+ private:
+  const std::uint8_t* data_;
+  std::size_t size_;
+  std::size_t fixed_size_;
+};
+
+class TransactionView : public RecordView {
+ public:
+  TransactionView(const std::uint8_t* data, std::size_t size);
+
+  DinersTransactionType transaction_type() const;
+  DinersTransactionStatus transaction_status() const;
+  DinersTransactionStatus previous_transaction_status() const;
+  DinersInProgressStatus in_progress_status() const;
+  unsigned int stan() const;
+  unsigned int invoice_number() const;
+  unsigned int batch_number() const;
+  unsigned int nii() const;
+  time_t tx_datetime() const;
+  bool is_adjusted() const;
+  bool is_preauth_completed() const;
+
+  // Amounts in minor units of currency()
+  std::string currency() const;
+  stdx::optional<std::uint64_t> amount() const;
+  stdx::optional<std::uint64_t> additional_amount() const;
+  stdx::optional<std::uint64_t> original_additional_amount() const;
+  stdx::optional<std::uint64_t> preauth_amount() const;
+
+  types::PosEntryMode pos_entry_mode() const;
+  types::PosConditionCode pos_condition_code() const;
+  stdx::optional<unsigned int> pan_sequence_number() const;
+
+  // The PAN with INCLUDE_CARD_DATA, else its last four digits
+  FieldRef pan() const;
+  // What a PanVault (batch_store.h) gives the PAN back for, if any
+  FieldRef pan_token() const;
+  FieldRef expiration_date() const;  // with INCLUDE_CARD_DATA
+  FieldRef rrn() const;
+  FieldRef auth_id_response() const;
+  FieldRef response_code() const;
+  FieldRef processing_code() const;
+  FieldRef tid() const;
+  FieldRef mid() const;
+  FieldRef tpdu() const;
+  FieldRef orig_pos_entry_mode() const;
+  FieldRef cardholder_name() const;  // with INCLUDE_CARD_DATA
+  bool has_icc_data() const;
+  FieldRef icc_data() const;
+  FieldRef issuer_emv_response() const;
+
+  // Written with INCLUDE_CARD_DATA
+  bool has_card_data() const;
+  FieldRef cvv() const;
+  FieldRef pin_block() const;
+  FieldRef track2() const;
+  FieldRef track1_data() const;
+
+  // Every field into 'tx', the PAN only with card data. The AID is not part
+  // of the record, no Diners message carries it.
+  void Load(DinersTransaction& tx) const;
+};
+
+// 'currency' is the ISO 4217 alpha code of the amounts. Empty if the record
+// would exceed 64 KB.
+std::vector<std::uint8_t> EncodeTransaction(const DinersTransaction& tx,
+                                            const std::string& currency,
+                                            CardDataPolicy policy = OMIT_CARD_DATA,
+                                            const std::string& pan_token = std::string());
+
+}
+
+#endif
@@ -24,6 +24,7 @@
 
 #include <stdx/optional>
 #include <iso8583/apdu.h>
+#include "field_mask.h"
 
 #include <types/pan.h>
 #include <types/amount.h>
@@ -79,6 +80,7 @@ class BatchUploadResponse {
 
  private:
   iso8583::Apdu apdu_;
+  FieldMask bitmap_;
 };
 
 iso8583::Apdu BuildBatchUploadRequest(DinersTransaction& tx, std::uint32_t batch_upload_stan);
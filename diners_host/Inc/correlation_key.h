@@ -0,0 +1,77 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__CORRELATION_KEY_H_
+#define DINERS__CORRELATION_KEY_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <stdx/optional>
+#include <diners/call_stats.h>
+#include "field_mask.h"
+
+namespace diners {
+
+// Fields tying a response to its request, kept as they are encoded on the
+// wire: MTI, processing code, STAN and NII as packed BCD, TID as its 8 ASCII
+// bytes. Fields absent from the message are 0 and not set in 'fields'.
+struct CorrelationKey {
+  std::uint16_t mti;
+  std::uint32_t processing_code;
+  std::uint32_t stan;
+  std::uint16_t nii;
+  std::uint64_t tid;
+  FieldMask fields;
+};
+
+// Scans an encoded message (TPDU already stripped) without decoding it.
+// Returns nullopt if the message is truncated or carries a field, before
+// DE 41, whose length is not known.
+stdx::optional<CorrelationKey> ReadCorrelationKey(const std::uint8_t* data,
+                                                  std::size_t size);
+stdx::optional<CorrelationKey> ReadCorrelationKey(
+    const std::vector<std::uint8_t>& data);
+
+// MTI of the response is the request MTI + 10 and every field present in
+// both messages is identical.
+bool IsResponseTo(const CorrelationKey& response,
+                  const CorrelationKey& request);
+
+// FAILURE_NONE if the response answers the request, otherwise why not:
+// FAILURE_MALFORMED if either message cannot be scanned, FAILURE_INVALID_MTI
+// or FAILURE_CORRELATION_MISMATCH.
+FailureCause MatchResponse(const std::uint8_t* request,
+                           std::size_t request_size,
+                           const std::uint8_t* response,
+                           std::size_t response_size);
+FailureCause MatchResponse(const std::vector<std::uint8_t>& request,
+                           const std::vector<std::uint8_t>& response);
+
+// Key of the request a response answers, for lookups among outstanding
+// requests.
+CorrelationKey RequestKeyOf(const CorrelationKey& response);
+
+bool operator==(const CorrelationKey& lhs, const CorrelationKey& rhs);
+bool operator!=(const CorrelationKey& lhs, const CorrelationKey& rhs);
+bool operator<(const CorrelationKey& lhs, const CorrelationKey& rhs);
+
+struct CorrelationKeyHash {
+  std::size_t operator()(const CorrelationKey& key) const;
+};
+
+}
+
+#endif
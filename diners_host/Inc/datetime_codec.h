@@ -0,0 +1,47 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__DATETIME_CODEC_H_
+#define DINERS__DATETIME_CODEC_H_
+
+#include <ctime>
+#include <cstdint>
+#include <iso8583/apdu.h>
+
+namespace diners {
+
+// DE 12 (hhmmss) and DE 13 (MMDD) as the integers carried on the wire
+struct IsoDateTime {
+  std::uint32_t time;
+  std::uint32_t date;
+};
+
+// Both fields from a single calendar breakdown. Timestamps of the current
+// day need no breakdown at all.
+IsoDateTime ToIsoDateTime(time_t timestamp);
+
+// Local time in the year that puts it closest to now, so dates read across
+// New Year fall in the right year. The current day is resolved without
+// mktime().
+time_t FromIsoDateTime(const IsoDateTime& iso_datetime);
+
+// DE 12 and DE 13 of the message, decoded without going through strings.
+// The caller checks both fields are present.
+time_t ReadIsoDateTime(const iso8583::Apdu& apdu);
+void WriteIsoDateTime(time_t timestamp, iso8583::Apdu& apdu);
+
+}
+
+#endif
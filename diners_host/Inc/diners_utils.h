@@ -16,6 +16,10 @@
 #ifndef DINERS__UTILS_MESSAGE_H_
 #define DINERS__UTILS_MESSAGE_H_
 
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
 #include <diners/diners_transaction.h>
 #include <types/pos_entry_mode.h>
 
@@ -26,5 +30,33 @@ std::string GetPosEntryMode(types::PosEntryMode & pos_entry_mode);
 std::string GetDinersConditionCode(types::PosConditionCode & pos_condition_code);
 types::Amount GetAmountRequired(DinersTransaction & tx);
 
+// ISO 4217 alpha code packed in an integer, first letter in the low byte
+std::uint32_t PackCurrency(const std::string& currency);
+std::string UnpackCurrency(std::uint32_t code);
+
+// ISO 4217 alpha code of 'amount', empty without one
+std::string CurrencyOf(const stdx::optional<types::Amount>& amount);
+
+// One BER-TLV of ICC data (DE 55)
+struct IccTlv {
+  std::size_t start;   // offset of the tag
+  std::uint32_t tag;
+  std::size_t value;   // offset of the value
+  std::size_t length;
+};
+
+// Reads the TLV at 'offset', padding skipped, and moves 'offset' past it.
+// False at the end of the data, or on a malformed TLV, 'offset' then being
+// where it starts.
+bool ReadIccTlv(const std::uint8_t* data, std::size_t size, std::size_t& offset,
+                IccTlv& tlv);
+
+// PAN and track data tags, which must not be kept
+bool IsIccCardTag(std::uint32_t tag);
+
+// 'icc_data' without the card tags, and without anything from a malformed
+// TLV on
+std::vector<std::uint8_t> StripIccCardTags(const std::vector<std::uint8_t>& icc_data);
+
 }
 #endif
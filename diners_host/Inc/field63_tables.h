@@ -0,0 +1,81 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__FIELD63_TABLES_H_
+#define DINERS__FIELD63_TABLES_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <stdx/optional>
+#include <iso8583/apdu.h>
+
+namespace diners {
+
+// DE 63 is a sequence of tables, each one laid out as
+//   length (2 bytes BCD, table id + data) | table id (2 chars) | data
+// the layout BuildCvvTable() and the other builders of table.h write and
+// ReadFieldFromTable() reads; Test/field63_test.cpp checks the two agree.
+
+const std::size_t kField63TableHeaderSize = 4;
+
+// Collects the tables of a request in one buffer and sets DE 63 once
+class Field63Builder {
+ public:
+  explicit Field63Builder(std::size_t capacity = 256);
+
+  // Table already carrying its length and id, e.g. from BuildCvvTable()
+  void AddTable(const std::vector<std::uint8_t>& full_table);
+  void AddTable(const char* table_id, const std::uint8_t* data,
+                std::size_t size);
+
+  bool IsEmpty() const;
+
+  // Sets DE 63 to the collected tables; leaves it untouched if there is
+  // none
+  void Commit(iso8583::Apdu& apdu) const;
+
+ private:
+  std::vector<std::uint8_t> buffer_;
+};
+
+// Table inside a DE 63 buffer, valid as long as that buffer is
+struct Field63Table {
+  const char* id;  // 2 chars, not null terminated
+  const std::uint8_t* data;
+  std::size_t size;
+};
+
+// Walks the tables of a DE 63 buffer without copying them
+class Field63TableIterator {
+ public:
+  Field63TableIterator(const std::uint8_t* data, std::size_t size);
+  explicit Field63TableIterator(const std::vector<std::uint8_t>& field63);
+
+  // False at the end of the field or on a malformed table
+  bool Next(Field63Table& table);
+
+ private:
+  const std::uint8_t* data_;
+  std::size_t size_;
+  std::size_t offset_;
+};
+
+stdx::optional<Field63Table> FindField63Table(
+    const std::vector<std::uint8_t>& field63, const char* table_id);
+
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__FIELD_MASK_H_
+#define DINERS__FIELD_MASK_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace diners {
+
+// Set of data elements 1..64 laid out as in the ISO 8583 primary bitmap:
+// DE 1 is the most significant bit, DE 64 the least significant one.
+typedef std::uint64_t FieldMask;
+
+constexpr FieldMask FieldBit(int field) {
+  return FieldMask(1) << (64 - field);
+}
+
+constexpr FieldMask MakeFieldMask() {
+  return 0;
+}
+
+template<typename... Fields>
+constexpr FieldMask MakeFieldMask(int field, Fields... fields) {
+  return FieldBit(field) | MakeFieldMask(fields...);
+}
+
+inline FieldMask MissingFields(FieldMask bitmap, FieldMask mandatory_fields) {
+  return mandatory_fields & ~bitmap;
+}
+
+// Primary bitmap of an encoded message (MTI followed by the bitmap, TPDU
+// already stripped). Returns 0 if the message is too short.
+FieldMask ReadPrimaryBitmap(const std::uint8_t* data, std::size_t size);
+FieldMask ReadPrimaryBitmap(const std::vector<std::uint8_t>& data);
+
+// Field numbers in the mask, e.g. "12,13".
+std::string FieldMaskToString(FieldMask mask);
+
+// True when every field of mandatory_fields is present in bitmap. Otherwise
+// logs the missing fields, prefixed with message_name.
+bool HasMandatoryFields(const char* message_name, FieldMask bitmap,
+                        FieldMask mandatory_fields);
+
+}
+
+#endif
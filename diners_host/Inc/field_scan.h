@@ -0,0 +1,85 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__FIELD_SCAN_H_
+#define DINERS__FIELD_SCAN_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <diners/call_stats.h>
+#include "field_mask.h"
+
+namespace diners {
+
+// Value of one field in an encoded message, length prefix excluded
+struct FieldSpan {
+  int field;
+  std::size_t offset;
+  std::size_t size;
+};
+
+// Walks the fields of an encoded message (TPDU already stripped) in order,
+// without decoding them. The field encodings are a copy of those of
+// GetProtocolSpec() (protocol.cpp), which the iso8583 library does not
+// expose; Test/field_scan_test.cpp checks that the two agree. Only the
+// primary bitmap is read; a message with a secondary bitmap stops at DE 65.
+class FieldScanner {
+ public:
+  FieldScanner(const std::uint8_t* data, std::size_t size);
+
+  // False at the end of the message, or when a field is truncated or of
+  // unknown encoding, in which case ErrorField() is that field.
+  bool Next(FieldSpan& span);
+
+  int ErrorField() const {
+    return error_field_;
+  }
+
+  // Where the next field, or the one in error, starts
+  std::size_t Offset() const {
+    return offset_;
+  }
+
+ private:
+  bool Fail(int field);
+
+  const std::uint8_t* data_;
+  std::size_t size_;
+  FieldMask bitmap_;
+  bool has_secondary_bitmap_;
+  std::size_t offset_;
+  int field_;
+  int error_field_;
+};
+
+// Response code (DE 39) of an encoded message, empty if it has none
+std::string ResponseCodeOf(const std::vector<std::uint8_t>& msg);
+
+// Why a response that answers its request was not accepted by the reader:
+// FAILURE_RESPONSE_CODE if the host declined, FAILURE_MISSING_FIELD if it
+// approved (or did not say) but a mandatory field is missing. Only the batch
+// upload, key download and key exchange readers reject a decline; the
+// authorization readers accept it and leave DE 39 in the transaction.
+FailureCause RejectionCause(const std::vector<std::uint8_t>& response);
+
+inline std::size_t BcdToInt(std::uint8_t bcd) {
+  return (bcd >> 4) * 10 + (bcd & 0x0F);
+}
+
+}
+
+#endif
@@ -26,6 +26,7 @@
 
 #include <stdx/optional>
 #include <iso8583/apdu.h>
+#include "field_mask.h"
 
 namespace diners {
 
@@ -64,6 +65,7 @@ class KeyDownloadResponse {
 
  private:
   iso8583::Apdu apdu_;
+  FieldMask bitmap_;
 };
 
 iso8583::Apdu BuildKeyDownloadRequest(DinersTransaction& tx);
@@ -0,0 +1,59 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__MANDATORY_FIELDS_H_
+#define DINERS__MANDATORY_FIELDS_H_
+
+#include "field_mask.h"
+#include "protocol.h"
+
+namespace diners {
+
+// Mandatory fields of host responses, by response MTI and processing code.
+
+// 0110 pre-auth, 0210 sale / refund / void / completion, 0330 TC and batch
+// upload, 0410 reversal, 0510 settlement (920000 and 960000)
+const FieldMask kFinancialResponseFields = MakeFieldMask(
+    kFieldProcessingCode, kFieldStan,
+    kFieldTimeLocalTransaction, kFieldDateLocalTransaction,
+    kFieldNii, kFieldRrn, kFieldResponseCode, kFieldCardAcceptorTerminalId);
+
+// 0230 offline sale and tip adjust advices
+const FieldMask kAdviceResponseFields = MakeFieldMask(
+    kFieldProcessingCode, kFieldStan,
+    kFieldNii, kFieldRrn, kFieldResponseCode, kFieldCardAcceptorTerminalId);
+
+// 0810 echo test, processing code 990000
+const FieldMask kEchoTestResponseFields = MakeFieldMask(
+    kFieldProcessingCode,
+    kFieldTimeLocalTransaction, kFieldDateLocalTransaction,
+    kFieldNii, kFieldCardAcceptorTerminalId);
+
+// 0810 TMK download, processing code 920000
+const FieldMask kKeyDownloadResponseFields = MakeFieldMask(
+    kFieldProcessingCode,
+    kFieldTimeLocalTransaction, kFieldDateLocalTransaction,
+    kFieldNii, kFieldResponseCode, kFieldCardAcceptorTerminalId, kField62);
+
+// 0810 key exchange, processing code 920000
+const FieldMask kKeyExchangeResponseFields = MakeFieldMask(
+    kFieldProcessingCode, kFieldStan,
+    kFieldTimeLocalTransaction, kFieldDateLocalTransaction,
+    kFieldNii, kFieldResponseCode, kFieldCardAcceptorTerminalId,
+    kField62, kField63);
+
+}
+
+#endif
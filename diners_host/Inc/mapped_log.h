@@ -0,0 +1,113 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS__MAPPED_LOG_H_
+#define DINERS__MAPPED_LOG_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace diners {
+
+// Append-only log of records in a memory-mapped file, for data that must
+// survive power loss. Each record carries a key and a one byte state that is
+// updated in place; records set to kRetired are dropped when the log is
+// compacted and never reported again. The payload of a retired record is
+// zeroed on disk, so what it held does not outlive it.
+//
+// A record is written with a checksum, so a record torn by a crash is
+// discarded when the file is reopened, with everything after it. Appends are
+// only guaranteed durable once Sync() returns; threads calling Sync()
+// together share one msync (group commit). The file uses the byte order of
+// the machine writing it.
+class MappedLog {
+ public:
+  static const std::uint8_t kRetired = 0xFF;
+
+  struct Record {
+    std::uint64_t sequence;
+    std::uint64_t key;
+    std::uint8_t state;
+    std::vector<std::uint8_t> payload;
+  };
+
+  // Opens the log at 'path', creating it with 'capacity' bytes if needed.
+  // Returns nullptr if the file cannot be used.
+  static std::unique_ptr<MappedLog> Open(const std::string& path,
+                                         std::size_t capacity);
+
+  ~MappedLog();
+
+  // Sequence of the new record, 0 if it does not fit, even after
+  // compaction. Sequences only grow, also across compactions.
+  std::uint64_t Append(std::uint64_t key, std::uint8_t state,
+                       const std::uint8_t* data, std::size_t size);
+
+  // Returns once the records up to 'sequence' are on disk
+  bool Sync(std::uint64_t sequence);
+
+  // Durable on return. Retiring zeroes the payload.
+  bool SetState(std::uint64_t sequence, std::uint8_t state);
+
+  bool Read(std::uint64_t sequence, Record& record) const;
+
+  // Up to 'max_count' records not retired, oldest first
+  std::vector<Record> LiveRecords(std::size_t max_count = std::size_t(-1)) const;
+
+  // Same, only those with 'key'
+  std::vector<Record> LiveRecords(std::uint64_t key,
+                                  std::size_t max_count) const;
+
+  std::size_t LiveCount() const;
+
+  // Sequence the next Append() gives, higher than any given before, also
+  // by a log reopened after a compaction
+  std::uint64_t NextSequence() const;
+
+ private:
+  MappedLog(const std::string& path, int fd, std::uint8_t* map,
+            std::size_t capacity);
+  MappedLog(const MappedLog&);
+  MappedLog& operator=(const MappedLog&);
+
+  bool Recover();
+  bool Compact(std::unique_lock<std::mutex>& lock);
+  bool SyncRange(std::size_t begin, std::size_t end) const;
+  void ReadAt(std::size_t offset, Record& record) const;
+
+  std::string path_;
+  int fd_;
+  std::uint8_t* map_;
+  std::size_t capacity_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable synced_;
+  std::map<std::uint64_t, std::size_t> index_;  // live record offsets
+  std::size_t tail_;
+  std::uint64_t next_sequence_;
+  std::size_t synced_offset_;
+  std::uint64_t synced_sequence_;
+  bool syncing_;
+};
+
+}
+
+#endif
@@ -24,6 +24,7 @@
 
 #include <stdx/optional>
 #include <iso8583/apdu.h>
+#include "field_mask.h"
 
 #include <types/pan.h>
 #include <types/amount.h>
@@ -80,6 +81,7 @@ class OfflineSaleResponse {
 
  private:
   iso8583::Apdu apdu_;
+  FieldMask bitmap_;
 };
 
 iso8583::Apdu BuildOfflineSaleRequest(DinersTransaction& tx);
@@ -24,6 +24,7 @@
 
 #include <stdx/optional>
 #include <iso8583/apdu.h>
+#include "field_mask.h"
 
 #include <types/pan.h>
 #include <types/amount.h>
@@ -82,6 +83,7 @@ class PreAuthResponse {
 
  private:
   iso8583::Apdu apdu_;
+  FieldMask bitmap_;
 };
 
 iso8583::Apdu BuildPreAuthRequest(DinersTransaction& tx);
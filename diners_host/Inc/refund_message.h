@@ -24,6 +24,7 @@
 
 #include <stdx/optional>
 #include <iso8583/apdu.h>
+#include "field_mask.h"
 
 #include <types/pan.h>
 #include <types/amount.h>
@@ -78,6 +79,7 @@ class RefundResponse {
 
  private:
   iso8583::Apdu apdu_;
+  FieldMask bitmap_;
 };
 
 iso8583::Apdu BuildRefundRequest(DinersTransaction& tx);
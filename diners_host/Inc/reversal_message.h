@@ -24,6 +24,7 @@
 
 #include <stdx/optional>
 #include <iso8583/apdu.h>
+#include "field_mask.h"
 
 #include <types/pan.h>
 #include <types/amount.h>
@@ -83,6 +84,7 @@ class ReversalResponse {
 
  private:
   iso8583::Apdu apdu_;
+  FieldMask bitmap_;
 };
 
 iso8583::Apdu BuildReversalRequest(DinersTransaction& tx);
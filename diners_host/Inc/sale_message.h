@@ -25,6 +25,7 @@
 
 #include <stdx/optional>
 #include <iso8583/apdu.h>
+#include "field_mask.h"
 #include <types/pan.h>
 #include <types/amount.h>
 #include <types/pos_entry_mode.h>
@@ -80,6 +81,7 @@ class SaleResponse {
 
  private:
   iso8583::Apdu apdu_;
+  FieldMask bitmap_;
 };
 
 iso8583::Apdu BuildSaleRequest(DinersTransaction& tx);
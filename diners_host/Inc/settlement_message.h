@@ -24,6 +24,7 @@
 
 #include <stdx/optional>
 #include <iso8583/apdu.h>
+#include "field_mask.h"
 
 #include <types/pan.h>
 #include <types/amount.h>
@@ -69,9 +70,11 @@ class SettlementResponse {
   std::string GetRrn() const;
   std::string GetResponseCode() const;
   std::string GetTid() const;
+  stdx::optional<BatchTotalsForDinersHost> GetBatchTotal() const;
 
  private:
   iso8583::Apdu apdu_;
+  FieldMask bitmap_;
 };
 
 iso8583::Apdu BuildSettlementRequest(diners::DinersSettlementData & settle_msg,bool after_batch_upload);
@@ -0,0 +1,276 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <diners/advice_queue.h>
+#include <algorithm>
+#include <utils/logger.h>
+#include <utils/converter.h>
+#include <diners/transaction_record.h>
+#include "mapped_log.h"
+
+namespace diners {
+
+namespace {
+const std::uint8_t kPending = 0;
+const std::uint8_t kHeld = 1;
+const std::chrono::milliseconds kIdleWait(1000);
+
+// Record payload: the advice type, then the transaction record
+const std::size_t kTypeSize = 1;
+
+std::vector<Advice> Unheld(std::vector<MappedLog::Record>& records,
+                           std::size_t max_count) {
+  std::vector<Advice> advices;
+  advices.reserve(std::min(max_count, records.size()));
+  for (auto& record : records) {
+    if (advices.size() == max_count)
+      break;
+    if (record.state == kHeld || record.payload.size() < kTypeSize)
+      continue;
+
+    advices.push_back(Advice());
+    advices.back().sequence = record.sequence;
+    advices.back().terminal = record.key;
+    advices.back().type = static_cast<AdviceType>(record.payload[0]);
+    advices.back().record.assign(record.payload.begin() + kTypeSize,
+                                 record.payload.end());
+  }
+  return advices;
+}
+}
+
+std::uint64_t TerminalKey(const std::string& tid) {
+  // DE 41 is ans 8, padded with spaces
+  const std::size_t kTidSize = 8;
+
+  std::uint64_t key = 0;
+  for (std::size_t i = 0; i < kTidSize; i++) {
+    key = (key << 8) | std::uint8_t(i < tid.size() ? tid[i] : ' ');
+  }
+  return key;
+}
+
+std::unique_ptr<AdviceQueue> AdviceQueue::Open(const std::string& path,
+                                               std::size_t capacity) {
+  std::unique_ptr<MappedLog> log = MappedLog::Open(path, capacity);
+  if (!log)
+    return nullptr;
+
+  for (const auto& record : log->LiveRecords()) {
+    if (record.state == kHeld && !log->SetState(record.sequence, kPending))
+      return nullptr;
+  }
+  return std::unique_ptr<AdviceQueue>(new AdviceQueue(std::move(log)));
+}
+
+AdviceQueue::AdviceQueue(std::unique_ptr<MappedLog> log)
+    : log_(std::move(log)),
+      woken_(false) {
+}
+
+AdviceQueue::~AdviceQueue() {
+}
+
+bool AdviceQueue::Enqueue(AdviceType type,
+                          const std::vector<std::uint8_t>& record) {
+  if (!Store(type, record, kPending))
+    return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  not_empty_.notify_all();
+  return true;
+}
+
+std::uint64_t AdviceQueue::Hold(AdviceType type,
+                                const std::vector<std::uint8_t>& record) {
+  std::uint64_t sequence = Store(type, record, kHeld);
+  if (!sequence)
+    return 0;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  held_.insert(sequence);
+  return sequence;
+}
+
+void AdviceQueue::Release(std::uint64_t sequence) {
+  // Left held if this fails: sent after the next restart
+  if (!log_->SetState(sequence, kPending))
+    logger::error("ADVICE - Cannot release advice");
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  held_.erase(sequence);
+  not_empty_.notify_all();
+}
+
+std::uint64_t AdviceQueue::Store(AdviceType type,
+                                 const std::vector<std::uint8_t>& record,
+                                 std::uint8_t state) {
+  TransactionView view(record.data(), record.size());
+  if (!view.valid()) {
+    logger::error("ADVICE - Not a transaction record");
+    return 0;
+  }
+
+  std::vector<std::uint8_t> payload;
+  payload.reserve(kTypeSize + record.size());
+  payload.push_back(type);
+  payload.insert(payload.end(), record.begin(), record.end());
+  std::uint64_t sequence = log_->Append(TerminalKey(view.tid().str()), state,
+                                        payload.data(), payload.size());
+  if (!sequence) {
+    logger::error("ADVICE - Queue full");
+    return 0;
+  }
+  if (!log_->Sync(sequence)) {
+    // The caller is told it failed, so it must not be sent
+    logger::error("ADVICE - Cannot write queue");
+    log_->SetState(sequence, MappedLog::kRetired);
+    return 0;
+  }
+  return sequence;
+}
+
+std::vector<Advice> AdviceQueue::Peek(std::size_t max_count) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<MappedLog::Record> records =
+      log_->LiveRecords(max_count + held_.size());
+  return Unheld(records, max_count);
+}
+
+std::vector<Advice> AdviceQueue::Peek(std::uint64_t terminal,
+                                      std::size_t max_count) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<MappedLog::Record> records =
+      log_->LiveRecords(terminal, max_count + held_.size());
+  return Unheld(records, max_count);
+}
+
+bool AdviceQueue::Remove(std::uint64_t sequence) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_.erase(sequence);
+  }
+  return log_->SetState(sequence, MappedLog::kRetired);
+}
+
+std::size_t AdviceQueue::Size() const {
+  return log_->LiveCount();
+}
+
+bool AdviceQueue::WaitNotEmpty(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  not_empty_.wait_for(lock, timeout, [this] {
+    return woken_ || HasDue();
+  });
+  bool woken = woken_;
+  woken_ = false;
+  return !woken && HasDue();
+}
+
+// Called with mutex_ held
+bool AdviceQueue::HasDue() const {
+  return log_->LiveCount() > held_.size();
+}
+
+void AdviceQueue::Wake() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  woken_ = true;
+  not_empty_.notify_all();
+}
+
+AdviceDrainer::AdviceDrainer(AdviceQueue& queue, AdviceChannel& channel,
+                             const AdviceDrainerConfig& config)
+    : queue_(queue),
+      channel_(channel),
+      config_(config),
+      running_(false) {
+}
+
+AdviceDrainer::~AdviceDrainer() {
+  Stop();
+}
+
+void AdviceDrainer::Start() {
+  if (running_.exchange(true))
+    return;
+  thread_ = std::thread(&AdviceDrainer::Run, this);
+}
+
+void AdviceDrainer::Stop() {
+  if (!running_.exchange(false))
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_.notify_all();
+  }
+  queue_.Wake();
+  thread_.join();
+}
+
+bool AdviceDrainer::DrainOnce() {
+  std::lock_guard<std::mutex> delivery(queue_.delivery_mutex());
+  std::vector<Advice> batch = queue_.Peek(config_.batch_size);
+  if (batch.empty())
+    return true;
+
+  if (!channel_.Connect())
+    return false;
+
+  // Terminals with an advice left to retry in this batch
+  std::set<std::uint64_t> held;
+  for (const auto& advice : batch) {
+    if (held.count(advice.terminal))
+      continue;
+
+    switch (channel_.Deliver(advice)) {
+      case ADVICE_REJECTED:
+        logger::error(("ADVICE - Rejected by host, dropped: "
+            + utils::ToString(advice.sequence)).c_str());
+        queue_.Remove(advice.sequence);
+        break;
+
+      case ADVICE_DELIVERED:
+        queue_.Remove(advice.sequence);
+        break;
+
+      default:
+        held.insert(advice.terminal);
+        break;
+    }
+  }
+
+  channel_.Disconnect();
+  return held.empty();
+}
+
+void AdviceDrainer::Run() {
+  std::chrono::milliseconds delay = config_.retry_delay;
+  while (running_) {
+    if (!queue_.WaitNotEmpty(kIdleWait))
+      continue;
+
+    if (DrainOnce()) {
+      delay = config_.retry_delay;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopped_.wait_for(lock, delay, [this] { return !running_; });
+    delay = std::min(delay * 2, config_.max_retry_delay);
+  }
+}
+
+}
@@ -19,17 +19,26 @@
 #include <utils/logger.h>
 #include <utils/converter.h>
 #include "protocol.h"
+#include "datetime_codec.h"
 #include <diners/transaction.h>
 #include "field_utils.h"
 #include "table.h"
 #include "table_cvv.h"
 #include "table_instalment.h"
 #include "table_preauth.h"
+#include "field63_tables.h"
 #include <tpcore/calendar.h>
 #include <diners/terminal_configuration.h>
 
 using namespace types;
 
+// apdu_utils.h is not part of this tree. Against its last released version
+// it has to declare SetCvv2Data(), SetPreAuthData() and SetInstalmentData()
+// with a Field63Builder& (field63_tables.h) instead of the iso8583::Apdu&,
+// and drop AddTableDataToField63() and CheckMandatoryFields(). The FDMS
+// request builders call Set*Data() on a Field63Builder and Commit() it to
+// the request once.
+
 namespace diners {
 
 // PRIVATE MEMBERS
@@ -76,10 +85,7 @@ void SetStan(const uint32_t& stan, iso8583::Apdu& apdu) {
 }
 
 void SetOriginalHostDatetime(const time_t& timestamp, iso8583::Apdu& apdu) {
-  apdu.SetField(kFieldTimeLocalTransaction,
-                iso8583::IsoTimeFromTimestamp(timestamp));
-  apdu.SetField(kFieldDateLocalTransaction,
-                iso8583::IsoDateFromTimestamp(timestamp));
+  WriteIsoDateTime(timestamp, apdu);
 }
 
 void SetNii(const uint32_t& nii, iso8583::Apdu& apdu) {
@@ -170,12 +176,11 @@ void SetInvoiceNumber(const uint32_t& invoice, iso8583::Apdu& apdu) {
   apdu.SetField(kField62, value);
 }
 
-void SetCvv2Data(const std::string& cvv, iso8583::Apdu& apdu) {
-  auto cvv_table_data = BuildCvvTable(cvv);
-  AddTableDataToField63(cvv_table_data, apdu);
+void SetCvv2Data(const std::string& cvv, Field63Builder& field63) {
+  field63.AddTable(BuildCvvTable(cvv));
 }
 
-void SetPreAuthData(const Transaction& tx, iso8583::Apdu& apdu) {
+void SetPreAuthData(const Transaction& tx, Field63Builder& field63) {
   auto invoice_str = utils::ToString(tx.original_invoice_number);
   auto invoice_str_padded = iso8583::RightAligned(invoice_str, 6, '0');
 
@@ -184,13 +189,11 @@ void SetPreAuthData(const Transaction& tx, iso8583::Apdu& apdu) {
 
   auto auth_code_padded = iso8583::LeftAligned(tx.auth_id_response_original, 6, ' ');
 
-  auto preauth_table_data = BuildPreAuthTable(invoice_str_padded, last_four_digits, auth_code_padded);
-  AddTableDataToField63(preauth_table_data, apdu);
+  field63.AddTable(BuildPreAuthTable(invoice_str_padded, last_four_digits, auth_code_padded));
 }
 
-void SetInstalmentData(const Transaction& tx, iso8583::Apdu& apdu) {
-  auto instalment_table_data = BuildInstalmentTable(tx);
-  AddTableDataToField63(instalment_table_data, apdu);
+void SetInstalmentData(const Transaction& tx, Field63Builder& field63) {
+  field63.AddTable(BuildInstalmentTable(tx));
 }
 
 
@@ -207,14 +210,8 @@ uint32_t GetStan(const iso8583::Apdu& apdu) {
 }
 
 stdx::optional<time_t> GetHostDatetime(const iso8583::Apdu& apdu) {
-  if (apdu.HasField(kFieldTimeLocalTransaction)
-      && apdu.HasField(kFieldDateLocalTransaction)) {
-    std::string date = apdu.GetFieldAsString(kFieldDateLocalTransaction);
-    date = iso8583::RightAligned(date, 4, '0');
-    std::string time = apdu.GetFieldAsString(kFieldTimeLocalTransaction);
-    time = iso8583::RightAligned(time, 6, '0');
-    return utils::GetDatetimefromIso8583Format(date, time);
-  }
+  if (HasDateTime(apdu))
+    return ReadIsoDateTime(apdu);
 
   return stdx::nullopt;
 }
@@ -275,32 +272,12 @@ bool ValidateBasicFields(const iso8583::Apdu& request_apdu,
   return true;
 }
 
-bool CheckMandatoryFields(const iso8583::Apdu& apdu,
-                          const std::vector<int>& fields) {
-  for (auto field_num : fields) {
-    if (!apdu.HasField(field_num))
-      return false;
-  }
-
-  return true;
-}
-
 void UpdateSystemDateTime(const iso8583::Apdu& response_apdu) {
   if (GetResponseCode(response_apdu) == "00" && HasDateTime(response_apdu)) {
     tpcore::SetSystemDatetime(*GetHostDatetime(response_apdu));
   }
 }
 
-void AddTableDataToField63(
-                           const std::vector<uint8_t>& full_table,
-                           iso8583::Apdu& apdu) {
-  auto field_content = apdu.GetFieldAsBytes(kField63);
-
-  field_content.insert(field_content.end(), full_table.begin(), full_table.end());
-
-  apdu.SetField(kField63, field_content);
-}
-
 void UpdateTransactionInfoFromHostResponse(const iso8583::Apdu& response_apdu,
                                            Transaction& tx) {
 
@@ -0,0 +1,99 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <diners/batch_reconciler.h>
+
+namespace diners {
+
+const char kReconcileErrorResponseCode[] = "95";
+
+namespace {
+bool TotalsAgree(const BatchTotal& local, const BatchTotal& host) {
+  return local.count == host.count && local.total == host.total;
+}
+}
+
+BatchReconciler::BatchReconciler(const BatchStore& batch)
+    : batch_(batch),
+      suspects_(batch.Size()),
+      uploaded_(batch.Size()) {
+}
+
+bool BatchReconciler::MarkSuspectStan(unsigned int stan) {
+  return MarkSuspect(batch_.FindStan(stan));
+}
+
+bool BatchReconciler::MarkSuspectInvoice(unsigned int invoice_number) {
+  return MarkSuspect(batch_.FindInvoice(invoice_number));
+}
+
+bool BatchReconciler::MarkSuspectRrn(const std::string& rrn) {
+  return MarkSuspect(batch_.FindRrn(rrn));
+}
+
+bool BatchReconciler::MarkSuspect(const stdx::optional<std::size_t>& index) {
+  if (!index)
+    return false;
+  suspects_[*index] = true;
+  return true;
+}
+
+bool BatchReconciler::IsSuspect(std::size_t index) const {
+  if (suspects_[index])
+    return true;
+
+  std::uint8_t flags = batch_.flags()[index];
+  return batch_.types()[index] == OFFLINE_SALE
+      || batch_.statuses()[index] == TO_ADVISE
+      || (flags & BatchStore::IS_ADJUSTED);
+}
+
+std::vector<std::size_t> BatchReconciler::UploadSet(
+    ReconcileStage stage,
+    const stdx::optional<BatchTotalsForDinersHost>& host_totals) const {
+  bool sales_agree = false;
+  bool refunds_agree = false;
+  if (host_totals && stage != RECONCILE_ALL) {
+    BatchTotalsForDinersHost local_totals = batch_.ComputeTotals();
+    sales_agree = TotalsAgree(local_totals.sales_total, host_totals->sales_total);
+    refunds_agree = TotalsAgree(local_totals.refunds_total,
+                                host_totals->refunds_total);
+  }
+
+  std::vector<std::size_t> indexes;
+  for (std::size_t i = 0; i < batch_.Size(); i++) {
+    if (uploaded_[i])
+      continue;
+
+    if (stage != RECONCILE_ALL) {
+      BatchStore::Category category = BatchStore::CategoryOf(
+          batch_.types()[i], batch_.statuses()[i]);
+      if (category == BatchStore::NOT_SETTLED
+          || (category == BatchStore::SETTLED_SALE && sales_agree)
+          || (category == BatchStore::SETTLED_REFUND && refunds_agree))
+        continue;
+      if (stage == RECONCILE_SUSPECTS && !IsSuspect(i))
+        continue;
+    }
+    indexes.push_back(i);
+  }
+  return indexes;
+}
+
+void BatchReconciler::MarkUploaded(std::size_t index) {
+  uploaded_[index] = true;
+}
+
+}
@@ -0,0 +1,591 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <diners/batch_store.h>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/logger.h>
+#include <diners/transaction_record.h>
+#include "diners_utils.h"
+
+namespace diners {
+
+namespace {
+const char kMagic[4] = { 'D', 'B', 'A', 'T' };
+const std::uint16_t kVersion = 4;
+
+struct FileHeader {
+  char magic[4];
+  std::uint16_t version;
+  std::uint16_t reserved;
+  std::uint32_t capacity;
+  std::uint32_t side_size;
+  std::uint32_t size;  // committed records
+  std::uint32_t side_used;
+  std::uint32_t nii;
+  std::uint32_t batch_number;
+  char tid[16];
+  char mid[24];
+  char tpdu[16];
+  char currency[4];
+};
+
+const std::size_t kFileHeaderSize = 256;
+
+std::size_t Align(std::size_t size) {
+  return (size + 7) & ~std::size_t(7);
+}
+
+void CopyString(char* out, std::size_t out_size, const std::string& value) {
+  std::memset(out, 0, out_size);
+  std::memcpy(out, value.data(), std::min(value.size(), out_size - 1));
+}
+
+std::string ReadString(const char* value, std::size_t size) {
+  return std::string(value, strnlen(value, size));
+}
+
+// Last four digits of a PAN as a number, nullopt if they are not digits
+stdx::optional<std::uint16_t> Last4(const std::string& pan) {
+  if (pan.size() < 4
+      || pan.find_first_not_of("0123456789", pan.size() - 4) != std::string::npos)
+    return stdx::nullopt;
+  std::uint16_t last4 = 0;
+  for (std::size_t i = pan.size() - 4; i < pan.size(); i++)
+    last4 = last4 * 10 + (pan[i] - '0');
+  return last4;
+}
+
+template<typename Key>
+stdx::optional<std::size_t> FindFirst(
+    const std::unordered_map<Key, std::size_t>& index, const Key& key) {
+  typename std::unordered_map<Key, std::size_t>::const_iterator it =
+      index.find(key);
+  if (it == index.end())
+    return stdx::nullopt;
+  return it->second;
+}
+
+template<typename Key>
+std::vector<std::size_t> FindAll(
+    const std::unordered_multimap<Key, std::size_t>& index, const Key& key) {
+  std::vector<std::size_t> indexes;
+  typedef typename std::unordered_multimap<Key, std::size_t>::const_iterator Iterator;
+  std::pair<Iterator, Iterator> range = index.equal_range(key);
+  for (Iterator it = range.first; it != range.second; ++it)
+    indexes.push_back(it->second);
+  std::sort(indexes.begin(), indexes.end());
+  return indexes;
+}
+
+bool SyncRange(std::uint8_t* map, std::size_t begin, std::size_t end) {
+  static const std::size_t kPageSize = sysconf(_SC_PAGESIZE);
+  std::size_t page_begin = begin & ~(kPageSize - 1);
+  return msync(map + page_begin, end - page_begin, MS_SYNC) == 0;
+}
+}
+
+// Offset of each column in the file, from the capacity
+struct BatchStore::Layout {
+  explicit Layout(std::size_t capacity) {
+    std::size_t offset = kFileHeaderSize;
+    amounts = Next(offset, capacity * 8);
+    additional_amounts = Next(offset, capacity * 8);
+    preauth_amounts = Next(offset, capacity * 8);
+    datetimes = Next(offset, capacity * 8);
+    stans = Next(offset, capacity * 4);
+    invoice_numbers = Next(offset, capacity * 4);
+    currencies = Next(offset, capacity * 4);
+    side_offsets = Next(offset, capacity * 4);
+    side_sizes = Next(offset, capacity * 4);
+    pan_sequence_numbers = Next(offset, capacity * 2);
+    types = Next(offset, capacity);
+    statuses = Next(offset, capacity);
+    pos_entry_modes = Next(offset, capacity);
+    pos_condition_codes = Next(offset, capacity);
+    flags = Next(offset, capacity);
+    side = offset;
+  }
+
+  static std::size_t Next(std::size_t& offset, std::size_t size) {
+    std::size_t column = offset;
+    offset = Align(offset + size);
+    return column;
+  }
+
+  std::size_t amounts;
+  std::size_t additional_amounts;
+  std::size_t preauth_amounts;
+  std::size_t datetimes;
+  std::size_t stans;
+  std::size_t invoice_numbers;
+  std::size_t currencies;
+  std::size_t side_offsets;
+  std::size_t side_sizes;
+  std::size_t pan_sequence_numbers;
+  std::size_t types;
+  std::size_t statuses;
+  std::size_t pos_entry_modes;
+  std::size_t pos_condition_codes;
+  std::size_t flags;
+  std::size_t side;
+};
+
+struct BatchStore::Index {
+  std::unordered_map<std::uint32_t, std::size_t> invoices;
+  std::unordered_map<std::uint32_t, std::size_t> stans;
+  std::unordered_map<std::string, std::size_t> rrns;
+  std::unordered_multimap<std::string, std::size_t> auth_codes;
+  std::unordered_multimap<std::uint16_t, std::size_t> pan_last4;
+};
+
+std::unique_ptr<BatchStore> BatchStore::Create(const std::string& path,
+                                               const BatchInfo& info,
+                                               std::size_t capacity,
+                                               std::size_t side_size) {
+  std::size_t map_size = Layout(capacity).side + side_size;
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0 || ftruncate(fd, map_size) != 0) {
+    logger::error(("BATCH - Cannot create " + path).c_str());
+    if (fd >= 0)
+      close(fd);
+    return nullptr;
+  }
+
+  FileHeader header = FileHeader();
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.capacity = capacity;
+  header.side_size = side_size;
+  header.nii = info.nii;
+  header.batch_number = info.batch_number;
+  CopyString(header.tid, sizeof(header.tid), info.tid);
+  CopyString(header.mid, sizeof(header.mid), info.mid);
+  CopyString(header.tpdu, sizeof(header.tpdu), info.tpdu);
+  CopyString(header.currency, sizeof(header.currency), info.currency);
+  if (pwrite(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))
+      || fsync(fd) != 0) {
+    logger::error(("BATCH - Cannot create " + path).c_str());
+    close(fd);
+    return nullptr;
+  }
+  close(fd);
+
+  return Open(path);
+}
+
+std::unique_ptr<BatchStore> BatchStore::Open(const std::string& path) {
+  int fd = open(path.c_str(), O_RDWR);
+  struct stat file_stat;
+  FileHeader header;
+  if (fd < 0 || fstat(fd, &file_stat) != 0
+      || pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))
+      || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0
+      || header.version != kVersion
+      || std::size_t(file_stat.st_size)
+          != Layout(header.capacity).side + header.side_size) {
+    logger::error(("BATCH - Not a batch file: " + path).c_str());
+    if (fd >= 0)
+      close(fd);
+    return nullptr;
+  }
+
+  void* map = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+  if (map == MAP_FAILED) {
+    logger::error(("BATCH - Cannot map " + path).c_str());
+    close(fd);
+    return nullptr;
+  }
+
+  std::unique_ptr<BatchStore> store(
+      new BatchStore(path, fd, static_cast<std::uint8_t*>(map),
+                     file_stat.st_size, header.capacity, header.side_size));
+  if (!store->ReadHeader()) {
+    logger::error(("BATCH - Corrupt batch file: " + path).c_str());
+    return nullptr;
+  }
+  return store;
+}
+
+BatchStore::BatchStore(const std::string& path, int fd, std::uint8_t* map,
+                       std::size_t map_size, std::size_t capacity,
+                       std::size_t side_size)
+    : path_(path),
+      fd_(fd),
+      map_(map),
+      map_size_(map_size),
+      capacity_(capacity),
+      side_size_(side_size),
+      layout_(new Layout(capacity)),
+      index_(new Index()),
+      size_(0),
+      side_used_(0),
+      pan_vault_(NULL) {
+}
+
+BatchStore::~BatchStore() {
+  munmap(map_, map_size_);
+  close(fd_);
+}
+
+bool BatchStore::ReadHeader() {
+  const FileHeader* header = reinterpret_cast<const FileHeader*>(map_);
+  if (header->size > capacity_ || header->side_used > side_size_)
+    return false;
+
+  size_ = header->size;
+  side_used_ = header->side_used;
+  info_.tid = ReadString(header->tid, sizeof(header->tid));
+  info_.mid = ReadString(header->mid, sizeof(header->mid));
+  info_.tpdu = ReadString(header->tpdu, sizeof(header->tpdu));
+  info_.currency = ReadString(header->currency, sizeof(header->currency));
+  info_.nii = header->nii;
+  info_.batch_number = header->batch_number;
+
+  // A record must lie in the committed part of the side area before
+  // anything reads it
+  const std::uint32_t* side_offset = Column<std::uint32_t>(layout_->side_offsets);
+  const std::uint32_t* side_size = Column<std::uint32_t>(layout_->side_sizes);
+  for (std::size_t i = 0; i < size_; i++) {
+    if (side_offset[i] > side_used_ || side_size[i] > side_used_ - side_offset[i]
+        || !View(i).valid())
+      return false;
+  }
+
+  index_->invoices.reserve(size_);
+  index_->stans.reserve(size_);
+  index_->rrns.reserve(size_);
+  for (std::size_t i = 0; i < size_; i++)
+    AddToIndex(i);
+  return true;
+}
+
+// The first record of a key stays in the unique indexes
+void BatchStore::AddToIndex(std::size_t index) {
+  index_->invoices.insert(std::make_pair(invoice_numbers()[index], index));
+  index_->stans.insert(std::make_pair(stans()[index], index));
+
+  TransactionView record = View(index);
+  if (!record.rrn().empty())
+    index_->rrns.insert(std::make_pair(record.rrn().str(), index));
+  if (!record.auth_id_response().empty())
+    index_->auth_codes.insert(std::make_pair(record.auth_id_response().str(), index));
+  stdx::optional<std::uint16_t> last4 = Last4(record.pan().str());
+  if (last4)
+    index_->pan_last4.insert(std::make_pair(*last4, index));
+}
+
+stdx::optional<std::size_t> BatchStore::Append(const DinersTransaction& tx) {
+  return Append(tx, info_.currency);
+}
+
+stdx::optional<std::size_t> BatchStore::Append(const DinersTransaction& tx,
+                                               const std::string& currency) {
+  std::string pan_token;
+  if (tx.pan && pan_vault_) {
+    pan_token = pan_vault_->Protect(tx.pan->ToString());
+    if (pan_token.empty()) {
+      logger::error("BATCH - PAN vault refused the card");
+      return stdx::nullopt;
+    }
+  }
+
+  std::vector<std::uint8_t> side = EncodeTransaction(tx, currency, OMIT_CARD_DATA,
+                                                     pan_token);
+  if (side.empty()) {
+    logger::error("BATCH - Transaction too large");
+    return stdx::nullopt;
+  }
+
+  if (size_ == capacity_ || side.size() > side_size_ - side_used_) {
+    logger::error("BATCH - Batch full");
+    return stdx::nullopt;
+  }
+
+  std::size_t index = size_;
+  std::uint8_t flags = 0;
+  if (tx.amount)
+    flags |= HAS_AMOUNT;
+  if (tx.additional_amount)
+    flags |= HAS_ADDITIONAL_AMOUNT;
+  if (tx.preauth_amount)
+    flags |= HAS_PREAUTH_AMOUNT;
+  if (tx.pan_sequence_number)
+    flags |= HAS_PAN_SEQUENCE_NUMBER;
+  if (tx.is_adjusted)
+    flags |= IS_ADJUSTED;
+  if (tx.is_preauth_completed)
+    flags |= IS_PREAUTH_COMPLETED;
+
+  Column<std::uint64_t>(layout_->amounts)[index] = tx.amount ? tx.amount->GetValue() : 0;
+  Column<std::uint64_t>(layout_->additional_amounts)[index] =
+      tx.additional_amount ? tx.additional_amount->GetValue() : 0;
+  Column<std::uint64_t>(layout_->preauth_amounts)[index] =
+      tx.preauth_amount ? tx.preauth_amount->GetValue() : 0;
+  Column<std::int64_t>(layout_->datetimes)[index] = tx.tx_datetime;
+  Column<std::uint32_t>(layout_->stans)[index] = tx.stan;
+  Column<std::uint32_t>(layout_->invoice_numbers)[index] = tx.invoice_number;
+  Column<std::uint32_t>(layout_->currencies)[index] = PackCurrency(currency);
+  Column<std::uint32_t>(layout_->side_offsets)[index] = side_used_;
+  Column<std::uint32_t>(layout_->side_sizes)[index] = side.size();
+  Column<std::uint16_t>(layout_->pan_sequence_numbers)[index] =
+      tx.pan_sequence_number ? *tx.pan_sequence_number : 0;
+  Column<std::uint8_t>(layout_->types)[index] = tx.transaction_type;
+  Column<std::uint8_t>(layout_->statuses)[index] = tx.transaction_status;
+  Column<std::uint8_t>(layout_->pos_entry_modes)[index] =
+      static_cast<std::uint8_t>(tx.pos_entry_mode);
+  Column<std::uint8_t>(layout_->pos_condition_codes)[index] =
+      static_cast<std::uint8_t>(tx.pos_condition_code);
+  Column<std::uint8_t>(layout_->flags)[index] = flags;
+  std::memcpy(map_ + layout_->side + side_used_, side.data(), side.size());
+
+  // The columns and the side area, then the count that makes them part of
+  // the batch
+  if (!SyncRange(map_, layout_->amounts, layout_->side + side_used_ + side.size())
+      || !Commit(size_ + 1, side_used_ + side.size())) {
+    logger::error("BATCH - Cannot write batch");
+    return stdx::nullopt;
+  }
+  AddToIndex(index);
+  return index;
+}
+
+bool BatchStore::Commit(std::size_t size, std::size_t side_used) {
+  FileHeader* header = reinterpret_cast<FileHeader*>(map_);
+  header->size = size;
+  header->side_used = side_used;
+  if (!SyncRange(map_, 0, kFileHeaderSize))
+    return false;
+
+  size_ = size;
+  side_used_ = side_used;
+  return true;
+}
+
+void BatchStore::Load(std::size_t index, DinersTransaction& tx) const {
+  TransactionView record = View(index);
+  record.Load(tx);
+  if (pan_vault_ && !record.pan_token().empty()) {
+    std::string pan = pan_vault_->Reveal(record.pan_token().str());
+    if (!pan.empty())
+      tx.pan = types::Pan(pan);
+  }
+
+  // What SetStatus() and SetAdditionalAmount() may have changed since
+  std::uint8_t flags = Column<std::uint8_t>(layout_->flags)[index];
+  std::string currency = UnpackCurrency(currencies()[index]);
+
+  tx.amount = stdx::nullopt;
+  if (flags & HAS_AMOUNT)
+    tx.amount = types::Amount(currency, Column<std::uint64_t>(layout_->amounts)[index]);
+  tx.additional_amount = stdx::nullopt;
+  if (flags & HAS_ADDITIONAL_AMOUNT)
+    tx.additional_amount = types::Amount(
+        currency, Column<std::uint64_t>(layout_->additional_amounts)[index]);
+  tx.preauth_amount = stdx::nullopt;
+  if (flags & HAS_PREAUTH_AMOUNT)
+    tx.preauth_amount = types::Amount(
+        currency, Column<std::uint64_t>(layout_->preauth_amounts)[index]);
+  tx.pan_sequence_number = stdx::nullopt;
+  if (flags & HAS_PAN_SEQUENCE_NUMBER)
+    tx.pan_sequence_number = Column<std::uint16_t>(layout_->pan_sequence_numbers)[index];
+  tx.is_adjusted = flags & IS_ADJUSTED;
+  tx.is_preauth_completed = flags & IS_PREAUTH_COMPLETED;
+
+  tx.tx_datetime = Column<std::int64_t>(layout_->datetimes)[index];
+  tx.stan = Column<std::uint32_t>(layout_->stans)[index];
+  tx.invoice_number = Column<std::uint32_t>(layout_->invoice_numbers)[index];
+  tx.transaction_type = static_cast<DinersTransactionType>(
+      Column<std::uint8_t>(layout_->types)[index]);
+  tx.transaction_status = static_cast<DinersTransactionStatus>(
+      Column<std::uint8_t>(layout_->statuses)[index]);
+  tx.pos_entry_mode = static_cast<types::PosEntryMode>(
+      Column<std::uint8_t>(layout_->pos_entry_modes)[index]);
+  tx.pos_condition_code = static_cast<types::PosConditionCode>(
+      Column<std::uint8_t>(layout_->pos_condition_codes)[index]);
+
+  tx.tid = info_.tid;
+  tx.mid = info_.mid;
+  tx.tpdu = info_.tpdu;
+  tx.nii = info_.nii;
+  tx.batch_number = info_.batch_number;
+}
+
+TransactionView BatchStore::View(std::size_t index) const {
+  return TransactionView(
+      map_ + layout_->side + Column<std::uint32_t>(layout_->side_offsets)[index],
+      Column<std::uint32_t>(layout_->side_sizes)[index]);
+}
+
+bool BatchStore::SetStatus(std::size_t index, DinersTransactionStatus status) {
+  if (index >= size_)
+    return false;
+
+  Column<std::uint8_t>(layout_->statuses)[index] = status;
+  return SyncColumns();
+}
+
+bool BatchStore::SetAdditionalAmount(std::size_t index, std::uint64_t amount) {
+  if (index >= size_)
+    return false;
+
+  Column<std::uint64_t>(layout_->additional_amounts)[index] = amount;
+  Column<std::uint8_t>(layout_->flags)[index] |= HAS_ADDITIONAL_AMOUNT | IS_ADJUSTED;
+  return SyncColumns();
+}
+
+// The columns only; the side area of a record never changes
+bool BatchStore::SyncColumns() {
+  return SyncRange(map_, layout_->amounts, layout_->side);
+}
+
+stdx::optional<std::size_t> BatchStore::FindInvoice(
+    unsigned int invoice_number) const {
+  return FindFirst(index_->invoices, std::uint32_t(invoice_number));
+}
+
+stdx::optional<std::size_t> BatchStore::FindStan(unsigned int stan) const {
+  return FindFirst(index_->stans, std::uint32_t(stan));
+}
+
+stdx::optional<std::size_t> BatchStore::FindRrn(const std::string& rrn) const {
+  return FindFirst(index_->rrns, rrn);
+}
+
+std::vector<std::size_t> BatchStore::FindAuthCode(
+    const std::string& auth_id_response) const {
+  return FindAll(index_->auth_codes, auth_id_response);
+}
+
+std::vector<std::size_t> BatchStore::FindPanLast4(const std::string& last4) const {
+  stdx::optional<std::uint16_t> key = Last4(last4);
+  if (!key || last4.size() != 4)
+    return std::vector<std::size_t>();
+  return FindAll(index_->pan_last4, *key);
+}
+
+BatchTotalsForDinersHost BatchStore::ComputeTotals() const {
+  CurrencyTotals currency_totals = TotalsOf(PackCurrency(info_.currency));
+  BatchTotalsForDinersHost totals;
+  totals.sales_total = currency_totals.sales_total;
+  totals.refunds_total = currency_totals.refunds_total;
+  return totals;
+}
+
+std::vector<CurrencyTotals> BatchStore::ComputeCurrencyTotals() const {
+  std::vector<std::uint32_t> codes(1, PackCurrency(info_.currency));
+  const std::uint32_t* currency = currencies();
+  for (std::size_t i = 0; i < size_; i++) {
+    if (currency[i] != codes.back()
+        && std::find(codes.begin(), codes.end(), currency[i]) == codes.end())
+      codes.push_back(currency[i]);
+  }
+
+  std::vector<CurrencyTotals> totals;
+  for (std::size_t i = 0; i < codes.size(); i++)
+    totals.push_back(TotalsOf(codes[i]));
+  return totals;
+}
+
+// One pass over the columns without branches: a record outside the
+// currency or not settled adds zero
+CurrencyTotals BatchStore::TotalsOf(std::uint32_t code) const {
+  std::uint64_t counts[kDinersTransactionTypeCount] = {};
+  std::uint64_t sums[kDinersTransactionTypeCount] = {};
+  const std::uint64_t* amount = amounts();
+  const std::uint64_t* additional = additional_amounts();
+  const std::uint32_t* currency = currencies();
+  const std::uint8_t* type = types();
+  const std::uint8_t* status = statuses();
+  for (std::size_t i = 0; i < size_; i++) {
+    std::uint64_t settled = (currency[i] == code)
+        & (status[i] == APPROVED || status[i] == TO_ADVISE)
+        & (type[i] < kDinersTransactionTypeCount);
+    std::size_t slot = type[i] * settled;
+    counts[slot] += settled;
+    sums[slot] += (amount[i] + additional[i]) & (0 - settled);
+  }
+
+  CurrencyTotals totals;
+  totals.currency = UnpackCurrency(code);
+  for (std::size_t i = 0; i < kDinersTransactionTypeCount; i++) {
+    totals.type_totals[i] = BatchTotal(counts[i], sums[i]);
+    Category category = CategoryOf(i, APPROVED);
+    if (category == SETTLED_SALE)
+      totals.sales_total += totals.type_totals[i];
+    else if (category == SETTLED_REFUND)
+      totals.refunds_total += totals.type_totals[i];
+  }
+  return totals;
+}
+
+BatchStore::Category BatchStore::CategoryOf(std::uint8_t type,
+                                            std::uint8_t status) {
+  if (status != APPROVED && status != TO_ADVISE)
+    return NOT_SETTLED;
+  if (type == REFUND)
+    return SETTLED_REFUND;
+  if (type == PREAUTH || type == AUTHORIZATION)
+    return NOT_SETTLED;
+  return SETTLED_SALE;
+}
+
+const std::uint64_t* BatchStore::amounts() const {
+  return Column<std::uint64_t>(layout_->amounts);
+}
+
+const std::uint64_t* BatchStore::additional_amounts() const {
+  return Column<std::uint64_t>(layout_->additional_amounts);
+}
+
+const std::uint64_t* BatchStore::preauth_amounts() const {
+  return Column<std::uint64_t>(layout_->preauth_amounts);
+}
+
+const std::uint32_t* BatchStore::currencies() const {
+  return Column<std::uint32_t>(layout_->currencies);
+}
+
+const std::uint32_t* BatchStore::stans() const {
+  return Column<std::uint32_t>(layout_->stans);
+}
+
+const std::uint32_t* BatchStore::invoice_numbers() const {
+  return Column<std::uint32_t>(layout_->invoice_numbers);
+}
+
+const std::int64_t* BatchStore::datetimes() const {
+  return Column<std::int64_t>(layout_->datetimes);
+}
+
+const std::uint8_t* BatchStore::types() const {
+  return Column<std::uint8_t>(layout_->types);
+}
+
+const std::uint8_t* BatchStore::statuses() const {
+  return Column<std::uint8_t>(layout_->statuses);
+}
+
+const std::uint8_t* BatchStore::flags() const {
+  return Column<std::uint8_t>(layout_->flags);
+}
+
+}
@@ -0,0 +1,240 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <diners/batch_totals.h>
+#include <cstddef>
+#include <cstring>
+#include <utils/logger.h>
+#include "diners_utils.h"
+#include "mapped_log.h"
+
+namespace diners {
+
+namespace {
+const std::uint8_t kCurrent = 0;
+
+// Record payload, the terminal being the record key
+struct TotalsRecord {
+  std::uint32_t host;
+  std::uint32_t batch;
+  std::uint32_t sales_count;
+  std::uint32_t refunds_count;
+  std::uint64_t sales_total;
+  std::uint64_t refunds_total;
+  std::uint32_t currency;  // not in records written before it was added
+  std::uint32_t reserved;
+};
+
+const std::size_t kRecordSizeWithoutCurrency = offsetof(TotalsRecord, currency);
+
+bool SameBatch(const BatchKey& lhs, const BatchKey& rhs) {
+  return lhs.host == rhs.host && lhs.terminal == rhs.terminal
+      && lhs.batch == rhs.batch;
+}
+
+void Add(BatchTotal& total, int count, std::int64_t amount) {
+  if ((count < 0 && total.count < unsigned(-count))
+      || (amount < 0 && total.total < std::uint64_t(-amount))) {
+    // Cancels something recorded before the ledger was in use
+    logger::error("TOTALS - Batch totals would go negative, kept at zero");
+    total = BatchTotal();
+    return;
+  }
+  total.count += count;
+  total.total += amount;
+}
+
+void Apply(RunningTotals& totals, TotalsEvent event, std::int64_t amount) {
+  switch (event) {
+    case TOTALS_SALE:
+      Add(totals.sales_total, 1, amount);
+      break;
+
+    case TOTALS_REFUND:
+      Add(totals.refunds_total, 1, amount);
+      break;
+
+    case TOTALS_SALE_CANCELLED:
+      Add(totals.sales_total, -1, -amount);
+      break;
+
+    case TOTALS_REFUND_CANCELLED:
+      Add(totals.refunds_total, -1, -amount);
+      break;
+
+    case TOTALS_SALE_ADJUSTED:
+      Add(totals.sales_total, 0, amount);
+      break;
+  }
+}
+}
+
+bool operator<(const BatchKey& lhs, const BatchKey& rhs) {
+  if (lhs.host != rhs.host)
+    return lhs.host < rhs.host;
+  if (lhs.terminal != rhs.terminal)
+    return lhs.terminal < rhs.terminal;
+  if (lhs.batch != rhs.batch)
+    return lhs.batch < rhs.batch;
+  return lhs.currency < rhs.currency;
+}
+
+std::uint32_t CurrencyKey(const std::string& currency) {
+  return PackCurrency(currency);
+}
+
+std::unique_ptr<BatchTotalsLedger> BatchTotalsLedger::Open(
+    const std::string& path, std::size_t capacity) {
+  std::unique_ptr<MappedLog> log = MappedLog::Open(path, capacity);
+  if (!log)
+    return nullptr;
+
+  std::unique_ptr<BatchTotalsLedger> ledger(
+      new BatchTotalsLedger(std::move(log)));
+  if (!ledger->Recover())
+    return nullptr;
+  return ledger;
+}
+
+BatchTotalsLedger::BatchTotalsLedger(std::unique_ptr<MappedLog> log)
+    : log_(std::move(log)) {
+}
+
+BatchTotalsLedger::~BatchTotalsLedger() {
+}
+
+// Keeps the newest record of each batch. Older ones are left when a crash
+// comes between an append and the retirement of the record it replaces.
+bool BatchTotalsLedger::Recover() {
+  for (const auto& record : log_->LiveRecords()) {
+    TotalsRecord payload = TotalsRecord();
+    if (record.payload.size() != sizeof(payload)
+        && record.payload.size() != kRecordSizeWithoutCurrency)
+      return false;
+    std::memcpy(&payload, record.payload.data(), record.payload.size());
+
+    BatchKey key(payload.host, record.key, payload.batch, payload.currency);
+    auto batch = batches_.find(key);
+    if (batch != batches_.end()) {
+      log_->SetState(batch->second.sequence, MappedLog::kRetired);
+      batches_.erase(batch);
+    }
+
+    Entry& entry = batches_[key];
+    entry.sequence = record.sequence;
+    entry.totals.sales_total = BatchTotal(payload.sales_count,
+                                          payload.sales_total);
+    entry.totals.refunds_total = BatchTotal(payload.refunds_count,
+                                            payload.refunds_total);
+  }
+  return true;
+}
+
+bool BatchTotalsLedger::Record(const BatchKey& key, TotalsEvent event,
+                               std::int64_t amount) {
+  std::uint64_t sequence;
+  std::uint64_t replaced = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = batches_[key];
+    if (entry.sequence)
+      replaced = entry.sequence;
+
+    RunningTotals totals = entry.totals;
+    Apply(totals, event, amount);
+
+    TotalsRecord payload = TotalsRecord();
+    payload.host = key.host;
+    payload.batch = key.batch;
+    payload.sales_count = totals.sales_total.count;
+    payload.refunds_count = totals.refunds_total.count;
+    payload.sales_total = totals.sales_total.total;
+    payload.refunds_total = totals.refunds_total.total;
+    payload.currency = key.currency;
+
+    // Appended under the lock, so records of a batch are in update order
+    sequence = log_->Append(key.terminal, kCurrent,
+                            reinterpret_cast<const std::uint8_t*>(&payload),
+                            sizeof(payload));
+    if (!sequence) {
+      logger::error("TOTALS - Ledger full");
+      if (!replaced)
+        batches_.erase(key);
+      return false;
+    }
+    entry.sequence = sequence;
+    entry.totals = totals;
+  }
+
+  // Outside the lock, so that updates of several lanes share one msync
+  if (!log_->Sync(sequence)) {
+    logger::error("TOTALS - Cannot write ledger");
+    return false;
+  }
+  if (replaced)
+    log_->SetState(replaced, MappedLog::kRetired);
+  return true;
+}
+
+RunningTotals BatchTotalsLedger::Get(const BatchKey& key) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto batch = batches_.find(key);
+  return batch == batches_.end() ? RunningTotals() : batch->second.totals;
+}
+
+std::vector<std::pair<BatchKey, RunningTotals>> BatchTotalsLedger::All() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::pair<BatchKey, RunningTotals>> totals;
+  totals.reserve(batches_.size());
+  for (const auto& batch : batches_) {
+    totals.push_back(std::make_pair(batch.first, batch.second.totals));
+  }
+  return totals;
+}
+
+std::vector<std::pair<BatchKey, RunningTotals>> BatchTotalsLedger::Currencies(
+    const BatchKey& key) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::pair<BatchKey, RunningTotals>> totals;
+  BatchKey first(key.host, key.terminal, key.batch, 0);
+  for (auto batch = batches_.lower_bound(first);
+       batch != batches_.end() && SameBatch(batch->first, key); ++batch) {
+    totals.push_back(std::make_pair(batch->first, batch->second.totals));
+  }
+  return totals;
+}
+
+bool BatchTotalsLedger::CloseBatch(const BatchKey& key) {
+  bool closed = true;
+  std::vector<std::pair<BatchKey, RunningTotals>> currencies = Currencies(key);
+  for (std::size_t i = 0; i < currencies.size(); i++)
+    closed = Close(currencies[i].first) && closed;
+  return closed;
+}
+
+bool BatchTotalsLedger::Close(const BatchKey& key) {
+  std::uint64_t sequence;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto batch = batches_.find(key);
+    if (batch == batches_.end())
+      return true;
+    sequence = batch->second.sequence;
+    batches_.erase(batch);
+  }
+  return log_->SetState(sequence, MappedLog::kRetired);
+}
+
+}
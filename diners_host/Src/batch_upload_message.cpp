@@ -19,6 +19,8 @@
 #include <iso8583/printer.h>
 #include <utils/logger.h>
 #include "protocol.h"
+#include "datetime_codec.h"
+#include "mandatory_fields.h"
 #include "diners_utils.h"
 
 namespace diners {
@@ -50,7 +52,8 @@ iso8583::Apdu BuildBatchUploadRequest(DinersTransaction& tx,
   message.SetHostDatetime(tx.tx_datetime);
 
   // DE 14 EXPIRATION DATE
-  message.SetExpirationDate(tx.expiration_date);
+  if (!tx.expiration_date.empty())
+    message.SetExpirationDate(tx.expiration_date);
 
   // DE 22 POS ENTRY MODE
   message.SetPosEntryMode(tx.pos_entry_mode);
@@ -89,11 +92,7 @@ bool ReadBatchUploadResponse(const std::vector<uint8_t>& data, DinersTransaction
 
   logger::debug(iso8583::Print(response.GetApdu()).c_str());
 
-  if (!response.IsValid() ||
-      (response.GetProcessingCode() != tx.processing_code) ||
-      (response.GetNii() != tx.nii) ||
-	  //(response.GetRrn() != tx.rrn) ||
-      (response.GetTid() != tx.tid))
+  if (!response.IsValid())
     return false;
 
   if (response.GetResponseCode() != "00")
@@ -129,10 +128,7 @@ void BatchUploadRequest::SetStan(uint32_t batch_upload_stan) {
 }
 
 void BatchUploadRequest::SetHostDatetime(time_t & time_stamp) {
-  apdu_.SetField(kFieldTimeLocalTransaction,
-                 iso8583::IsoTimeFromTimestamp(time_stamp));
-  apdu_.SetField(kFieldDateLocalTransaction,
-                 iso8583::IsoDateFromTimestamp(time_stamp));
+  WriteIsoDateTime(time_stamp, apdu_);
 }
 
 void BatchUploadRequest::SetExpirationDate(const std::string& expiration_date) {
@@ -214,12 +210,11 @@ iso8583::Apdu BatchUploadRequest::GetApdu() const {
  * BATCH UPLOAD RESPONSE
  **************************************/
 BatchUploadResponse::BatchUploadResponse(const std::uint8_t* data, size_t size)
-    : apdu_(GetProtocolSpec(), data, size) {
+    : apdu_(GetProtocolSpec(), data, size),
+      bitmap_(ReadPrimaryBitmap(data, size)) {
 }
 
 bool BatchUploadResponse::IsValid() const {
-  bool output = true;
-
   if (!apdu_.HasMti()) {
     return false;
   }
@@ -227,16 +222,8 @@ bool BatchUploadResponse::IsValid() const {
   if (mti != 330) {
     return false;
   }
-  output &= apdu_.HasField(kFieldProcessingCode);
-  output &= apdu_.HasField(kFieldStan);
-  output &= apdu_.HasField(kFieldTimeLocalTransaction);
-  output &= apdu_.HasField(kFieldDateLocalTransaction);
-  output &= apdu_.HasField(kFieldNii);
-  output &= apdu_.HasField(kFieldRrn);
-  output &= apdu_.HasField(kFieldResponseCode);
-  output &= apdu_.HasField(kFieldCardAcceptorTerminalId);
-
-  return output;
+
+  return HasMandatoryFields("BATCH UPLOAD", bitmap_, kFinancialResponseFields);
 }
 
 iso8583::Apdu BatchUploadResponse::GetApdu() const {
@@ -252,9 +239,7 @@ std::uint32_t BatchUploadResponse::GetStan() const {
 }
 
 time_t BatchUploadResponse::GetHostDatetime() const {
-  std::string date = apdu_.GetFieldAsString(kFieldDateLocalTransaction);
-  std::string time = apdu_.GetFieldAsString(kFieldTimeLocalTransaction);
-  return utils::GetDatetimefromIso8583Format(date, time);
+  return ReadIsoDateTime(apdu_);
 }
 
 std::uint32_t BatchUploadResponse::GetNii() const {
@@ -0,0 +1,162 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "correlation_key.h"
+#include "protocol.h"
+#include "field_scan.h"
+
+namespace diners {
+
+namespace {
+const std::size_t kMtiSize = 2;
+const std::size_t kBitmapSize = 8;
+const std::size_t kTidSize = 8;
+
+const FieldMask kCorrelationFields = MakeFieldMask(
+    kFieldProcessingCode, kFieldStan, kFieldNii, kFieldCardAcceptorTerminalId);
+
+std::uint64_t ReadPacked(const std::uint8_t* data, std::size_t size) {
+  std::uint64_t value = 0;
+  for (std::size_t i = 0; i < size; i++) {
+    value = (value << 8) | data[i];
+  }
+  return value;
+}
+}
+
+stdx::optional<CorrelationKey> ReadCorrelationKey(const std::uint8_t* data,
+                                                  std::size_t size) {
+  if (size < kMtiSize + kBitmapSize)
+    return stdx::nullopt;
+
+  CorrelationKey key = CorrelationKey();
+  key.mti = ReadPacked(data, kMtiSize);
+
+  FieldScanner scanner(data, size);
+  FieldSpan span;
+  while (scanner.Next(span) && span.field <= kFieldCardAcceptorTerminalId) {
+    const std::uint8_t* value = data + span.offset;
+    switch (span.field) {
+      case kFieldProcessingCode:
+        key.processing_code = ReadPacked(value, span.size);
+        break;
+      case kFieldStan:
+        key.stan = ReadPacked(value, span.size);
+        break;
+      case kFieldNii:
+        key.nii = ReadPacked(value, span.size);
+        break;
+      case kFieldCardAcceptorTerminalId:
+        key.tid = ReadPacked(value, kTidSize);
+        break;
+    }
+  }
+
+  // Fields after DE 41 do not matter
+  if (scanner.ErrorField()
+      && scanner.ErrorField() <= kFieldCardAcceptorTerminalId)
+    return stdx::nullopt;
+
+  key.fields = ReadPrimaryBitmap(data, size) & kCorrelationFields;
+  return key;
+}
+
+stdx::optional<CorrelationKey> ReadCorrelationKey(
+    const std::vector<std::uint8_t>& data) {
+  return ReadCorrelationKey(data.data(), data.size());
+}
+
+bool IsResponseTo(const CorrelationKey& response,
+                  const CorrelationKey& request) {
+  if (response.mti != request.mti + 0x10)
+    return false;
+
+  FieldMask common = response.fields & request.fields;
+  if ((common & FieldBit(kFieldProcessingCode))
+      && response.processing_code != request.processing_code)
+    return false;
+  if ((common & FieldBit(kFieldStan)) && response.stan != request.stan)
+    return false;
+  if ((common & FieldBit(kFieldNii)) && response.nii != request.nii)
+    return false;
+  if ((common & FieldBit(kFieldCardAcceptorTerminalId))
+      && response.tid != request.tid)
+    return false;
+
+  return true;
+}
+
+FailureCause MatchResponse(const std::uint8_t* request,
+                           std::size_t request_size,
+                           const std::uint8_t* response,
+                           std::size_t response_size) {
+  auto request_key = ReadCorrelationKey(request, request_size);
+  auto response_key = ReadCorrelationKey(response, response_size);
+  if (!request_key || !response_key)
+    return FAILURE_MALFORMED;
+  if (response_key->mti != request_key->mti + 0x10)
+    return FAILURE_INVALID_MTI;
+  if (!IsResponseTo(*response_key, *request_key))
+    return FAILURE_CORRELATION_MISMATCH;
+  return FAILURE_NONE;
+}
+
+FailureCause MatchResponse(const std::vector<std::uint8_t>& request,
+                           const std::vector<std::uint8_t>& response) {
+  return MatchResponse(request.data(), request.size(), response.data(),
+                       response.size());
+}
+
+CorrelationKey RequestKeyOf(const CorrelationKey& response) {
+  CorrelationKey request = response;
+  request.mti -= 0x10;
+  return request;
+}
+
+bool operator==(const CorrelationKey& lhs, const CorrelationKey& rhs) {
+  return lhs.mti == rhs.mti && lhs.processing_code == rhs.processing_code
+      && lhs.stan == rhs.stan && lhs.nii == rhs.nii && lhs.tid == rhs.tid
+      && lhs.fields == rhs.fields;
+}
+
+bool operator!=(const CorrelationKey& lhs, const CorrelationKey& rhs) {
+  return !(lhs == rhs);
+}
+
+bool operator<(const CorrelationKey& lhs, const CorrelationKey& rhs) {
+  if (lhs.mti != rhs.mti)
+    return lhs.mti < rhs.mti;
+  if (lhs.processing_code != rhs.processing_code)
+    return lhs.processing_code < rhs.processing_code;
+  if (lhs.stan != rhs.stan)
+    return lhs.stan < rhs.stan;
+  if (lhs.nii != rhs.nii)
+    return lhs.nii < rhs.nii;
+  if (lhs.tid != rhs.tid)
+    return lhs.tid < rhs.tid;
+  return lhs.fields < rhs.fields;
+}
+
+std::size_t CorrelationKeyHash::operator()(const CorrelationKey& key) const {
+  std::uint64_t hash = key.stan;
+  hash = hash * 31 + key.mti;
+  hash = hash * 31 + key.processing_code;
+  hash = hash * 31 + key.nii;
+  hash = hash * 31 + key.tid;
+  hash = hash * 31 + key.fields;
+  return static_cast<std::size_t>(hash ^ (hash >> 32));
+}
+
+}
@@ -0,0 +1,138 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "datetime_codec.h"
+#include <mutex>
+#include "protocol.h"
+
+namespace diners {
+
+namespace {
+const time_t kSecondsPerDay = 24 * 60 * 60;
+
+// Local calendar day the terminal is in, refreshed when the clock leaves it
+struct Day {
+  time_t start;
+  time_t end;
+  int year;  // years since 1900
+  std::uint32_t date;  // MMDD
+};
+
+void LoadDay(time_t now, Day& day) {
+  struct tm local;
+  localtime_r(&now, &local);
+  day.year = local.tm_year;
+  day.date = (local.tm_mon + 1) * 100 + local.tm_mday;
+
+  local.tm_hour = 0;
+  local.tm_min = 0;
+  local.tm_sec = 0;
+  local.tm_isdst = -1;
+  day.start = mktime(&local);
+
+  local.tm_mday += 1;
+  local.tm_isdst = -1;
+  day.end = mktime(&local);
+}
+
+// A copy, as hosts may run on several threads
+Day Today() {
+  static std::mutex mutex;
+  static Day today = { 0, 0, 0, 0 };
+  time_t now = time(NULL);
+  std::lock_guard<std::mutex> lock(mutex);
+  if (now < today.start || now >= today.end)
+    LoadDay(now, today);
+  return today;
+}
+
+// Offsets from midnight are wall-clock time only on days without a
+// daylight saving change
+bool IsRegularDay(const Day& day) {
+  return day.end - day.start == kSecondsPerDay;
+}
+
+std::uint32_t SecondsToIsoTime(time_t seconds) {
+  return (seconds / 3600) * 10000 + (seconds / 60 % 60) * 100 + seconds % 60;
+}
+
+time_t IsoTimeToSeconds(std::uint32_t iso_time) {
+  return (iso_time / 10000) * 3600 + (iso_time / 100 % 100) * 60
+      + iso_time % 100;
+}
+
+time_t Distance(time_t lhs, time_t rhs) {
+  return lhs > rhs ? lhs - rhs : rhs - lhs;
+}
+}
+
+IsoDateTime ToIsoDateTime(time_t timestamp) {
+  IsoDateTime output;
+
+  Day today = Today();
+  if (timestamp >= today.start && timestamp < today.end
+      && IsRegularDay(today)) {
+    output.time = SecondsToIsoTime(timestamp - today.start);
+    output.date = today.date;
+    return output;
+  }
+
+  struct tm local;
+  localtime_r(&timestamp, &local);
+  output.time = local.tm_hour * 10000 + local.tm_min * 100 + local.tm_sec;
+  output.date = (local.tm_mon + 1) * 100 + local.tm_mday;
+  return output;
+}
+
+time_t FromIsoDateTime(const IsoDateTime& iso_datetime) {
+  Day today = Today();
+  if (iso_datetime.date == today.date && IsRegularDay(today))
+    return today.start + IsoTimeToSeconds(iso_datetime.time);
+
+  // DE 13 has no year. Of the previous, current and next year, the one
+  // that puts the date closest to now, e.g. 1231 read on 1 January is in
+  // the previous year.
+  time_t now = time(NULL);
+  time_t output = 0;
+  for (int year = today.year - 1; year <= today.year + 1; year++) {
+    struct tm local = tm();
+    local.tm_year = year;
+    local.tm_mon = iso_datetime.date / 100 - 1;
+    local.tm_mday = iso_datetime.date % 100;
+    local.tm_hour = iso_datetime.time / 10000;
+    local.tm_min = iso_datetime.time / 100 % 100;
+    local.tm_sec = iso_datetime.time % 100;
+    local.tm_isdst = -1;
+    time_t candidate = mktime(&local);
+    if (year == today.year - 1 || Distance(candidate, now) < Distance(output, now))
+      output = candidate;
+  }
+  return output;
+}
+
+time_t ReadIsoDateTime(const iso8583::Apdu& apdu) {
+  IsoDateTime iso_datetime;
+  iso_datetime.time = apdu.GetFieldAsInteger(kFieldTimeLocalTransaction);
+  iso_datetime.date = apdu.GetFieldAsInteger(kFieldDateLocalTransaction);
+  return FromIsoDateTime(iso_datetime);
+}
+
+void WriteIsoDateTime(time_t timestamp, iso8583::Apdu& apdu) {
+  IsoDateTime iso_datetime = ToIsoDateTime(timestamp);
+  apdu.SetField(kFieldTimeLocalTransaction, iso_datetime.time);
+  apdu.SetField(kFieldDateLocalTransaction, iso_datetime.date);
+}
+
+}
@@ -14,7 +14,12 @@
  ------------------------------------------------------------------------------
  */
 #include <diners/diners_host.h>
+#include <diners/batch_reconciler.h>
+#include <diners/batch_store.h>
+#include <diners/frame_capture.h>
+#include <diners/transaction_record.h>
 #include <stdx/string>
+#include <utils/converter.h>
 #include <utils/strings.h>
 #include <utils/logger.h>
 #include <iso8583/printer.h>
@@ -32,9 +37,14 @@
 #include "settlement_message.h"
 #include "batch_upload_message.h"
 #include "tc_upload_message.h"
+#include "correlation_key.h"
+#include "diners_utils.h"
+#include "field_scan.h"
 
 using namespace diners;
 
+const std::chrono::milliseconds DinersHost::kDefaultPiggybackSlice(2000);
+
 namespace {
 const size_t kTpduSize = 5;
 const size_t kHeaderSize = 4;
@@ -46,17 +56,42 @@ std::vector<uint8_t> AddTpdu(const std::vector<uint8_t>& msg,
   output.insert(output.end(), msg.begin(), msg.end());
   return output;
 }
+
+// Reversal of 'tx' as if the host approved it. A void keeps the status of
+// the voided sale.
+DinersTransaction PendingReversal(const DinersTransaction& tx) {
+  DinersTransaction reversal = tx;
+  if (reversal.in_progress_status != IN_PROGRESS_VOID)
+    reversal.previous_transaction_status = APPROVED;
+  return reversal;
+}
+
+iso8583::Apdu BuildAdviceRequest(AdviceType type, DinersTransaction& tx) {
+  switch (type) {
+    case ADVICE_TIP_ADJUST:
+      return BuildTipAdjustRequest(tx);
+    case ADVICE_TC_UPLOAD:
+      return BuildTcUploadRequest(tx);
+    case ADVICE_REVERSAL:
+      return BuildReversalRequest(tx);
+    case ADVICE_OFFLINE_SALE:
+    default:
+      return BuildOfflineSaleRequest(tx);
+  }
+}
 }
 
 DinersHost::Status DinersHost::AuthorizeSale(DinersTransaction& tx) {
-	return PerformOnline(&BuildSaleRequest, &ReadSaleResponse, tx);
+	return PerformAuthorization(&BuildSaleRequest, &ReadSaleResponse, tx);
 }
 
 DinersHost::Status DinersHost::PerformVoid(DinersTransaction& tx) {
-    return PerformOnline(&BuildVoidRequest, &ReadVoidResponse, tx);
+    return PerformAuthorization(&BuildVoidRequest, &ReadVoidResponse, tx);
 }
 
 DinersHost::Status DinersHost::PerformTcUpload(DinersTransaction& tx) {
+  if (advice_queue_)
+    return QueueAdvice(ADVICE_TC_UPLOAD, tx);
   return PerformOnline(&BuildTcUploadRequest, &ReadTcUploadResponse, tx);
 }
 
@@ -65,14 +100,16 @@ DinersHost::Status DinersHost::PerformTMKDownload(DinersTransaction& tx) {
 }
 
 DinersHost::Status DinersHost::AuthorizeRefund(DinersTransaction& tx) {
-    return PerformOnline(&BuildRefundRequest, &ReadRefundResponse, tx);
+    return PerformAuthorization(&BuildRefundRequest, &ReadRefundResponse, tx);
 }
 
 DinersHost::Status DinersHost::AuthorizePreAuth(DinersTransaction& tx) {
-    return PerformOnline(&BuildPreAuthRequest, &ReadPreAuthResponse, tx);
+    return PerformAuthorization(&BuildPreAuthRequest, &ReadPreAuthResponse, tx);
 }
 
 DinersHost::Status DinersHost::SendTipAdjust(DinersTransaction& tx) {
+    if (advice_queue_)
+        return QueueAdvice(ADVICE_TIP_ADJUST, tx);
     return PerformOnline(&BuildTipAdjustRequest, &ReadTipAdjustResponse, tx);
 }
 
@@ -81,11 +118,13 @@ DinersHost::Status DinersHost::SendReversal(DinersTransaction& tx) {
 }
 
 DinersHost::Status DinersHost::SendOfflineSale(DinersTransaction& tx) {
+    if (advice_queue_)
+        return QueueAdvice(ADVICE_OFFLINE_SALE, tx);
     return PerformOnline(&BuildOfflineSaleRequest, &ReadOfflineSaleResponse, tx);
 }
 
 DinersHost::Status DinersHost::PerformSaleCompletion(DinersTransaction& tx) {
-    return PerformOnline(&BuildSaleCompletionRequest, &ReadSaleCompletionResponse, tx);
+    return PerformAuthorization(&BuildSaleCompletionRequest, &ReadSaleCompletionResponse, tx);
 }
 
 DinersHost::Status DinersHost::PerformDinersTestTransaction(TestTransaction& test_tx) {
@@ -97,12 +136,48 @@ DinersHost::Status DinersHost::PerformSettlement(DinersSettlementData& settle_ms
     return PerformOnline(settlement_request, &ReadSettlementResponse, settle_msg);
 }
 
+DinersHost::Status DinersHost::PerformReconciledSettlement(DinersSettlementData& settle_msg,
+                                                           const BatchStore& batch,
+                                                           BatchReconciler& reconciler,
+                                                           unsigned int (*next_stan)()) {
+	Status status = PerformSettlement(settle_msg, false);
+	const ReconcileStage kStages[] = { RECONCILE_SUSPECTS, RECONCILE_MISMATCHED, RECONCILE_ALL };
+	for (ReconcileStage stage : kStages) {
+		if (status != COMPLETED || settle_msg.response_code != kReconcileErrorResponseCode)
+			break;
+
+		std::vector<std::size_t> indexes = reconciler.UploadSet(stage, settle_msg.host_batch_summary);
+		if (indexes.empty())
+			continue;
+
+		logger::debug(("DINERS - Reconciliation uploads " + utils::ToString(indexes.size())
+				+ " of " + utils::ToString(batch.Size()) + " records").c_str());
+		for (std::size_t index : indexes) {
+			status = PerformBatchUpload(batch, index, next_stan());
+			if (status != COMPLETED)
+				return status;
+			reconciler.MarkUploaded(index);
+		}
+
+		settle_msg.stan = next_stan();
+		status = PerformSettlement(settle_msg, true);
+	}
+	return status;
+}
+
 DinersHost::Status DinersHost::PerformBatchUpload(DinersTransaction& tx, unsigned int batch_upload_stan) {
 	iso8583::Apdu batch_upload_request = BuildBatchUploadRequest(tx, batch_upload_stan);
     return PerformOnline(batch_upload_request, &ReadBatchUploadResponse, tx);
 }
 
+DinersHost::Status DinersHost::PerformBatchUpload(const BatchStore& batch, std::size_t index,
+                                                  unsigned int batch_upload_stan) {
+	batch.Load(index, batch_upload_tx_);
+	return PerformBatchUpload(batch_upload_tx_, batch_upload_stan);
+}
+
 bool DinersHost::PreConnect(const std::string& host_name) {
+    piggyback_terminal_ = stdx::nullopt;
     comms_ = comms::Client(host_name.c_str());
     comms::CommsStatus status = comms_.PreConnect();
     if (status == comms::COMMS_OK)
@@ -115,28 +190,169 @@ bool DinersHost::WaitForConnection(std::uint32_t timeout) {
 }
 
 bool DinersHost::Disconnect() {
+    if (piggyback_terminal_) {
+    	// The authorization's stats are usually taken by now; the advices
+    	// must not show up in those of the next call
+    	CallStats stats = call_stats_;
+    	DeliverQueuedAdvices(*piggyback_terminal_);
+    	call_stats_ = stats;
+    	piggyback_terminal_ = stdx::nullopt;
+    }
+
     comms::CommsStatus status = comms_.Disconnect();
     if (status == comms::COMMS_OK)
     	return true;
     return false;
 }
 
-DinersHost::Status DinersHost::SendMessage(const utils::bytes& msg, const std::string tpdu) {
-	uint64_t byte_sent;
+AdviceResult DinersHost::DeliverAdvice(const Advice& advice) {
+	OnlineTrace trace(ONLINE_HOST_DINERS);
+	TransactionView record(advice.record.data(), advice.record.size());
+	if (!record.valid()) {
+		logger::error("DINERS - Unreadable queued advice, dropped");
+		return ADVICE_REJECTED;
+	}
+
+	DinersTransaction tx;
+	record.Load(tx);
+	if (!record.pan_token().empty()) {
+		std::string pan = pan_vault_ ? pan_vault_->Reveal(record.pan_token().str()) : std::string();
+		if (pan.empty()) {
+			logger::error("DINERS - PAN of a queued advice not in the vault");
+			return ADVICE_RETRY;
+		}
+		tx.pan = types::Pan(pan);
+	}
+
+	iso8583::Apdu request = BuildAdviceRequest(advice.type, tx);
+	trace.Mark(STAGE_BUILD);
+	trace.SetMessageType(request.GetMti());
+
+	utils::bytes response;
+	if (Exchange(AddTpdu(request.text, tx.tpdu), response, trace) != COMPLETED)
+		return ADVICE_RETRY;
+
+	std::string response_code = ResponseCodeOf(response);
+	trace.Mark(STAGE_PARSE);
+	if (response_code.empty()) {
+		call_stats_.failure = FAILURE_MISSING_FIELD;
+		return ADVICE_RETRY;
+	}
+	return response_code == "00" ? ADVICE_DELIVERED : ADVICE_REJECTED;
+}
+
+DinersHost::Status DinersHost::PerformAuthorization(BuildRequestFunc<DinersTransaction> request_func, ReadAndValidateResponseFunc<DinersTransaction> response_func, DinersTransaction& tx) {
+	std::uint64_t reversal = 0;
+	if (reversal_journal_) {
+		// Nothing is sent that could not be reversed. The reversal is built
+		// from the record when it is sent.
+		std::vector<uint8_t> record;
+		if (EncodeQueued(PendingReversal(tx), record))
+			reversal = reversal_journal_->Hold(ADVICE_REVERSAL, record);
+		if (!reversal)
+			return TRANSIENT_FAILURE;
+	}
+
+	Status status = PerformOnline(request_func, response_func, tx);
+	if (reversal) {
+		// A request that never left may be retried with the same STAN, which
+		// the reversal would then cancel
+		if (status == COMPLETED || !request_sent_)
+			reversal_journal_->Remove(reversal);
+		else
+			reversal_journal_->Release(reversal);
+	}
+
+	// Sent once the caller is done with the response, see Disconnect()
+	if (status == COMPLETED && advice_queue_
+			&& piggyback_slice_ > std::chrono::milliseconds::zero())
+		piggyback_terminal_ = TerminalKey(tx.tid);
+	return status;
+}
+
+bool DinersHost::EncodeQueued(const DinersTransaction& tx, std::vector<uint8_t>& record) const {
+	std::string pan_token;
+	if (tx.pan) {
+		if (pan_vault_)
+			pan_token = pan_vault_->Protect(tx.pan->ToString());
+		if (pan_token.empty()) {
+			logger::error("DINERS - No PAN vault to queue the transaction");
+			return false;
+		}
+	}
+
+	record = EncodeTransaction(tx, CurrencyOf(tx.amount), OMIT_CARD_DATA, pan_token);
+	return !record.empty();
+}
+
+DinersHost::Status DinersHost::QueueAdvice(AdviceType type, DinersTransaction& tx) {
+	// Built here only for what building sets in 'tx', as when it is sent
+	// at once; the message sent is built from the queued record
+	BuildAdviceRequest(type, tx);
+
+	std::vector<uint8_t> record;
+	if (!EncodeQueued(tx, record) || !advice_queue_->Enqueue(type, record))
+		return TRANSIENT_FAILURE;
+	tx.is_advice_queued = true;
+	return COMPLETED;
+}
+
+void DinersHost::DeliverQueuedAdvices(std::uint64_t terminal) {
+	const std::size_t kBatchSize = 8;
+
+	// When the drainer is sending, it sends these too
+	std::unique_lock<std::mutex> delivery(advice_queue_->delivery_mutex(), std::try_to_lock);
+	if (!delivery.owns_lock())
+		return;
+
+	auto deadline = std::chrono::steady_clock::now() + piggyback_slice_;
+	while (true) {
+		std::vector<Advice> batch = advice_queue_->Peek(terminal, kBatchSize);
+		if (batch.empty())
+			return;
+
+		for (const auto& advice : batch) {
+			if (std::chrono::steady_clock::now() >= deadline)
+				return;
+
+			AdviceResult result = DeliverAdvice(advice);
+			if (result == ADVICE_RETRY)
+				return;
+			if (result == ADVICE_REJECTED)
+				logger::error("DINERS - Advice rejected by host, dropped");
+			advice_queue_->Remove(advice.sequence);
+		}
+	}
+}
+
+CallStats DinersHost::TakeCallStats() {
+	CallStats stats = call_stats_;
+	call_stats_ = CallStats();
+	return stats;
+}
+
+DinersHost::Status DinersHost::SendMessage(const utils::bytes& frame) {
+	uint64_t byte_sent = 0;
     comms::CommsStatus comms_status;
 
-    std::vector<uint8_t> msg_to_send = AddTpdu(msg, tpdu);
-    logger::xdebug(msg_to_send.data(), msg_to_send.size());
+    logger::xdebug(frame.data(), frame.size());
+    CaptureFrame(ONLINE_HOST_DINERS, CAPTURE_SENT, frame.data(), frame.size(),
+                 kTpduSize);
 
-    comms_status = comms_.Send(msg_to_send, &byte_sent);
+    comms_status = comms_.Send(frame, &byte_sent);
+    if (byte_sent > 0)
+    	request_sent_ = true;
     if (comms_status != comms::COMMS_OK) {
     	logger::error("DINERS - Error when sending message");
+    	call_stats_.failure = FAILURE_SEND_ERROR;
         comms_.Disconnect();
         return TRANSIENT_FAILURE;
     }
 
-    if (byte_sent != msg_to_send.size()) {
+    call_stats_.bytes_sent += byte_sent;
+    if (byte_sent != frame.size()) {
     	logger::error("DINERS - Message not fully sent");
+    	call_stats_.failure = FAILURE_PARTIAL_SEND;
         comms_.Disconnect();
         return TRANSIENT_FAILURE;
     }
@@ -144,50 +360,113 @@ DinersHost::Status DinersHost::SendMessage(const utils::bytes& msg, const std::s
     return COMPLETED;
 }
 
-DinersHost::Status DinersHost::ReceiveMessage(utils::bytes& msg) {
+DinersHost::Status DinersHost::ReceiveMessage(utils::bytes& msg, OnlineTrace& trace) {
     const size_t kMaxBytes = 99999;
 
+    // comms returns whole frames, so the server wait includes the transfer
     comms::CommsStatus comms_status = comms_.Receive(msg, kMaxBytes);
+    trace.Mark(STAGE_SERVER_WAIT);
     if (comms_status != comms::COMMS_OK) {
+    	call_stats_.failure = FAILURE_RECEIVE_ERROR;
     	comms_.Disconnect();
         return TRANSIENT_FAILURE;;
     }
 
+    call_stats_.bytes_received += msg.size();
     logger::xdebug(msg.data(), msg.size());
+    CaptureFrame(ONLINE_HOST_DINERS, CAPTURE_RECEIVED, msg.data(), msg.size(),
+                 kTpduSize);
     if (msg.size() < kTpduSize) {
+    	call_stats_.failure = FAILURE_SHORT_FRAME;
         comms_.Disconnect();
         return TRANSIENT_FAILURE;
     }
 
     // strip TPDU and HEADER
     msg.erase(msg.begin(), msg.begin() + kTpduSize);
+    trace.Mark(STAGE_RECEIVE);
     return COMPLETED;
 }
 
 template<typename T>
 DinersHost::Status DinersHost::PerformOnline(BuildRequestFunc<T> request_func, ReadAndValidateResponseFunc<T> response_func, T& tx) {
-	return PerformOnline(request_func(tx), response_func, tx);
+	OnlineTrace trace(ONLINE_HOST_DINERS);
+	iso8583::Apdu request = request_func(tx);
+	trace.Mark(STAGE_BUILD);
+	return PerformOnline(request, response_func, tx, trace);
 }
 
 template<typename T>
 DinersHost::Status DinersHost::PerformOnline(iso8583::Apdu request, ReadAndValidateResponseFunc<T> response_func, T& tx) {
+	OnlineTrace trace(ONLINE_HOST_DINERS);
+	return PerformOnline(request, response_func, tx, trace);
+}
+
+DinersHost::Status DinersHost::Exchange(const utils::bytes& frame, utils::bytes& response, OnlineTrace& trace) {
 	std::uint32_t timeout = 30000;
-    if (comms_.WaitConnected(timeout) != comms::COMMS_CONNECTED) {
+    request_sent_ = false;
+    bool connected = comms_.WaitConnected(timeout) == comms::COMMS_CONNECTED;
+    trace.Mark(STAGE_CONNECT_WAIT);
+    if (!connected) {
+    	call_stats_.failure = FAILURE_CONNECT;
     	comms_.Disconnect();
         return TRANSIENT_FAILURE;
     }
 
-    if (SendMessage(request.text, tx.tpdu) != COMPLETED)
+    Status status = SendMessage(frame);
+    trace.Mark(STAGE_SEND);
+    if (status != COMPLETED)
     	return TRANSIENT_FAILURE;
 
-    utils::bytes msg_response_v;
-    if (ReceiveMessage(msg_response_v) != COMPLETED)
+    if (ReceiveMessage(response, trace) != COMPLETED)
         return TRANSIENT_FAILURE;
 
-    if (!response_func(msg_response_v, tx))
+    FailureCause mismatch = MatchResponse(frame.data() + kTpduSize,
+                                          frame.size() - kTpduSize,
+                                          response.data(), response.size());
+    if (mismatch != FAILURE_NONE) {
+    	trace.Mark(STAGE_PARSE);
+    	logger::error("DINERS - Response does not match request");
+    	call_stats_.failure = mismatch;
+    	return Status::PERM_FAILURE;
+    }
+
+    return COMPLETED;
+}
+
+template<typename T>
+DinersHost::Status DinersHost::PerformOnline(const iso8583::Apdu& request, ReadAndValidateResponseFunc<T> response_func, T& tx, OnlineTrace& trace) {
+	trace.SetMessageType(request.GetMti());
+
+	utils::bytes msg_response_v;
+	Status status = Exchange(AddTpdu(request.text, tx.tpdu), msg_response_v, trace);
+	if (status != COMPLETED)
+		return status;
+
+    bool valid = response_func(msg_response_v, tx);
+    trace.Mark(STAGE_PARSE);
+    if (!valid) {
+    	// MTI and correlation are checked above, the readers reject responses
+    	// lacking mandatory fields; only the batch upload reader also rejects
+    	// a decline, the authorization ones return it in tx.response_code
+    	call_stats_.failure = RejectionCause(msg_response_v);
     	return Status::PERM_FAILURE;
+    }
 
     return COMPLETED;
 }
 
 
+
+bool DinersAdviceChannel::Connect() {
+    const std::uint32_t kTimeout = 30000;
+    return host_.PreConnect(host_name_) && host_.WaitForConnection(kTimeout);
+}
+
+AdviceResult DinersAdviceChannel::Deliver(const Advice& advice) {
+    return host_.DeliverAdvice(advice);
+}
+
+void DinersAdviceChannel::Disconnect() {
+    host_.Disconnect();
+}
@@ -105,5 +105,93 @@ types::Amount GetAmountRequired(DinersTransaction & tx){
     return amount;
 }
 
+std::uint32_t PackCurrency(const std::string& currency) {
+  std::uint32_t code = 0;
+  for (std::size_t i = 0; i < currency.size() && i < 3; i++)
+    code |= std::uint32_t(std::uint8_t(currency[i])) << (8 * i);
+  return code;
+}
+
+std::string UnpackCurrency(std::uint32_t code) {
+  std::string currency;
+  for (; code != 0; code >>= 8)
+    currency += char(code & 0xFF);
+  return currency;
+}
+
+std::string CurrencyOf(const stdx::optional<types::Amount>& amount) {
+  return amount ? amount->GetCurrency() : std::string();
+}
+
+bool ReadIccTlv(const std::uint8_t* data, std::size_t size, std::size_t& offset,
+                IccTlv& tlv) {
+  while (offset < size && (data[offset] == 0x00 || data[offset] == 0xFF))
+    offset++;
+  if (offset == size)
+    return false;
+
+  std::size_t next = offset;
+  std::uint32_t tag = data[next++];
+  bool valid = true;
+  if ((tag & 0x1F) == 0x1F) {
+    do {
+      valid = next < size && tag <= 0xFFFFFF;
+      if (valid)
+        tag = (tag << 8) | data[next];
+    } while (valid && (data[next++] & 0x80));
+  }
+
+  std::size_t length = 0;
+  valid = valid && next < size;
+  if (valid) {
+    length = data[next++];
+    if (length & 0x80) {
+      std::size_t length_size = length & 0x7F;
+      valid = length_size <= 2 && next + length_size <= size;
+      length = 0;
+      for (std::size_t i = 0; valid && i < length_size; i++)
+        length = (length << 8) | data[next++];
+    }
+  }
+  if (!valid || length > size - next)
+    return false;
+
+  tlv.start = offset;
+  tlv.tag = tag;
+  tlv.value = next;
+  tlv.length = length;
+  offset = next + length;
+  return true;
+}
+
+bool IsIccCardTag(std::uint32_t tag) {
+  switch (tag) {
+    case 0x56:  // Track 1 data
+    case 0x57:  // Track 2 equivalent data
+    case 0x5A:  // PAN
+    case 0x5F20:  // Cardholder name
+    case 0x5F24:  // Application expiration date
+    case 0x9F0B:  // Cardholder name extended
+    case 0x9F1F:  // Track 1 discretionary data
+    case 0x9F20:  // Track 2 discretionary data
+    case 0x9F6B:  // Track 2 data
+      return true;
+    default:
+      return false;
+  }
+}
+
+std::vector<std::uint8_t> StripIccCardTags(const std::vector<std::uint8_t>& icc_data) {
+  std::vector<std::uint8_t> stripped;
+  std::size_t offset = 0;
+  IccTlv tlv;
+  while (ReadIccTlv(icc_data.data(), icc_data.size(), offset, tlv)) {
+    if (!IsIccCardTag(tlv.tag))
+      stripped.insert(stripped.end(), icc_data.begin() + tlv.start,
+                      icc_data.begin() + offset);
+  }
+  return stripped;
+}
+
 }
 
@@ -0,0 +1,106 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "field63_tables.h"
+#include <cstring>
+#include "protocol.h"
+
+namespace diners {
+
+namespace {
+const std::size_t kLengthSize = 2;
+const std::size_t kTableIdSize = 2;
+
+std::size_t ReadBcdLength(const std::uint8_t* data) {
+  std::size_t length = 0;
+  for (std::size_t i = 0; i < kLengthSize; i++) {
+    length = length * 100 + (data[i] >> 4) * 10 + (data[i] & 0x0F);
+  }
+  return length;
+}
+
+void AppendBcdLength(std::size_t length, std::vector<std::uint8_t>& buffer) {
+  std::size_t high = length / 100 % 100;
+  std::size_t low = length % 100;
+  buffer.push_back(((high / 10) << 4) | (high % 10));
+  buffer.push_back(((low / 10) << 4) | (low % 10));
+}
+}
+
+Field63Builder::Field63Builder(std::size_t capacity) {
+  buffer_.reserve(capacity);
+}
+
+void Field63Builder::AddTable(const std::vector<std::uint8_t>& full_table) {
+  buffer_.insert(buffer_.end(), full_table.begin(), full_table.end());
+}
+
+void Field63Builder::AddTable(const char* table_id, const std::uint8_t* data,
+                              std::size_t size) {
+  AppendBcdLength(kTableIdSize + size, buffer_);
+  buffer_.insert(buffer_.end(), table_id, table_id + kTableIdSize);
+  buffer_.insert(buffer_.end(), data, data + size);
+}
+
+bool Field63Builder::IsEmpty() const {
+  return buffer_.empty();
+}
+
+void Field63Builder::Commit(iso8583::Apdu& apdu) const {
+  if (!buffer_.empty())
+    apdu.SetField(kField63, buffer_);
+}
+
+Field63TableIterator::Field63TableIterator(const std::uint8_t* data,
+                                           std::size_t size)
+    : data_(data),
+      size_(size),
+      offset_(0) {
+}
+
+Field63TableIterator::Field63TableIterator(
+    const std::vector<std::uint8_t>& field63)
+    : data_(field63.data()),
+      size_(field63.size()),
+      offset_(0) {
+}
+
+bool Field63TableIterator::Next(Field63Table& table) {
+  if (offset_ + kField63TableHeaderSize > size_)
+    return false;
+
+  std::size_t length = ReadBcdLength(data_ + offset_);
+  if (length < kTableIdSize || offset_ + kLengthSize + length > size_)
+    return false;
+
+  table.id = reinterpret_cast<const char*>(data_ + offset_ + kLengthSize);
+  table.data = data_ + offset_ + kField63TableHeaderSize;
+  table.size = length - kTableIdSize;
+  offset_ += kLengthSize + length;
+  return true;
+}
+
+stdx::optional<Field63Table> FindField63Table(
+    const std::vector<std::uint8_t>& field63, const char* table_id) {
+  Field63TableIterator tables(field63);
+  Field63Table table;
+  while (tables.Next(table)) {
+    if (std::memcmp(table.id, table_id, kTableIdSize) == 0)
+      return table;
+  }
+  return stdx::nullopt;
+}
+
+}
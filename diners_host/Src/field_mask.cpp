@@ -0,0 +1,66 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "field_mask.h"
+#include <utils/logger.h>
+#include <utils/converter.h>
+
+namespace diners {
+
+namespace {
+const std::size_t kMtiSize = 2;
+const std::size_t kBitmapSize = 8;
+}
+
+FieldMask ReadPrimaryBitmap(const std::uint8_t* data, std::size_t size) {
+  if (size < kMtiSize + kBitmapSize)
+    return 0;
+
+  FieldMask bitmap = 0;
+  for (std::size_t i = 0; i < kBitmapSize; i++) {
+    bitmap = (bitmap << 8) | data[kMtiSize + i];
+  }
+  return bitmap;
+}
+
+FieldMask ReadPrimaryBitmap(const std::vector<std::uint8_t>& data) {
+  return ReadPrimaryBitmap(data.data(), data.size());
+}
+
+std::string FieldMaskToString(FieldMask mask) {
+  std::string output;
+  for (int field = 1; field <= 64; field++) {
+    if (mask & FieldBit(field)) {
+      if (!output.empty())
+        output += ",";
+      output += utils::ToString(field);
+    }
+  }
+  return output;
+}
+
+bool HasMandatoryFields(const char* message_name, FieldMask bitmap,
+                        FieldMask mandatory_fields) {
+  FieldMask missing = MissingFields(bitmap, mandatory_fields);
+  if (!missing)
+    return true;
+
+  std::string error = std::string("DINERS - ") + message_name
+      + " - Missing mandatory fields: " + FieldMaskToString(missing);
+  logger::error(error.c_str());
+  return false;
+}
+
+}
@@ -0,0 +1,187 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "field_scan.h"
+#include "protocol.h"
+
+namespace diners {
+
+namespace {
+const std::size_t kMtiSize = 2;
+const std::size_t kBitmapSize = 8;
+const int kFieldSecondaryBitmap = 1;
+const int kLastPrimaryField = 64;
+
+enum Encoding {
+  UNKNOWN,
+  FIXED,  // size bytes
+  LLVAR_NUMERIC,  // 1 byte BCD length in digits, 2 digits per byte
+  LLVAR,  // 1 byte BCD length in bytes
+  LLLVAR  // 2 bytes BCD length in bytes
+};
+
+struct FieldEncoding {
+  Encoding encoding;
+  std::size_t size;
+};
+
+// As in protocol.cpp; a change there has to be made here too
+FieldEncoding EncodingOf(int field) {
+  switch (field) {
+    case kFieldPan:
+    case kFieldTrack2Data:
+      return { LLVAR_NUMERIC, 0 };
+    case kFieldAdditionalResponseData:
+    case kFieldTrack1Data:
+      return { LLVAR, 0 };
+    case kFieldAdditionalDataNational:
+    case kFieldAdditionalDataPrivate:
+    case kFieldAdditionalAmount:
+    case kFieldIccData:
+    case kFieldNationalUseData:
+    case kField60:
+    case kField61:
+    case kField62:
+    case kField63:
+      return { LLLVAR, 0 };
+    case kFieldPosConditionCode:
+      return { FIXED, 1 };
+    case kFieldDateLocalTransaction:
+    case kFieldDateExpiration:
+    case kFieldDateSettlement:
+    case kFieldPosEntryMode:
+    case kFieldPanSequenceNumber:
+    case kFieldNii:
+    case kFieldResponseCode:
+    case kFieldCurrencyCode:
+      return { FIXED, 2 };
+    case kFieldProcessingCode:
+    case kFieldStan:
+    case kFieldTimeLocalTransaction:
+      return { FIXED, 3 };
+    case kFieldDateTimeTransmission:
+      return { FIXED, 5 };
+    case kFieldAmount:
+    case kFieldAuthorizationId:
+      return { FIXED, 6 };
+    case kFieldCardAcceptorTerminalId:
+    case kFieldPinBlock:
+      return { FIXED, 8 };
+    case kFieldRrn:
+      return { FIXED, 12 };
+    case kFieldCardAcceptorId:
+      return { FIXED, 15 };
+    case kFieldCardAcceptorNameLocation:
+      return { FIXED, 40 };
+    default:
+      return { UNKNOWN, 0 };
+  }
+}
+}
+
+FieldScanner::FieldScanner(const std::uint8_t* data, std::size_t size)
+    : data_(data),
+      size_(size),
+      bitmap_(ReadPrimaryBitmap(data, size)),
+      has_secondary_bitmap_(bitmap_ & FieldBit(kFieldSecondaryBitmap)),
+      offset_(kMtiSize + kBitmapSize),
+      field_(kFieldSecondaryBitmap),
+      error_field_(0) {
+  if (size < kMtiSize + kBitmapSize) {
+    offset_ = 0;
+    error_field_ = kFieldSecondaryBitmap;
+    field_ = kLastPrimaryField;
+  } else if (has_secondary_bitmap_) {
+    offset_ += kBitmapSize;
+  }
+}
+
+bool FieldScanner::Next(FieldSpan& span) {
+  if (error_field_)
+    return false;
+
+  do {
+    if (++field_ > kLastPrimaryField) {
+      // The secondary fields are not scanned
+      if (has_secondary_bitmap_)
+        return Fail(kLastPrimaryField + 1);
+      return false;
+    }
+  } while (!(bitmap_ & FieldBit(field_)));
+
+  FieldEncoding encoding = EncodingOf(field_);
+  std::size_t prefix_size = 0;
+  std::size_t value_size = encoding.size;
+  switch (encoding.encoding) {
+    case FIXED:
+      break;
+    case LLVAR_NUMERIC:
+    case LLVAR:
+      prefix_size = 1;
+      if (offset_ + prefix_size > size_)
+        return Fail(field_);
+      value_size = BcdToInt(data_[offset_]);
+      if (encoding.encoding == LLVAR_NUMERIC)
+        value_size = (value_size + 1) / 2;
+      break;
+    case LLLVAR:
+      prefix_size = 2;
+      if (offset_ + prefix_size > size_)
+        return Fail(field_);
+      value_size = BcdToInt(data_[offset_]) * 100
+          + BcdToInt(data_[offset_ + 1]);
+      break;
+    default:
+      return Fail(field_);
+  }
+
+  if (offset_ + prefix_size + value_size > size_)
+    return Fail(field_);
+
+  span.field = field_;
+  span.offset = offset_ + prefix_size;
+  span.size = value_size;
+  offset_ = span.offset + value_size;
+  return true;
+}
+
+bool FieldScanner::Fail(int field) {
+  error_field_ = field;
+  return false;
+}
+
+std::string ResponseCodeOf(const std::vector<std::uint8_t>& msg) {
+  const int kResponseCode = 39;
+
+  FieldScanner scanner(msg.data(), msg.size());
+  FieldSpan span;
+  while (scanner.Next(span)) {
+    if (span.field == kResponseCode)
+      return std::string(msg.begin() + span.offset,
+                         msg.begin() + span.offset + span.size);
+    if (span.field > kResponseCode)
+      break;
+  }
+  return std::string();
+}
+
+FailureCause RejectionCause(const std::vector<std::uint8_t>& response) {
+  std::string response_code = ResponseCodeOf(response);
+  if (!response_code.empty() && response_code != "00")
+    return FAILURE_RESPONSE_CODE;
+  return FAILURE_MISSING_FIELD;
+}
+
+}
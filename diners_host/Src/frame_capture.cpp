@@ -0,0 +1,262 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <diners/frame_capture.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "diners_utils.h"
+#include "field_scan.h"
+#include "protocol.h"
+
+namespace diners {
+
+namespace {
+const std::size_t kSlotCount = 128;
+const std::size_t kSlotSize = 1024;
+const std::size_t kFileHeaderSize = 8;
+const std::size_t kRecordHeaderSize = 28;
+const std::uint16_t kFileVersion = 1;
+const std::size_t kPanClearPrefix = 6;
+const std::size_t kPanClearSuffix = 4;
+const std::size_t kMtiSize = 2;
+const std::size_t kBitmapSize = 8;
+
+struct CaptureRecord {
+  std::int64_t time;
+  std::uint8_t host;
+  std::uint8_t direction;
+  std::uint16_t header_size;
+  std::uint32_t frame_size;
+  std::uint32_t captured_size;
+  std::uint8_t data[kSlotSize];
+};
+
+// The version is 2 * sequence + 1 while the record is written and
+// 2 * sequence + 2 once it is complete, so a reader can tell a record it
+// copied while it was rewritten.
+struct CaptureSlot {
+  std::atomic<std::uint64_t> version;
+  CaptureRecord record;
+};
+
+// Static storage, so zero initialised
+CaptureSlot slots[kSlotCount];
+std::atomic<std::uint64_t> next_sequence;
+std::atomic<std::uint64_t> dropped_frames;
+char crash_capture_path[256];
+
+void ZeroDigits(std::uint8_t* value, std::size_t first, std::size_t last) {
+  for (std::size_t digit = first; digit < last; digit++) {
+    value[digit / 2] &= digit % 2 ? 0xF0 : 0x0F;
+  }
+}
+
+// Zeroes the card tags of BER-TLV encoded ICC data, and everything from a
+// malformed TLV on
+void MaskIccData(std::uint8_t* data, std::size_t size) {
+  std::size_t offset = 0;
+  IccTlv tlv;
+  while (ReadIccTlv(data, size, offset, tlv)) {
+    if (IsIccCardTag(tlv.tag))
+      std::memset(data + tlv.value, 0, tlv.length);
+  }
+  std::memset(data + offset, 0, size - offset);
+}
+
+// 'data' is the message, TPDU excluded
+void MaskMessage(std::uint8_t* data, std::size_t size) {
+  FieldScanner scanner(data, size);
+  FieldSpan span;
+  while (scanner.Next(span)) {
+    std::uint8_t* value = data + span.offset;
+    switch (span.field) {
+      case kFieldPan: {
+        std::size_t digits = BcdToInt(value[-1]);
+        if (digits > kPanClearPrefix + kPanClearSuffix)
+          ZeroDigits(value, kPanClearPrefix, digits - kPanClearSuffix);
+        else
+          std::memset(value, 0, span.size);
+        break;
+      }
+      case kFieldTrack2Data:
+      case kFieldTrack1Data:
+      case kFieldPinBlock:
+        std::memset(value, 0, span.size);
+        break;
+      case kFieldIccData:
+        MaskIccData(value, span.size);
+        break;
+    }
+  }
+
+  // Unreadable field, or bytes past the last field
+  std::memset(data + scanner.Offset(), 0, size - scanner.Offset());
+}
+
+// For hosts whose field encodings are not known here: only the MTI and the
+// bitmaps are kept
+void MaskUnknownMessage(std::uint8_t* data, std::size_t size) {
+  std::size_t kept = kMtiSize + kBitmapSize;
+  if (size > kMtiSize && (data[kMtiSize] & 0x80))
+    kept += kBitmapSize;
+  if (kept < size)
+    std::memset(data + kept, 0, size - kept);
+}
+
+std::int64_t MicrosecondsSinceEpoch() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void PutLittleEndian(std::uint8_t* output, std::uint64_t value,
+                     std::size_t size) {
+  for (std::size_t i = 0; i < size; i++) {
+    output[i] = value >> (8 * i);
+  }
+}
+
+bool WriteAll(int fd, const std::uint8_t* data, std::size_t size) {
+  while (size) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+void OnCrash(int signal_number) {
+  int fd = open(crash_capture_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd >= 0) {
+    WriteFrameCapture(fd);
+    close(fd);
+  }
+
+  std::signal(signal_number, SIG_DFL);
+  std::raise(signal_number);
+}
+}
+
+void CaptureFrame(OnlineHost host, CaptureDirection direction,
+                  const std::uint8_t* frame, std::size_t size,
+                  std::size_t header_size) {
+  std::uint64_t sequence = next_sequence.fetch_add(1,
+                                                   std::memory_order_relaxed);
+  CaptureSlot& slot = slots[sequence % kSlotCount];
+
+  // Skip the slot if another writer holds it, or already put a newer frame
+  // in it
+  std::uint64_t version = slot.version.load(std::memory_order_relaxed);
+  if ((version & 1) || version > 2 * sequence
+      || !slot.version.compare_exchange_strong(version, 2 * sequence + 1,
+                                               std::memory_order_relaxed)) {
+    dropped_frames.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+
+  CaptureRecord& record = slot.record;
+  std::size_t captured_size = size < kSlotSize ? size : kSlotSize;
+  if (header_size > captured_size)
+    header_size = captured_size;
+
+  record.time = MicrosecondsSinceEpoch();
+  record.host = host;
+  record.direction = direction;
+  record.header_size = header_size;
+  record.frame_size = size;
+  record.captured_size = captured_size;
+  std::memcpy(record.data, frame, captured_size);
+  // Only the Diners field encodings are known; scanning another host's
+  // message with them would misplace every field
+  if (host == ONLINE_HOST_DINERS)
+    MaskMessage(record.data + header_size, captured_size - header_size);
+  else
+    MaskUnknownMessage(record.data + header_size, captured_size - header_size);
+
+  slot.version.store(2 * sequence + 2, std::memory_order_release);
+}
+
+std::uint64_t DroppedCapturedFrames() {
+  return dropped_frames.load(std::memory_order_relaxed);
+}
+
+bool WriteFrameCapture(const std::string& path) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    return false;
+
+  bool written = WriteFrameCapture(fd);
+  return close(fd) == 0 && written;
+}
+
+bool WriteFrameCapture(int fd) {
+  std::uint8_t file_header[kFileHeaderSize] = { 'F', 'C', 'A', 'P' };
+  PutLittleEndian(file_header + 4, kFileVersion, 2);
+  if (!WriteAll(fd, file_header, sizeof(file_header)))
+    return false;
+
+  std::uint64_t end = next_sequence.load(std::memory_order_acquire);
+  std::uint64_t sequence = end > kSlotCount ? end - kSlotCount : 0;
+  for (; sequence < end; sequence++) {
+    const CaptureSlot& slot = slots[sequence % kSlotCount];
+    std::uint64_t version = slot.version.load(std::memory_order_acquire);
+    if (version != 2 * sequence + 2)
+      continue;
+
+    CaptureRecord record;
+    std::memcpy(&record, &slot.record,
+                offsetof(CaptureRecord, data) + kSlotSize);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.version.load(std::memory_order_relaxed) != version
+        || record.captured_size > kSlotSize)
+      continue;
+
+    std::uint8_t header[kRecordHeaderSize];
+    PutLittleEndian(header, sequence, 8);
+    PutLittleEndian(header + 8, record.time, 8);
+    header[16] = record.host;
+    header[17] = record.direction;
+    PutLittleEndian(header + 18, record.header_size, 2);
+    PutLittleEndian(header + 20, record.frame_size, 4);
+    PutLittleEndian(header + 24, record.captured_size, 4);
+    if (!WriteAll(fd, header, sizeof(header))
+        || !WriteAll(fd, record.data, record.captured_size))
+      return false;
+  }
+
+  return true;
+}
+
+void InstallFrameCaptureCrashHandler(const char* path) {
+  std::strncpy(crash_capture_path, path, sizeof(crash_capture_path) - 1);
+
+  const int kSignals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+  for (int signal_number : kSignals) {
+    std::signal(signal_number, &OnCrash);
+  }
+}
+
+}
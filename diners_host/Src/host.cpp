@@ -14,6 +14,9 @@
  ------------------------------------------------------------------------------
  */
 #include <diners/host.h>
+#include <diners/online_trace.h>
+#include <diners/call_stats.h>
+#include <diners/frame_capture.h>
 
 #include <string>
 #include <sstream>
@@ -45,6 +48,8 @@
 #include "tip_adjust_message.h"
 #include "test_transaction_message.h"
 #include "tmk_download_message.h"
+#include "correlation_key.h"
+#include "field_scan.h"
 
 #include <utils/logger.h>
 #include <utils/converter.h>
@@ -210,16 +215,21 @@ Host::Status Host::SendMessage(const std::vector<uint8_t>& msg,
   std::vector<uint8_t> msg_to_send = AddTpdu(msg, tpdu);
 
   //logger::xdebug(msg_to_send.data(), msg_to_send.size());
+  CaptureFrame(ONLINE_HOST_FDMS, CAPTURE_SENT, msg_to_send.data(),
+               msg_to_send.size(), kTpduSize);
 
   comms_status = comms_.Send(msg_to_send, &byte_sent);
   if (comms_status != comms::COMMS_OK) {
     //logger::error("FDMS - Error when sending message");
+    call_stats_.failure = FAILURE_SEND_ERROR;
     comms_.Disconnect();
     return TRANSIENT_FAILURE;
   }
 
+  call_stats_.bytes_sent += byte_sent;
   if (byte_sent != msg_to_send.size()) {
     //logger::error("FDMS - Message not fully sent");
+    call_stats_.failure = FAILURE_PARTIAL_SEND;
     comms_.Disconnect();
     return TRANSIENT_FAILURE;
   }
@@ -227,28 +237,42 @@ Host::Status Host::SendMessage(const std::vector<uint8_t>& msg,
   return COMPLETED;
 }
 
-Host::Status Host::ReceiveMessage(std::vector<uint8_t>& msg) {
+Host::Status Host::ReceiveMessage(std::vector<uint8_t>& msg,
+                                  OnlineTrace& trace) {
 
   size_t max_bytes = 9999;
   comms::CommsStatus comms_status = comms_.Receive(msg, max_bytes);
+  trace.Mark(STAGE_SERVER_WAIT);
 
   if (comms_status != comms::COMMS_OK) {
+    call_stats_.failure = FAILURE_RECEIVE_ERROR;
     comms_.Disconnect();
     return TRANSIENT_FAILURE;;
   }
 
+  call_stats_.bytes_received += msg.size();
   //logger::xdebug(msg.data(), msg.size());
+  CaptureFrame(ONLINE_HOST_FDMS, CAPTURE_RECEIVED, msg.data(), msg.size(),
+               kTpduSize);
 
   if (msg.size() < kTpduSize) {
+    call_stats_.failure = FAILURE_SHORT_FRAME;
     comms_.Disconnect();
     return TRANSIENT_FAILURE;
   }
 
 // strip TPDU
   msg.erase(msg.begin(), msg.begin() + kTpduSize);
+  trace.Mark(STAGE_RECEIVE);
   return COMPLETED;
 }
 
+CallStats Host::TakeCallStats() {
+  CallStats stats = call_stats_;
+  call_stats_ = CallStats();
+  return stats;
+}
+
 bool Host::PreConnect(const std::string& host_name) {
   comms_ = comms::Client(host_name.c_str());
   comms::CommsStatus status = comms_.PreConnect();
@@ -272,30 +296,56 @@ template<typename T>
 Host::Status Host::PerformOnline(BuildRequestFunc<T> request_func,
                                  ReadAndValidateResponseFunc<T> response_func,
                                  T& tx) {
-  return PerformOnline(request_func(tx), response_func, tx);
+  OnlineTrace trace(ONLINE_HOST_FDMS);
+  iso8583::Apdu request = request_func(tx);
+  trace.Mark(STAGE_BUILD);
+  return PerformOnline(request, response_func, tx, trace);
 }
 
 template<typename T>
 Host::Status Host::PerformOnline(iso8583::Apdu request,
                                  ReadAndValidateResponseFunc<T> response_func,
                                  T& tx) {
+  OnlineTrace trace(ONLINE_HOST_FDMS);
+  return PerformOnline(request, response_func, tx, trace);
+}
+
+template<typename T>
+Host::Status Host::PerformOnline(const iso8583::Apdu& request,
+                                 ReadAndValidateResponseFunc<T> response_func,
+                                 T& tx, OnlineTrace& trace) {
   uint32_t timeout = 10000;
+  trace.SetMessageType(request.GetMti());
 
-  if (comms_.WaitConnected(timeout) != comms::COMMS_CONNECTED) {
+  bool connected = comms_.WaitConnected(timeout) == comms::COMMS_CONNECTED;
+  trace.Mark(STAGE_CONNECT_WAIT);
+  if (!connected) {
+    call_stats_.failure = FAILURE_CONNECT;
     comms_.Disconnect();
     return TRANSIENT_FAILURE;
   }
 
+  // the request dump is part of preparing the request
   logger::debug(iso8583::Print(request).c_str());
-  if (SendMessage(request.text, tx.tpdu) != COMPLETED)
+  trace.Mark(STAGE_BUILD);
+
+  Status status = SendMessage(request.text, tx.tpdu);
+  trace.Mark(STAGE_SEND);
+  if (status != COMPLETED)
     return TRANSIENT_FAILURE;
 
   std::vector<uint8_t> msg_response_v;
-  if (ReceiveMessage(msg_response_v) != COMPLETED)
+  if (ReceiveMessage(msg_response_v, trace) != COMPLETED)
     return TRANSIENT_FAILURE;
 
-  if (!response_func(request, msg_response_v, tx))
+  bool valid = response_func(request, msg_response_v, tx);
+  trace.Mark(STAGE_PARSE);
+  if (!valid) {
+    FailureCause mismatch = MatchResponse(request.text, msg_response_v);
+    call_stats_.failure =
+        mismatch != FAILURE_NONE ? mismatch : RejectionCause(msg_response_v);
     return Status::PERM_FAILURE;
+  }
 
   return COMPLETED;
 }
@@ -17,6 +17,8 @@
 #include <diners/diners_transaction.h>
 #include "key_request_message.h"
 #include "protocol.h"
+#include "datetime_codec.h"
+#include "mandatory_fields.h"
 #include <iso8583/field_types.h>
 #include <iso8583/encoder.h>
 #include <utils/converter.h>
@@ -52,10 +54,7 @@ bool ReadKeyDownloadResponse(const utils::bytes& data, DinersTransaction& tx) {
 
   logger::debug(iso8583::Print(response.GetApdu()).c_str());
 
-  if (!response.IsValid() ||
-      (response.GetProcessingCode() != tx.processing_code) ||
-      (response.GetNii() != tx.nii) ||
-      (response.GetTid() != tx.tid))
+  if (!response.IsValid())
     return false;
 
   if(response.GetResponseCode()!="00")
@@ -103,12 +102,11 @@ iso8583::Apdu KeyDownloadRequest::GetApdu() const {
  * KEY DOWNLOAD RESPONSE
  **************************************/
 KeyDownloadResponse::KeyDownloadResponse(const uint8_t *data, size_t size)
-    : apdu_(GetProtocolSpec(), data, size) {
+    : apdu_(GetProtocolSpec(), data, size),
+      bitmap_(ReadPrimaryBitmap(data, size)) {
 }
 
 bool KeyDownloadResponse::IsValid() const {
-  bool output = true;
-
   if (!apdu_.HasMti()) {
     return false;
   }
@@ -117,15 +115,7 @@ bool KeyDownloadResponse::IsValid() const {
     return false;
   }
 
-  output &= apdu_.HasField(kFieldProcessingCode);
-  output &= apdu_.HasField(kFieldTimeLocalTransaction);
-  output &= apdu_.HasField(kFieldDateLocalTransaction);
-  output &= apdu_.HasField(kFieldNii);
-  output &= apdu_.HasField(kFieldResponseCode);
-  output &= apdu_.HasField(kFieldCardAcceptorTerminalId);
-  output &= apdu_.HasField(kField62);
-
-  return output;
+  return HasMandatoryFields("KEY DOWNLOAD", bitmap_, kKeyDownloadResponseFields);
 }
 
 iso8583::Apdu KeyDownloadResponse::GetApdu() const {
@@ -137,9 +127,7 @@ std::string KeyDownloadResponse::GetProcessingCode() const {
 }
 
 time_t KeyDownloadResponse::GetHostDatetime() const {
-  std::string date = apdu_.GetFieldAsString(kFieldDateLocalTransaction);
-  std::string time = apdu_.GetFieldAsString(kFieldTimeLocalTransaction);
-  return utils::GetDatetimefromIso8583Format(date, time);
+  return ReadIsoDateTime(apdu_);
 }
 
 uint32_t KeyDownloadResponse::GetNii() const {
@@ -18,6 +18,7 @@
 #include <diners/key_exchange.h>
 
 #include "protocol.h"
+#include "mandatory_fields.h"
 #include "field_utils.h"
 #include <iso8583/field_types.h>
 #include <iso8583/encoder.h>
@@ -25,6 +26,7 @@
 #include <utils/logger.h>
 #include <iso8583/printer.h>
 #include "apdu_utils.h"
+#include "field63_tables.h"
 #include <tpcore/calendar.h>
 
 using namespace types;
@@ -34,21 +36,16 @@ namespace diners {
 // PRIVATE DECLARATIONS
 void GetEncryptedTidLocation(const iso8583::Apdu& apdu,
                              KeyExchange& key_exchange);
-void GetEncryptedPinKey(const iso8583::Apdu& apdu,
+bool GetEncryptedPinKey(const iso8583::Apdu& apdu,
                         KeyExchange& key_exchange);
-void GetEncryptedTLEKey(const iso8583::Apdu& apdu,
+bool GetEncryptedTLEKey(const iso8583::Apdu& apdu,
                         KeyExchange& key_exchange);
 
 // PRIVATE DATA
 static const int kKeyExchangeRequestMti = 800;
 static const std::string kKeyExchangeProcessingCode = "920000";
-
-static const std::vector<int> kKeyExchangeRspMandatoryFields = {
-    kFieldProcessingCode,
-    kFieldStan, kFieldTimeLocalTransaction, kFieldDateLocalTransaction,
-    kFieldNii,
-    kFieldResponseCode, kFieldCardAcceptorTerminalId,
-    kField62, kField63 };
+static const char kKeyTableId[] = "KP";
+static const size_t kKeySize = 16;
 
 // PUBLIC FUNCTIONS
 iso8583::Apdu BuildKeyExchangeRequest(const KeyExchange& key_exchange) {
@@ -74,7 +71,8 @@ bool ReadAndValidateKeyExchangeResponse(const iso8583::Apdu& request_apdu,
 
   logger::debug(iso8583::Print(response_apdu).c_str());
 
-  if (!CheckMandatoryFields(response_apdu, kKeyExchangeRspMandatoryFields)
+  if (!HasMandatoryFields("KEY EXCHANGE", ReadPrimaryBitmap(data),
+                          kKeyExchangeResponseFields)
       || !ValidateBasicFields(request_apdu, response_apdu))
     return false;
 
@@ -94,9 +92,11 @@ bool ReadAndValidateKeyExchangeResponse(const iso8583::Apdu& request_apdu,
 
   //GetEncryptedTidLocation(response_apdu,  key_exchange);
 
-  GetEncryptedPinKey(response_apdu, key_exchange);
-
-  GetEncryptedTLEKey(response_apdu, key_exchange);
+  if (!GetEncryptedPinKey(response_apdu, key_exchange)
+      || !GetEncryptedTLEKey(response_apdu, key_exchange)) {
+    logger::error("KEY EXCHANGE - No KP table with both keys in DE 63");
+    return false;
+  }
 
   return true;
 
@@ -110,22 +110,28 @@ void GetEncryptedTidLocation(const iso8583::Apdu& apdu,
     key_exchange.tid_location = tid_location;
 }
 
-void GetEncryptedPinKey(const iso8583::Apdu& apdu,
+// False if the KP table is missing or too short for both keys
+bool GetEncryptedPinKey(const iso8583::Apdu& apdu,
                         KeyExchange& key_exchange) {
     std::vector<uint8_t> field_content = apdu.GetFieldAsBytes(kField63);
 
-    std::vector<uint8_t> pvt_key = ReadFieldFromTable("KP", field_content);
-    std::vector<uint8_t> value(pvt_key.begin(), pvt_key.begin() + 16);
-    key_exchange.pin_key = value;
+    auto keys = FindField63Table(field_content, kKeyTableId);
+    if (!keys || keys->size < 2 * kKeySize)
+      return false;
+    key_exchange.pin_key.assign(keys->data, keys->data + kKeySize);
+    return true;
 }
 
-void GetEncryptedTLEKey(const iso8583::Apdu& apdu,
+bool GetEncryptedTLEKey(const iso8583::Apdu& apdu,
                         KeyExchange& key_exchange) {
     std::vector<uint8_t> field_content = apdu.GetFieldAsBytes(kField63);
 
-    std::vector<uint8_t> pvt_key = ReadFieldFromTable("KP", field_content);
-    std::vector<uint8_t> value(pvt_key.begin() + 16, pvt_key.begin() + 32);
-    key_exchange.tle_key = value;
+    auto keys = FindField63Table(field_content, kKeyTableId);
+    if (!keys || keys->size < 2 * kKeySize)
+      return false;
+    key_exchange.tle_key.assign(keys->data + kKeySize,
+                                keys->data + 2 * kKeySize);
+    return true;
 }
 
 }
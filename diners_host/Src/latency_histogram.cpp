@@ -0,0 +1,131 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <diners/latency_histogram.h>
+
+namespace diners {
+
+namespace {
+unsigned int HighestBit(std::uint64_t value) {
+  unsigned int output = 0;
+  while (value >>= 1) {
+    output++;
+  }
+  return output;
+}
+
+void StoreMax(std::atomic<std::uint64_t>& max, std::uint64_t value) {
+  std::uint64_t current = max.load(std::memory_order_relaxed);
+  while (value > current
+      && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+  }
+}
+}
+
+LatencyHistogram::LatencyHistogram() {
+  Reset();
+}
+
+LatencyHistogram::LatencyHistogram(const LatencyHistogram& other) {
+  Reset();
+  Merge(other);
+}
+
+LatencyHistogram& LatencyHistogram::operator=(const LatencyHistogram& other) {
+  if (this != &other) {
+    Reset();
+    Merge(other);
+  }
+  return *this;
+}
+
+std::size_t LatencyHistogram::BucketOf(std::uint64_t micros) {
+  const std::uint64_t kSubBuckets = 1 << kSubBucketBits;
+  const std::uint64_t kLimit = (std::uint64_t(1) << kMaxBits) - 1;
+  if (micros > kLimit)
+    micros = kLimit;
+  if (micros < kSubBuckets)
+    return micros;
+
+  // magnitude m >= 1 covers [2^(m+3), 2^(m+4)) in kSubBuckets steps
+  unsigned int magnitude = HighestBit(micros) - kSubBucketBits + 1;
+  return magnitude * kSubBuckets + ((micros >> (magnitude - 1)) - kSubBuckets);
+}
+
+std::uint64_t LatencyHistogram::BucketUpperBound(std::size_t bucket) {
+  const std::uint64_t kSubBuckets = 1 << kSubBucketBits;
+  std::size_t magnitude = bucket / kSubBuckets;
+  std::uint64_t sub_bucket = bucket % kSubBuckets;
+  if (magnitude == 0)
+    return sub_bucket;
+  return ((kSubBuckets + sub_bucket + 1) << (magnitude - 1)) - 1;
+}
+
+void LatencyHistogram::Record(std::uint64_t micros) {
+  buckets_[BucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(micros, std::memory_order_relaxed);
+  StoreMax(max_, micros);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  for (std::size_t i = 0; i < kBucketCount; i++) {
+    buckets_[i].fetch_add(other.buckets_[i].load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+  }
+  count_.fetch_add(other.Count(), std::memory_order_relaxed);
+  sum_.fetch_add(other.sum_.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+  StoreMax(max_, other.Max());
+}
+
+void LatencyHistogram::Reset() {
+  for (std::size_t i = 0; i < kBucketCount; i++) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Mean() const {
+  std::uint64_t count = Count();
+  return count ? double(sum_.load(std::memory_order_relaxed)) / count : 0;
+}
+
+std::uint64_t LatencyHistogram::Percentile(double percentile) const {
+  std::uint64_t count = Count();
+  std::uint64_t max = Max();
+  if (!count)
+    return 0;
+
+  std::uint64_t rank = std::uint64_t(percentile / 100 * count + 0.5);
+  if (rank == 0)
+    rank = 1;
+
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < kBucketCount; i++) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen < rank)
+      continue;
+
+    // The last bucket also holds everything above 2^32 us
+    std::uint64_t upper = BucketUpperBound(i);
+    return upper < max && i + 1 < kBucketCount ? upper : max;
+  }
+  return max;
+}
+
+}
@@ -0,0 +1,413 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "mapped_log.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/logger.h>
+
+namespace diners {
+
+namespace {
+const char kMagic[4] = { 'D', 'M', 'L', 'G' };
+const std::uint16_t kVersion = 1;
+
+struct FileHeader {
+  char magic[4];
+  std::uint16_t version;
+  std::uint16_t reserved;
+  std::uint64_t capacity;
+  std::uint64_t next_sequence;  // first sequence if the log is empty
+  std::uint64_t used_sequence;  // sequences below it were given out before
+                                // the last compaction; 0 in older files
+};
+
+struct RecordHeader {
+  std::uint32_t size;
+  std::uint32_t crc;  // of size, sequence, key and payload
+  std::uint64_t sequence;
+  std::uint64_t key;
+  std::uint8_t state;
+  std::uint8_t reserved[7];
+};
+
+const std::size_t kFileHeaderSize = 64;
+const std::size_t kRecordHeaderSize = sizeof(RecordHeader);
+
+std::size_t Align(std::size_t size) {
+  return (size + 7) & ~std::size_t(7);
+}
+
+class CrcTable {
+ public:
+  CrcTable() {
+    for (std::uint32_t i = 0; i < 256; i++) {
+      std::uint32_t value = i;
+      for (int bit = 0; bit < 8; bit++)
+        value = value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+      table_[i] = value;
+    }
+  }
+
+  std::uint32_t Update(std::uint32_t crc, const void* data,
+                       std::size_t size) const {
+    const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; i++)
+      crc = table_[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+  }
+
+ private:
+  std::uint32_t table_[256];
+};
+
+std::uint32_t RecordCrc(const RecordHeader& header,
+                        const std::uint8_t* payload) {
+  static const CrcTable table;
+  std::uint32_t crc = table.Update(0, &header.size, sizeof(header.size));
+  crc = table.Update(crc, &header.sequence, sizeof(header.sequence));
+  crc = table.Update(crc, &header.key, sizeof(header.key));
+  return table.Update(crc, payload, header.size);
+}
+
+FileHeader* HeaderOf(std::uint8_t* map) {
+  return reinterpret_cast<FileHeader*>(map);
+}
+
+RecordHeader* RecordAt(std::uint8_t* map, std::size_t offset) {
+  return reinterpret_cast<RecordHeader*>(map + offset);
+}
+
+std::uint8_t* MapFile(int fd, std::size_t capacity) {
+  void* map = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  return map == MAP_FAILED ? NULL : static_cast<std::uint8_t*>(map);
+}
+
+// Creates an empty log file of 'capacity' bytes
+bool InitFile(int fd, std::size_t capacity, std::uint64_t next_sequence,
+              std::uint64_t used_sequence) {
+  if (ftruncate(fd, capacity) != 0)
+    return false;
+
+  FileHeader header = FileHeader();
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.capacity = capacity;
+  header.next_sequence = next_sequence;
+  header.used_sequence = used_sequence;
+  return pwrite(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header))
+      && fsync(fd) == 0;
+}
+
+bool SyncDirectory(const std::string& path) {
+  std::vector<char> copy(path.begin(), path.end());
+  copy.push_back('\0');
+  int fd = open(dirname(copy.data()), O_RDONLY);
+  if (fd < 0)
+    return false;
+  bool synced = fsync(fd) == 0;
+  close(fd);
+  return synced;
+}
+}
+
+std::unique_ptr<MappedLog> MappedLog::Open(const std::string& path,
+                                           std::size_t capacity) {
+  capacity = Align(capacity);
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    logger::error(("LOG - Cannot open " + path).c_str());
+    return nullptr;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0
+      || (file_stat.st_size == 0 && !InitFile(fd, capacity, 1, 1))
+      || (file_stat.st_size != 0 && std::size_t(file_stat.st_size)
+          < kFileHeaderSize + kRecordHeaderSize)) {
+    logger::error(("LOG - Cannot initialise " + path).c_str());
+    close(fd);
+    return nullptr;
+  }
+  if (file_stat.st_size != 0)
+    capacity = file_stat.st_size;
+
+  std::uint8_t* map = MapFile(fd, capacity);
+  if (!map) {
+    logger::error(("LOG - Cannot map " + path).c_str());
+    close(fd);
+    return nullptr;
+  }
+
+  std::unique_ptr<MappedLog> log(new MappedLog(path, fd, map, capacity));
+  if (!log->Recover()) {
+    logger::error(("LOG - Not a log file: " + path).c_str());
+    return nullptr;
+  }
+  return log;
+}
+
+MappedLog::MappedLog(const std::string& path, int fd, std::uint8_t* map,
+                     std::size_t capacity)
+    : path_(path),
+      fd_(fd),
+      map_(map),
+      capacity_(capacity),
+      tail_(kFileHeaderSize),
+      next_sequence_(1),
+      synced_offset_(kFileHeaderSize),
+      synced_sequence_(0),
+      syncing_(false) {
+}
+
+MappedLog::~MappedLog() {
+  munmap(map_, capacity_);
+  close(fd_);
+}
+
+bool MappedLog::Recover() {
+  const FileHeader* header = HeaderOf(map_);
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0
+      || header->version != kVersion || header->capacity != capacity_)
+    return false;
+
+  index_.clear();
+  std::uint64_t min_sequence = header->next_sequence;
+  next_sequence_ = std::max(header->next_sequence, header->used_sequence);
+  std::size_t offset = kFileHeaderSize;
+  while (offset + kRecordHeaderSize <= capacity_) {
+    // A retired record has its payload zeroed, maybe only in part, so its
+    // checksum no longer holds. Append() never writes one.
+    const RecordHeader* record = RecordAt(map_, offset);
+    if (record->size > capacity_ - offset - kRecordHeaderSize
+        || record->sequence < min_sequence
+        || (record->state != kRetired && record->crc
+            != RecordCrc(*record, map_ + offset + kRecordHeaderSize)))
+      break;
+
+    if (record->state != kRetired)
+      index_[record->sequence] = offset;
+    min_sequence = record->sequence + 1;
+    next_sequence_ = std::max(next_sequence_, min_sequence);
+    offset += Align(kRecordHeaderSize + record->size);
+  }
+
+  // Clear what follows the last valid record, so that a record appended by
+  // a write that never completed cannot come back after newer records
+  tail_ = offset;
+  if (tail_ < capacity_) {
+    std::memset(map_ + tail_, 0, capacity_ - tail_);
+    if (!SyncRange(tail_, capacity_))
+      return false;
+  }
+
+  synced_offset_ = tail_;
+  synced_sequence_ = next_sequence_ - 1;
+  return true;
+}
+
+std::uint64_t MappedLog::Append(std::uint64_t key, std::uint8_t state,
+                                const std::uint8_t* data, std::size_t size) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::size_t record_size = Align(kRecordHeaderSize + size);
+  if (record_size > capacity_ - tail_
+      && (!Compact(lock) || record_size > capacity_ - tail_))
+    return 0;
+
+  RecordHeader* record = RecordAt(map_, tail_);
+  std::memcpy(map_ + tail_ + kRecordHeaderSize, data, size);
+  record->size = size;
+  record->sequence = next_sequence_++;
+  record->key = key;
+  record->state = state;
+  record->crc = RecordCrc(*record, map_ + tail_ + kRecordHeaderSize);
+
+  index_[record->sequence] = tail_;
+  tail_ += record_size;
+  return record->sequence;
+}
+
+bool MappedLog::Sync(std::uint64_t sequence) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (synced_sequence_ < sequence) {
+    if (syncing_) {
+      synced_.wait(lock);
+      continue;
+    }
+
+    // Leader: syncs what every waiting thread appended so far
+    syncing_ = true;
+    std::size_t begin = synced_offset_;
+    std::size_t end = tail_;
+    std::uint64_t target = next_sequence_ - 1;
+    lock.unlock();
+    bool synced = SyncRange(begin, end);
+    lock.lock();
+
+    syncing_ = false;
+    if (synced) {
+      synced_offset_ = std::max(synced_offset_, end);
+      synced_sequence_ = std::max(synced_sequence_, target);
+    }
+    synced_.notify_all();
+    if (!synced)
+      return false;
+  }
+  return true;
+}
+
+bool MappedLog::SetState(std::uint64_t sequence, std::uint8_t state) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto entry = index_.find(sequence);
+  if (entry == index_.end())
+    return false;
+
+  std::size_t offset = entry->second;
+  RecordHeader* record = RecordAt(map_, offset);
+  record->state = state;
+  if (state == kRetired)
+    index_.erase(entry);
+  bool synced = SyncRange(offset, offset + kRecordHeaderSize);
+  if (!synced || state != kRetired)
+    return synced;
+
+  // Only once the state is on disk, as the checksum fails without the payload
+  std::size_t payload = offset + kRecordHeaderSize;
+  std::memset(map_ + payload, 0, record->size);
+  return SyncRange(payload, payload + record->size);
+}
+
+bool MappedLog::Read(std::uint64_t sequence, Record& record) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto entry = index_.find(sequence);
+  if (entry == index_.end())
+    return false;
+
+  ReadAt(entry->second, record);
+  return true;
+}
+
+std::vector<MappedLog::Record> MappedLog::LiveRecords(
+    std::size_t max_count) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Record> records(std::min(max_count, index_.size()));
+  auto entry = index_.begin();
+  for (std::size_t i = 0; i < records.size(); i++, ++entry) {
+    ReadAt(entry->second, records[i]);
+  }
+  return records;
+}
+
+std::vector<MappedLog::Record> MappedLog::LiveRecords(
+    std::uint64_t key, std::size_t max_count) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Record> records;
+  for (auto entry = index_.begin();
+      entry != index_.end() && records.size() < max_count; ++entry) {
+    if (RecordAt(map_, entry->second)->key != key)
+      continue;
+
+    records.push_back(Record());
+    ReadAt(entry->second, records.back());
+  }
+  return records;
+}
+
+std::size_t MappedLog::LiveCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return index_.size();
+}
+
+std::uint64_t MappedLog::NextSequence() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return next_sequence_;
+}
+
+void MappedLog::ReadAt(std::size_t offset, Record& record) const {
+  const RecordHeader* header = RecordAt(map_, offset);
+  const std::uint8_t* payload = map_ + offset + kRecordHeaderSize;
+  record.sequence = header->sequence;
+  record.key = header->key;
+  record.state = header->state;
+  record.payload.assign(payload, payload + header->size);
+}
+
+// Rewrites the live records to a new file that replaces the log. Called
+// with the lock held, when the log is full.
+bool MappedLog::Compact(std::unique_lock<std::mutex>& lock) {
+  synced_.wait(lock, [this] { return !syncing_; });
+
+  std::string compact_path = path_ + ".compact";
+  int fd = open(compact_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    return false;
+
+  // Recover() expects no record older than the header sequence
+  std::uint64_t first_sequence =
+      index_.empty() ? next_sequence_ : index_.begin()->first;
+  std::uint8_t* map = NULL;
+  if (!InitFile(fd, capacity_, first_sequence, next_sequence_)
+      || !(map = MapFile(fd, capacity_))) {
+    close(fd);
+    unlink(compact_path.c_str());
+    return false;
+  }
+
+  std::map<std::uint64_t, std::size_t> index;
+  std::size_t tail = kFileHeaderSize;
+  for (const auto& entry : index_) {
+    const RecordHeader* record = RecordAt(map_, entry.second);
+    std::size_t record_size = Align(kRecordHeaderSize + record->size);
+    std::memcpy(map + tail, record, record_size);
+    index[entry.first] = tail;
+    tail += record_size;
+  }
+
+  if (msync(map, capacity_, MS_SYNC) != 0
+      || rename(compact_path.c_str(), path_.c_str()) != 0) {
+    munmap(map, capacity_);
+    close(fd);
+    unlink(compact_path.c_str());
+    return false;
+  }
+  SyncDirectory(path_);
+
+  munmap(map_, capacity_);
+  close(fd_);
+  fd_ = fd;
+  map_ = map;
+  index_.swap(index);
+  tail_ = tail;
+  synced_offset_ = tail_;
+  synced_sequence_ = next_sequence_ - 1;
+  return true;
+}
+
+bool MappedLog::SyncRange(std::size_t begin, std::size_t end) const {
+  if (begin >= end)
+    return true;
+
+  static const std::size_t kPageSize = sysconf(_SC_PAGESIZE);
+  std::size_t page_begin = begin & ~(kPageSize - 1);
+  return msync(map_ + page_begin, end - page_begin, MS_SYNC) == 0;
+}
+
+}
@@ -19,6 +19,8 @@
 #include <iso8583/printer.h>
 #include <utils/logger.h>
 #include "protocol.h"
+#include "datetime_codec.h"
+#include "mandatory_fields.h"
 #include "diners_utils.h"
 
 namespace diners {
@@ -42,7 +44,8 @@ iso8583::Apdu BuildOfflineSaleRequest(DinersTransaction& tx) {
     message.SetHostDatetime(tx.tx_datetime);
 
     // DE 14 EXPIRATION DATE
-    message.SetExpirationDate(tx.expiration_date);
+    if (!tx.expiration_date.empty())
+      message.SetExpirationDate(tx.expiration_date);
 
     // DE 22 POS ENTRY MODE
     tx.orig_pos_entry_mode = message.SetPosEntryMode(tx.pos_entry_mode);
@@ -93,11 +96,7 @@ bool ReadOfflineSaleResponse(const std::vector<uint8_t>& data, DinersTransaction
 
     logger::debug(iso8583::Print(response.GetApdu()));
 
-  if (!response.IsValid() ||
-      (response.GetProcessingCode() != tx.processing_code) ||
-      (response.GetStan() != tx.stan) ||
-      (response.GetNii() != tx.nii) ||
-      (response.GetTid() != tx.tid))
+  if (!response.IsValid())
     return false;
 
   //tx.tx_datetime = response.GetHostDatetime();
@@ -137,8 +136,7 @@ void OfflineSaleRequest::SetExpirationDate(const std::string& expiration_date) {
 }
 
 void OfflineSaleRequest::SetHostDatetime(time_t time_stamp) {
-    apdu_.SetField(kFieldTimeLocalTransaction, iso8583::IsoTimeFromTimestamp(time_stamp));
-    apdu_.SetField(kFieldDateLocalTransaction, iso8583::IsoDateFromTimestamp(time_stamp));
+    WriteIsoDateTime(time_stamp, apdu_);
 }
 
 std::string OfflineSaleRequest::SetPosEntryMode(types::PosEntryMode & pos_entry_mode) {
@@ -199,12 +197,11 @@ iso8583::Apdu OfflineSaleRequest::GetApdu() const {
  * OFFLINE SALE RESPONSE
  **************************************/
 OfflineSaleResponse::OfflineSaleResponse(const uint8_t *data, size_t size)
-    : apdu_(GetProtocolSpec(), data, size) {
+    : apdu_(GetProtocolSpec(), data, size),
+      bitmap_(ReadPrimaryBitmap(data, size)) {
 }
 
 bool OfflineSaleResponse::IsValid() const {
-	bool output = true;
-
     if (!apdu_.HasMti()) {
     	return false;
     }
@@ -213,13 +210,7 @@ bool OfflineSaleResponse::IsValid() const {
     	return false;
     }
 
-    output &= apdu_.HasField(kFieldProcessingCode);
-    output &= apdu_.HasField(kFieldStan);
-    output &= apdu_.HasField(kFieldNii);
-    output &= apdu_.HasField(kFieldRrn);
-    output &= apdu_.HasField(kFieldResponseCode);
-    output &= apdu_.HasField(kFieldCardAcceptorTerminalId);
-    return output;
+    return HasMandatoryFields("OFFLINE SALE", bitmap_, kAdviceResponseFields);
 }
 
 iso8583::Apdu OfflineSaleResponse::GetApdu() const {
@@ -231,9 +222,7 @@ std::string OfflineSaleResponse::GetProcessingCode() const {
 }
 
 time_t OfflineSaleResponse::GetHostDatetime() const {
-    std::string date = apdu_.GetFieldAsString(kFieldDateLocalTransaction);
-    std::string time = apdu_.GetFieldAsString(kFieldTimeLocalTransaction);
-    return utils::GetDatetimefromIso8583Format(date, time);
+    return ReadIsoDateTime(apdu_);
 }
 
 std::uint32_t OfflineSaleResponse::GetStan() const {
@@ -0,0 +1,121 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <diners/online_trace.h>
+#include <cstdio>
+#include <cstring>
+
+namespace diners {
+
+namespace {
+const int kMessageTypes[] = { 100, 200, 220, 320, 400, 500, 800 };
+const std::size_t kMessageTypeCount = sizeof(kMessageTypes)
+    / sizeof(kMessageTypes[0]) + 1;  // last one for any other MTI
+
+const char* const kHostNames[kOnlineHostCount] = { "FDMS", "DINERS" };
+const char* const kStageNames[kOnlineStageCount] = { "build", "connect_wait",
+    "send", "server_wait", "receive", "parse" };
+
+LatencyHistogram histograms[kOnlineHostCount][kMessageTypeCount][kOnlineStageCount];
+
+std::size_t MessageTypeIndex(int mti) {
+  std::size_t index = 0;
+  while (index < kMessageTypeCount - 1 && kMessageTypes[index] != mti)
+    index++;
+  return index;
+}
+}
+
+const char* OnlineHostName(OnlineHost host) {
+  return host < kOnlineHostCount ? kHostNames[host] : "";
+}
+
+const char* OnlineStageName(OnlineStage stage) {
+  return stage < kOnlineStageCount ? kStageNames[stage] : "";
+}
+
+OnlineTrace::OnlineTrace(OnlineHost host)
+    : host_(host),
+      mti_(0),
+      last_(Clock::now()) {
+  std::memset(micros_, 0, sizeof(micros_));
+  std::memset(reached_, 0, sizeof(reached_));
+}
+
+OnlineTrace::~OnlineTrace() {
+  std::size_t message_type = MessageTypeIndex(mti_);
+  for (int stage = 0; stage < kOnlineStageCount; stage++) {
+    if (reached_[stage])
+      histograms[host_][message_type][stage].Record(micros_[stage]);
+  }
+}
+
+void OnlineTrace::Mark(OnlineStage stage) {
+  Clock::time_point now = Clock::now();
+  micros_[stage] += std::chrono::duration_cast<std::chrono::microseconds>(
+      now - last_).count();
+  reached_[stage] = true;
+  last_ = now;
+}
+
+const LatencyHistogram& GetOnlineLatency(OnlineHost host, int mti,
+                                         OnlineStage stage) {
+  return histograms[host][MessageTypeIndex(mti)][stage];
+}
+
+std::string DumpOnlineLatency() {
+  std::string output;
+
+  for (int host = 0; host < kOnlineHostCount; host++) {
+    for (std::size_t type = 0; type < kMessageTypeCount; type++) {
+      char mti[8];
+      if (type < kMessageTypeCount - 1)
+        std::snprintf(mti, sizeof(mti), "%04d", kMessageTypes[type]);
+      else
+        std::strcpy(mti, "other");
+
+      for (int stage = 0; stage < kOnlineStageCount; stage++) {
+        const LatencyHistogram& histogram = histograms[host][type][stage];
+        if (!histogram.Count())
+          continue;
+
+        char line[160];
+        std::snprintf(line, sizeof(line),
+                      "%s %s %s count=%lu p50=%lu p90=%lu p99=%lu max=%lu\n",
+                      kHostNames[host], mti, kStageNames[stage],
+                      (unsigned long) histogram.Count(),
+                      (unsigned long) histogram.Percentile(50),
+                      (unsigned long) histogram.Percentile(90),
+                      (unsigned long) histogram.Percentile(99),
+                      (unsigned long) histogram.Max());
+        output += line;
+      }
+    }
+  }
+
+  return output;
+}
+
+void ResetOnlineLatency() {
+  for (int host = 0; host < kOnlineHostCount; host++) {
+    for (std::size_t type = 0; type < kMessageTypeCount; type++) {
+      for (int stage = 0; stage < kOnlineStageCount; stage++) {
+        histograms[host][type][stage].Reset();
+      }
+    }
+  }
+}
+
+}
@@ -0,0 +1,403 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <diners/preauth_ledger.h>
+#include <algorithm>
+#include <cstring>
+#include <utils/converter.h>
+#include <utils/logger.h>
+#include "mapped_log.h"
+
+namespace diners {
+
+namespace {
+const std::uint8_t kOpen = 0;
+const std::uint8_t kExpiring = 1;
+
+const std::size_t kTokenSize = 64;
+const std::size_t kAuthCodeSize = 8;
+
+// Record payload, the hold id being the record key
+struct HoldRecord {
+  std::uint64_t authorized;
+  std::uint64_t completed;
+  std::int64_t expires_at;
+  std::uint32_t invoice_number;
+  char auth_id_response[kAuthCodeSize];
+  char card_token[kTokenSize];
+};
+
+void CopyString(char* out, std::size_t out_size, const std::string& value) {
+  std::memset(out, 0, out_size);
+  std::memcpy(out, value.data(), std::min(value.size(), out_size));
+}
+
+std::string ReadString(const char* value, std::size_t size) {
+  return std::string(value, std::find(value, value + size, '\0'));
+}
+
+void RemoveFromIndex(std::unordered_multimap<std::string, std::uint64_t>& index,
+                     const std::string& key, std::uint64_t id) {
+  auto range = index.equal_range(key);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == id) {
+      index.erase(it);
+      return;
+    }
+  }
+}
+}
+
+std::unique_ptr<PreauthLedger> PreauthLedger::Open(const std::string& path,
+                                                   std::size_t capacity) {
+  std::unique_ptr<MappedLog> log = MappedLog::Open(path, capacity);
+  if (!log)
+    return nullptr;
+
+  std::unique_ptr<PreauthLedger> ledger(new PreauthLedger(std::move(log)));
+  if (!ledger->Recover())
+    return nullptr;
+  return ledger;
+}
+
+PreauthLedger::PreauthLedger(std::unique_ptr<MappedLog> log)
+    : log_(std::move(log)),
+      next_id_(1) {
+}
+
+PreauthLedger::~PreauthLedger() {
+}
+
+// Keeps the newest record of each hold, as BatchTotalsLedger does. Ids are
+// never reused: each Add() appends one record, so an id given out is below
+// the next sequence of the log.
+bool PreauthLedger::Recover() {
+  for (const auto& record : log_->LiveRecords()) {
+    HoldRecord payload;
+    if (record.payload.size() != sizeof(payload))
+      return false;
+    std::memcpy(&payload, record.payload.data(), sizeof(payload));
+
+    PreauthHold hold;
+    hold.id = record.key;
+    hold.card_token = ReadString(payload.card_token, kTokenSize);
+    hold.auth_id_response = ReadString(payload.auth_id_response, kAuthCodeSize);
+    hold.authorized = payload.authorized;
+    hold.completed = payload.completed;
+    hold.expires_at = payload.expires_at;
+    hold.invoice_number = payload.invoice_number;
+    hold.expiring = record.state == kExpiring;
+
+    auto entry = holds_.find(hold.id);
+    if (entry != holds_.end()) {
+      log_->SetState(entry->second.sequence, MappedLog::kRetired);
+      Erase(entry);
+    }
+    Insert(record.sequence, hold);
+  }
+  next_id_ = log_->NextSequence();
+  return true;
+}
+
+void PreauthLedger::Insert(std::uint64_t sequence, const PreauthHold& hold) {
+  Entry& entry = holds_[hold.id];
+  entry.sequence = sequence;
+  entry.hold = hold;
+  tokens_.insert(std::make_pair(hold.card_token, hold.id));
+  auth_codes_.insert(std::make_pair(hold.auth_id_response, hold.id));
+  expiries_.insert(std::make_pair(hold.expires_at, hold.id));
+}
+
+void PreauthLedger::Erase(std::map<std::uint64_t, Entry>::iterator entry) {
+  const PreauthHold& hold = entry->second.hold;
+  RemoveFromIndex(tokens_, hold.card_token, hold.id);
+  RemoveFromIndex(auth_codes_, hold.auth_id_response, hold.id);
+  expiries_.erase(std::make_pair(hold.expires_at, hold.id));
+  holds_.erase(entry);
+}
+
+// Appends the new state of 'hold', or only retires its record if 'close'.
+// Called with the lock held; it is released before waiting for the disk,
+// so that changes from several lanes share one msync.
+bool PreauthLedger::Commit(std::unique_lock<std::mutex>& lock,
+                           const PreauthHold& hold, bool close) {
+  std::uint64_t replaced = 0;
+  PreauthHold previous;
+  auto entry = holds_.find(hold.id);
+  if (entry != holds_.end()) {
+    replaced = entry->second.sequence;
+    previous = entry->second.hold;
+    Erase(entry);
+  }
+
+  std::uint64_t sequence = 0;
+  if (!close) {
+    HoldRecord payload;
+    std::memset(&payload, 0, sizeof(payload));
+    payload.authorized = hold.authorized;
+    payload.completed = hold.completed;
+    payload.expires_at = hold.expires_at;
+    payload.invoice_number = hold.invoice_number;
+    CopyString(payload.auth_id_response, kAuthCodeSize, hold.auth_id_response);
+    CopyString(payload.card_token, kTokenSize, hold.card_token);
+
+    // Appended under the lock, so records of a hold are in update order
+    sequence = log_->Append(hold.id, kOpen,
+                            reinterpret_cast<const std::uint8_t*>(&payload),
+                            sizeof(payload));
+    if (!sequence) {
+      logger::error("PREAUTH - Ledger full");
+      if (replaced)
+        Insert(replaced, previous);
+      return false;
+    }
+    Insert(sequence, hold);
+  }
+  lock.unlock();
+
+  if (sequence && !log_->Sync(sequence)) {
+    logger::error("PREAUTH - Cannot write ledger");
+    return false;
+  }
+  if (replaced)
+    return log_->SetState(replaced, MappedLog::kRetired);
+  return true;
+}
+
+std::uint64_t PreauthLedger::Add(const PreauthHold& hold) {
+  if (hold.card_token.size() > kTokenSize
+      || hold.auth_id_response.size() > kAuthCodeSize) {
+    logger::error("PREAUTH - Card token or authorization code too long");
+    return 0;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  PreauthHold added = hold;
+  added.id = next_id_++;
+  if (!Commit(lock, added, false))
+    return 0;
+  return added.id;
+}
+
+bool PreauthLedger::TopUp(std::uint64_t id, std::uint64_t amount,
+                          std::time_t expires_at) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto entry = holds_.find(id);
+  if (entry == holds_.end())
+    return false;
+
+  PreauthHold hold = entry->second.hold;
+  if (hold.expiring)
+    return false;
+  hold.authorized += amount;
+  hold.expires_at = std::max(hold.expires_at, expires_at);
+  return Commit(lock, hold, false);
+}
+
+bool PreauthLedger::Complete(std::uint64_t id, std::uint64_t amount,
+                             bool final) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto entry = holds_.find(id);
+  if (entry == holds_.end())
+    return false;
+
+  PreauthHold hold = entry->second.hold;
+  if (hold.expiring)
+    return false;
+  if (amount > hold.Remaining()) {
+    logger::error("PREAUTH - Completion above the amount remaining");
+    return false;
+  }
+  hold.completed += amount;
+  return Commit(lock, hold, final || hold.Remaining() == 0);
+}
+
+bool PreauthLedger::Release(std::uint64_t id) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto entry = holds_.find(id);
+  if (entry == holds_.end())
+    return false;
+
+  PreauthHold hold = entry->second.hold;
+  return Commit(lock, hold, true);
+}
+
+// The state byte of the current record, written under the lock so that a
+// Release() cannot retire the record in between
+stdx::optional<PreauthHold> PreauthLedger::MarkExpiring(std::uint64_t id,
+                                                        std::time_t now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto entry = holds_.find(id);
+  if (entry == holds_.end())
+    return stdx::nullopt;
+
+  PreauthHold& hold = entry->second.hold;
+  if (hold.expiring)
+    return hold;
+  if (hold.expires_at > now)
+    return stdx::nullopt;
+  if (!log_->SetState(entry->second.sequence, kExpiring)) {
+    logger::error("PREAUTH - Cannot write ledger");
+    return stdx::nullopt;
+  }
+  hold.expiring = true;
+  return hold;
+}
+
+stdx::optional<PreauthHold> PreauthLedger::Get(std::uint64_t id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto entry = holds_.find(id);
+  if (entry == holds_.end())
+    return stdx::nullopt;
+  return entry->second.hold;
+}
+
+std::vector<PreauthHold> PreauthLedger::Find(const KeyIndex& index,
+                                             const std::string& key) const {
+  std::vector<PreauthHold> holds;
+  auto range = index.equal_range(key);
+  for (auto it = range.first; it != range.second; ++it)
+    holds.push_back(holds_.find(it->second)->second.hold);
+  std::sort(holds.begin(), holds.end(),
+            [](const PreauthHold& lhs, const PreauthHold& rhs) {
+              return lhs.id < rhs.id;
+            });
+  return holds;
+}
+
+std::vector<PreauthHold> PreauthLedger::FindByToken(
+    const std::string& card_token) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return Find(tokens_, card_token);
+}
+
+std::vector<PreauthHold> PreauthLedger::FindByAuthCode(
+    const std::string& auth_id_response) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return Find(auth_codes_, auth_id_response);
+}
+
+// Through the authorization code, which is shared by few holds
+stdx::optional<PreauthHold> PreauthLedger::Match(
+    const std::string& card_token, const std::string& auth_id_response) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto range = auth_codes_.equal_range(auth_id_response);
+  stdx::optional<PreauthHold> match;
+  for (auto it = range.first; it != range.second; ++it) {
+    const PreauthHold& hold = holds_.find(it->second)->second.hold;
+    if (hold.card_token == card_token && (!match || hold.id < match->id))
+      match = hold;
+  }
+  return match;
+}
+
+std::vector<PreauthHold> PreauthLedger::Expired(std::time_t now,
+                                                std::size_t max_count) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<PreauthHold> holds;
+  for (auto it = expiries_.begin();
+       it != expiries_.end() && it->first <= now && holds.size() < max_count;
+       ++it)
+    holds.push_back(holds_.find(it->second)->second.hold);
+  return holds;
+}
+
+stdx::optional<std::time_t> PreauthLedger::NextExpiry() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (expiries_.empty())
+    return stdx::nullopt;
+  return expiries_.begin()->first;
+}
+
+std::size_t PreauthLedger::Size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return holds_.size();
+}
+
+PreauthSweeper::PreauthSweeper(PreauthLedger& ledger,
+                               PreauthExpiryHandler& handler,
+                               std::chrono::seconds max_interval)
+    : ledger_(ledger),
+      handler_(handler),
+      max_interval_(max_interval),
+      running_(false) {
+}
+
+PreauthSweeper::~PreauthSweeper() {
+  Stop();
+}
+
+void PreauthSweeper::Start() {
+  if (running_.exchange(true))
+    return;
+  thread_ = std::thread(&PreauthSweeper::Run, this);
+}
+
+void PreauthSweeper::Stop() {
+  if (!running_.exchange(false))
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_.notify_all();
+  }
+  thread_.join();
+}
+
+std::size_t PreauthSweeper::SweepOnce(std::time_t now) {
+  const std::size_t kBatchSize = 64;
+  std::size_t released = 0;
+  for (;;) {
+    std::vector<PreauthHold> expired = ledger_.Expired(now, kBatchSize);
+    std::size_t batch_released = 0;
+    for (const auto& candidate : expired) {
+      // Topped up or completed since the snapshot: not expired any more.
+      // Marked first, so that a crash before the release runs the handler
+      // again rather than losing the host cancellation.
+      stdx::optional<PreauthHold> hold = ledger_.MarkExpiring(candidate.id, now);
+      if (!hold)
+        continue;
+      handler_.Expired(*hold);
+      if (ledger_.Release(hold->id))
+        batch_released++;
+    }
+    released += batch_released;
+    if (expired.size() < kBatchSize || batch_released == 0)
+      break;
+  }
+  if (released)
+    logger::debug(("PREAUTH - Released " + utils::ToString(released)
+        + " expired holds").c_str());
+  return released;
+}
+
+void PreauthSweeper::Run() {
+  while (running_) {
+    SweepOnce(time(NULL));
+
+    std::chrono::seconds wait = max_interval_;
+    stdx::optional<std::time_t> next_expiry = ledger_.NextExpiry();
+    if (next_expiry) {
+      std::time_t now = time(NULL);
+      wait = std::min(wait, std::chrono::seconds(
+          *next_expiry > now ? *next_expiry - now : 1));
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopped_.wait_for(lock, wait, [this] { return !running_; });
+  }
+}
+
+}
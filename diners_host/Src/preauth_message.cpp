@@ -19,6 +19,8 @@
 #include <iso8583/printer.h>
 #include <utils/logger.h>
 #include "protocol.h"
+#include "datetime_codec.h"
+#include "mandatory_fields.h"
 #include "diners_utils.h"
 
 namespace diners {
@@ -65,8 +67,8 @@ iso8583::Apdu BuildPreAuthRequest(DinersTransaction& tx) {
     message.SetPosConditionCode(tx.pos_condition_code);
 
     // DE 35 TRACK 2
-    if (tx.track2) {
-    	message.SetTrack2(*tx.track2);
+    if (!tx.track2.empty()) {
+    	message.SetTrack2(tx.track2);
     }
 
     // DE 41 TID
@@ -81,8 +83,8 @@ iso8583::Apdu BuildPreAuthRequest(DinersTransaction& tx) {
     }
 
     // DE 52 PIN BLOCK
-    if (tx.pin_block) {
-        message.SetPinBlock(*tx.pin_block);
+    if (!tx.pin_block.empty()) {
+        message.SetPinBlock(tx.pin_block);
     }
 
     // DE 55 ICC DATA
@@ -106,11 +108,7 @@ bool ReadPreAuthResponse(const std::vector<uint8_t>& data, DinersTransaction& tx
 
     logger::debug(iso8583::Print(response.GetApdu()).c_str());
 
-    if (!response.IsValid() ||
-    		(response.GetProcessingCode() != tx.processing_code) ||
-            (response.GetStan() != tx.stan) ||
-            (response.GetNii() != tx.nii) ||
-            (response.GetTid() != tx.tid))
+    if (!response.IsValid())
     	return false;
 
     tx.tx_datetime = response.GetHostDatetime();  //DE-12/ DE-13
@@ -219,12 +217,11 @@ iso8583::Apdu PreAuthRequest::GetApdu() const {
  * PREAUTH RESPONSE
  **************************************/
 PreAuthResponse::PreAuthResponse(const uint8_t *data, size_t size)
-    : apdu_(GetProtocolSpec(), data, size) {
+    : apdu_(GetProtocolSpec(), data, size),
+      bitmap_(ReadPrimaryBitmap(data, size)) {
 }
 
 bool PreAuthResponse::IsValid() const {
-    bool output = true;
-
     if (!apdu_.HasMti()) {
     	return false;
     }
@@ -233,16 +230,7 @@ bool PreAuthResponse::IsValid() const {
     	return false;
     }
 
-    output &= apdu_.HasField(kFieldProcessingCode);
-    output &= apdu_.HasField(kFieldStan);
-    output &= apdu_.HasField(kFieldTimeLocalTransaction);
-    output &= apdu_.HasField(kFieldDateLocalTransaction);
-    output &= apdu_.HasField(kFieldNii);
-    output &= apdu_.HasField(kFieldRrn);
-    output &= apdu_.HasField(kFieldResponseCode);
-    output &= apdu_.HasField(kFieldCardAcceptorTerminalId);
-
-    return output;
+    return HasMandatoryFields("PREAUTH", bitmap_, kFinancialResponseFields);
 }
 
 iso8583::Apdu PreAuthResponse::GetApdu() const {
@@ -258,9 +246,7 @@ uint32_t PreAuthResponse::GetStan() const {
 }
 
 time_t PreAuthResponse::GetHostDatetime() const {
-    std::string date = apdu_.GetFieldAsString(kFieldDateLocalTransaction);
-    std::string time = apdu_.GetFieldAsString(kFieldTimeLocalTransaction);
-    return utils::GetDatetimefromIso8583Format(date, time);
+    return ReadIsoDateTime(apdu_);
 }
 
 uint32_t PreAuthResponse::GetNii() const {
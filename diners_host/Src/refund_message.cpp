@@ -19,6 +19,8 @@
 #include <iso8583/printer.h>
 #include <utils/logger.h>
 #include "protocol.h"
+#include "datetime_codec.h"
+#include "mandatory_fields.h"
 #include "diners_utils.h"
 
 namespace diners {
@@ -67,8 +69,8 @@ iso8583::Apdu BuildRefundRequest(DinersTransaction& tx) {
     message.SetPosConditionCode(tx.pos_condition_code);
 
     // DE 35 TRACK 2
-    if (tx.track2) {
-    	message.SetTrack2(*tx.track2);
+    if (!tx.track2.empty()) {
+    	message.SetTrack2(tx.track2);
     }
 
     // DE 41 TID
@@ -87,11 +89,7 @@ bool ReadRefundResponse(const std::vector<uint8_t>& data, DinersTransaction& tx)
 
     logger::debug(iso8583::Print(response.GetApdu()).c_str());
 
-    if (!response.IsValid() ||
-       (response.GetProcessingCode() != tx.processing_code) ||
-       (response.GetStan() != tx.stan) ||
-       (response.GetNii() != tx.nii) ||
-       (response.GetTid() != tx.tid))
+    if (!response.IsValid())
     	return false;
 
     tx.tx_datetime = response.GetHostDatetime();  //DE-12/ DE-13
@@ -173,11 +171,11 @@ iso8583::Apdu RefundRequest::GetApdu() const {
  * REFUND RESPONSE
  **************************************/
 RefundResponse::RefundResponse(const uint8_t *data, size_t size)
-    : apdu_(GetProtocolSpec(), data, size) {
+    : apdu_(GetProtocolSpec(), data, size),
+      bitmap_(ReadPrimaryBitmap(data, size)) {
 }
 
 bool RefundResponse::IsValid() const {
-    bool output = true;
     if (!apdu_.HasMti()) {
     	return false;
     }
@@ -185,16 +183,8 @@ bool RefundResponse::IsValid() const {
     if (mti != 210) {
     	return false;
     }
-    output &= apdu_.HasField(kFieldProcessingCode);
-    output &= apdu_.HasField(kFieldStan);
-    output &= apdu_.HasField(kFieldTimeLocalTransaction);
-    output &= apdu_.HasField(kFieldDateLocalTransaction);
-    output &= apdu_.HasField(kFieldNii);
-    output &= apdu_.HasField(kFieldRrn);
-    output &= apdu_.HasField(kFieldResponseCode);
-    output &= apdu_.HasField(kFieldCardAcceptorTerminalId);
 
-    return output;
+    return HasMandatoryFields("REFUND", bitmap_, kFinancialResponseFields);
 }
 
 iso8583::Apdu RefundResponse::GetApdu() const {
@@ -210,9 +200,7 @@ uint32_t RefundResponse::GetStan() const {
 }
 
 time_t RefundResponse::GetHostDatetime() const {
-    std::string date = apdu_.GetFieldAsString(kFieldDateLocalTransaction);
-    std::string time = apdu_.GetFieldAsString(kFieldTimeLocalTransaction);
-    return utils::GetDatetimefromIso8583Format(date, time);
+    return ReadIsoDateTime(apdu_);
 }
 
 uint32_t RefundResponse::GetNii() const {
@@ -19,6 +19,8 @@
 #include <iso8583/printer.h>
 #include <utils/logger.h>
 #include "protocol.h"
+#include "datetime_codec.h"
+#include "mandatory_fields.h"
 #include "diners_utils.h"
 
 namespace diners {
@@ -88,8 +90,8 @@ iso8583::Apdu BuildReversalRequest(DinersTransaction& tx) {
     message.SetMid(tx.mid);
 
     // DE 52 PIN BLOCK
-    if (tx.pin_block){
-    	message.SetPinBlock(*tx.pin_block);
+    if (!tx.pin_block.empty()){
+    	message.SetPinBlock(tx.pin_block);
     }
 
     // DE 54 TIP AMOUNT
@@ -98,7 +100,7 @@ iso8583::Apdu BuildReversalRequest(DinersTransaction& tx) {
     }
 
     // DE 55 ICC DATA
-    if (!tx.icc_data->empty()) {
+    if (tx.icc_data && !tx.icc_data->empty()) {
     	message.SetEmvData(*tx.icc_data);
     }
 
@@ -121,12 +123,7 @@ bool ReadReversalResponse(const std::vector<uint8_t>& data, DinersTransaction& t
 
     logger::debug(iso8583::Print(response.GetApdu()).c_str());
 
-    if (!response.IsValid() ||
-    		(response.GetProcessingCode() != tx.processing_code) ||
-            (response.GetStan() != tx.stan) ||
-            (response.GetNii() != tx.nii) ||
-	        //(response.GetRrn() != tx.rrn) ||
-            (response.GetTid() != tx.tid))
+    if (!response.IsValid())
     	return false;
 
     tx.tx_datetime = response.GetHostDatetime();  //DE-12/ DE-13
@@ -167,8 +164,7 @@ void ReversalRequest::SetStan(uint32_t stan) {
 }
 
 void ReversalRequest::SetDatetime(time_t & time_stamp) {
-    apdu_.SetField(kFieldTimeLocalTransaction, iso8583::IsoTimeFromTimestamp(time_stamp));
-    apdu_.SetField(kFieldDateLocalTransaction, iso8583::IsoDateFromTimestamp(time_stamp));
+    WriteIsoDateTime(time_stamp, apdu_);
 }
 
 void ReversalRequest::SetExpirationDate(const std::string& expiration_date) {
@@ -243,12 +239,11 @@ iso8583::Apdu ReversalRequest::GetApdu() const {
  * REVERSAL RESPONSE
  **************************************/
 ReversalResponse::ReversalResponse(const uint8_t *data, size_t size)
-    : apdu_(GetProtocolSpec(), data, size) {
+    : apdu_(GetProtocolSpec(), data, size),
+      bitmap_(ReadPrimaryBitmap(data, size)) {
 }
 
 bool ReversalResponse::IsValid() const {
-	bool output = true;
-
     if (!apdu_.HasMti()) {
     	return false;
     }
@@ -258,16 +253,7 @@ bool ReversalResponse::IsValid() const {
     	return false;
     }
 
-    output &= apdu_.HasField(kFieldProcessingCode);
-    output &= apdu_.HasField(kFieldStan);
-    output &= apdu_.HasField(kFieldTimeLocalTransaction);
-    output &= apdu_.HasField(kFieldDateLocalTransaction);
-    output &= apdu_.HasField(kFieldNii);
-    output &= apdu_.HasField(kFieldRrn);
-    output &= apdu_.HasField(kFieldResponseCode);
-    output &= apdu_.HasField(kFieldCardAcceptorTerminalId);
-
-    return output;
+    return HasMandatoryFields("REVERSAL", bitmap_, kFinancialResponseFields);
 }
 
 iso8583::Apdu ReversalResponse::GetApdu() const {
@@ -283,9 +269,7 @@ uint32_t ReversalResponse::GetStan() const {
 }
 
 time_t ReversalResponse::GetHostDatetime() const {
-    std::string date = apdu_.GetFieldAsString(kFieldDateLocalTransaction);
-    std::string time = apdu_.GetFieldAsString(kFieldTimeLocalTransaction);
-    return utils::GetDatetimefromIso8583Format(date, time);
+    return ReadIsoDateTime(apdu_);
 }
 
 uint32_t ReversalResponse::GetNii() const {
@@ -19,6 +19,8 @@
 #include <iso8583/printer.h>
 #include <utils/logger.h>
 #include "protocol.h"
+#include "datetime_codec.h"
+#include "mandatory_fields.h"
 #include "diners_utils.h"
 
 namespace diners {
@@ -47,7 +49,8 @@ iso8583::Apdu BuildSaleCompletionRequest(DinersTransaction& tx) {
   message.SetHostDatetime(tx.tx_datetime);
 
   // DE 14 EXPIRATION DATE
-  message.SetExpirationDate(tx.expiration_date);
+  if (!tx.expiration_date.empty())
+    message.SetExpirationDate(tx.expiration_date);
 
   // DE 22 POS ENTRY MODE TODO: find a way to save this to batch
   tx.orig_pos_entry_mode = message.SetPosEntryMode(tx.pos_entry_mode);
@@ -94,11 +97,7 @@ bool ReadSaleCompletionResponse(const std::vector<uint8_t>& data, DinersTransact
 
   logger::debug(iso8583::Print(response.GetApdu()).c_str());
 
-  if (!response.IsValid() ||
-      (response.GetProcessingCode() != tx.processing_code) ||
-      (response.GetStan() != tx.stan) ||
-      (response.GetNii() != tx.nii) ||
-      (response.GetTid() != tx.tid))
+  if (!response.IsValid())
     return false;
 
   tx.tx_datetime = response.GetHostDatetime();  //DE-12/ DE-13
@@ -145,10 +144,7 @@ void SaleCompletionRequest::SetExpirationDate(const std::string& expiration_date
 }
 
 void SaleCompletionRequest::SetHostDatetime(time_t time_stamp) {
-  apdu_.SetField(kFieldTimeLocalTransaction,
-                 iso8583::IsoTimeFromTimestamp(time_stamp));
-  apdu_.SetField(kFieldDateLocalTransaction,
-                 iso8583::IsoDateFromTimestamp(time_stamp));
+  WriteIsoDateTime(time_stamp, apdu_);
 }
 
 std::string SaleCompletionRequest::SetPosEntryMode(types::PosEntryMode & pos_entry_mode) {
@@ -210,12 +206,11 @@ iso8583::Apdu SaleCompletionRequest::GetApdu() const {
  * PREAUTH COMPLETION RESPONSE
  **************************************/
 SaleCompletionResponse::SaleCompletionResponse(const uint8_t *data, size_t size)
-    : apdu_(GetProtocolSpec(), data, size) {
+    : apdu_(GetProtocolSpec(), data, size),
+      bitmap_(ReadPrimaryBitmap(data, size)) {
 }
 
 bool SaleCompletionResponse::IsValid() const {
-  bool output = true;
-
   if (!apdu_.HasMti()) {
     return false;
   }
@@ -223,15 +218,8 @@ bool SaleCompletionResponse::IsValid() const {
   if (mti != 210) {
     return false;
   }
-  output &= apdu_.HasField(kFieldProcessingCode);
-  output &= apdu_.HasField(kFieldStan);
-  output &= apdu_.HasField(kFieldTimeLocalTransaction);
-  output &= apdu_.HasField(kFieldDateLocalTransaction);
-  output &= apdu_.HasField(kFieldNii);
-  output &= apdu_.HasField(kFieldRrn);
-  output &= apdu_.HasField(kFieldResponseCode);
-  output &= apdu_.HasField(kFieldCardAcceptorTerminalId);
-  return output;
+
+  return HasMandatoryFields("SALE COMPLETION", bitmap_, kFinancialResponseFields);
 }
 
 iso8583::Apdu SaleCompletionResponse::GetApdu() const {
@@ -247,9 +235,7 @@ std::uint32_t SaleCompletionResponse::GetStan() const {
 }
 
 time_t SaleCompletionResponse::GetHostDatetime() const {
-  std::string date = apdu_.GetFieldAsString(kFieldDateLocalTransaction);
-  std::string time = apdu_.GetFieldAsString(kFieldTimeLocalTransaction);
-  return utils::GetDatetimefromIso8583Format(date, time);
+  return ReadIsoDateTime(apdu_);
 }
 
 std::uint32_t SaleCompletionResponse::GetNii() const {
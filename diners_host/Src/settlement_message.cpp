@@ -14,11 +14,14 @@
  ------------------------------------------------------------------------------
  */
 #include "settlement_message.h"
+#include <cstdlib>
 #include <utils/converter.h>
 #include <iso8583/encoder.h>
 #include <iso8583/printer.h>
 #include <utils/logger.h>
 #include "protocol.h"
+#include "datetime_codec.h"
+#include "mandatory_fields.h"
 #include "diners_utils.h"
 
 namespace diners {
@@ -57,11 +60,7 @@ bool ReadSettlementResponse(const std::vector<uint8_t>& data, DinersSettlementDa
 
   logger::debug(iso8583::Print(response.GetApdu()).c_str());
 
-  if (!response.IsValid() ||
-      (response.GetProcessingCode() != settle_msg.processing_code) ||
-      (response.GetStan() != settle_msg.stan) ||
-      (response.GetNii() != settle_msg.nii) ||
-      (response.GetTid() != settle_msg.tid))
+  if (!response.IsValid())
     return false;
 
   settle_msg.tx_datetime = response.GetHostDatetime();
@@ -70,6 +69,8 @@ bool ReadSettlementResponse(const std::vector<uint8_t>& data, DinersSettlementDa
 
   settle_msg.rrn = response.GetRrn();                           //DE-37
 
+  settle_msg.host_batch_summary = response.GetBatchTotal();     //DE-63
+
   return true;
 }
 
@@ -139,12 +140,11 @@ iso8583::Apdu SettlementRequest::GetApdu() const {
  * SETTLEMENT RESPONSE
  **************************************/
 SettlementResponse::SettlementResponse(const uint8_t *data, size_t size)
-    : apdu_(GetProtocolSpec(), data, size) {
+    : apdu_(GetProtocolSpec(), data, size),
+      bitmap_(ReadPrimaryBitmap(data, size)) {
 }
 
 bool SettlementResponse::IsValid() const {
-  bool output = true;
-
   if (!apdu_.HasMti()) {
     return false;
   }
@@ -152,15 +152,8 @@ bool SettlementResponse::IsValid() const {
   if (mti != 510) {
     return false;
   }
-  output &= apdu_.HasField(kFieldProcessingCode);
-  output &= apdu_.HasField(kFieldStan);
-  output &= apdu_.HasField(kFieldTimeLocalTransaction);
-  output &= apdu_.HasField(kFieldDateLocalTransaction);
-  output &= apdu_.HasField(kFieldNii);
-  output &= apdu_.HasField(kFieldRrn);
-  output &= apdu_.HasField(kFieldResponseCode);
-  output &= apdu_.HasField(kFieldCardAcceptorTerminalId);
-  return output;
+
+  return HasMandatoryFields("SETTLEMENT", bitmap_, kFinancialResponseFields);
 }
 
 iso8583::Apdu SettlementResponse::GetApdu() const {
@@ -176,9 +169,7 @@ uint32_t SettlementResponse::GetStan() const {
 }
 
 time_t SettlementResponse::GetHostDatetime() const {
-  std::string date = apdu_.GetFieldAsString(kFieldDateLocalTransaction);
-  std::string time = apdu_.GetFieldAsString(kFieldTimeLocalTransaction);
-  return utils::GetDatetimefromIso8583Format(date, time);
+  return ReadIsoDateTime(apdu_);
 }
 
 uint32_t SettlementResponse::GetNii() const {
@@ -197,4 +188,25 @@ std::string SettlementResponse::GetTid() const {
   return apdu_.GetFieldAsString(kFieldCardAcceptorTerminalId);
 }
 
+// Same layout as the request: sales count and total, refunds count and total
+stdx::optional<BatchTotalsForDinersHost> SettlementResponse::GetBatchTotal() const {
+  if ((bitmap_ & FieldBit(kField63)) == 0)
+    return stdx::nullopt;
+
+  std::vector<uint8_t> field_content = apdu_.GetFieldAsBytes(kField63);
+  std::string totals(field_content.begin(), field_content.end());
+  if (totals.size() < 30
+      || totals.find_first_not_of("0123456789") < 30)
+    return stdx::nullopt;
+
+  BatchTotalsForDinersHost batch_totals;
+  batch_totals.sales_total = BatchTotal(
+      std::strtoul(totals.substr(0, 3).c_str(), NULL, 10),
+      std::strtoull(totals.substr(3, 12).c_str(), NULL, 10));
+  batch_totals.refunds_total = BatchTotal(
+      std::strtoul(totals.substr(15, 3).c_str(), NULL, 10),
+      std::strtoull(totals.substr(18, 12).c_str(), NULL, 10));
+  return batch_totals;
+}
+
 }
@@ -16,6 +16,8 @@
 
 #include "tc_upload_message.h"
 #include "protocol.h"
+#include "datetime_codec.h"
+#include "mandatory_fields.h"
 #include "diners_utils.h"
 #include <iso8583/field_types.h>
 #include <iso8583/encoder.h>
@@ -88,12 +90,7 @@ iso8583::Apdu BuildTcUploadRequest(DinersTransaction& tx) {
 bool ReadTcUploadResponse(const std::vector<uint8_t>& data, DinersTransaction& tx) {
   TcUploadResponse response(data.data(), data.size());
   logger::debug(iso8583::Print(response.GetApdu()).c_str());
-  if (!response.IsValid() ||
-      (response.GetProcessingCode() != tx.processing_code) ||
-      (response.GetStan() != tx.stan) ||
-      (response.GetNii() != tx.nii) ||
-	  //(response.GetRrn() != tx.rrn)||
-      (response.GetTid() != tx.tid))
+  if (!response.IsValid())
     return false;
 
   tx.tx_datetime = response.GetHostDatetime();  //DE-12/ DE-13
@@ -127,10 +124,7 @@ void TcUploadRequest::SetStan(uint32_t stan) {
 }
 
 void TcUploadRequest::SetHostDatetime(time_t time_stamp) {
-  apdu_.SetField(kFieldTimeLocalTransaction,
-                 iso8583::IsoTimeFromTimestamp(time_stamp));
-  apdu_.SetField(kFieldDateLocalTransaction,
-                 iso8583::IsoDateFromTimestamp(time_stamp));
+  WriteIsoDateTime(time_stamp, apdu_);
 }
 
 std::string TcUploadRequest::SetPosEntryMode(types::PosEntryMode & pos_entry_mode) {
@@ -187,12 +181,11 @@ iso8583::Apdu TcUploadRequest::GetApdu() const {
  * TRANSACTION CERTIFICATE UPLOAD RESPONSE
  **************************************/
 TcUploadResponse::TcUploadResponse(const uint8_t *data, size_t size)
-    : apdu_(GetProtocolSpec(), data, size) {
+    : apdu_(GetProtocolSpec(), data, size),
+      bitmap_(ReadPrimaryBitmap(data, size)) {
 }
 
 bool TcUploadResponse::IsValid() const {
-  bool output = true;
-
   if (!apdu_.HasMti()) {
     return false;
   }
@@ -200,16 +193,8 @@ bool TcUploadResponse::IsValid() const {
   if (mti != 330) {
     return false;
   }
-  output &= apdu_.HasField(kFieldProcessingCode);
-  output &= apdu_.HasField(kFieldStan);
-  output &= apdu_.HasField(kFieldTimeLocalTransaction);
-  output &= apdu_.HasField(kFieldDateLocalTransaction);
-  output &= apdu_.HasField(kFieldNii);
-  output &= apdu_.HasField(kFieldRrn);
-  output &= apdu_.HasField(kFieldResponseCode);
-  output &= apdu_.HasField(kFieldCardAcceptorTerminalId);
 
-  return output;
+  return HasMandatoryFields("TC UPLOAD", bitmap_, kFinancialResponseFields);
 }
 
 iso8583::Apdu TcUploadResponse::GetApdu() const {
@@ -225,9 +210,7 @@ uint32_t TcUploadResponse::GetStan() const {
 }
 
 time_t TcUploadResponse::GetHostDatetime() const {
-  std::string date = apdu_.GetFieldAsString(kFieldDateLocalTransaction);
-  std::string time = apdu_.GetFieldAsString(kFieldTimeLocalTransaction);
-  return utils::GetDatetimefromIso8583Format(date, time);
+  return ReadIsoDateTime(apdu_);
 }
 
 uint32_t TcUploadResponse::GetNii() const {
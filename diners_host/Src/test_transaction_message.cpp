@@ -17,6 +17,8 @@
 #include <diners/test_transaction.h>
 #include "test_transaction_message.h"
 #include "protocol.h"
+#include "datetime_codec.h"
+#include "mandatory_fields.h"
 #include <iso8583/field_types.h>
 #include <iso8583/encoder.h>
 #include <utils/converter.h>
@@ -51,10 +53,7 @@ iso8583::Apdu BuildEchoTestRequest(TestTransaction& tx) {
 bool ReadEchoTestResponse(const std::vector<uint8_t>& data, TestTransaction& tx) {
   EchoTestResponse response(data.data(), data.size());
   logger::debug(iso8583::Print(response.GetApdu()).c_str());
-  if (!response.IsValid() ||
-      (response.GetProcessingCode() != tx.processing_code) ||
-      (response.GetNii() != tx.nii)||
-      (response.GetTid() != tx.tid))
+  if (!response.IsValid())
     return false;
 
   tx.host_datetime = response.GetHostDatetime();  //DE-12/ DE-13
@@ -92,12 +91,11 @@ iso8583::Apdu EchoTestRequest::GetApdu() const {
  * ECHO TEST RESPONSE
  **************************************/
 EchoTestResponse::EchoTestResponse(const uint8_t *data, size_t size)
-    : apdu_(GetProtocolSpec(), data, size) {
+    : apdu_(GetProtocolSpec(), data, size),
+      bitmap_(ReadPrimaryBitmap(data, size)) {
 }
 
 bool EchoTestResponse::IsValid() const {
-  bool output = true;
-
   if (!apdu_.HasMti()) {
     return false;
   }
@@ -105,13 +103,8 @@ bool EchoTestResponse::IsValid() const {
   if (mti != 810) {
     return false;
   }
-  output &= apdu_.HasField(kFieldProcessingCode);
-  output &= apdu_.HasField(kFieldTimeLocalTransaction);
-  output &= apdu_.HasField(kFieldDateLocalTransaction);
-  output &= apdu_.HasField(kFieldNii);
-  output &= apdu_.HasField(kFieldCardAcceptorTerminalId);
 
-  return output;
+  return HasMandatoryFields("ECHO TEST", bitmap_, kEchoTestResponseFields);
 }
 
 iso8583::Apdu EchoTestResponse::GetApdu() const {
@@ -123,9 +116,7 @@ std::string EchoTestResponse::GetProcessingCode() const {
 }
 
 time_t EchoTestResponse::GetHostDatetime() const {
-  std::string date = apdu_.GetFieldAsString(kFieldDateLocalTransaction);
-  std::string time = apdu_.GetFieldAsString(kFieldTimeLocalTransaction);
-  return utils::GetDatetimefromIso8583Format(date, time);
+  return ReadIsoDateTime(apdu_);
 }
 
 uint32_t EchoTestResponse::GetNii() const {
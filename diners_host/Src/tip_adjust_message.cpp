@@ -20,6 +20,8 @@
 #include <iso8583/printer.h>
 #include <utils/logger.h>
 #include "protocol.h"
+#include "datetime_codec.h"
+#include "mandatory_fields.h"
 #include "diners_utils.h"
 
 using namespace types;
@@ -47,7 +49,8 @@ iso8583::Apdu BuildTipAdjustRequest(DinersTransaction& tx) {
     message.SetHostDatetime(stdx::time(nullptr));
 
     // DE 14 EXPIRATION DATE
-    message.SetExpirationDate(tx.expiration_date);
+    if (!tx.expiration_date.empty())
+      message.SetExpirationDate(tx.expiration_date);
 
     // DE 22 POS ENTRY MODE
     message.SetPosEntryMode(tx.pos_entry_mode);
@@ -102,12 +105,7 @@ bool ReadTipAdjustResponse(const std::vector<uint8_t>& data, DinersTransaction&
 
     logger::debug(iso8583::Print(response.GetApdu()).c_str());
 
-    if (!response.IsValid() ||
-    		(response.GetProcessingCode()!=tx.processing_code)||
-            (response.GetStan() != tx.stan) ||
-            (response.GetNii() != tx.nii) ||
-	        //(response.GetRrn() != tx.rrn)||
-            (response.GetTid() != tx.tid))
+    if (!response.IsValid())
     	return false;
 
     tx.response_code = response.GetResponseCode();       //DE-39
@@ -152,8 +150,7 @@ void TipAdjustRequest::SetExpirationDate(const std::string& expiration_date) {
 }
 
 void TipAdjustRequest::SetHostDatetime(time_t time_stamp) {
-    apdu_.SetField(kFieldTimeLocalTransaction, iso8583::IsoTimeFromTimestamp(time_stamp));
-    apdu_.SetField(kFieldDateLocalTransaction, iso8583::IsoDateFromTimestamp(time_stamp));
+    WriteIsoDateTime(time_stamp, apdu_);
 }
 
 void TipAdjustRequest::SetPosEntryMode(types::PosEntryMode & pos_entry_mode) {
@@ -219,12 +216,11 @@ iso8583::Apdu TipAdjustRequest::GetApdu() const {
  * TIP ADJUST RESPONSE
  **************************************/
 TipAdjustResponse::TipAdjustResponse(const uint8_t *data, size_t size)
-    : apdu_(GetProtocolSpec(), data, size) {
+    : apdu_(GetProtocolSpec(), data, size),
+      bitmap_(ReadPrimaryBitmap(data, size)) {
 }
 
 bool TipAdjustResponse::IsValid() const {
-	bool output = true;
-
     if (!apdu_.HasMti()) {
     	return false;
     }
@@ -233,13 +229,7 @@ bool TipAdjustResponse::IsValid() const {
     	return false;
     }
 
-    output &= apdu_.HasField(kFieldProcessingCode);
-    output &= apdu_.HasField(kFieldStan);
-    output &= apdu_.HasField(kFieldNii);
-    output &= apdu_.HasField(kFieldRrn);
-    output &= apdu_.HasField(kFieldResponseCode);
-    output &= apdu_.HasField(kFieldCardAcceptorTerminalId);
-    return output;
+    return HasMandatoryFields("TIP ADJUST", bitmap_, kAdviceResponseFields);
 }
 
 iso8583::Apdu TipAdjustResponse::GetApdu() const {
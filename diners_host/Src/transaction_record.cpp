@@ -0,0 +1,540 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <diners/transaction_record.h>
+#include <cstring>
+#include "diners_utils.h"
+
+namespace diners {
+
+namespace {
+const char kTransactionMagic[4] = { 'D', 'T', 'R', 'X' };
+
+// Oldest reader version able to read the records written by this one
+const std::uint16_t kCompatibleVersion = 1;
+
+const std::size_t kMaxRecordSize = 0xFFFF;
+
+// Record header
+enum HeaderLayout {
+  HEADER_MAGIC = 0,
+  HEADER_VERSION = 4,
+  HEADER_COMPATIBLE_VERSION = 6,
+  HEADER_FIXED_SIZE = 8,
+  HEADER_FLAGS = 10,
+  HEADER_RECORD_SIZE = 12,
+  HEADER_SIZE = 16
+};
+
+// Fixed part of a transaction record. Variable fields are (16-bit offset,
+// 16-bit size) slots. New fields go before TX_FIXED_SIZE, never elsewhere.
+enum TransactionLayout {
+  TX_STAN = HEADER_SIZE,
+  TX_INVOICE_NUMBER = 20,
+  TX_BATCH_NUMBER = 24,
+  TX_NII = 28,
+  TX_DATETIME = 32,
+  TX_AMOUNT = 40,
+  TX_ADDITIONAL_AMOUNT = 48,
+  TX_ORIGINAL_ADDITIONAL_AMOUNT = 56,
+  TX_PREAUTH_AMOUNT = 64,
+  TX_CURRENCY = 72,
+  TX_TYPE = 76,
+  TX_STATUS = 77,
+  TX_PREVIOUS_STATUS = 78,
+  TX_IN_PROGRESS_STATUS = 79,
+  TX_POS_ENTRY_MODE = 80,
+  TX_POS_CONDITION_CODE = 81,
+  TX_PAN_SEQUENCE_NUMBER = 82,
+  TX_PAN = 84,
+  TX_EXPIRATION_DATE = 88,
+  TX_RRN = 92,
+  TX_AUTH_ID_RESPONSE = 96,
+  TX_RESPONSE_CODE = 100,
+  TX_PROCESSING_CODE = 104,
+  TX_TID = 108,
+  TX_MID = 112,
+  TX_TPDU = 116,
+  TX_ORIG_POS_ENTRY_MODE = 120,
+  TX_CARDHOLDER_NAME = 124,
+  TX_ICC_DATA = 128,
+  TX_ISSUER_EMV_RESPONSE = 132,
+  TX_CVV = 136,
+  TX_PIN_BLOCK = 140,
+  TX_TRACK2 = 144,
+  TX_TRACK1_DATA = 148,
+  TX_PAN_TOKEN = 152,  // version 2
+  TX_FIXED_SIZE = 156
+};
+
+enum TransactionFlag {
+  HAS_AMOUNT = 1 << 0,
+  HAS_ADDITIONAL_AMOUNT = 1 << 1,
+  HAS_ORIGINAL_ADDITIONAL_AMOUNT = 1 << 2,
+  HAS_PREAUTH_AMOUNT = 1 << 3,
+  HAS_PAN_SEQUENCE_NUMBER = 1 << 4,
+  HAS_PAN = 1 << 5,  // TX_PAN is the full PAN, not its last four digits
+  HAS_ICC_DATA = 1 << 6,
+  HAS_CARD_DATA = 1 << 7,
+  IS_ADJUSTED = 1 << 8,
+  IS_PREAUTH_COMPLETED = 1 << 9
+};
+
+std::uint64_t LoadLe(const std::uint8_t* in, std::size_t size) {
+  std::uint64_t value = 0;
+  for (std::size_t i = size; i > 0; i--)
+    value = (value << 8) | in[i - 1];
+  return value;
+}
+
+void StoreLe(std::uint8_t* out, std::size_t size, std::uint64_t value) {
+  for (std::size_t i = 0; i < size; i++, value >>= 8)
+    out[i] = std::uint8_t(value & 0xFF);
+}
+
+// Builds a record: the fixed part first, the variable fields appended as
+// they are put
+class RecordWriter {
+ public:
+  RecordWriter(const char* magic, std::size_t fixed_size)
+      : record_(fixed_size, 0),
+        flags_(0),
+        overflow_(false) {
+    std::memcpy(&record_[HEADER_MAGIC], magic, 4);
+    Put16(HEADER_VERSION, kRecordVersion);
+    Put16(HEADER_COMPATIBLE_VERSION, kCompatibleVersion);
+    Put16(HEADER_FIXED_SIZE, fixed_size);
+  }
+
+  void Put8(std::size_t offset, std::uint8_t value) {
+    record_[offset] = value;
+  }
+
+  void Put16(std::size_t offset, std::uint16_t value) {
+    StoreLe(&record_[offset], 2, value);
+  }
+
+  void Put32(std::size_t offset, std::uint32_t value) {
+    StoreLe(&record_[offset], 4, value);
+  }
+
+  void Put64(std::size_t offset, std::uint64_t value) {
+    StoreLe(&record_[offset], 8, value);
+  }
+
+  void SetFlag(std::uint16_t flag) {
+    flags_ |= flag;
+  }
+
+  // Empty values take no room, their slot stays (0, 0)
+  void PutField(std::size_t slot, const std::uint8_t* data, std::size_t size) {
+    if (size == 0)
+      return;
+    if (record_.size() + size > kMaxRecordSize) {
+      overflow_ = true;
+      return;
+    }
+    Put16(slot, record_.size());
+    Put16(slot + 2, size);
+    record_.insert(record_.end(), data, data + size);
+  }
+
+  template<typename T>
+  void PutField(std::size_t slot, const T& value) {
+    PutField(slot, reinterpret_cast<const std::uint8_t*>(value.data()), value.size());
+  }
+
+  std::vector<std::uint8_t> Finish() {
+    if (overflow_)
+      return std::vector<std::uint8_t>();
+    Put16(HEADER_FLAGS, flags_);
+    Put32(HEADER_RECORD_SIZE, record_.size());
+    return std::move(record_);
+  }
+
+ private:
+  std::vector<std::uint8_t> record_;
+  std::uint16_t flags_;
+  bool overflow_;
+};
+
+void PutOptionalAmount(RecordWriter& record, std::size_t offset, TransactionFlag flag,
+                       const stdx::optional<types::Amount>& amount) {
+  if (!amount)
+    return;
+  record.SetFlag(flag);
+  record.Put64(offset, amount->GetValue());
+}
+
+stdx::optional<types::Amount> ToAmount(const std::string& currency,
+                                       const stdx::optional<std::uint64_t>& value) {
+  if (!value)
+    return stdx::nullopt;
+  return types::Amount(currency, *value);
+}
+
+}
+
+/**************************************
+ * RecordView
+ **************************************/
+RecordView::RecordView(const std::uint8_t* data, std::size_t size, const char* magic)
+    : data_(NULL),
+      size_(0),
+      fixed_size_(0) {
+  if (size < HEADER_SIZE || std::memcmp(data + HEADER_MAGIC, magic, 4) != 0)
+    return;
+  if (LoadLe(data + HEADER_COMPATIBLE_VERSION, 2) > kRecordVersion)
+    return;
+
+  std::size_t fixed_size = LoadLe(data + HEADER_FIXED_SIZE, 2);
+  std::size_t record_size = LoadLe(data + HEADER_RECORD_SIZE, 4);
+  if (fixed_size < HEADER_SIZE || fixed_size > record_size || record_size > size)
+    return;
+
+  data_ = data;
+  size_ = record_size;
+  fixed_size_ = fixed_size;
+}
+
+std::uint16_t RecordView::version() const {
+  return valid() ? LoadLe(data_ + HEADER_VERSION, 2) : 0;
+}
+
+bool RecordView::HasFlag(std::uint16_t flag) const {
+  return valid() && (LoadLe(data_ + HEADER_FLAGS, 2) & flag) != 0;
+}
+
+// Fields past the fixed part were added after the record was written
+std::uint8_t RecordView::Read8(std::size_t offset) const {
+  return offset + 1 <= fixed_size_ ? data_[offset] : 0;
+}
+
+std::uint16_t RecordView::Read16(std::size_t offset) const {
+  return offset + 2 <= fixed_size_ ? LoadLe(data_ + offset, 2) : 0;
+}
+
+std::uint32_t RecordView::Read32(std::size_t offset) const {
+  return offset + 4 <= fixed_size_ ? LoadLe(data_ + offset, 4) : 0;
+}
+
+std::uint64_t RecordView::Read64(std::size_t offset) const {
+  return offset + 8 <= fixed_size_ ? LoadLe(data_ + offset, 8) : 0;
+}
+
+FieldRef RecordView::Field(std::size_t slot) const {
+  std::size_t offset = Read16(slot);
+  std::size_t size = Read16(slot + 2);
+  if (size == 0 || offset < fixed_size_ || offset + size > size_)
+    return FieldRef();
+  return FieldRef(data_ + offset, size);
+}
+
+/**************************************
+ * TransactionView
+ **************************************/
+TransactionView::TransactionView(const std::uint8_t* data, std::size_t size)
+    : RecordView(data, size, kTransactionMagic) {
+}
+
+DinersTransactionType TransactionView::transaction_type() const {
+  return static_cast<DinersTransactionType>(Read8(TX_TYPE));
+}
+
+DinersTransactionStatus TransactionView::transaction_status() const {
+  return static_cast<DinersTransactionStatus>(Read8(TX_STATUS));
+}
+
+DinersTransactionStatus TransactionView::previous_transaction_status() const {
+  return static_cast<DinersTransactionStatus>(Read8(TX_PREVIOUS_STATUS));
+}
+
+DinersInProgressStatus TransactionView::in_progress_status() const {
+  return static_cast<DinersInProgressStatus>(Read8(TX_IN_PROGRESS_STATUS));
+}
+
+unsigned int TransactionView::stan() const {
+  return Read32(TX_STAN);
+}
+
+unsigned int TransactionView::invoice_number() const {
+  return Read32(TX_INVOICE_NUMBER);
+}
+
+unsigned int TransactionView::batch_number() const {
+  return Read32(TX_BATCH_NUMBER);
+}
+
+unsigned int TransactionView::nii() const {
+  return Read32(TX_NII);
+}
+
+time_t TransactionView::tx_datetime() const {
+  return static_cast<time_t>(static_cast<std::int64_t>(Read64(TX_DATETIME)));
+}
+
+bool TransactionView::is_adjusted() const {
+  return HasFlag(IS_ADJUSTED);
+}
+
+bool TransactionView::is_preauth_completed() const {
+  return HasFlag(IS_PREAUTH_COMPLETED);
+}
+
+std::string TransactionView::currency() const {
+  return UnpackCurrency(Read32(TX_CURRENCY));
+}
+
+stdx::optional<std::uint64_t> TransactionView::amount() const {
+  if (!HasFlag(HAS_AMOUNT))
+    return stdx::nullopt;
+  return Read64(TX_AMOUNT);
+}
+
+stdx::optional<std::uint64_t> TransactionView::additional_amount() const {
+  if (!HasFlag(HAS_ADDITIONAL_AMOUNT))
+    return stdx::nullopt;
+  return Read64(TX_ADDITIONAL_AMOUNT);
+}
+
+stdx::optional<std::uint64_t> TransactionView::original_additional_amount() const {
+  if (!HasFlag(HAS_ORIGINAL_ADDITIONAL_AMOUNT))
+    return stdx::nullopt;
+  return Read64(TX_ORIGINAL_ADDITIONAL_AMOUNT);
+}
+
+stdx::optional<std::uint64_t> TransactionView::preauth_amount() const {
+  if (!HasFlag(HAS_PREAUTH_AMOUNT))
+    return stdx::nullopt;
+  return Read64(TX_PREAUTH_AMOUNT);
+}
+
+types::PosEntryMode TransactionView::pos_entry_mode() const {
+  return static_cast<types::PosEntryMode>(Read8(TX_POS_ENTRY_MODE));
+}
+
+types::PosConditionCode TransactionView::pos_condition_code() const {
+  return static_cast<types::PosConditionCode>(Read8(TX_POS_CONDITION_CODE));
+}
+
+stdx::optional<unsigned int> TransactionView::pan_sequence_number() const {
+  if (!HasFlag(HAS_PAN_SEQUENCE_NUMBER))
+    return stdx::nullopt;
+  return static_cast<unsigned int>(Read16(TX_PAN_SEQUENCE_NUMBER));
+}
+
+FieldRef TransactionView::pan() const {
+  return Field(TX_PAN);
+}
+
+FieldRef TransactionView::pan_token() const {
+  return Field(TX_PAN_TOKEN);
+}
+
+FieldRef TransactionView::expiration_date() const {
+  return Field(TX_EXPIRATION_DATE);
+}
+
+FieldRef TransactionView::rrn() const {
+  return Field(TX_RRN);
+}
+
+FieldRef TransactionView::auth_id_response() const {
+  return Field(TX_AUTH_ID_RESPONSE);
+}
+
+FieldRef TransactionView::response_code() const {
+  return Field(TX_RESPONSE_CODE);
+}
+
+FieldRef TransactionView::processing_code() const {
+  return Field(TX_PROCESSING_CODE);
+}
+
+FieldRef TransactionView::tid() const {
+  return Field(TX_TID);
+}
+
+FieldRef TransactionView::mid() const {
+  return Field(TX_MID);
+}
+
+FieldRef TransactionView::tpdu() const {
+  return Field(TX_TPDU);
+}
+
+FieldRef TransactionView::orig_pos_entry_mode() const {
+  return Field(TX_ORIG_POS_ENTRY_MODE);
+}
+
+FieldRef TransactionView::cardholder_name() const {
+  return Field(TX_CARDHOLDER_NAME);
+}
+
+bool TransactionView::has_icc_data() const {
+  return HasFlag(HAS_ICC_DATA);
+}
+
+FieldRef TransactionView::icc_data() const {
+  return Field(TX_ICC_DATA);
+}
+
+FieldRef TransactionView::issuer_emv_response() const {
+  return Field(TX_ISSUER_EMV_RESPONSE);
+}
+
+bool TransactionView::has_card_data() const {
+  return HasFlag(HAS_CARD_DATA);
+}
+
+FieldRef TransactionView::cvv() const {
+  return Field(TX_CVV);
+}
+
+FieldRef TransactionView::pin_block() const {
+  return Field(TX_PIN_BLOCK);
+}
+
+FieldRef TransactionView::track2() const {
+  return Field(TX_TRACK2);
+}
+
+FieldRef TransactionView::track1_data() const {
+  return Field(TX_TRACK1_DATA);
+}
+
+void TransactionView::Load(DinersTransaction& tx) const {
+  std::string amount_currency = currency();
+
+  tx.transaction_type = transaction_type();
+  tx.transaction_status = transaction_status();
+  tx.previous_transaction_status = previous_transaction_status();
+  tx.in_progress_status = in_progress_status();
+  tx.stan = stan();
+  tx.invoice_number = invoice_number();
+  tx.batch_number = batch_number();
+  tx.nii = nii();
+  tx.is_preauth_completed = is_preauth_completed();
+  tx.is_adjusted = is_adjusted();
+  tx.tx_datetime = tx_datetime();
+  tx.amount = ToAmount(amount_currency, amount());
+  tx.additional_amount = ToAmount(amount_currency, additional_amount());
+  tx.original_additional_amount = ToAmount(amount_currency, original_additional_amount());
+  tx.preauth_amount = ToAmount(amount_currency, preauth_amount());
+
+  tx.rrn = rrn().str();
+  tx.auth_id_response = auth_id_response().str();
+  tx.response_code = response_code().str();
+  tx.processing_code = processing_code().str();
+  tx.tid = tid().str();
+  tx.mid = mid().str();
+  tx.tpdu = tpdu().str();
+  tx.pos_entry_mode = pos_entry_mode();
+  tx.pos_condition_code = pos_condition_code();
+  tx.orig_pos_entry_mode = orig_pos_entry_mode().str();
+
+  tx.pan = stdx::nullopt;
+  if (HasFlag(HAS_PAN))
+    tx.pan = types::Pan(pan().str());
+  tx.expiration_date = expiration_date().str();
+  tx.pan_sequence_number = pan_sequence_number();
+  tx.cvv = cvv().str();
+  tx.pin_block = pin_block().bytes();
+  tx.track2 = track2().bytes();
+  tx.track1_data = track1_data().str();
+  tx.cardholder_name = cardholder_name().str();
+  tx.icc_data = stdx::nullopt;
+  if (has_icc_data())
+    tx.icc_data = icc_data().bytes();
+  tx.issuer_emv_response = issuer_emv_response().bytes();
+}
+
+/**************************************
+ * Encoding
+ **************************************/
+std::vector<std::uint8_t> EncodeTransaction(const DinersTransaction& tx,
+                                            const std::string& currency,
+                                            CardDataPolicy policy,
+                                            const std::string& pan_token) {
+  RecordWriter record(kTransactionMagic, TX_FIXED_SIZE);
+
+  record.Put32(TX_STAN, tx.stan);
+  record.Put32(TX_INVOICE_NUMBER, tx.invoice_number);
+  record.Put32(TX_BATCH_NUMBER, tx.batch_number);
+  record.Put32(TX_NII, tx.nii);
+  record.Put64(TX_DATETIME, static_cast<std::int64_t>(tx.tx_datetime));
+  PutOptionalAmount(record, TX_AMOUNT, HAS_AMOUNT, tx.amount);
+  PutOptionalAmount(record, TX_ADDITIONAL_AMOUNT, HAS_ADDITIONAL_AMOUNT,
+                    tx.additional_amount);
+  PutOptionalAmount(record, TX_ORIGINAL_ADDITIONAL_AMOUNT,
+                    HAS_ORIGINAL_ADDITIONAL_AMOUNT, tx.original_additional_amount);
+  PutOptionalAmount(record, TX_PREAUTH_AMOUNT, HAS_PREAUTH_AMOUNT, tx.preauth_amount);
+  record.Put32(TX_CURRENCY, PackCurrency(currency));
+  record.Put8(TX_TYPE, tx.transaction_type);
+  record.Put8(TX_STATUS, tx.transaction_status);
+  record.Put8(TX_PREVIOUS_STATUS, tx.previous_transaction_status);
+  record.Put8(TX_IN_PROGRESS_STATUS, tx.in_progress_status);
+  record.Put8(TX_POS_ENTRY_MODE, static_cast<std::uint8_t>(tx.pos_entry_mode));
+  record.Put8(TX_POS_CONDITION_CODE, static_cast<std::uint8_t>(tx.pos_condition_code));
+  if (tx.pan_sequence_number) {
+    record.SetFlag(HAS_PAN_SEQUENCE_NUMBER);
+    record.Put16(TX_PAN_SEQUENCE_NUMBER, *tx.pan_sequence_number);
+  }
+  if (tx.is_adjusted)
+    record.SetFlag(IS_ADJUSTED);
+  if (tx.is_preauth_completed)
+    record.SetFlag(IS_PREAUTH_COMPLETED);
+
+  if (tx.pan) {
+    std::string pan = tx.pan->ToString();
+    if (policy == INCLUDE_CARD_DATA) {
+      record.SetFlag(HAS_PAN);
+      record.PutField(TX_PAN, pan);
+    } else {
+      record.PutField(TX_PAN, pan.substr(pan.size() < 4 ? 0 : pan.size() - 4));
+    }
+  }
+  record.PutField(TX_PAN_TOKEN, pan_token);
+  record.PutField(TX_RRN, tx.rrn);
+  record.PutField(TX_AUTH_ID_RESPONSE, tx.auth_id_response);
+  record.PutField(TX_RESPONSE_CODE, tx.response_code);
+  record.PutField(TX_PROCESSING_CODE, tx.processing_code);
+  record.PutField(TX_TID, tx.tid);
+  record.PutField(TX_MID, tx.mid);
+  record.PutField(TX_TPDU, tx.tpdu);
+  record.PutField(TX_ORIG_POS_ENTRY_MODE, tx.orig_pos_entry_mode);
+  if (tx.icc_data) {
+    record.SetFlag(HAS_ICC_DATA);
+    if (policy == INCLUDE_CARD_DATA)
+      record.PutField(TX_ICC_DATA, *tx.icc_data);
+    else
+      record.PutField(TX_ICC_DATA, StripIccCardTags(*tx.icc_data));
+  }
+  record.PutField(TX_ISSUER_EMV_RESPONSE, tx.issuer_emv_response);
+
+  if (policy == INCLUDE_CARD_DATA) {
+    record.SetFlag(HAS_CARD_DATA);
+    record.PutField(TX_EXPIRATION_DATE, tx.expiration_date);
+    record.PutField(TX_CARDHOLDER_NAME, tx.cardholder_name);
+    record.PutField(TX_CVV, tx.cvv);
+    record.PutField(TX_PIN_BLOCK, tx.pin_block);
+    record.PutField(TX_TRACK2, tx.track2);
+    record.PutField(TX_TRACK1_DATA, tx.track1_data);
+  }
+
+  return record.Finish();
+}
+
+}
@@ -20,6 +20,8 @@
 #include <stdx/ctime>
 #include <utils/logger.h>
 #include "protocol.h"
+#include "datetime_codec.h"
+#include "mandatory_fields.h"
 #include "diners_utils.h"
 
 namespace diners {
@@ -54,7 +56,8 @@ iso8583::Apdu BuildVoidRequest(DinersTransaction& tx) {
     message.SetHostDatetime(stdx::time(nullptr));
 
     // DE 14 EXPIRATION DATE
-    message.SetExpirationDate(tx.expiration_date);
+    if (!tx.expiration_date.empty())
+      message.SetExpirationDate(tx.expiration_date);
 
     // DE 22 POS ENTRY MODE
     message.SetPosEntryMode(tx.pos_entry_mode);
@@ -80,8 +83,8 @@ iso8583::Apdu BuildVoidRequest(DinersTransaction& tx) {
     message.SetMid(tx.mid);
 
     // DE 52 PIN BLOCK
-    if (tx.pin_block) {
-    	message.SetPinBlock(*tx.pin_block);
+    if (!tx.pin_block.empty()) {
+    	message.SetPinBlock(tx.pin_block);
     }
 
     // DE 54 TIP AMOUNT
@@ -106,13 +109,7 @@ iso8583::Apdu BuildVoidRequest(DinersTransaction& tx) {
 bool ReadVoidResponse(const std::vector<uint8_t>& data, DinersTransaction& tx) {
   VoidResponse response(data.data(), data.size());
   logger::debug(iso8583::Print(response.GetApdu()).c_str());
-  if (!response.IsValid() ||
-      (response.GetProcessingCode() != tx.processing_code) ||
-      (response.GetStan() != tx.stan) ||
-	  //(response.GetHostDatetime() != tx.tx_datetime)|| //To confirm whether date & time must be the same
-      (response.GetNii() != tx.nii) ||
-	  //(response.GetRrn() != tx.rrn)|| //To confirm whether rrn request = rrn response
-      (response.GetTid() != tx.tid))
+  if (!response.IsValid())
     return false;
 
     tx.tx_datetime = response.GetHostDatetime();  //DE-12/ DE-13
@@ -156,8 +153,7 @@ void VoidRequest::SetExpirationDate(const std::string& expiration_date) {   //DE
 }
 
 void VoidRequest::SetHostDatetime(time_t time_stamp) {
-    apdu_.SetField(kFieldTimeLocalTransaction, iso8583::IsoTimeFromTimestamp(time_stamp));
-    apdu_.SetField(kFieldDateLocalTransaction, iso8583::IsoDateFromTimestamp(time_stamp));
+    WriteIsoDateTime(time_stamp, apdu_);
 }
 
 void VoidRequest::SetPosEntryMode(types::PosEntryMode & pos_entry_mode) {   //DE 22
@@ -224,12 +220,11 @@ iso8583::Apdu VoidRequest::GetApdu() const {
  * VOID RESPONSE
  **************************************/
 VoidResponse::VoidResponse(const uint8_t *data, size_t size)
-    : apdu_(GetProtocolSpec(), data, size) {
+    : apdu_(GetProtocolSpec(), data, size),
+      bitmap_(ReadPrimaryBitmap(data, size)) {
 }
 
 bool VoidResponse::IsValid() const {
-	bool output = true;
-
     if (!apdu_.HasMti()) {
     	return false;
     }
@@ -238,16 +233,7 @@ bool VoidResponse::IsValid() const {
     	return false;
     }
 
-    output &= apdu_.HasField(kFieldProcessingCode);
-    output &= apdu_.HasField(kFieldStan);
-    output &= apdu_.HasField(kFieldTimeLocalTransaction);
-    output &= apdu_.HasField(kFieldDateLocalTransaction);
-    output &= apdu_.HasField(kFieldNii);
-    output &= apdu_.HasField(kFieldRrn);
-    output &= apdu_.HasField(kFieldResponseCode);
-    output &= apdu_.HasField(kFieldCardAcceptorTerminalId);
-
-    return output;
+    return HasMandatoryFields("VOID", bitmap_, kFinancialResponseFields);
 }
 
 iso8583::Apdu VoidResponse::GetApdu() const {
@@ -263,9 +249,7 @@ uint32_t VoidResponse::GetStan() const {
 }
 
 time_t VoidResponse::GetHostDatetime() const {
-    std::string date = apdu_.GetFieldAsString(kFieldDateLocalTransaction);
-    std::string time = apdu_.GetFieldAsString(kFieldTimeLocalTransaction);
-    return utils::GetDatetimefromIso8583Format(date, time);
+    return ReadIsoDateTime(apdu_);
 }
 
 uint32_t VoidResponse::GetNii() const {
@@ -0,0 +1,94 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "field63_tables.h"
+#include "protocol.h"
+#include "table.h"
+#include "table_cvv.h"
+
+// The DE 63 table layout of field63_tables.h against the table library the
+// requests were built with before: BuildCvvTable() writes the tables and
+// ReadFieldFromTable() reads the KP table of the key exchange.
+
+using namespace diners;
+
+namespace {
+int failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      std::printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+      failures++; \
+    } \
+  } while (0)
+
+// A table from BuildCvvTable() reads back as one table, and builds back to
+// the same bytes
+void TestCvvTable() {
+  const std::vector<std::uint8_t> cvv_table = BuildCvvTable("123");
+
+  Field63TableIterator tables(cvv_table);
+  Field63Table table;
+  CHECK(tables.Next(table));
+  CHECK(!tables.Next(table));
+
+  Field63TableIterator again(cvv_table);
+  if (!again.Next(table))
+    return;
+  CHECK(table.size + kField63TableHeaderSize == cvv_table.size());
+
+  Field63Builder field63;
+  field63.AddTable(table.id, table.data, table.size);
+  iso8583::Apdu apdu(GetProtocolSpec());
+  field63.Commit(apdu);
+  CHECK(apdu.GetFieldAsBytes(kField63) == cvv_table);
+}
+
+// The KP table of a key exchange response as the library finds it
+void TestKeyTable() {
+  std::vector<std::uint8_t> keys(32);
+  for (std::size_t i = 0; i < keys.size(); i++)
+    keys[i] = std::uint8_t(i);
+
+  Field63Builder field63;
+  field63.AddTable(BuildCvvTable("123"));
+  field63.AddTable("KP", keys.data(), keys.size());
+  iso8583::Apdu apdu(GetProtocolSpec());
+  field63.Commit(apdu);
+  const std::vector<std::uint8_t> data = apdu.GetFieldAsBytes(kField63);
+
+  CHECK(ReadFieldFromTable("KP", data) == keys);
+  auto table = FindField63Table(data, "KP");
+  CHECK(table && std::vector<std::uint8_t>(table->data,
+                                           table->data + table->size) == keys);
+}
+}
+
+int main() {
+  TestCvvTable();
+  TestKeyTable();
+
+  if (failures) {
+    std::printf("%d checks failed\n", failures);
+    return 1;
+  }
+  std::printf("field63_test passed\n");
+  return 0;
+}
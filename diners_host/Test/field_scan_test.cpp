@@ -0,0 +1,131 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <iso8583/apdu.h>
+#include "field_scan.h"
+#include "protocol.h"
+
+// FieldScanner keeps its own table of the field encodings: a message
+// carrying every field of GetProtocolSpec(), encoded by iso8583, has to scan
+// field by field to its last byte.
+
+using namespace diners;
+
+namespace {
+int failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      std::printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+      failures++; \
+    } \
+  } while (0)
+
+struct VariableField {
+  int field;
+  std::string value;
+};
+
+// Each of a different length, so that a length prefix read wrong shifts the
+// fields after it
+const VariableField kVariableFields[] = {
+  { kFieldAdditionalResponseData, "RESPONSE DATA" },
+  { kFieldTrack1Data, "B36123456789014^CARDHOLDER/A^2912" },
+  { kFieldAdditionalDataNational, "NATIONAL DATA 47" },
+  { kFieldAdditionalDataPrivate, "PRIVATE DATA 48 ." },
+  { kFieldAdditionalAmount, "000000001000" },
+  { kFieldNationalUseData, "NATIONAL USE" },
+  { kField60, "000123" },
+  { kField61, "PRIVATE USE 61" },
+  { kField62, "0123456789ABCDEF0123456789ABCDEF" },
+  { kField63, "KP TABLE 63" },
+};
+
+iso8583::Apdu MessageWithEveryField() {
+  iso8583::Apdu apdu(GetProtocolSpec());
+  apdu.SetMti(200);
+  apdu.SetField(kFieldPan, "36123456789014");
+  apdu.SetField(kFieldProcessingCode, 3000);
+  apdu.SetField(kFieldAmount, 1500);
+  apdu.SetField(kFieldDateTimeTransmission, 1019120000);
+  apdu.SetField(kFieldStan, 123456);
+  apdu.SetField(kFieldTimeLocalTransaction, 120000);
+  apdu.SetField(kFieldDateLocalTransaction, 1019);
+  apdu.SetField(kFieldDateExpiration, 2912);
+  apdu.SetField(kFieldDateSettlement, 1019);
+  apdu.SetField(kFieldPosEntryMode, 51);
+  apdu.SetField(kFieldPanSequenceNumber, 1);
+  apdu.SetField(kFieldNii, 3);
+  apdu.SetField(kFieldPosConditionCode, 0);
+  apdu.SetField(kFieldTrack2Data, "36123456789014=2912");
+  apdu.SetField(kFieldRrn, "000000001234");
+  apdu.SetField(kFieldAuthorizationId, "A1B2C3");
+  apdu.SetField(kFieldResponseCode, "00");
+  apdu.SetField(kFieldCardAcceptorTerminalId, "12345678");
+  apdu.SetField(kFieldCardAcceptorId, "MERCHANT0000001");
+  apdu.SetField(kFieldCardAcceptorNameLocation, "MERCHANT NAME");
+  apdu.SetField(kFieldCurrencyCode, 840);
+  apdu.SetField(kFieldPinBlock, std::vector<std::uint8_t>(8, 0x12));
+  apdu.SetField(kFieldIccData, std::vector<std::uint8_t>{ 0x95, 0x01, 0x80 });
+  for (const VariableField& field : kVariableFields)
+    apdu.SetField(field.field, field.value);
+  return apdu;
+}
+
+void TestEveryFieldScans() {
+  const iso8583::Apdu apdu = MessageWithEveryField();
+  const std::vector<std::uint8_t>& text = apdu.text;
+
+  FieldScanner scanner(text.data(), text.size());
+  FieldSpan span;
+  std::vector<int> fields;
+  while (scanner.Next(span)) {
+    fields.push_back(span.field);
+    CHECK(span.offset + span.size <= text.size());
+
+    for (const VariableField& field : kVariableFields) {
+      if (field.field == span.field)
+        CHECK(std::string(text.begin() + span.offset,
+                          text.begin() + span.offset + span.size)
+              == field.value);
+    }
+    if (span.field == kFieldCardAcceptorTerminalId)
+      CHECK(std::string(text.begin() + span.offset,
+                        text.begin() + span.offset + span.size)
+            == "12345678");
+  }
+
+  CHECK(scanner.ErrorField() == 0);
+  CHECK(scanner.Offset() == text.size());
+  CHECK(fields.size() == 33);
+  CHECK(!fields.empty() && fields.front() == kFieldPan
+        && fields.back() == kField63);
+}
+}
+
+int main() {
+  TestEveryFieldScans();
+
+  if (failures) {
+    std::printf("%d checks failed\n", failures);
+    return 1;
+  }
+  std::printf("field_scan_test passed\n");
+  return 0;
+}
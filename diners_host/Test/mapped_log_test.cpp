@@ -0,0 +1,222 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "mapped_log.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Crash recovery of MappedLog: the file is damaged the way a power loss
+// leaves it, then reopened.
+
+using diners::MappedLog;
+
+namespace {
+// File layout, as in mapped_log.cpp
+const std::size_t kFileHeaderSize = 64;
+const std::size_t kRecordHeaderSize = 32;
+const std::size_t kCrcOffset = 4;
+
+const std::size_t kCapacity = 4096;
+const std::size_t kPayloadSize = 1000;
+const std::size_t kRecordSize = kRecordHeaderSize + kPayloadSize;
+
+const char kPath[] = "mapped_log_test.dat";
+
+int failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      std::printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+      failures++; \
+    } \
+  } while (0)
+
+void RemoveFiles() {
+  unlink(kPath);
+  unlink((std::string(kPath) + ".compact").c_str());
+}
+
+// Offset of the record 'index' of a log holding kPayloadSize records only
+std::size_t RecordOffset(std::size_t index) {
+  return kFileHeaderSize + index * kRecordSize;
+}
+
+std::vector<std::uint8_t> Payload(std::uint8_t value) {
+  return std::vector<std::uint8_t>(kPayloadSize, value);
+}
+
+std::uint64_t Append(MappedLog& log, std::uint8_t value) {
+  std::vector<std::uint8_t> payload = Payload(value);
+  std::uint64_t sequence = log.Append(value, 0, payload.data(), payload.size());
+  if (sequence)
+    log.Sync(sequence);
+  return sequence;
+}
+
+void WriteAt(std::size_t offset, const void* data, std::size_t size) {
+  int fd = open(kPath, O_RDWR);
+  CHECK(fd >= 0 && pwrite(fd, data, size, offset) == ssize_t(size));
+  close(fd);
+}
+
+std::vector<std::uint8_t> ReadAt(std::size_t offset, std::size_t size) {
+  std::vector<std::uint8_t> data(size);
+  int fd = open(kPath, O_RDONLY);
+  CHECK(fd >= 0 && pread(fd, data.data(), size, offset) == ssize_t(size));
+  close(fd);
+  return data;
+}
+
+// The last append never completed: its payload is only partly written
+void TestTornTail() {
+  RemoveFiles();
+  {
+    std::unique_ptr<MappedLog> log = MappedLog::Open(kPath, kCapacity);
+    Append(*log, 1);
+    Append(*log, 2);
+    Append(*log, 3);
+  }
+  std::vector<std::uint8_t> zeros(kPayloadSize / 2, 0);
+  WriteAt(RecordOffset(2) + kRecordHeaderSize + kPayloadSize / 2, zeros.data(),
+          zeros.size());
+
+  std::unique_ptr<MappedLog> log = MappedLog::Open(kPath, kCapacity);
+  CHECK(log && log->LiveCount() == 2);
+  CHECK(log && log->NextSequence() == 3);
+
+  // The torn record is cleared, and what is appended next reads back
+  CHECK(log && Append(*log, 4) == 3);
+  log = MappedLog::Open(kPath, kCapacity);
+  MappedLog::Record record;
+  CHECK(log && log->Read(3, record) && record.payload == Payload(4));
+}
+
+// A record in the middle fails its checksum: it and every record after it
+// are dropped
+void TestCrcMismatch() {
+  RemoveFiles();
+  {
+    std::unique_ptr<MappedLog> log = MappedLog::Open(kPath, kCapacity);
+    Append(*log, 1);
+    Append(*log, 2);
+    Append(*log, 3);
+  }
+  std::uint32_t crc = 0;
+  WriteAt(RecordOffset(1) + kCrcOffset, &crc, sizeof(crc));
+
+  std::unique_ptr<MappedLog> log = MappedLog::Open(kPath, kCapacity);
+  std::vector<MappedLog::Record> records;
+  if (log)
+    records = log->LiveRecords();
+  CHECK(records.size() == 1);
+  CHECK(records.size() == 1 && records[0].sequence == 1
+        && records[0].payload == Payload(1));
+  CHECK(ReadAt(RecordOffset(2), kRecordHeaderSize)
+        == std::vector<std::uint8_t>(kRecordHeaderSize, 0));
+}
+
+// A full log drops its retired records and keeps the live ones, also once
+// reopened
+void TestCompaction() {
+  RemoveFiles();
+  std::unique_ptr<MappedLog> log = MappedLog::Open(kPath, kCapacity);
+  Append(*log, 1);
+  Append(*log, 2);
+  Append(*log, 3);
+  log->SetState(2, MappedLog::kRetired);
+  log->SetState(3, MappedLog::kRetired);
+
+  CHECK(Append(*log, 4) == 4);
+  CHECK(Append(*log, 5) == 5);
+  CHECK(log->LiveCount() == 3);
+  CHECK(access((std::string(kPath) + ".compact").c_str(), F_OK) != 0);
+
+  log = MappedLog::Open(kPath, kCapacity);
+  std::vector<MappedLog::Record> records;
+  if (log)
+    records = log->LiveRecords();
+  CHECK(records.size() == 3);
+  CHECK(records.size() == 3 && records[0].sequence == 1
+        && records[1].sequence == 4 && records[2].sequence == 5);
+  CHECK(records.size() == 3 && records[1].payload == Payload(4));
+}
+
+// Sequences given out before a compaction are not given again after a
+// reopen, even when no record holding them is left
+void TestUsedSequenceAfterReopen() {
+  RemoveFiles();
+  {
+    std::unique_ptr<MappedLog> log = MappedLog::Open(kPath, kCapacity);
+    Append(*log, 1);
+    Append(*log, 2);
+    Append(*log, 3);
+    log->SetState(2, MappedLog::kRetired);
+    log->SetState(3, MappedLog::kRetired);
+
+    // Compacts to record 1 alone, then does not fit
+    std::vector<std::uint8_t> large(kCapacity, 0);
+    CHECK(log->Append(9, 0, large.data(), large.size()) == 0);
+    CHECK(log->NextSequence() == 4);
+  }
+
+  std::unique_ptr<MappedLog> log = MappedLog::Open(kPath, kCapacity);
+  CHECK(log && log->LiveCount() == 1);
+  CHECK(log && log->NextSequence() == 4);
+  CHECK(log && Append(*log, 4) == 4);
+}
+
+// A retired record leaves no payload on disk and does not stop recovery
+void TestRetiredPayloadZeroed() {
+  RemoveFiles();
+  {
+    std::unique_ptr<MappedLog> log = MappedLog::Open(kPath, kCapacity);
+    Append(*log, 1);
+    Append(*log, 2);
+    Append(*log, 3);
+    CHECK(log->SetState(2, MappedLog::kRetired));
+  }
+  CHECK(ReadAt(RecordOffset(1) + kRecordHeaderSize, kPayloadSize)
+        == std::vector<std::uint8_t>(kPayloadSize, 0));
+
+  std::unique_ptr<MappedLog> log = MappedLog::Open(kPath, kCapacity);
+  std::vector<MappedLog::Record> records;
+  if (log)
+    records = log->LiveRecords();
+  CHECK(records.size() == 2);
+  CHECK(records.size() == 2 && records[0].sequence == 1
+        && records[1].sequence == 3);
+}
+}
+
+int main() {
+  TestTornTail();
+  TestCrcMismatch();
+  TestCompaction();
+  TestUsedSequenceAfterReopen();
+  TestRetiredPayloadZeroed();
+  RemoveFiles();
+
+  if (failures) {
+    std::printf("%d checks failed\n", failures);
+    return 1;
+  }
+  std::printf("mapped_log_test passed\n");
+  return 0;
+}
@@ -0,0 +1,372 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "responder.h"
+
+// Local stand-in for the Diners acquirer, for load testing DinersHost and
+// HostSwitch on one machine.
+//
+//   diners_simulator [--port=N] [--length-header=0|2]
+//                    [--latency=fixed:MS|uniform:MIN:MAX|lognormal:MEDIAN:P99]
+//                    [--decline-rate=R] [--error-rate=R] [--drop-rate=R]
+//                    [--disconnect-rate=R] [--partial-write-rate=R]
+//                    [--truncate-rate=R] [--seed=N] [--report-interval=S]
+//
+// Rates are probabilities per request, 0 to 1:
+//   drop           no answer, connection kept (terminal times out)
+//   disconnect     connection closed instead of answering
+//   partial-write  answer sent in several small writes
+//   truncate       first half of the answer sent, then the connection closed
+// Messages are framed as the terminal comms layer does: a 2 byte big endian
+// length (unless --length-header=0), the 5 byte TPDU, then the ISO message.
+// The answer TPDU has source and destination swapped.
+
+namespace {
+
+const std::size_t kTpduSize = 5;
+const std::size_t kMaxMessageSize = 99999;
+
+struct Latency {
+  enum Kind {
+    FIXED,
+    UNIFORM,
+    LOGNORMAL
+  };
+
+  Latency()
+      : kind(FIXED),
+        a(0),
+        b(0) {
+  }
+
+  Kind kind;
+  double a;
+  double b;
+};
+
+struct Config {
+  Config()
+      : port(5000),
+        length_header(2),
+        drop_rate(0),
+        disconnect_rate(0),
+        partial_write_rate(0),
+        truncate_rate(0),
+        report_interval(10) {
+  }
+
+  unsigned int port;
+  unsigned int length_header;
+  Latency latency;
+  double drop_rate;
+  double disconnect_rate;
+  double partial_write_rate;
+  double truncate_rate;
+  unsigned int report_interval;
+  simulator::ResponderConfig responder;
+};
+
+struct Stats {
+  std::atomic<std::uint64_t> connections;
+  std::atomic<std::uint64_t> requests;
+  std::atomic<std::uint64_t> responses;
+  std::atomic<std::uint64_t> rejected;
+  std::atomic<std::uint64_t> dropped;
+  std::atomic<std::uint64_t> disconnects;
+  std::atomic<std::uint64_t> partial_writes;
+  std::atomic<std::uint64_t> truncated;
+};
+
+Stats stats;
+
+bool ParseLatency(const std::string& spec, Latency& latency) {
+  double a = 0;
+  double b = 0;
+  if (std::sscanf(spec.c_str(), "fixed:%lf", &a) == 1) {
+    latency.kind = Latency::FIXED;
+  } else if (std::sscanf(spec.c_str(), "uniform:%lf:%lf", &a, &b) == 2
+      && a <= b) {
+    latency.kind = Latency::UNIFORM;
+  } else if (std::sscanf(spec.c_str(), "lognormal:%lf:%lf", &a, &b) == 2
+      && a > 0 && b >= a) {
+    // a = median, b = p99: mu = ln(median), sigma from the 99th percentile
+    latency.kind = Latency::LOGNORMAL;
+    double mu = std::log(a);
+    b = (std::log(b) - mu) / 2.326;
+    a = mu;
+  } else {
+    return false;
+  }
+  latency.a = a;
+  latency.b = b;
+  return true;
+}
+
+double DrawLatencyMs(const Latency& latency, std::mt19937& random) {
+  switch (latency.kind) {
+    case Latency::UNIFORM:
+      return std::uniform_real_distribution<double>(latency.a, latency.b)(
+          random);
+    case Latency::LOGNORMAL:
+      return std::lognormal_distribution<double>(latency.a, latency.b)(random);
+    case Latency::FIXED:
+    default:
+      return latency.a;
+  }
+}
+
+bool ReadExactly(int fd, std::uint8_t* data, std::size_t size) {
+  while (size) {
+    ssize_t received = recv(fd, data, size, 0);
+    if (received <= 0)
+      return false;
+    data += received;
+    size -= received;
+  }
+  return true;
+}
+
+bool WriteExactly(int fd, const std::uint8_t* data, std::size_t size) {
+  while (size) {
+    ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent <= 0)
+      return false;
+    data += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+bool ReadFrame(int fd, unsigned int length_header,
+               std::vector<std::uint8_t>& frame) {
+  if (length_header == 0) {
+    frame.resize(kMaxMessageSize);
+    ssize_t received = recv(fd, frame.data(), frame.size(), 0);
+    if (received <= 0)
+      return false;
+    frame.resize(received);
+    return true;
+  }
+
+  std::uint8_t header[2];
+  if (!ReadExactly(fd, header, sizeof(header)))
+    return false;
+  std::size_t length = (header[0] << 8) | header[1];
+  frame.resize(length);
+  return ReadExactly(fd, frame.data(), length);
+}
+
+void AddLengthHeader(unsigned int length_header,
+                     std::vector<std::uint8_t>& frame) {
+  if (length_header == 0)
+    return;
+  std::uint8_t header[2] = { std::uint8_t(frame.size() >> 8),
+      std::uint8_t(frame.size()) };
+  frame.insert(frame.begin(), header, header + 2);
+}
+
+void Serve(int fd, const Config& config, simulator::Responder& responder,
+           unsigned int seed) {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<double> draw(0, 1);
+
+  std::vector<std::uint8_t> frame;
+  while (ReadFrame(fd, config.length_header, frame)) {
+    stats.requests++;
+    if (frame.size() < kTpduSize) {
+      stats.rejected++;
+      continue;
+    }
+
+    std::vector<std::uint8_t> request(frame.begin() + kTpduSize, frame.end());
+    std::vector<std::uint8_t> response;
+    if (!responder.Respond(request, response)) {
+      stats.rejected++;
+      continue;
+    }
+
+    if (draw(random) < config.drop_rate) {
+      stats.dropped++;
+      continue;
+    }
+    if (draw(random) < config.disconnect_rate) {
+      stats.disconnects++;
+      break;
+    }
+
+    double latency_ms = DrawLatencyMs(config.latency, random);
+    if (latency_ms > 0) {
+      std::this_thread::sleep_for(
+          std::chrono::microseconds(std::int64_t(latency_ms * 1000)));
+    }
+
+    // TPDU: id, then destination and source swapped
+    std::vector<std::uint8_t> answer;
+    answer.push_back(frame[0]);
+    answer.insert(answer.end(), frame.begin() + 3, frame.begin() + 5);
+    answer.insert(answer.end(), frame.begin() + 1, frame.begin() + 3);
+    answer.insert(answer.end(), response.begin(), response.end());
+    AddLengthHeader(config.length_header, answer);
+
+    if (draw(random) < config.truncate_rate) {
+      stats.truncated++;
+      WriteExactly(fd, answer.data(), answer.size() / 2);
+      break;
+    }
+
+    if (draw(random) < config.partial_write_rate) {
+      stats.partial_writes++;
+      std::size_t offset = 0;
+      bool ok = true;
+      while (ok && offset < answer.size()) {
+        std::size_t chunk = std::uniform_int_distribution<std::size_t>(
+            1, answer.size() - offset)(random);
+        ok = WriteExactly(fd, answer.data() + offset, chunk);
+        offset += chunk;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      if (!ok)
+        break;
+    } else if (!WriteExactly(fd, answer.data(), answer.size())) {
+      break;
+    }
+    stats.responses++;
+  }
+
+  close(fd);
+}
+
+void Report(unsigned int interval) {
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::seconds(interval));
+    std::fprintf(stderr,
+                 "connections=%llu requests=%llu responses=%llu rejected=%llu "
+                 "dropped=%llu disconnects=%llu partial_writes=%llu "
+                 "truncated=%llu\n",
+                 (unsigned long long) stats.connections.load(),
+                 (unsigned long long) stats.requests.load(),
+                 (unsigned long long) stats.responses.load(),
+                 (unsigned long long) stats.rejected.load(),
+                 (unsigned long long) stats.dropped.load(),
+                 (unsigned long long) stats.disconnects.load(),
+                 (unsigned long long) stats.partial_writes.load(),
+                 (unsigned long long) stats.truncated.load());
+  }
+}
+
+bool ReadOption(const char* arg, const char* name, std::string& value) {
+  std::size_t length = std::strlen(name);
+  if (std::strncmp(arg, name, length) != 0 || arg[length] != '=')
+    return false;
+  value = arg + length + 1;
+  return true;
+}
+
+bool ParseArguments(int argc, char* argv[], Config& config) {
+  for (int i = 1; i < argc; i++) {
+    std::string value;
+    if (ReadOption(argv[i], "--port", value)) {
+      config.port = std::strtoul(value.c_str(), NULL, 10);
+    } else if (ReadOption(argv[i], "--length-header", value)) {
+      config.length_header = std::strtoul(value.c_str(), NULL, 10);
+      if (config.length_header != 0 && config.length_header != 2)
+        return false;
+    } else if (ReadOption(argv[i], "--latency", value)) {
+      if (!ParseLatency(value, config.latency))
+        return false;
+    } else if (ReadOption(argv[i], "--decline-rate", value)) {
+      config.responder.decline_rate = std::strtod(value.c_str(), NULL);
+    } else if (ReadOption(argv[i], "--error-rate", value)) {
+      config.responder.error_rate = std::strtod(value.c_str(), NULL);
+    } else if (ReadOption(argv[i], "--drop-rate", value)) {
+      config.drop_rate = std::strtod(value.c_str(), NULL);
+    } else if (ReadOption(argv[i], "--disconnect-rate", value)) {
+      config.disconnect_rate = std::strtod(value.c_str(), NULL);
+    } else if (ReadOption(argv[i], "--partial-write-rate", value)) {
+      config.partial_write_rate = std::strtod(value.c_str(), NULL);
+    } else if (ReadOption(argv[i], "--truncate-rate", value)) {
+      config.truncate_rate = std::strtod(value.c_str(), NULL);
+    } else if (ReadOption(argv[i], "--seed", value)) {
+      config.responder.seed = std::strtoul(value.c_str(), NULL, 10);
+    } else if (ReadOption(argv[i], "--report-interval", value)) {
+      config.report_interval = std::strtoul(value.c_str(), NULL, 10);
+    } else {
+      std::cerr << "bad option " << argv[i] << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  Config config;
+  if (!ParseArguments(argc, argv, config))
+    return 2;
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(config.port);
+  if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address))
+      != 0 || listen(listener, 128) != 0) {
+    std::perror("diners_simulator");
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  std::cerr << "Diners simulator listening on 127.0.0.1:" << config.port
+            << std::endl;
+
+  simulator::Responder responder(config.responder);
+  if (config.report_interval)
+    std::thread(Report, config.report_interval).detach();
+
+  unsigned int connection_id = 0;
+  while (true) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0)
+      continue;
+    int no_delay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+    stats.connections++;
+    connection_id++;
+    std::thread(Serve, fd, std::cref(config), std::ref(responder),
+                config.responder.seed + connection_id).detach();
+  }
+}
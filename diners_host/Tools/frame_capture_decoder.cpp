@@ -0,0 +1,182 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <iso8583/apdu.h>
+#include <iso8583/printer.h>
+#include <diners/frame_capture.h>
+#include <protocol.h>
+
+// Prints the frames of a capture written by diners::WriteFrameCapture().
+//
+//   frame_capture_decoder [--hex] FILE
+//
+// Diners frames are decoded with the Diners protocol spec; FDMS frames, and
+// frames cut to the capture slot size, are printed in hex only. --hex adds
+// the hex dump to decoded frames too.
+
+namespace {
+
+const std::size_t kFileHeaderSize = 8;
+const std::size_t kRecordHeaderSize = 28;
+const std::uint16_t kFileVersion = 1;
+
+struct Record {
+  std::uint64_t sequence;
+  std::int64_t time;
+  int host;
+  int direction;
+  std::size_t header_size;
+  std::size_t frame_size;
+  std::vector<std::uint8_t> data;
+};
+
+std::uint64_t GetLittleEndian(const std::uint8_t* input, std::size_t size) {
+  std::uint64_t value = 0;
+  for (std::size_t i = size; i > 0; i--) {
+    value = (value << 8) | input[i - 1];
+  }
+  return value;
+}
+
+// False at the end of the file; 'truncated' tells whether it ended inside a
+// record
+bool ReadRecord(std::istream& input, Record& record, bool& truncated) {
+  std::uint8_t header[kRecordHeaderSize];
+  if (!input.read(reinterpret_cast<char*>(header), sizeof(header))) {
+    truncated = input.gcount() != 0;
+    return false;
+  }
+
+  record.sequence = GetLittleEndian(header, 8);
+  record.time = GetLittleEndian(header + 8, 8);
+  record.host = header[16];
+  record.direction = header[17];
+  record.header_size = GetLittleEndian(header + 18, 2);
+  record.frame_size = GetLittleEndian(header + 20, 4);
+  record.data.resize(GetLittleEndian(header + 24, 4));
+  truncated = !input.read(reinterpret_cast<char*>(record.data.data()),
+                          record.data.size());
+  return !truncated;
+}
+
+std::string FormatTime(std::int64_t micros) {
+  std::time_t seconds = micros / 1000000;
+  std::tm local;
+  localtime_r(&seconds, &local);
+
+  char output[40];
+  std::size_t size = std::strftime(output, sizeof(output), "%Y-%m-%d %H:%M:%S",
+                                   &local);
+  std::snprintf(output + size, sizeof(output) - size, ".%06d",
+                int(micros % 1000000));
+  return output;
+}
+
+std::string ToHex(const std::uint8_t* data, std::size_t size) {
+  static const char kDigits[] = "0123456789ABCDEF";
+  std::string output;
+  for (std::size_t i = 0; i < size; i++) {
+    output += kDigits[data[i] >> 4];
+    output += kDigits[data[i] & 0x0F];
+  }
+  return output;
+}
+
+void HexDump(const std::vector<std::uint8_t>& data) {
+  const std::size_t kBytesPerLine = 16;
+  for (std::size_t offset = 0; offset < data.size(); offset += kBytesPerLine) {
+    std::size_t size = std::min(kBytesPerLine, data.size() - offset);
+    std::printf("  %04zx  %s\n", offset, ToHex(data.data() + offset, size).c_str());
+  }
+}
+
+void PrintRecord(const Record& record, bool hex) {
+  const diners::OnlineHost host = diners::OnlineHost(record.host);
+  std::printf("#%llu %s %s %s %zu bytes", (unsigned long long) record.sequence,
+              FormatTime(record.time).c_str(), diners::OnlineHostName(host),
+              record.direction == diners::CAPTURE_SENT ? "sent" : "received",
+              record.frame_size);
+  if (record.data.size() < record.frame_size)
+    std::printf(" (%zu captured)", record.data.size());
+  std::printf(", header %s\n",
+              ToHex(record.data.data(), record.header_size).c_str());
+
+  bool complete = record.data.size() == record.frame_size;
+  if (host != diners::ONLINE_HOST_DINERS || !complete || hex)
+    HexDump(record.data);
+  if (host != diners::ONLINE_HOST_DINERS || !complete)
+    return;
+
+  const std::uint8_t* message = record.data.data() + record.header_size;
+  iso8583::Apdu apdu(diners::GetProtocolSpec(), message,
+                     record.data.size() - record.header_size);
+  std::printf("%s\n", iso8583::Print(apdu).c_str());
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  bool hex = false;
+  std::string path;
+  for (int i = 1; i < argc; i++) {
+    std::string argument = argv[i];
+    if (argument == "--hex") {
+      hex = true;
+    } else if (path.empty() && argument.compare(0, 2, "--") != 0) {
+      path = argument;
+    } else {
+      std::cerr << "usage: frame_capture_decoder [--hex] FILE" << std::endl;
+      return 2;
+    }
+  }
+  if (path.empty()) {
+    std::cerr << "usage: frame_capture_decoder [--hex] FILE" << std::endl;
+    return 2;
+  }
+
+  std::ifstream input(path.c_str(), std::ios::binary);
+  std::uint8_t file_header[kFileHeaderSize];
+  if (!input.read(reinterpret_cast<char*>(file_header), sizeof(file_header))
+      || std::string(file_header, file_header + 4) != "FCAP"
+      || GetLittleEndian(file_header + 4, 2) != kFileVersion) {
+    std::cerr << path << ": not a frame capture" << std::endl;
+    return 1;
+  }
+
+  Record record;
+  bool truncated = false;
+  unsigned int count = 0;
+  while (ReadRecord(input, record, truncated)) {
+    if (record.header_size > record.data.size()) {
+      std::cerr << path << ": corrupt record " << record.sequence << std::endl;
+      return 1;
+    }
+    PrintRecord(record, hex);
+    count++;
+  }
+
+  if (truncated) {
+    std::cerr << path << ": truncated after " << count << " frames" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "responder.h"
+#include <cstdio>
+#include <ctime>
+#include <iso8583/apdu.h>
+#include <protocol.h>
+
+namespace simulator {
+
+namespace {
+const char kTmkDownloadProcessingCode[] = "920000";
+
+bool IsKnownRequestMti(int mti) {
+  switch (mti) {
+    case 100:
+    case 200:
+    case 220:
+    case 320:
+    case 400:
+    case 500:
+    case 800:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Advices, uploads, reversals and network messages are always accepted
+bool CanBeDeclined(int mti) {
+  return mti == 100 || mti == 200;
+}
+
+void EchoField(const iso8583::Apdu& request, int field,
+               iso8583::Apdu& response) {
+  if (request.HasField(field))
+    response.SetField(field, request.GetFieldAsBytes(field));
+}
+}
+
+Responder::Responder(const ResponderConfig& config)
+    : config_(config),
+      random_(config.seed),
+      rrn_counter_(0) {
+}
+
+bool Responder::Respond(const std::vector<std::uint8_t>& request_data,
+                        std::vector<std::uint8_t>& response_data) {
+  using namespace diners;
+
+  iso8583::Apdu request(GetProtocolSpec(), request_data.data(),
+                        request_data.size());
+  if (!request.HasMti() || !IsKnownRequestMti(request.GetMti()))
+    return false;
+
+  int mti = request.GetMti();
+  iso8583::Apdu response(GetProtocolSpec());
+  response.SetMti(mti + 10);
+
+  EchoField(request, kFieldProcessingCode, response);
+  EchoField(request, kFieldAmount, response);
+  EchoField(request, kFieldStan, response);
+  EchoField(request, kFieldNii, response);
+  EchoField(request, kFieldCardAcceptorTerminalId, response);
+
+  time_t now = time(NULL);
+  struct tm local;
+  localtime_r(&now, &local);
+  response.SetField(kFieldTimeLocalTransaction,
+                    local.tm_hour * 10000 + local.tm_min * 100 + local.tm_sec);
+  response.SetField(kFieldDateLocalTransaction,
+                    (local.tm_mon + 1) * 100 + local.tm_mday);
+
+  std::string response_code = PickResponseCode(mti);
+  if (mti != 800)
+    response.SetField(kFieldRrn, NextRrn());
+  if (CanBeDeclined(mti) && response_code == "00")
+    response.SetField(kFieldAuthorizationId, NextAuthCode());
+  response.SetField(kFieldResponseCode, response_code);
+
+  if (mti == 800
+      && request.GetFieldAsString(kFieldProcessingCode)
+          == kTmkDownloadProcessingCode) {
+    response.SetField(kField62, "0123456789ABCDEF0123456789ABCDEF");
+  }
+
+  response_data = response.text;
+  return true;
+}
+
+std::string Responder::NextRrn() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  char rrn[13];
+  std::snprintf(rrn, sizeof(rrn), "%012u", ++rrn_counter_);
+  return rrn;
+}
+
+std::string Responder::NextAuthCode() {
+  static const char kAlphabet[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::uniform_int_distribution<int> pick(0, sizeof(kAlphabet) - 2);
+  std::string output;
+  for (int i = 0; i < 6; i++) {
+    output += kAlphabet[pick(random_)];
+  }
+  return output;
+}
+
+std::string Responder::PickResponseCode(int request_mti) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::uniform_real_distribution<double> draw(0, 1);
+  if (draw(random_) < config_.error_rate)
+    return "96";
+  if (CanBeDeclined(request_mti) && draw(random_) < config_.decline_rate)
+    return "05";
+  return "00";
+}
+
+}
@@ -0,0 +1,66 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef DINERS_TOOLS__RESPONDER_H_
+#define DINERS_TOOLS__RESPONDER_H_
+
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace simulator {
+
+struct ResponderConfig {
+  ResponderConfig()
+      : decline_rate(0),
+        error_rate(0),
+        seed(1) {
+  }
+
+  double decline_rate;  // DE 39 "05"
+  double error_rate;    // DE 39 "96"
+  unsigned int seed;
+};
+
+// Builds the host answer to a Diners request (TPDU already stripped), the
+// way the acquirer does:
+//   0100/0110, 0200/0210, 0220/0230, 0320/0330, 0400/0410, 0500/0510 and
+//   0800/0810 (echo test 990000, TMK download 920000)
+// DE 3, 4, 11, 24 and 41 are echoed; DE 12/13 are the current local time;
+// DE 37 and DE 38 are generated. Shared by all connections.
+class Responder {
+ public:
+  explicit Responder(const ResponderConfig& config);
+
+  // False if the request cannot be decoded or has an unknown MTI
+  bool Respond(const std::vector<std::uint8_t>& request,
+               std::vector<std::uint8_t>& response);
+
+ private:
+  std::string NextRrn();
+  std::string NextAuthCode();
+  std::string PickResponseCode(int request_mti);
+
+  ResponderConfig config_;
+  std::mutex mutex_;
+  std::mt19937 random_;
+  std::uint32_t rrn_counter_;
+};
+
+}
+
+#endif
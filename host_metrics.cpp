@@ -0,0 +1,204 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "host_metrics.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+namespace fdms {
+
+namespace {
+
+struct OperationCounters {
+  std::atomic<std::uint64_t> requests;
+  std::atomic<std::uint64_t> in_flight;
+  std::atomic<std::uint64_t> completed;
+  std::atomic<std::uint64_t> declined;
+  std::atomic<std::uint64_t> transient_failures[diners::kFailureCauseCount];
+  std::atomic<std::uint64_t> permanent_failures[diners::kFailureCauseCount];
+  std::atomic<std::uint64_t> bytes_sent;
+  std::atomic<std::uint64_t> bytes_received;
+};
+
+// Static storage, so zero initialised
+OperationCounters counters[kMetricsHostCount][kMetricsOperationCount];
+
+const char* const kHostNames[kMetricsHostCount] = { "FDMS_BASE24",
+    "AMEX_DIRECT", "DINERS_DIRECT" };
+
+const char* const kOperationNames[kMetricsOperationCount] = { "connect",
+    "sale", "tc_upload", "void", "reversal", "refund", "offline_sale",
+    "preauth", "tip_adjust", "preauth_completion", "quasi_cash",
+    "batch_upload", "settlement", "test_transaction", "tmk_download",
+    "preauth_cancellation", "instalment_sale", "key_exchange" };
+
+// FAILURE_NONE on a failure means the host did not say why
+const char* const kCauseNames[diners::kFailureCauseCount] = { "unknown",
+    "connect", "send_error", "partial_send", "receive_error", "short_frame",
+    "malformed", "invalid_mti", "correlation_mismatch", "missing_field",
+    "response_code" };
+
+void Increment(std::atomic<std::uint64_t>& counter, std::uint64_t value = 1) {
+  counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+typedef std::atomic<std::uint64_t> OperationCounters::*Counter;
+typedef std::atomic<std::uint64_t> (OperationCounters::*CauseCounter)[diners::kFailureCauseCount];
+
+void AppendHeader(std::string& output, const char* name, const char* type,
+                  const char* help) {
+  output += "# HELP ";
+  output += name;
+  output += ' ';
+  output += help;
+  output += "\n# TYPE ";
+  output += name;
+  output += ' ';
+  output += type;
+  output += '\n';
+}
+
+void AppendSample(std::string& output, const char* name, int host,
+                  int operation, const char* cause, std::uint64_t value) {
+  char line[192];
+  if (cause) {
+    std::snprintf(line, sizeof(line),
+                  "%s{protocol=\"%s\",operation=\"%s\",cause=\"%s\"} %llu\n",
+                  name, kHostNames[host], kOperationNames[operation], cause,
+                  (unsigned long long) value);
+  } else {
+    std::snprintf(line, sizeof(line),
+                  "%s{protocol=\"%s\",operation=\"%s\"} %llu\n", name,
+                  kHostNames[host], kOperationNames[operation],
+                  (unsigned long long) value);
+  }
+  output += line;
+}
+
+void AppendCounter(std::string& output, const char* name, const char* type,
+                   const char* help, Counter counter) {
+  AppendHeader(output, name, type, help);
+  for (int host = 0; host < kMetricsHostCount; host++) {
+    for (int operation = 0; operation < kMetricsOperationCount; operation++) {
+      const OperationCounters& series = counters[host][operation];
+      if (series.requests.load(std::memory_order_relaxed))
+        AppendSample(output, name, host, operation, NULL,
+                     (series.*counter).load(std::memory_order_relaxed));
+    }
+  }
+}
+
+void AppendCauseCounter(std::string& output, const char* name,
+                        const char* help, CauseCounter counter) {
+  AppendHeader(output, name, "counter", help);
+  for (int host = 0; host < kMetricsHostCount; host++) {
+    for (int operation = 0; operation < kMetricsOperationCount; operation++) {
+      const OperationCounters& series = counters[host][operation];
+      for (int cause = 0; cause < diners::kFailureCauseCount; cause++) {
+        std::uint64_t value = (series.*counter)[cause].load(
+            std::memory_order_relaxed);
+        if (value)
+          AppendSample(output, name, host, operation, kCauseNames[cause],
+                       value);
+      }
+    }
+  }
+}
+
+}
+
+HostCallMeter::HostCallMeter(MetricsHost host, MetricsOperation operation)
+    : host_(host),
+      operation_(operation) {
+  OperationCounters& series = counters[host_][operation_];
+  Increment(series.requests);
+  Increment(series.in_flight);
+}
+
+HostCallMeter::~HostCallMeter() {
+  counters[host_][operation_].in_flight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void HostCallMeter::Finish(HostSwitch::Status status,
+                           const diners::CallStats& stats) {
+  OperationCounters& series = counters[host_][operation_];
+  Increment(series.bytes_sent, stats.bytes_sent);
+  Increment(series.bytes_received, stats.bytes_received);
+
+  switch (status) {
+    case HostSwitch::Status::COMPLETED:
+      Increment(series.completed);
+      break;
+
+    case HostSwitch::Status::TRANSIENT_FAILURE:
+      Increment(series.transient_failures[stats.failure]);
+      break;
+
+    default:
+      Increment(series.permanent_failures[stats.failure]);
+      break;
+  }
+}
+
+void HostCallMeter::Declined() {
+  Increment(counters[host_][operation_].declined);
+}
+
+std::string FormatHostMetrics() {
+  std::string output;
+  AppendCounter(output, "hostswitch_requests_total", "counter",
+                "Operations started.", &OperationCounters::requests);
+  AppendCounter(output, "hostswitch_in_flight", "gauge",
+                "Operations in progress.", &OperationCounters::in_flight);
+  AppendCounter(output, "hostswitch_completed_total", "counter",
+                "Operations the host answered.", &OperationCounters::completed);
+  AppendCounter(output, "hostswitch_declined_total", "counter",
+                "Completed operations with a response code other than 00.",
+                &OperationCounters::declined);
+  AppendCauseCounter(output, "hostswitch_transient_failures_total",
+                     "Operations that did not complete the exchange.",
+                     &OperationCounters::transient_failures);
+  AppendCauseCounter(output, "hostswitch_permanent_failures_total",
+                     "Operations whose response was rejected.",
+                     &OperationCounters::permanent_failures);
+  AppendCounter(output, "hostswitch_bytes_sent_total", "counter",
+                "Bytes sent to the host, TPDU included.",
+                &OperationCounters::bytes_sent);
+  AppendCounter(output, "hostswitch_bytes_received_total", "counter",
+                "Bytes received from the host, TPDU included.",
+                &OperationCounters::bytes_received);
+  return output;
+}
+
+bool WriteHostMetrics(const std::string& path) {
+  std::string text = FormatHostMetrics();
+  std::string temporary_path = path + ".tmp";
+
+  std::FILE* file = std::fopen(temporary_path.c_str(), "w");
+  if (!file)
+    return false;
+
+  bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+  written = std::fclose(file) == 0 && written;
+  if (!written) {
+    std::remove(temporary_path.c_str());
+    return false;
+  }
+
+  return std::rename(temporary_path.c_str(), path.c_str()) == 0;
+}
+
+}
@@ -0,0 +1,90 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef FDMS__HOST_METRICS_H_
+#define FDMS__HOST_METRICS_H_
+
+#include <string>
+#include <fdms/host_switch.h>
+#include <diners/call_stats.h>
+
+namespace fdms {
+
+// Host protocols as labelled in the metrics
+enum MetricsHost {
+  METRICS_FDMS_BASE24,
+  METRICS_AMEX_DIRECT,
+  METRICS_DINERS_DIRECT,
+  kMetricsHostCount
+};
+
+// HostSwitch operations as labelled in the metrics. The DCC variants count
+// with the operation they extend; OP_CONNECT is WaitForConnection().
+enum MetricsOperation {
+  OP_CONNECT,
+  OP_SALE,
+  OP_TC_UPLOAD,
+  OP_VOID,
+  OP_REVERSAL,
+  OP_REFUND,
+  OP_OFFLINE_SALE,
+  OP_PREAUTH,
+  OP_TIP_ADJUST,
+  OP_PREAUTH_COMPLETION,
+  OP_QUASI_CASH,
+  OP_BATCH_UPLOAD,
+  OP_SETTLEMENT,
+  OP_TEST_TRANSACTION,
+  OP_TMK_DOWNLOAD,
+  OP_PREAUTH_CANCELLATION,
+  OP_INSTALMENT_SALE,
+  OP_KEY_EXCHANGE,
+  kMetricsOperationCount
+};
+
+// Counts one HostSwitch operation. The request is counted and in flight
+// from construction to destruction; Finish() counts the outcome, with the
+// failure cause and traffic reported by the host.
+class HostCallMeter {
+ public:
+  HostCallMeter(MetricsHost host, MetricsOperation operation);
+  ~HostCallMeter();
+
+  void Finish(HostSwitch::Status status, const diners::CallStats& stats);
+
+  // Completed, but the host response code is not "00"
+  void Declined();
+
+ private:
+  HostCallMeter(const HostCallMeter&);
+  HostCallMeter& operator=(const HostCallMeter&);
+
+  MetricsHost host_;
+  MetricsOperation operation_;
+};
+
+// Every counter in the Prometheus text exposition format, e.g.
+//   hostswitch_requests_total{protocol="DINERS_DIRECT",operation="sale"} 12
+// Only operations that have been requested are listed.
+std::string FormatHostMetrics();
+
+// Writes FormatHostMetrics() to a temporary file renamed over 'path', so a
+// collector (e.g. the node exporter textfile collector) never reads a
+// partial file.
+bool WriteHostMetrics(const std::string& path);
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef FDMS__HOST_POOL_H_
+#define FDMS__HOST_POOL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fdms {
+
+// Host objects of one protocol shared by concurrent transactions. A host
+// holds a connection and per-call state, so it is checked out for the whole
+// of a transaction, from PreConnect to Disconnect. The factory makes hosts
+// as they are needed, up to 'max_size' of them; once all are out,
+// Acquire() waits for one to be released.
+template<typename HostType>
+class HostPool {
+ public:
+  typedef std::function<std::unique_ptr<HostType>()> Factory;
+
+  // Without a factory the pool only hands out the hosts given to Add()
+  HostPool(const Factory& factory, std::size_t max_size)
+      : factory_(factory),
+        max_size_(max_size),
+        size_(0) {
+  }
+
+  // 'host' stays owned by the caller and must outlive the pool
+  void Add(HostType& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(&host);
+    size_++;
+    available_.notify_one();
+  }
+
+  // nullptr if no host is released within 'timeout'
+  HostType* Acquire(std::chrono::milliseconds timeout) {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+        + timeout;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (idle_.empty()) {
+      if (factory_ && size_ < max_size_)
+        return Make(lock);
+      if (available_.wait_until(lock, deadline) == std::cv_status::timeout
+          && idle_.empty())
+        return NULL;
+    }
+
+    HostType* host = idle_.back();
+    idle_.pop_back();
+    return host;
+  }
+
+  void Release(HostType* host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(host);
+    available_.notify_one();
+  }
+
+ private:
+  HostPool(const HostPool&);
+  HostPool& operator=(const HostPool&);
+
+  // The slot is taken before the factory runs, unlocked
+  HostType* Make(std::unique_lock<std::mutex>& lock) {
+    size_++;
+    lock.unlock();
+    std::unique_ptr<HostType> host = factory_();
+    lock.lock();
+
+    if (!host) {
+      size_--;
+      available_.notify_one();  // the freed slot may let a waiter make one
+      return NULL;
+    }
+    owned_.push_back(std::move(host));
+    return owned_.back().get();
+  }
+
+  Factory factory_;
+  std::size_t max_size_;
+  std::size_t size_;  // hosts made or added, out or idle
+  std::mutex mutex_;
+  std::condition_variable available_;
+  std::vector<HostType*> idle_;
+  std::vector<std::unique_ptr<HostType>> owned_;
+};
+
+}
+
+#endif
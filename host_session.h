@@ -0,0 +1,179 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef FDMS__HOST_SESSION_H_
+#define FDMS__HOST_SESSION_H_
+
+#include <cstddef>
+#include <functional>
+#include <stdx/optional>
+
+namespace fdms {
+
+// One adapter type per host protocol (see host_switch.cpp). An adapter names
+// the concrete host class (HostType) and implements every HostSwitch
+// operation for it, so supporting a new protocol is one adapter type, its
+// HostPool and one case in HostSwitch::Route.
+struct FdmsHostAdapter;
+struct AmexHostAdapter;
+struct DinersHostAdapter;
+
+namespace detail {
+
+template<typename T, typename... Ts>
+struct IndexOf;
+
+template<typename T, typename... Ts>
+struct IndexOf<T, T, Ts...> {
+  static const std::size_t value = 0;
+};
+
+template<typename T, typename U, typename... Ts>
+struct IndexOf<T, U, Ts...> {
+  static const std::size_t value = 1 + IndexOf<T, Ts...>::value;
+};
+
+}
+
+// Closed set of hosts HostSwitch can route to. It holds a reference to the
+// selected host object and the index of its adapter. Visit() dispatches
+// through a table built at compile time, so there is no if/else chain and no
+// functor allocation per call.
+//
+// A visitor provides a ResultType typedef and a member template
+//   template<typename Adapter>
+//   ResultType Apply(typename Adapter::HostType& host) const;
+template<typename... Adapters>
+class HostVariant {
+ public:
+  template<typename Adapter>
+  static HostVariant Of(typename Adapter::HostType& host) {
+    return HostVariant(detail::IndexOf<Adapter, Adapters...>::value, &host);
+  }
+
+  template<typename Adapter>
+  bool Is() const {
+    return index_ == detail::IndexOf<Adapter, Adapters...>::value;
+  }
+
+  // Host of 'Adapter', which must be the selected one (see Is())
+  template<typename Adapter>
+  typename Adapter::HostType& Get() const {
+    return *static_cast<typename Adapter::HostType*>(host_);
+  }
+
+  template<typename Visitor>
+  typename Visitor::ResultType Visit(const Visitor& visitor) const {
+    typedef typename Visitor::ResultType (*Thunk)(const Visitor&, void*);
+    static const Thunk kThunks[] = { &Invoke<Visitor, Adapters>... };
+    return kThunks[index_](visitor, host_);
+  }
+
+ private:
+  HostVariant(std::size_t index, void* host)
+      : index_(index),
+        host_(host) {
+  }
+
+  template<typename Visitor, typename Adapter>
+  static typename Visitor::ResultType Invoke(const Visitor& visitor, void* host) {
+    return visitor.template Apply<Adapter>(
+        *static_cast<typename Adapter::HostType*>(host));
+  }
+
+  std::size_t index_;
+  void* host_;
+};
+
+typedef HostVariant<FdmsHostAdapter, AmexHostAdapter, DinersHostAdapter> HostSession;
+
+// Routing context of one transaction: the host session HostSwitch::Route()
+// checked out of a pool for it. Every operation of the transaction is given
+// the route, so concurrent transactions never share a host. The session goes
+// back to its pool on Release() or destruction, disconnected first if it is
+// still connected.
+class HostRoute {
+ public:
+  // Called with whether the session is still connected
+  typedef std::function<void(bool connected)> ReturnFunc;
+
+  HostRoute()
+      : connected_(false) {
+  }
+
+  HostRoute(const HostSession& session, const ReturnFunc& return_func)
+      : session_(session),
+        return_func_(return_func),
+        connected_(false) {
+  }
+
+  HostRoute(HostRoute&& other)
+      : session_(other.session_),
+        return_func_(std::move(other.return_func_)),
+        connected_(other.connected_) {
+    other.session_ = stdx::nullopt;
+    other.return_func_ = ReturnFunc();
+  }
+
+  HostRoute& operator=(HostRoute&& other) {
+    if (this != &other) {
+      Release();
+      session_ = other.session_;
+      return_func_ = std::move(other.return_func_);
+      connected_ = other.connected_;
+      other.session_ = stdx::nullopt;
+      other.return_func_ = ReturnFunc();
+    }
+    return *this;
+  }
+
+  ~HostRoute() {
+    Release();
+  }
+
+  bool IsRouted() const {
+    return static_cast<bool>(session_);
+  }
+
+  // Only while IsRouted()
+  const HostSession& session() const {
+    return *session_;
+  }
+
+  void SetConnected(bool connected) {
+    connected_ = connected;
+  }
+
+  void Release() {
+    session_ = stdx::nullopt;
+    ReturnFunc return_func;
+    return_func.swap(return_func_);
+    if (return_func)
+      return_func(connected_);
+    connected_ = false;
+  }
+
+ private:
+  HostRoute(const HostRoute&);
+  HostRoute& operator=(const HostRoute&);
+
+  stdx::optional<HostSession> session_;
+  ReturnFunc return_func_;
+  bool connected_;
+};
+
+}
+
+#endif
@@ -14,11 +14,52 @@
  ------------------------------------------------------------------------------
  */
 #include <fdms/host_switch.h>
+#include <chrono>
+#include <mutex>
+#include <diners/batch_reconciler.h>
 #include <diners/diners_host.h>
-#include <functional>
 #include <utils/get_default.h>
 #include <amex/amex_host.h>
 #include "app_counter.h"
+#include "batch_totals.h"
+#include "host_metrics.h"
+#include "host_pool.h"
+#include "host_session.h"
+#include "transaction_adapters.h"
+
+// fdms/host_switch.h is not part of this tree. Against its last released
+// version, class HostSwitch has to:
+// - include <mutex>, "host_pool.h" and "host_session.h", and forward declare
+//   diners::BatchStore and diners::BatchReconciler
+// - replace current_host_protocol_ with
+//     HostRoute current_route_;
+//     std::unique_ptr<HostPool<Host>> fdms_pool_;
+//     std::unique_ptr<HostPool<amex::AmexHost>> amex_pool_;
+//     std::unique_ptr<HostPool<diners::DinersHost>> diners_pool_;
+//     std::once_flag host_pools_once_;
+// - declare, public:
+//     HostRoute Route(unsigned int host_index);
+//     bool WaitForConnection(HostRoute& route);
+//     bool Disconnect(HostRoute& route);
+//   and a HostRoute& overload, route first, of every Status operation
+//   (AuthorizeSale ... AuthorizeQuasiCash, PerformBatchUpload,
+//   PerformSettlement and the PerformFdms* / AuthorizeFdms* ones), plus
+//     Status PerformDinersReconciledSettlement(HostRoute& route,
+//         SettlementData& settle_msg, const diners::BatchStore& batch,
+//         diners::BatchReconciler& reconciler);
+//     Status PerformDinersReconciledSettlement(SettlementData& settle_msg,
+//         const diners::BatchStore& batch,
+//         diners::BatchReconciler& reconciler);
+// - declare, private:
+//     template<typename Op>
+//     Status PerformActionWithTx(HostRoute& route, Transaction& tx);
+//     std::unique_ptr<amex::AmexHost> MakeAmexHost();
+//     void InitHostPools();
+// - drop PerformAmexBatchUpload() and PerformDinersBatchUpload(), which
+//   moved into the adapters below
+// Host (diners/host.h, not in this tree either) has to declare
+// CallStats TakeCallStats() and a CallStats call_stats_ member, as
+// DinersHost does.
 
 namespace fdms {
 
@@ -44,329 +85,473 @@ HostSwitch::Status ConvertAmexStatus(amex::AmexHost::Status status) {
   return utils::GetDefault(map, status, HostSwitch::Status::PERM_FAILURE);
 }
 
-amex::AmexTransactionType ConvertTxToAmexTxType(TransactionType tx_type) {
-  amex::AmexTransactionType amex_tx_type = amex::AmexTransactionType::SALE;
-  switch (tx_type) {
-    case TransactionType::REFUND:
-      amex_tx_type = amex::AmexTransactionType::REFUND;
-      break;
-
-    case TransactionType::PREAUTH:
-      amex_tx_type = amex::AmexTransactionType::PREAUTH;
-      break;
-
-    case TransactionType::PREAUTH_COMPLETION_ONLINE:
-      amex_tx_type = amex::AmexTransactionType::PREAUTH_COMPLETION_ONLINE;
-      break;
+HostSwitch::Status ConvertDinersStatus(diners::DinersHost::Status status) {
+  static std::map<diners::DinersHost::Status, HostSwitch::Status> map =
+      {
+          { diners::DinersHost::Status::COMPLETED, HostSwitch::Status::COMPLETED },
+          { diners::DinersHost::Status::TRANSIENT_FAILURE, HostSwitch::Status::TRANSIENT_FAILURE },
+          { diners::DinersHost::Status::PERM_FAILURE, HostSwitch::Status::PERM_FAILURE },
+      };
+  return utils::GetDefault(map, status, HostSwitch::Status::PERM_FAILURE);
+}
 
-    case TransactionType::OFFLINE_SALE:
-      amex_tx_type = amex::AmexTransactionType::OFFLINE_SALE;
-      break;
+// Response code of a completed operation, empty if the host sets none
+// Y1 and Y3 are the offline approvals of a chip card
+bool IsDeclined(const std::string& response_code) {
+  return !response_code.empty() && response_code != "00" &&
+         response_code != "Y1" && response_code != "Y3";
+}
+
+}
+
+namespace host_ops {
+
+// Operation tags. Each host adapter maps a tag to the host method that
+// implements it.
+struct AuthorizeSale {};
+struct AuthorizeSaleWithDccEnquiry {};
+struct AuthorizeSaleWithDccAllowed {};
+struct PerformTcUpload {};
+struct PerformVoid {};
+struct SendReversal {};
+struct AuthorizeRefund {};
+struct PerformOfflineSale {};
+struct PerformOfflineWithDccEnquiry {};
+struct PerformOfflineWithDccAllowed {};
+struct AuthorizePreAuth {};
+struct AuthorizePreAuthWithDccEnquiry {};
+struct AuthorizePreAuthWithDccAllowed {};
+struct PerformTipAdjust {};
+struct AuthorizePreAuthCompletion {};
+struct AuthorizePreAuthCompletionWithDccEnquiry {};
+struct AuthorizePreAuthCompletionWithDccAllowed {};
+struct AuthorizeQuasiCash {};
+
+// Metrics label of each operation
+MetricsOperation OperationOf(AuthorizeSale) { return OP_SALE; }
+MetricsOperation OperationOf(AuthorizeSaleWithDccEnquiry) { return OP_SALE; }
+MetricsOperation OperationOf(AuthorizeSaleWithDccAllowed) { return OP_SALE; }
+MetricsOperation OperationOf(PerformTcUpload) { return OP_TC_UPLOAD; }
+MetricsOperation OperationOf(PerformVoid) { return OP_VOID; }
+MetricsOperation OperationOf(SendReversal) { return OP_REVERSAL; }
+MetricsOperation OperationOf(AuthorizeRefund) { return OP_REFUND; }
+MetricsOperation OperationOf(PerformOfflineSale) { return OP_OFFLINE_SALE; }
+MetricsOperation OperationOf(PerformOfflineWithDccEnquiry) { return OP_OFFLINE_SALE; }
+MetricsOperation OperationOf(PerformOfflineWithDccAllowed) { return OP_OFFLINE_SALE; }
+MetricsOperation OperationOf(AuthorizePreAuth) { return OP_PREAUTH; }
+MetricsOperation OperationOf(AuthorizePreAuthWithDccEnquiry) { return OP_PREAUTH; }
+MetricsOperation OperationOf(AuthorizePreAuthWithDccAllowed) { return OP_PREAUTH; }
+MetricsOperation OperationOf(PerformTipAdjust) { return OP_TIP_ADJUST; }
+MetricsOperation OperationOf(AuthorizePreAuthCompletion) { return OP_PREAUTH_COMPLETION; }
+MetricsOperation OperationOf(AuthorizePreAuthCompletionWithDccEnquiry) { return OP_PREAUTH_COMPLETION; }
+MetricsOperation OperationOf(AuthorizePreAuthCompletionWithDccAllowed) { return OP_PREAUTH_COMPLETION; }
+MetricsOperation OperationOf(AuthorizeQuasiCash) { return OP_QUASI_CASH; }
+
+}
+
+struct FdmsHostAdapter {
+  typedef Host HostType;
+  static const MetricsHost kMetricsHost = METRICS_FDMS_BASE24;
+  typedef Host::Status (Host::*TxMethod)(Transaction&);
+
+  static TxMethod Method(host_ops::AuthorizeSale) { return &Host::AuthorizeSale; }
+  static TxMethod Method(host_ops::AuthorizeSaleWithDccEnquiry) { return &Host::AuthorizeSaleWithDccEnquiry; }
+  static TxMethod Method(host_ops::AuthorizeSaleWithDccAllowed) { return &Host::AuthorizeSaleWithDccAllowed; }
+  static TxMethod Method(host_ops::PerformTcUpload) { return &Host::PerformTcUpload; }
+  static TxMethod Method(host_ops::PerformVoid) { return &Host::PerformVoid; }
+  static TxMethod Method(host_ops::SendReversal) { return &Host::SendReversal; }
+  static TxMethod Method(host_ops::AuthorizeRefund) { return &Host::AuthorizeRefund; }
+  static TxMethod Method(host_ops::PerformOfflineSale) { return &Host::PerformOfflineSale; }
+  static TxMethod Method(host_ops::PerformOfflineWithDccEnquiry) { return &Host::PerformOfflineWithDccEnquiry; }
+  static TxMethod Method(host_ops::PerformOfflineWithDccAllowed) { return &Host::PerformOfflineWithDccAllowed; }
+  static TxMethod Method(host_ops::AuthorizePreAuth) { return &Host::AuthorizePreAuth; }
+  static TxMethod Method(host_ops::AuthorizePreAuthWithDccEnquiry) { return &Host::AuthorizePreAuthWithDccEnquiry; }
+  static TxMethod Method(host_ops::AuthorizePreAuthWithDccAllowed) { return &Host::AuthorizePreAuthWithDccAllowed; }
+  static TxMethod Method(host_ops::PerformTipAdjust) { return &Host::SendTipAdjust; }
+  static TxMethod Method(host_ops::AuthorizePreAuthCompletion) { return &Host::AuthorizePreAuthCompletion; }
+  static TxMethod Method(host_ops::AuthorizePreAuthCompletionWithDccEnquiry) { return &Host::AuthorizePreAuthCompletionWithDccEnquiry; }
+  static TxMethod Method(host_ops::AuthorizePreAuthCompletionWithDccAllowed) { return &Host::AuthorizePreAuthCompletionWithDccAllowed; }
+  static TxMethod Method(host_ops::AuthorizeQuasiCash) { return &Host::AuthorizeQuasiCash; }
+
+  template<typename Op>
+  static HostSwitch::Status PerformTx(HostType& host, Transaction& tx) {
+    return ConvertStatus((host.*Method(Op()))(tx));
+  }
 
-    case TransactionType::SALE:
-      default:     // TODO: other types
-      amex_tx_type = amex::AmexTransactionType::SALE;
-      break;
+  static HostSwitch::Status PerformBatchUpload(HostType& host,
+                                               std::vector<Transaction>& transaction_list) {
+    return ConvertStatus(host.PerformBatchUpload(transaction_list));
   }
 
-  return amex_tx_type;
-}
+  static HostSwitch::Status PerformSettlement(HostType& host,
+                                              SettlementData& settle_msg,
+                                              bool after_batch_upload) {
+    return ConvertStatus(host.PerformSettlement(settle_msg, after_batch_upload));
+  }
 
-amex::AmexTransaction BuildAmexTransactionFromTransaction(const Transaction tx) {
-  amex::AmexTransaction amex_tx;
+  static HostSwitch::Status PerformTestTransaction(HostType& host, TestTransaction& test_tx) {
+    return ConvertStatus(host.PerformTestTransaction(test_tx));
+  }
 
-  amex_tx.pan = tx.pan;
-  amex_tx.processing_code = tx.processing_code;
-  amex_tx.amount = tx.amount;
+  static diners::CallStats TakeCallStats(HostType& host) {
+    return host.TakeCallStats();
+  }
+};
+
+struct AmexHostAdapter {
+  typedef amex::AmexHost HostType;
+  static const MetricsHost kMetricsHost = METRICS_AMEX_DIRECT;
+  typedef amex::AmexHost::Status (amex::AmexHost::*TxMethod)(amex::AmexTransaction&);
+
+  static TxMethod Method(host_ops::AuthorizeSale) { return &amex::AmexHost::AuthorizeSale; }
+  static TxMethod Method(host_ops::AuthorizeSaleWithDccEnquiry) { return &amex::AmexHost::AuthorizeSale; }
+  static TxMethod Method(host_ops::AuthorizeSaleWithDccAllowed) { return &amex::AmexHost::AuthorizeSale; }
+  static TxMethod Method(host_ops::PerformTcUpload) { return &amex::AmexHost::PerformTcUpload; }
+  static TxMethod Method(host_ops::PerformVoid) { return &amex::AmexHost::PerformVoid; }
+  static TxMethod Method(host_ops::SendReversal) { return &amex::AmexHost::SendReversal; }
+  static TxMethod Method(host_ops::AuthorizeRefund) { return &amex::AmexHost::AuthorizeRefund; }
+  static TxMethod Method(host_ops::PerformOfflineSale) { return &amex::AmexHost::SendOfflineSale; }
+  static TxMethod Method(host_ops::PerformOfflineWithDccEnquiry) { return &amex::AmexHost::SendOfflineSale; }
+  static TxMethod Method(host_ops::PerformOfflineWithDccAllowed) { return &amex::AmexHost::SendOfflineSale; }
+  static TxMethod Method(host_ops::AuthorizePreAuth) { return &amex::AmexHost::AuthorizePreAuth; }
+  static TxMethod Method(host_ops::AuthorizePreAuthWithDccEnquiry) { return &amex::AmexHost::AuthorizePreAuth; }
+  static TxMethod Method(host_ops::AuthorizePreAuthWithDccAllowed) { return &amex::AmexHost::AuthorizePreAuth; }
+  static TxMethod Method(host_ops::PerformTipAdjust) { return &amex::AmexHost::SendTipAdjust; }
+  static TxMethod Method(host_ops::AuthorizePreAuthCompletion) { return &amex::AmexHost::AuthorizePreAuthCompletion; }
+  static TxMethod Method(host_ops::AuthorizePreAuthCompletionWithDccEnquiry) { return &amex::AmexHost::AuthorizePreAuthCompletion; }
+  static TxMethod Method(host_ops::AuthorizePreAuthCompletionWithDccAllowed) { return &amex::AmexHost::AuthorizePreAuthCompletion; }
+  static TxMethod Method(host_ops::AuthorizeQuasiCash) { return &amex::AmexHost::AuthorizeSale; }
+
+  template<typename Op>
+  static HostSwitch::Status PerformTx(HostType& host, Transaction& tx) {
+    AmexTransactionAdapter amex_tx(tx);
+    return ConvertAmexStatus((host.*Method(Op()))(amex_tx.get()));
+  }
 
-  amex_tx.stan = tx.stan;
-  amex_tx.expiration_date = tx.expiration_date;
-  amex_tx.pos_entry_mode = tx.pos_entry_mode;
-  amex_tx.nii = tx.nii;
-  amex_tx.pos_condition_code = tx.pos_condition_code;
+  static HostSwitch::Status PerformBatchUpload(HostType& host,
+                                               std::vector<Transaction>& transaction_list) {
+    amex::AmexHost::Status status = amex::AmexHost::Status::COMPLETED;
+    for (auto& tx : transaction_list) {
+      AmexTransactionAdapter amex_tx(tx, false);
+      status = host.PerformBatchUpload(amex_tx.get(), NextAppCounter(&GetNextStanNo));
+      if (status != amex::AmexHost::Status::COMPLETED)
+        break;
+    }
 
-  if (tx.track2_equivalent_data) {
-    amex_tx.track2 = tx.track2_equivalent_data->GetData();
+    return ConvertAmexStatus(status);
   }
 
-  amex_tx.tid = tx.tid;
-  amex_tx.mid = tx.mid;
+  static HostSwitch::Status PerformSettlement(HostType& host,
+                                              SettlementData& settle_msg,
+                                              bool after_batch_upload) {
+    amex::AmexSettlementData amex_settle = BuildAmexSettlementData(settle_msg);
+    amex::AmexHost::Status status = host.PerformSettlement(amex_settle, after_batch_upload);
+    FillSettlementDataWithAmexSettlementData(settle_msg, amex_settle);
+    return ConvertAmexStatus(status);
+  }
 
-  if (!tx.track1_data.empty()) {
-    amex_tx.track1_data = tx.track1_data;
+  static HostSwitch::Status PerformTestTransaction(HostType&, TestTransaction&) {
+    return HostSwitch::Status::PERM_FAILURE;
   }
 
-  if (!tx.pin_data.empty()) {
-    amex_tx.pin_block = tx.pin_data;
+  // The Amex host does not report failure causes nor traffic
+  static diners::CallStats TakeCallStats(HostType&) {
+    return diners::CallStats();
+  }
+};
+
+struct DinersHostAdapter {
+  typedef diners::DinersHost HostType;
+  static const MetricsHost kMetricsHost = METRICS_DINERS_DIRECT;
+  typedef diners::DinersHost::Status (diners::DinersHost::*TxMethod)(diners::DinersTransaction&);
+
+  static TxMethod Method(host_ops::AuthorizeSale) { return &diners::DinersHost::AuthorizeSale; }
+  static TxMethod Method(host_ops::AuthorizeSaleWithDccEnquiry) { return &diners::DinersHost::AuthorizeSale; }
+  static TxMethod Method(host_ops::AuthorizeSaleWithDccAllowed) { return &diners::DinersHost::AuthorizeSale; }
+  static TxMethod Method(host_ops::PerformTcUpload) { return &diners::DinersHost::PerformTcUpload; }
+  static TxMethod Method(host_ops::PerformVoid) { return &diners::DinersHost::PerformVoid; }
+  static TxMethod Method(host_ops::SendReversal) { return &diners::DinersHost::SendReversal; }
+  static TxMethod Method(host_ops::AuthorizeRefund) { return &diners::DinersHost::AuthorizeRefund; }
+  static TxMethod Method(host_ops::PerformOfflineSale) { return &diners::DinersHost::SendOfflineSale; }
+  static TxMethod Method(host_ops::PerformOfflineWithDccEnquiry) { return &diners::DinersHost::SendOfflineSale; }
+  static TxMethod Method(host_ops::PerformOfflineWithDccAllowed) { return &diners::DinersHost::SendOfflineSale; }
+  static TxMethod Method(host_ops::AuthorizePreAuth) { return &diners::DinersHost::AuthorizePreAuth; }
+  static TxMethod Method(host_ops::AuthorizePreAuthWithDccEnquiry) { return &diners::DinersHost::AuthorizePreAuth; }
+  static TxMethod Method(host_ops::AuthorizePreAuthWithDccAllowed) { return &diners::DinersHost::AuthorizePreAuth; }
+  static TxMethod Method(host_ops::PerformTipAdjust) { return &diners::DinersHost::SendTipAdjust; }
+  static TxMethod Method(host_ops::AuthorizePreAuthCompletion) { return &diners::DinersHost::PerformSaleCompletion; }
+  static TxMethod Method(host_ops::AuthorizePreAuthCompletionWithDccEnquiry) { return &diners::DinersHost::PerformSaleCompletion; }
+  static TxMethod Method(host_ops::AuthorizePreAuthCompletionWithDccAllowed) { return &diners::DinersHost::PerformSaleCompletion; }
+  static TxMethod Method(host_ops::AuthorizeQuasiCash) { return &diners::DinersHost::AuthorizeSale; }
+
+  template<typename Op>
+  static HostSwitch::Status PerformTx(HostType& host, Transaction& tx) {
+    DinersTransactionAdapter diners_tx(tx);
+    return ConvertDinersStatus((host.*Method(Op()))(diners_tx.get()));
   }
 
-  amex_tx.additional_amount = tx.secondary_amount;
-  amex_tx.icc_data = tx.icc_data;
-  amex_tx.transaction_type = ConvertTxToAmexTxType(tx.transaction_type);
-  amex_tx.tpdu = tx.tpdu;
+  static HostSwitch::Status PerformBatchUpload(HostType& host,
+                                               std::vector<Transaction>& transaction_list) {
+    diners::DinersHost::Status status = diners::DinersHost::Status::COMPLETED;
+    for (auto& tx : transaction_list) {
+      DinersTransactionAdapter diners_tx(tx, false);
+      status = host.PerformBatchUpload(diners_tx.get(), NextAppCounter(&GetNextStanNo));
+      if (status != diners::DinersHost::Status::COMPLETED)
+        break;
+    }
 
-  amex_tx.tx_datetime = tx.tx_datetime;
-  amex_tx.rrn = tx.rrn;
-  amex_tx.auth_id_response = tx.auth_id_response;
-  amex_tx.response_code = tx.response_code;
-  amex_tx.issuer_emv_response = tx.issuer_emv_response;
+    return ConvertDinersStatus(status);
+  }
 
-  amex_tx.invoice_number = tx.invoice_num;
-  amex_tx.amex_4dbc = tx.cvv;
-  amex_tx.preauth_amount = tx.preauth_amount;
+  static HostSwitch::Status PerformSettlement(HostType& host,
+                                              SettlementData& settle_msg,
+                                              bool after_batch_upload) {
+    diners::DinersSettlementData diners_settle = BuildDinersSettlementData(settle_msg);
+    diners::DinersHost::Status status = host.PerformSettlement(diners_settle, after_batch_upload);
+    FillSettlementDataWithDinersSettlementData(settle_msg, diners_settle);
+    return ConvertDinersStatus(status);
+  }
 
-  return amex_tx;
-}
+  static HostSwitch::Status PerformTestTransaction(HostType& host, TestTransaction& test_tx) {
+    diners::TestTransaction diners_tx;
+    diners_tx.processing_code = "990000";
+    diners_tx.tpdu = test_tx.tpdu;
+    diners_tx.nii = test_tx.nii;
+    diners_tx.tid = test_tx.tid;
+    diners_tx.mid = test_tx.mid;
+    return ConvertDinersStatus(host.PerformDinersTestTransaction(diners_tx));
+  }
 
-amex::AmexSettlementData BuildAmexSettlementData(const SettlementData & settle_data){
-  amex::AmexSettlementData amex_settle;
-  amex_settle.tx_datetime = settle_data.tx_datetime;
-  amex_settle.batch_number = settle_data.batch_number;
-  amex_settle.nii = settle_data.nii;
-  amex_settle.tpdu = settle_data.tpdu;
-  amex_settle.tid = settle_data.tid;
-  amex_settle.mid = settle_data.mid;
-  amex_settle.rrn = settle_data.rrn;
-  amex_settle.stan = settle_data.stan;
+  static diners::CallStats TakeCallStats(HostType& host) {
+    return host.TakeCallStats();
+  }
+};
 
-  amex_settle.batch_summary.credit_total.count = settle_data.batch_summary.refunds_total.count;
-  amex_settle.batch_summary.credit_total.total = settle_data.batch_summary.refunds_total.total;
-  amex_settle.batch_summary.debit_total.count = settle_data.batch_summary.sales_total.count;
-  amex_settle.batch_summary.debit_total.total = settle_data.batch_summary.sales_total.total;
-  amex_settle.batch_summary.currency = settle_data.batch_summary.currency;
+namespace {
 
-  amex_settle.invoice_num = GetNextInvoiceNo();  //TODO: check / clarify amex requirement
+// Visitors, one per HostSwitch operation. They are applied to the current
+// HostSession and forward to the adapter of the selected host, counting the
+// operation in the host metrics.
+template<typename Op>
+class TxVisitor {
+ public:
+  typedef HostSwitch::Status ResultType;
 
-  return amex_settle;
-}
+  explicit TxVisitor(Transaction& tx)
+      : tx_(tx) {
+  }
 
-void FillSettlementDataWithAmexSettlementData(SettlementData & settle_data, const amex::AmexSettlementData amex_settle_data) {
-  settle_data.processing_code = amex_settle_data.processing_code;
-  settle_data.tx_datetime = amex_settle_data.tx_datetime;
-  settle_data.rrn = amex_settle_data.rrn;
-  settle_data.response_code = amex_settle_data.response_code;
-  settle_data.stan = amex_settle_data.stan;
-  settle_data.nii = amex_settle_data.nii;
-  settle_data.tid = amex_settle_data.tid;
-}
+  template<typename Adapter>
+  ResultType Apply(typename Adapter::HostType& host) const {
+    HostCallMeter meter(Adapter::kMetricsHost, host_ops::OperationOf(Op()));
+    ResultType status = Adapter::template PerformTx<Op>(host, tx_);
+    meter.Finish(status, Adapter::TakeCallStats(host));
+    if (status != HostSwitch::Status::COMPLETED)
+      return status;
 
-void FillTransactionWithAmexTransactionData(Transaction& tx, const amex::AmexTransaction amex_tx) {
+    if (IsDeclined(tx_.response_code))
+      meter.Declined();
+    else
+      UpdateBatchTotals(Adapter::kMetricsHost, host_ops::OperationOf(Op()), tx_);
+    return status;
+  }
 
-  tx.processing_code = amex_tx.processing_code;
-  tx.tx_datetime = amex_tx.tx_datetime;  // TODO: check that. Shall we have a host datetime somewhere?
-  tx.rrn = amex_tx.rrn;
-  tx.auth_id_response = amex_tx.auth_id_response;
-  tx.response_code = amex_tx.response_code;
-  tx.issuer_emv_response = amex_tx.issuer_emv_response;
-}
+ private:
+  Transaction& tx_;
+};
 
-HostSwitch::Status ConvertDinersStatus(diners::DinersHost::Status status) {
-  static std::map<diners::DinersHost::Status, HostSwitch::Status> map =
-      {
-          { diners::DinersHost::Status::COMPLETED, HostSwitch::Status::COMPLETED },
-          { diners::DinersHost::Status::TRANSIENT_FAILURE, HostSwitch::Status::TRANSIENT_FAILURE },
-          { diners::DinersHost::Status::PERM_FAILURE, HostSwitch::Status::PERM_FAILURE },
-      };
-  return utils::GetDefault(map, status, HostSwitch::Status::PERM_FAILURE);
-}
+class BatchUploadVisitor {
+ public:
+  typedef HostSwitch::Status ResultType;
 
-diners::DinersTransactionType ConvertTxToDinersTxType(TransactionType tx_type) {
-  diners::DinersTransactionType diners_tx_type = diners::DinersTransactionType::SALE;
-  switch (tx_type) {
-    case TransactionType::REFUND:
-      diners_tx_type = diners::DinersTransactionType::REFUND;
-      break;
+  explicit BatchUploadVisitor(std::vector<Transaction>& transaction_list)
+      : transaction_list_(transaction_list) {
+  }
 
-    case TransactionType::PREAUTH:
-      diners_tx_type = diners::DinersTransactionType::PREAUTH;
-      break;
+  template<typename Adapter>
+  ResultType Apply(typename Adapter::HostType& host) const {
+    HostCallMeter meter(Adapter::kMetricsHost, OP_BATCH_UPLOAD);
+    ResultType status = Adapter::PerformBatchUpload(host, transaction_list_);
+    meter.Finish(status, Adapter::TakeCallStats(host));
+    return status;
+  }
 
-    case TransactionType::AUTHORIZATION:
-      diners_tx_type = diners::DinersTransactionType::AUTHORIZATION;
-      break;
+ private:
+  std::vector<Transaction>& transaction_list_;
+};
 
-    case TransactionType::OFFLINE_SALE:
-      diners_tx_type = diners::DinersTransactionType::OFFLINE_SALE;
-      break;
+class SettlementVisitor {
+ public:
+  typedef HostSwitch::Status ResultType;
 
-    case TransactionType::PREAUTH_COMPLETION_OFFLINE:
-      diners_tx_type = diners::DinersTransactionType::PREAUTH_COMPLETION_OFFLINE;
-      break;
+  SettlementVisitor(SettlementData& settle_msg, bool after_batch_upload)
+      : settle_msg_(settle_msg),
+        after_batch_upload_(after_batch_upload) {
+  }
 
-    default:     // TODO: other types
-      diners_tx_type = diners::DinersTransactionType::SALE;
-      break;
+  template<typename Adapter>
+  ResultType Apply(typename Adapter::HostType& host) const {
+    HostCallMeter meter(Adapter::kMetricsHost, OP_SETTLEMENT);
+    FillBatchSummary(Adapter::kMetricsHost, settle_msg_);
+    ResultType status = Adapter::PerformSettlement(host, settle_msg_, after_batch_upload_);
+    meter.Finish(status, Adapter::TakeCallStats(host));
+    if (status != HostSwitch::Status::COMPLETED)
+      return status;
+
+    if (IsDeclined(settle_msg_.response_code))
+      meter.Declined();
+    else
+      CloseBatchTotals(Adapter::kMetricsHost, settle_msg_);
+    return status;
   }
 
-  return diners_tx_type;
-}
+ private:
+  SettlementData& settle_msg_;
+  bool after_batch_upload_;
+};
 
-diners::DinersTransactionStatus ConvertTxToDinersTxStatus(TransactionStatus tx_status) {
-  diners::DinersTransactionStatus diners_tx_status = diners::DinersTransactionStatus::IN_PROGRESS;
-  switch (tx_status) {
-    case TransactionStatus::IN_PROGRESS:
-      diners_tx_status = diners::DinersTransactionStatus::IN_PROGRESS;
-      break;
+class TestTransactionVisitor {
+ public:
+  typedef HostSwitch::Status ResultType;
 
-    case TransactionStatus::APPROVED:
-      diners_tx_status = diners::DinersTransactionStatus::APPROVED;
-      break;
+  explicit TestTransactionVisitor(TestTransaction& test_tx)
+      : test_tx_(test_tx) {
+  }
 
-    case TransactionStatus::DECLINED:
-      diners_tx_status = diners::DinersTransactionStatus::DECLINED;
-      break;
+  template<typename Adapter>
+  ResultType Apply(typename Adapter::HostType& host) const {
+    HostCallMeter meter(Adapter::kMetricsHost, OP_TEST_TRANSACTION);
+    ResultType status = Adapter::PerformTestTransaction(host, test_tx_);
+    meter.Finish(status, Adapter::TakeCallStats(host));
+    return status;
+  }
 
-    case TransactionStatus::NOT_ALLOWED:
-      diners_tx_status = diners::DinersTransactionStatus::NOT_ALLOWED;
-      break;
+ private:
+  TestTransaction& test_tx_;
+};
 
-    case TransactionStatus::TO_ADVISE:
-      diners_tx_status = diners::DinersTransactionStatus::TO_ADVISE;
-      break;
+// Connection management has the same signature on every host, so these
+// visitors call the host directly. Only the wait for the connection is
+// metered.
+class PreConnectVisitor {
+ public:
+  typedef bool ResultType;
 
-    case TransactionStatus::CANCELLED:
-    default:     // TODO: other transaction status
-      diners_tx_status = diners::DinersTransactionStatus::DECLINED;
-      break;
+  explicit PreConnectVisitor(const std::string& host_name)
+      : host_name_(host_name) {
   }
 
-  return diners_tx_status;
-}
-
-diners::DinersInProgressStatus ConvertTxToDinersInProgressStatus(InProgressStatus in_progress_status){
-  diners::DinersInProgressStatus diners_in_status;
-  switch(in_progress_status){
-  case InProgressStatus::IN_PROGRESS_NONE:
-    diners_in_status = diners::DinersInProgressStatus::IN_PROGRESS_NONE;
-    break;
+  template<typename Adapter>
+  ResultType Apply(typename Adapter::HostType& host) const {
+    return host.PreConnect(host_name_);
+  }
 
-  case InProgressStatus::IN_PROGRESS_VOID:
-    diners_in_status = diners::DinersInProgressStatus::IN_PROGRESS_VOID;
-    break;
+ private:
+  const std::string& host_name_;
+};
 
-  case InProgressStatus::IN_PROGRESS_PREAUTH_COMPLETION:
-    diners_in_status = diners::DinersInProgressStatus::IN_PROGRESS_SALE_COMPLETION;
-    break;
+class WaitForConnectionVisitor {
+ public:
+  typedef bool ResultType;
 
-  default:     // TODO: other status
-    diners_in_status = diners::DinersInProgressStatus::IN_PROGRESS_NONE;
-    break;
+  explicit WaitForConnectionVisitor(uint32_t timeout)
+      : timeout_(timeout) {
   }
 
-  return diners_in_status;
-}
-
-diners::DinersTransaction BuildDinersTransactionFromTransaction(const Transaction tx) {
-	diners::DinersTransaction diners_tx;
-
-    diners_tx.pan = tx.pan;
-    diners_tx.processing_code = tx.processing_code;
-    diners_tx.amount = tx.amount;
+  template<typename Adapter>
+  ResultType Apply(typename Adapter::HostType& host) const {
+    HostCallMeter meter(Adapter::kMetricsHost, OP_CONNECT);
+    bool connected = host.WaitForConnection(timeout_);
+
+    diners::CallStats stats;
+    if (!connected)
+      stats.failure = diners::FAILURE_CONNECT;
+    meter.Finish(connected ? HostSwitch::Status::COMPLETED
+                           : HostSwitch::Status::TRANSIENT_FAILURE, stats);
+    return connected;
+  }
 
-    diners_tx.stan = tx.stan;
-    diners_tx.expiration_date = tx.expiration_date;
-    diners_tx.pos_entry_mode = tx.pos_entry_mode;
-    diners_tx.nii = tx.nii;
-    diners_tx.pos_condition_code = tx.pos_condition_code;
+ private:
+  uint32_t timeout_;
+};
 
-    if (tx.track2_equivalent_data) {
-    	diners_tx.track2 = tx.track2_equivalent_data->GetData();
-    }
+class DisconnectVisitor {
+ public:
+  typedef bool ResultType;
 
-    if(tx.aid){
-    	diners_tx.aid = tx.aid;
-    }
+  template<typename Adapter>
+  ResultType Apply(typename Adapter::HostType& host) const {
+    return host.Disconnect();
+  }
+};
 
-    diners_tx.tid = tx.tid;
-    diners_tx.mid = tx.mid;
-    diners_tx.cvv = tx.cvv;
+// Operations only the FDMS host supports call it directly
+template<typename... Params, typename... Args>
+HostSwitch::Status PerformFdmsOperation(Host& host, MetricsOperation operation,
+                                        Host::Status (Host::*method)(Params...),
+                                        Args&... args) {
+  HostCallMeter meter(METRICS_FDMS_BASE24, operation);
+  HostSwitch::Status status = ConvertStatus((host.*method)(args...));
+  meter.Finish(status, host.TakeCallStats());
+  return status;
+}
 
-    if (!tx.track1_data.empty()) {
-    	diners_tx.track1_data = tx.track1_data;
-    }
+// Hosts of each protocol a switch runs at once. FDMS is limited to the
+// switch's own host, see HostSwitch::InitHostPools().
+const std::size_t kMaxHostsPerProtocol = 4;
 
-    if (!tx.pin_data.empty()) {
-    	diners_tx.pin_block = tx.pin_data;
-    }
+// Wait for a host of the protocol when all are out
+const std::chrono::milliseconds kRouteTimeout(30000);
 
-    diners_tx.additional_amount = tx.secondary_amount;
-    diners_tx.original_additional_amount = tx.original_secondary_amount;
-    diners_tx.icc_data = tx.icc_data;
-    diners_tx.transaction_type = ConvertTxToDinersTxType(tx.transaction_type);
-    diners_tx.in_progress_status = ConvertTxToDinersInProgressStatus(tx.in_progress_status);
-    diners_tx.transaction_status = ConvertTxToDinersTxStatus(tx.transaction_status);
-    diners_tx.previous_transaction_status = ConvertTxToDinersTxStatus(tx.previous_transaction_status);
-    diners_tx.tpdu = tx.tpdu;
-
-    diners_tx.tx_datetime = tx.tx_datetime;
-    diners_tx.rrn = tx.rrn;
-    diners_tx.auth_id_response = tx.auth_id_response;
-    diners_tx.response_code = tx.response_code;
-    diners_tx.issuer_emv_response = tx.issuer_emv_response;
-
-    diners_tx.invoice_number = tx.invoice_num;
-    diners_tx.batch_number = tx.batch_num;
-    diners_tx.preauth_amount = tx.preauth_amount;
-    diners_tx.cardholder_name = tx.card_holder_name;
-    if(tx.pan_sequence_number){
-    	diners_tx.pan_sequence_number = tx.pan_sequence_number;
-    }
+bool IsFdms(const HostRoute& route) {
+  return route.IsRouted() && route.session().Is<FdmsHostAdapter>();
+}
 
-    diners_tx.is_preauth_completed = tx.is_preauth_completed;
-    diners_tx.is_adjusted = tx.is_adjusted;
+bool IsDiners(const HostRoute& route) {
+  return route.IsRouted() && route.session().Is<DinersHostAdapter>();
+}
 
-    return diners_tx;
+unsigned int NextStan() {
+  return NextAppCounter(&GetNextStanNo);
 }
 
-diners::DinersSettlementData BuildDinersSettlementData(const SettlementData & settle_data){
-	diners::DinersSettlementData diners_settle;
-    diners_settle.tx_datetime = settle_data.tx_datetime; //To check
-    diners_settle.batch_number = settle_data.batch_number;
-    diners_settle.nii = settle_data.nii;
-    diners_settle.tpdu = settle_data.tpdu;
-    diners_settle.tid = settle_data.tid;
-    diners_settle.mid = settle_data.mid;
-    diners_settle.rrn = settle_data.rrn;
-    diners_settle.stan = settle_data.stan;
+// Checks a host out of 'pool' and starts its connection to 'host_name'.
+// Not routed if no host is free or the connection cannot be started.
+template<typename Adapter>
+HostRoute CheckOut(HostPool<typename Adapter::HostType>& pool,
+                   const std::string& host_name) {
+  typedef typename Adapter::HostType HostType;
+  HostType* host = pool.Acquire(kRouteTimeout);
+  if (!host)
+    return HostRoute();
 
-    diners_settle.batch_summary.refunds_total.count = settle_data.batch_summary.refunds_total.count;
-    diners_settle.batch_summary.refunds_total.total = settle_data.batch_summary.refunds_total.total;
-    diners_settle.batch_summary.sales_total.count = settle_data.batch_summary.sales_total.count;
-    diners_settle.batch_summary.sales_total.total = settle_data.batch_summary.sales_total.total;
-    diners_settle.batch_summary.currency = settle_data.batch_summary.currency;
+  HostPool<HostType>* host_pool = &pool;
+  HostRoute route(HostSession::Of<Adapter>(*host), [host_pool, host](bool connected) {
+    if (connected)
+      host->Disconnect();
+    host_pool->Release(host);
+  });
 
-    diners_settle.invoice_num = GetNextInvoiceNo();  //TODO: check
-    return diners_settle;
-}
+  if (!route.session().Visit(PreConnectVisitor(host_name)))
+    return HostRoute();
 
-void FillSettlementDataWithDinersSettlementData(SettlementData & settle_data, const diners::DinersSettlementData diners_settle_data) {
-	settle_data.processing_code = diners_settle_data.processing_code;
-    settle_data.tx_datetime = diners_settle_data.tx_datetime;
-    settle_data.rrn = diners_settle_data.rrn;
-    settle_data.response_code = diners_settle_data.response_code;
-    settle_data.stan = diners_settle_data.stan;
-    settle_data.nii = diners_settle_data.nii;
-    settle_data.tid = diners_settle_data.tid;
+  route.SetConnected(true);
+  return route;
 }
 
-void FillTransactionWithDinersTransactionData(Transaction& tx, const diners::DinersTransaction diners_tx) {
-	tx.processing_code = diners_tx.processing_code;
-    tx.tx_datetime = diners_tx.tx_datetime;  // TODO: check that. Shall we have a host datetime somewhere?
-    tx.rrn = diners_tx.rrn;
-    tx.auth_id_response = diners_tx.auth_id_response;
-    tx.response_code = diners_tx.response_code;
-    tx.issuer_emv_response = diners_tx.issuer_emv_response;
 }
 
+std::unique_ptr<amex::AmexHost> HostSwitch::MakeAmexHost() {
+  return stdx::make_unique<amex::AmexHost>(
+      app_settings_.managed_settings_->amex_config.Origin(),
+      app_settings_.managed_settings_->amex_config.CountryCode(),
+      app_settings_.managed_settings_->amex_config.Region(),
+      app_settings_.managed_settings_->amex_config.RoutingIndicator());
 }
 
 amex::AmexHost& HostSwitch::GetAmexHost() {
   if (!host_amex_) {
-    host_amex_ = stdx::make_unique<amex::AmexHost>(
-        app_settings_.managed_settings_->amex_config.Origin(),
-        app_settings_.managed_settings_->amex_config.CountryCode(),
-        app_settings_.managed_settings_->amex_config.Region(),
-        app_settings_.managed_settings_->amex_config.RoutingIndicator());
+    host_amex_ = MakeAmexHost();
   }
 
   return *host_amex_;
@@ -380,368 +565,380 @@ diners::DinersHost& HostSwitch::GetDinersHost() {
   return *host_diners_;
 }
 
-template<typename T1, typename T2, typename T3>
-HostSwitch::Status HostSwitch::PerformActionWithTx(T1 f1, T2 f2, T3 f3, Transaction& tx) {
-  using namespace std::placeholders;
+// Each pool starts with the switch's own host of the protocol, which the
+// route-less API keeps using. Further Amex and Diners hosts are made as
+// concurrent transactions need them; Diners hosts share the advice queue
+// and reversal journal of the switch's own. The FDMS host is constructed
+// with the switch, so its pool holds that one host only.
+void HostSwitch::InitHostPools() {
+  fdms_pool_ = stdx::make_unique<HostPool<Host>>(HostPool<Host>::Factory(), 1);
+  fdms_pool_->Add(host_fdms_);
 
-  if (!current_host_protocol_) {
-    return HostSwitch::Status::PERM_FAILURE;
-  }
+  amex_pool_ = stdx::make_unique<HostPool<amex::AmexHost>>(
+      [this]() { return MakeAmexHost(); }, kMaxHostsPerProtocol);
+  amex_pool_->Add(GetAmexHost());
 
-  if (*current_host_protocol_ == HostProtocol::FDMS_BASE24) {
-    auto f = std::bind < Host::Status > (f1, host_fdms_, _1);
-    Host::Status status = f(tx);
-    return ConvertStatus(status);
+  diners::DinersHost& diners_host = GetDinersHost();
+  diners_pool_ = stdx::make_unique<HostPool<diners::DinersHost>>(
+      [&diners_host]() {
+        std::unique_ptr<diners::DinersHost> host = stdx::make_unique<diners::DinersHost>();
+        host->CopySettings(diners_host);
+        return host;
+      }, kMaxHostsPerProtocol);
+  diners_pool_->Add(diners_host);
+}
 
-  }
+HostRoute HostSwitch::Route(unsigned int host_index) {
+  stdx::optional<HostDefinition> host_config = app_settings_.managed_settings_->GetHostDefinition(host_index);
+  if (!host_config)
+    return HostRoute();
 
-  else if (*current_host_protocol_ == HostProtocol::AMEX_DIRECT) {
-    auto f = std::bind < amex::AmexHost::Status > (f2, GetAmexHost(), _1);
-    amex::AmexTransaction amex_tx = BuildAmexTransactionFromTransaction(tx);
-    amex::AmexHost::Status status = f(amex_tx);
-    FillTransactionWithAmexTransactionData(tx, amex_tx);
-    return ConvertAmexStatus(status);
+  std::call_once(host_pools_once_, &HostSwitch::InitHostPools, this);
+  switch (host_config->host_protocol) {
+    case HostProtocol::FDMS_BASE24:
+      return CheckOut<FdmsHostAdapter>(*fdms_pool_, host_config->comms_host_name);
 
-  }
+    case HostProtocol::AMEX_DIRECT:
+      return CheckOut<AmexHostAdapter>(*amex_pool_, host_config->comms_host_name);
+
+    case HostProtocol::DINERS_DIRECT:
+      return CheckOut<DinersHostAdapter>(*diners_pool_, host_config->comms_host_name);
 
-  else if(*current_host_protocol_ == HostProtocol::DINERS_DIRECT){
-	auto f = std::bind < diners::DinersHost::Status > (f3, GetDinersHost(), _1);
-	diners::DinersTransaction diners_tx = BuildDinersTransactionFromTransaction(tx);
-	diners::DinersHost::Status status = f(diners_tx);
-	FillTransactionWithDinersTransactionData(tx, diners_tx);
-	return ConvertDinersStatus(status);
+    default:
+      return HostRoute();
   }
+}
 
-  current_host_protocol_ = stdx::nullopt;
-  return HostSwitch::Status::PERM_FAILURE;
+bool HostSwitch::WaitForConnection(HostRoute& route) {
+  if (!route.IsRouted())
+    return false;
+
+  // The route stays checked out until Disconnect(): an operation tried
+  // anyway fails on the host as TRANSIENT_FAILURE, as it always did
+  uint32_t timeout = 30000;  // TODO: don't hardcode
+  return route.session().Visit(WaitForConnectionVisitor(timeout));
 }
 
-bool HostSwitch::PreConnect(unsigned int host_index) {
-	stdx::optional<HostDefinition> host_config = app_settings_.managed_settings_->GetHostDefinition(host_index);
-    if (!host_config)
-    	return false;
+bool HostSwitch::Disconnect(HostRoute& route) {
+  if (!route.IsRouted())
+    return true;
 
-    bool ret = false;
-    current_host_protocol_ = host_config->host_protocol;
-    if (*current_host_protocol_ == HostProtocol::FDMS_BASE24)
-    	ret = host_fdms_.PreConnect(host_config->comms_host_name);
-    else if (*current_host_protocol_ == HostProtocol::AMEX_DIRECT)
-    	ret = GetAmexHost().PreConnect(host_config->comms_host_name);
-    else if (*current_host_protocol_ == HostProtocol::DINERS_DIRECT)
-    	ret = GetDinersHost().PreConnect(host_config->comms_host_name);
+  bool ret = route.session().Visit(DisconnectVisitor());
+  route.SetConnected(false);
+  route.Release();
+  return ret;
+}
 
-    if (!ret)
-    	current_host_protocol_ = stdx::nullopt;
-    return ret;
+template<typename Op>
+HostSwitch::Status HostSwitch::PerformActionWithTx(HostRoute& route, Transaction& tx) {
+  if (!route.IsRouted())
+    return HostSwitch::Status::PERM_FAILURE;
+
+  return route.session().Visit(TxVisitor<Op>(tx));
 }
 
-HostSwitch::Status HostSwitch::AuthorizeSale(Transaction& tx) {
-    return PerformActionWithTx(&Host::AuthorizeSale,
-                               &amex::AmexHost::AuthorizeSale,
-                               &diners::DinersHost::AuthorizeSale,
-                               tx);
+HostSwitch::Status HostSwitch::AuthorizeSale(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::AuthorizeSale>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::AuthorizeSaleWithDccEnquiry(Transaction& tx) {
-    return PerformActionWithTx(&Host::AuthorizeSaleWithDccEnquiry,
-                               &amex::AmexHost::AuthorizeSale,
-							   &diners::DinersHost::AuthorizeSale,
-                               tx);
+HostSwitch::Status HostSwitch::AuthorizeSaleWithDccEnquiry(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::AuthorizeSaleWithDccEnquiry>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::AuthorizeSaleWithDccAllowed(Transaction& tx) {
-    return PerformActionWithTx(&Host::AuthorizeSaleWithDccAllowed,
-                               &amex::AmexHost::AuthorizeSale,
-							   &diners::DinersHost::AuthorizeSale,
-                               tx);
+HostSwitch::Status HostSwitch::AuthorizeSaleWithDccAllowed(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::AuthorizeSaleWithDccAllowed>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::PerformTcUpload(Transaction& tx) {
-    return PerformActionWithTx(&Host::PerformTcUpload,
-                               &amex::AmexHost::PerformTcUpload,
-							   &diners::DinersHost::PerformTcUpload,
-                               tx);
+HostSwitch::Status HostSwitch::PerformTcUpload(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::PerformTcUpload>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::PerformVoid(Transaction& tx) {
-    return PerformActionWithTx(&Host::PerformVoid,
-                               &amex::AmexHost::PerformVoid,
-							   &diners::DinersHost::PerformVoid,
-                               tx);
-}
-
-HostSwitch::Status HostSwitch::PerformAmexBatchUpload(std::vector<Transaction>& transaction_list){
-	HostSwitch::Status output = HostSwitch::Status::PERM_FAILURE;
-    std::vector<amex::AmexTransaction> amex_tx_list;
-    std::transform(transaction_list.begin(), transaction_list.end(), std::back_inserter(amex_tx_list), BuildAmexTransactionFromTransaction);
-
-    amex::AmexHost::Status status;
-    for (auto tx : amex_tx_list){
-    	status = GetAmexHost().PerformBatchUpload(tx, GetNextStanNo());
-        if (status != amex::AmexHost::Status::COMPLETED)
-        	break;
-    }
+HostSwitch::Status HostSwitch::PerformVoid(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::PerformVoid>(route, tx);
+}
 
-    output = ConvertAmexStatus(status);
-    return output;
+HostSwitch::Status HostSwitch::SendReversal(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::SendReversal>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::PerformBatchUpload(std::vector<Transaction>& transaction_list) {
-	HostSwitch::Status output = HostSwitch::Status::PERM_FAILURE;
-	if (!current_host_protocol_)
-		return output;
-
-	if (*current_host_protocol_ == HostProtocol::FDMS_BASE24) {
-		Host::Status status = host_fdms_.PerformBatchUpload(transaction_list);
-        output = ConvertStatus(status);
-	}
-	else if (*current_host_protocol_ == HostProtocol::AMEX_DIRECT) {
-		output = PerformAmexBatchUpload(transaction_list);
-	}
-	else if (*current_host_protocol_ == HostProtocol::DINERS_DIRECT){
-		output = PerformDinersBatchUpload(transaction_list);
-    }
+HostSwitch::Status HostSwitch::AuthorizeRefund(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::AuthorizeRefund>(route, tx);
+}
 
-	return output;
+HostSwitch::Status HostSwitch::PerformOfflineSale(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::PerformOfflineSale>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::PerformDinersBatchUpload(std::vector<Transaction>& transaction_list){
-    std::vector<diners::DinersTransaction> diners_tx_list;
-    std::transform(transaction_list.begin(), transaction_list.end(), std::back_inserter(diners_tx_list), BuildDinersTransactionFromTransaction);
+HostSwitch::Status HostSwitch::PerformOfflineWithDccEnquiry(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::PerformOfflineWithDccEnquiry>(route, tx);
+}
 
-    diners::DinersHost::Status status;
-    for (auto diners_tx : diners_tx_list){
-    	status = GetDinersHost().PerformBatchUpload(diners_tx, GetNextStanNo());
-        if (status != diners::DinersHost::Status::COMPLETED)
-        	break;
-    }
+HostSwitch::Status HostSwitch::PerformOfflineWithDccAllowed(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::PerformOfflineWithDccAllowed>(route, tx);
+}
 
-    return ConvertDinersStatus(status);
+HostSwitch::Status HostSwitch::AuthorizePreAuth(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::AuthorizePreAuth>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::SendReversal(Transaction& tx) {
-    return PerformActionWithTx(&Host::SendReversal,
-                               &amex::AmexHost::SendReversal,
-							   &diners::DinersHost::SendReversal,
-                               tx);
+HostSwitch::Status HostSwitch::AuthorizePreAuthWithDccEnquiry(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::AuthorizePreAuthWithDccEnquiry>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::AuthorizeRefund(Transaction& tx) {
-    return PerformActionWithTx(&Host::AuthorizeRefund,
-                               &amex::AmexHost::AuthorizeRefund,
-							   &diners::DinersHost::AuthorizeRefund,
-                               tx);
+HostSwitch::Status HostSwitch::AuthorizePreAuthWithDccAllowed(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::AuthorizePreAuthWithDccAllowed>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::PerformOfflineSale(Transaction& tx) {
-    return PerformActionWithTx(&Host::PerformOfflineSale,
-                               &amex::AmexHost::SendOfflineSale,
-							   &diners::DinersHost::SendOfflineSale,
-                               tx);
+HostSwitch::Status HostSwitch::PerformTipAdjust(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::PerformTipAdjust>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::PerformOfflineWithDccEnquiry(Transaction& tx) {
-    return PerformActionWithTx(&Host::PerformOfflineWithDccEnquiry,
-                               &amex::AmexHost::SendOfflineSale,
-							   &diners::DinersHost::SendOfflineSale,
-                               tx);
+HostSwitch::Status HostSwitch::AuthorizePreAuthCompletion(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::AuthorizePreAuthCompletion>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::PerformOfflineWithDccAllowed(Transaction& tx) {
-    return PerformActionWithTx(&Host::PerformOfflineWithDccAllowed,
-                               &amex::AmexHost::SendOfflineSale,
-							   &diners::DinersHost::SendOfflineSale,
-                               tx);
+HostSwitch::Status HostSwitch::AuthorizePreAuthCompletionWithDccEnquiry(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::AuthorizePreAuthCompletionWithDccEnquiry>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::AuthorizePreAuth(Transaction& tx) {
-    return PerformActionWithTx(&Host::AuthorizePreAuth,
-                               &amex::AmexHost::AuthorizePreAuth,
-							   &diners::DinersHost::AuthorizePreAuth,
-                               tx);
+HostSwitch::Status HostSwitch::AuthorizePreAuthCompletionWithDccAllowed(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::AuthorizePreAuthCompletionWithDccAllowed>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::AuthorizePreAuthWithDccEnquiry(Transaction& tx) {
-    return PerformActionWithTx(&Host::AuthorizePreAuthWithDccEnquiry,
-                               &amex::AmexHost::AuthorizePreAuth,
-							   &diners::DinersHost::AuthorizePreAuth,
-                               tx);
+HostSwitch::Status HostSwitch::AuthorizeQuasiCash(HostRoute& route, Transaction& tx) {
+  return PerformActionWithTx<host_ops::AuthorizeQuasiCash>(route, tx);
 }
 
-HostSwitch::Status HostSwitch::AuthorizePreAuthWithDccAllowed(Transaction& tx) {
-    return PerformActionWithTx(&Host::AuthorizePreAuthWithDccAllowed,
-                               &amex::AmexHost::AuthorizePreAuth,
-							   &diners::DinersHost::AuthorizePreAuth,
-                               tx);
+HostSwitch::Status HostSwitch::PerformBatchUpload(HostRoute& route,
+                                                  std::vector<Transaction>& transaction_list) {
+  if (!route.IsRouted())
+    return HostSwitch::Status::PERM_FAILURE;
+
+  return route.session().Visit(BatchUploadVisitor(transaction_list));
 }
 
-HostSwitch::Status HostSwitch::PerformTipAdjust(Transaction& tx) {
-    return PerformActionWithTx(&Host::SendTipAdjust,
-                               &amex::AmexHost::SendTipAdjust,
-							   &diners::DinersHost::SendTipAdjust,
-                               tx);
+HostSwitch::Status HostSwitch::PerformSettlement(HostRoute& route, SettlementData& settle_msg,
+                                                 bool after_batch_upload) {
+  if (!route.IsRouted())
+    return HostSwitch::Status::PERM_FAILURE;
+
+  return route.session().Visit(SettlementVisitor(settle_msg, after_batch_upload));
 }
 
-HostSwitch::Status HostSwitch::PerformFdmsTMKDownload(TMKDownloadMessage& tmk_download_msg) {
-	if (!current_host_protocol_ || *current_host_protocol_ != HostProtocol::FDMS_BASE24) {
-		return HostSwitch::Status::PERM_FAILURE;
-    }
+HostSwitch::Status HostSwitch::PerformFdmsTestTransaction(HostRoute& route, TestTransaction& test_tx) {
+  if (!route.IsRouted())
+    return HostSwitch::Status::PERM_FAILURE;
 
-    Host::Status status = host_fdms_.PerformTMKDownload(tmk_download_msg);
-    return ConvertStatus(status);
+  return route.session().Visit(TestTransactionVisitor(test_tx));
 }
 
-HostSwitch::Status HostSwitch::AuthorizePreAuthCompletion(Transaction& tx) {
-    return PerformActionWithTx(&Host::AuthorizePreAuthCompletion,
-                               &amex::AmexHost::AuthorizePreAuthCompletion,
-							   &diners::DinersHost::PerformSaleCompletion,
-                               tx);
+HostSwitch::Status HostSwitch::PerformFdmsTMKDownload(HostRoute& route,
+                                                      TMKDownloadMessage& tmk_download_msg) {
+  if (!IsFdms(route))
+    return HostSwitch::Status::PERM_FAILURE;
+
+  return PerformFdmsOperation(route.session().Get<FdmsHostAdapter>(), OP_TMK_DOWNLOAD,
+                              &Host::PerformTMKDownload, tmk_download_msg);
 }
 
-HostSwitch::Status HostSwitch::AuthorizePreAuthCompletionWithDccEnquiry(Transaction& tx) {
-    return PerformActionWithTx(&Host::AuthorizePreAuthCompletionWithDccEnquiry,
-                               &amex::AmexHost::AuthorizePreAuthCompletion,
-							   &diners::DinersHost::PerformSaleCompletion,
-                               tx);
+HostSwitch::Status HostSwitch::PerformFdmsPreAuthCancellation(HostRoute& route, Transaction& tx) {
+  if (!IsFdms(route))
+    return HostSwitch::Status::PERM_FAILURE;
+
+  return PerformFdmsOperation(route.session().Get<FdmsHostAdapter>(), OP_PREAUTH_CANCELLATION,
+                              &Host::PerformPreAuthCancellation, tx);
 }
 
-HostSwitch::Status HostSwitch::AuthorizePreAuthCompletionWithDccAllowed(Transaction& tx) {
-	return PerformActionWithTx(&Host::AuthorizePreAuthCompletionWithDccAllowed,
-                               &amex::AmexHost::AuthorizePreAuthCompletion,
-							   &diners::DinersHost::PerformSaleCompletion,
-                               tx);
+HostSwitch::Status HostSwitch::AuthorizeFdmsInstalmentSale(HostRoute& route, Transaction& tx) {
+  if (!IsFdms(route))
+    return HostSwitch::Status::PERM_FAILURE;
+
+  HostSwitch::Status status = PerformFdmsOperation(route.session().Get<FdmsHostAdapter>(),
+                                                   OP_INSTALMENT_SALE,
+                                                   &Host::AuthorizeInstalmentSale, tx);
+  if (status == HostSwitch::Status::COMPLETED && !IsDeclined(tx.response_code))
+    UpdateBatchTotals(METRICS_FDMS_BASE24, OP_INSTALMENT_SALE, tx);
+  return status;
 }
 
-HostSwitch::Status HostSwitch::AuthorizeQuasiCash(Transaction& tx) {
-	return PerformActionWithTx(&Host::AuthorizeQuasiCash,
-                               &amex::AmexHost::AuthorizeSale,
-							   &diners::DinersHost::AuthorizeSale,
-                               tx);
+HostSwitch::Status HostSwitch::PerformFdmsKeyExchange(HostRoute& route, KeyExchange& key_exchange) {
+  if (!IsFdms(route))
+    return HostSwitch::Status::PERM_FAILURE;
+
+  return PerformFdmsOperation(route.session().Get<FdmsHostAdapter>(), OP_KEY_EXCHANGE,
+                              &Host::PerformKeyExchange, key_exchange);
 }
 
-HostSwitch::Status HostSwitch::PerformFdmsPreAuthCancellation(Transaction& tx) {
-	if (!current_host_protocol_ || *current_host_protocol_ != HostProtocol::FDMS_BASE24) {
-		return HostSwitch::Status::PERM_FAILURE;
-    }
+HostSwitch::Status HostSwitch::PerformFdmsSettlement(HostRoute& route, SettlementData& settle_msg,
+                                                     bool after_batch_upload) {
+  if (!IsFdms(route))
+    return HostSwitch::Status::PERM_FAILURE;
 
-    Host::Status status = host_fdms_.PerformPreAuthCancellation(tx);
-    return ConvertStatus(status);
+  FillBatchSummary(METRICS_FDMS_BASE24, settle_msg);
+  HostSwitch::Status status = PerformFdmsOperation(route.session().Get<FdmsHostAdapter>(),
+                                                   OP_SETTLEMENT,
+                                                   &Host::PerformSettlement, settle_msg,
+                                                   after_batch_upload);
+  if (status == HostSwitch::Status::COMPLETED && !IsDeclined(settle_msg.response_code))
+    CloseBatchTotals(METRICS_FDMS_BASE24, settle_msg);
+  return status;
+}
+
+HostSwitch::Status HostSwitch::PerformDinersReconciledSettlement(HostRoute& route,
+                                                                 SettlementData& settle_msg,
+                                                                 const diners::BatchStore& batch,
+                                                                 diners::BatchReconciler& reconciler) {
+  if (!IsDiners(route))
+    return HostSwitch::Status::PERM_FAILURE;
+
+  diners::DinersHost& host = route.session().Get<DinersHostAdapter>();
+  HostCallMeter meter(METRICS_DINERS_DIRECT, OP_SETTLEMENT);
+  FillBatchSummary(METRICS_DINERS_DIRECT, settle_msg);
+  diners::DinersSettlementData diners_settle = BuildDinersSettlementData(settle_msg);
+  HostSwitch::Status status = ConvertDinersStatus(
+      host.PerformReconciledSettlement(diners_settle, batch, reconciler, &NextStan));
+  FillSettlementDataWithDinersSettlementData(settle_msg, diners_settle);
+  meter.Finish(status, host.TakeCallStats());
+  if (status != HostSwitch::Status::COMPLETED)
+    return status;
+
+  if (IsDeclined(settle_msg.response_code))
+    meter.Declined();
+  else
+    CloseBatchTotals(METRICS_DINERS_DIRECT, settle_msg);
+  return status;
+}
+
+/**************************************
+ * Route-less API: one transaction at a time, on current_route_
+ **************************************/
+bool HostSwitch::PreConnect(unsigned int host_index) {
+  // the previous host goes back first, it may be the only one of its pool
+  current_route_.Release();
+  current_route_ = Route(host_index);
+  return current_route_.IsRouted();
 }
 
-HostSwitch::Status HostSwitch::AuthorizeFdmsInstalmentSale(Transaction& tx) {
-	if (!current_host_protocol_ || *current_host_protocol_ != HostProtocol::FDMS_BASE24) {
-		return HostSwitch::Status::PERM_FAILURE;
-    }
+bool HostSwitch::WaitForConnection() {
+  return WaitForConnection(current_route_);
+}
 
-    Host::Status status = host_fdms_.AuthorizeInstalmentSale(tx);
-    return ConvertStatus(status);
+bool HostSwitch::Disconnect() {
+  return Disconnect(current_route_);
 }
 
-HostSwitch::Status HostSwitch::PerformFdmsKeyExchange(KeyExchange& key_exchange) {
-	if (!current_host_protocol_ || *current_host_protocol_ != HostProtocol::FDMS_BASE24) {
-		return HostSwitch::Status::PERM_FAILURE;
-    }
+bool HostSwitch::isAmex() {
+  return current_route_.IsRouted() && current_route_.session().Is<AmexHostAdapter>();
+}
 
-    Host::Status status = host_fdms_.PerformKeyExchange(key_exchange);
-    return ConvertStatus(status);
+HostSwitch::Status HostSwitch::AuthorizeSale(Transaction& tx) {
+  return AuthorizeSale(current_route_, tx);
 }
 
-HostSwitch::Status HostSwitch::PerformFdmsSettlement(SettlementData& settle_msg, bool after_batch_upload) {
-	if (!current_host_protocol_ || *current_host_protocol_ != HostProtocol::FDMS_BASE24)
-		return HostSwitch::Status::PERM_FAILURE;
+HostSwitch::Status HostSwitch::AuthorizeSaleWithDccEnquiry(Transaction& tx) {
+  return AuthorizeSaleWithDccEnquiry(current_route_, tx);
+}
 
-	Host::Status status = host_fdms_.PerformSettlement(settle_msg, after_batch_upload);
-    return ConvertStatus(status);
+HostSwitch::Status HostSwitch::AuthorizeSaleWithDccAllowed(Transaction& tx) {
+  return AuthorizeSaleWithDccAllowed(current_route_, tx);
 }
 
-HostSwitch::Status HostSwitch::PerformSettlement(SettlementData& settle_msg, bool after_batch_upload) {
-	HostSwitch::Status output = HostSwitch::Status::PERM_FAILURE;
-	if (!current_host_protocol_)
-		return output;
-
-	if (*current_host_protocol_ == HostProtocol::FDMS_BASE24){
-		Host::Status status = host_fdms_.PerformSettlement(settle_msg, after_batch_upload);
-        output = ConvertStatus(status);
-	}
-    else if (*current_host_protocol_ == HostProtocol::AMEX_DIRECT){
-    	amex::AmexSettlementData amex_settle;
-        amex_settle = BuildAmexSettlementData(settle_msg);
-        amex::AmexHost::Status status_amex = GetAmexHost().PerformSettlement(amex_settle, after_batch_upload);
-        FillSettlementDataWithAmexSettlementData(settle_msg, amex_settle);
-        output = ConvertAmexStatus(status_amex);
-    }
-    else if(*current_host_protocol_ == HostProtocol::DINERS_DIRECT){
-    	diners::DinersSettlementData diners_settle;
-        diners_settle = BuildDinersSettlementData(settle_msg);
-        diners::DinersHost::Status status_diners = GetDinersHost().PerformSettlement(diners_settle, after_batch_upload);
-        FillSettlementDataWithDinersSettlementData(settle_msg, diners_settle);
-        return ConvertDinersStatus(status_diners);
-    }
+HostSwitch::Status HostSwitch::PerformTcUpload(Transaction& tx) {
+  return PerformTcUpload(current_route_, tx);
+}
 
-	return output;
+HostSwitch::Status HostSwitch::PerformVoid(Transaction& tx) {
+  return PerformVoid(current_route_, tx);
 }
 
-HostSwitch::Status HostSwitch::PerformFdmsTestTransaction(TestTransaction & test_tx) {
-	if (!current_host_protocol_)
-		return HostSwitch::Status::PERM_FAILURE;
-    else if(*current_host_protocol_ == HostProtocol::FDMS_BASE24){
-    	Host::Status status = host_fdms_.PerformTestTransaction(test_tx);
-        return ConvertStatus(status);
-    }
-    else if(*current_host_protocol_ == HostProtocol::DINERS_DIRECT){
-    	diners::TestTransaction diners_tx;
-	    diners_tx.processing_code = "990000";
-	    diners_tx.tpdu = test_tx.tpdu;
-	    diners_tx.nii = test_tx.nii;
-	    diners_tx.tid = test_tx.tid;
-	    diners_tx.mid = test_tx.mid;
-	    diners::DinersHost::Status status = GetDinersHost().PerformDinersTestTransaction(diners_tx);
-	    return ConvertDinersStatus(status);
-    }
+HostSwitch::Status HostSwitch::SendReversal(Transaction& tx) {
+  return SendReversal(current_route_, tx);
+}
 
-	return HostSwitch::Status::PERM_FAILURE;
+HostSwitch::Status HostSwitch::AuthorizeRefund(Transaction& tx) {
+  return AuthorizeRefund(current_route_, tx);
 }
 
-bool HostSwitch::WaitForConnection() {
-	if (!current_host_protocol_)
-		return false;
+HostSwitch::Status HostSwitch::PerformOfflineSale(Transaction& tx) {
+  return PerformOfflineSale(current_route_, tx);
+}
 
-    uint32_t timeout = 30000;  // TODO: don't hardcode
-    bool ret = true;
-    if (*current_host_protocol_ == HostProtocol::FDMS_BASE24)
-    	ret = host_fdms_.WaitForConnection(timeout);
-    else if (*current_host_protocol_ == HostProtocol::AMEX_DIRECT)
-    	ret = GetAmexHost().WaitForConnection(timeout);
-    else if (*current_host_protocol_ == HostProtocol::DINERS_DIRECT)
-    	ret = GetDinersHost().WaitForConnection(timeout);
+HostSwitch::Status HostSwitch::PerformOfflineWithDccEnquiry(Transaction& tx) {
+  return PerformOfflineWithDccEnquiry(current_route_, tx);
+}
 
-    if (!ret)
-    	current_host_protocol_ = stdx::nullopt;
-    return ret;
+HostSwitch::Status HostSwitch::PerformOfflineWithDccAllowed(Transaction& tx) {
+  return PerformOfflineWithDccAllowed(current_route_, tx);
 }
 
-bool HostSwitch::Disconnect() {
-	if (!current_host_protocol_)
-		return true;
+HostSwitch::Status HostSwitch::AuthorizePreAuth(Transaction& tx) {
+  return AuthorizePreAuth(current_route_, tx);
+}
 
-	bool ret = true;
-    if (*current_host_protocol_ == HostProtocol::FDMS_BASE24)
-    	ret = host_fdms_.Disconnect();
-    else if (*current_host_protocol_ == HostProtocol::AMEX_DIRECT)
-    	ret = GetAmexHost().Disconnect();
-    else if (*current_host_protocol_ == HostProtocol::DINERS_DIRECT)
-    	ret = GetDinersHost().Disconnect();
+HostSwitch::Status HostSwitch::AuthorizePreAuthWithDccEnquiry(Transaction& tx) {
+  return AuthorizePreAuthWithDccEnquiry(current_route_, tx);
+}
 
-    current_host_protocol_ = stdx::nullopt;
-    return ret;
+HostSwitch::Status HostSwitch::AuthorizePreAuthWithDccAllowed(Transaction& tx) {
+  return AuthorizePreAuthWithDccAllowed(current_route_, tx);
 }
 
-bool HostSwitch::isAmex() {
-	if (*current_host_protocol_ == HostProtocol::AMEX_DIRECT)
-		return true;
-    else
-    	return false;
+HostSwitch::Status HostSwitch::PerformTipAdjust(Transaction& tx) {
+  return PerformTipAdjust(current_route_, tx);
+}
+
+HostSwitch::Status HostSwitch::AuthorizePreAuthCompletion(Transaction& tx) {
+  return AuthorizePreAuthCompletion(current_route_, tx);
+}
+
+HostSwitch::Status HostSwitch::AuthorizePreAuthCompletionWithDccEnquiry(Transaction& tx) {
+  return AuthorizePreAuthCompletionWithDccEnquiry(current_route_, tx);
+}
+
+HostSwitch::Status HostSwitch::AuthorizePreAuthCompletionWithDccAllowed(Transaction& tx) {
+  return AuthorizePreAuthCompletionWithDccAllowed(current_route_, tx);
+}
+
+HostSwitch::Status HostSwitch::AuthorizeQuasiCash(Transaction& tx) {
+  return AuthorizeQuasiCash(current_route_, tx);
+}
+
+HostSwitch::Status HostSwitch::PerformBatchUpload(std::vector<Transaction>& transaction_list) {
+  return PerformBatchUpload(current_route_, transaction_list);
+}
+
+HostSwitch::Status HostSwitch::PerformSettlement(SettlementData& settle_msg, bool after_batch_upload) {
+  return PerformSettlement(current_route_, settle_msg, after_batch_upload);
+}
+
+HostSwitch::Status HostSwitch::PerformFdmsTestTransaction(TestTransaction & test_tx) {
+  return PerformFdmsTestTransaction(current_route_, test_tx);
+}
+
+HostSwitch::Status HostSwitch::PerformFdmsTMKDownload(TMKDownloadMessage& tmk_download_msg) {
+  return PerformFdmsTMKDownload(current_route_, tmk_download_msg);
 }
 
+HostSwitch::Status HostSwitch::PerformFdmsPreAuthCancellation(Transaction& tx) {
+  return PerformFdmsPreAuthCancellation(current_route_, tx);
+}
+
+HostSwitch::Status HostSwitch::AuthorizeFdmsInstalmentSale(Transaction& tx) {
+  return AuthorizeFdmsInstalmentSale(current_route_, tx);
+}
+
+HostSwitch::Status HostSwitch::PerformFdmsKeyExchange(KeyExchange& key_exchange) {
+  return PerformFdmsKeyExchange(current_route_, key_exchange);
 }
 
+HostSwitch::Status HostSwitch::PerformFdmsSettlement(SettlementData& settle_msg, bool after_batch_upload) {
+  return PerformFdmsSettlement(current_route_, settle_msg, after_batch_upload);
+}
+
+HostSwitch::Status HostSwitch::PerformDinersReconciledSettlement(SettlementData& settle_msg,
+                                                                 const diners::BatchStore& batch,
+                                                                 diners::BatchReconciler& reconciler) {
+  return PerformDinersReconciledSettlement(current_route_, settle_msg, batch, reconciler);
+}
+
+}
@@ -0,0 +1,225 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "settlement_orchestrator.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <utils/converter.h>
+#include <utils/logger.h>
+#include "app_counter.h"
+#include "batch_totals.h"
+#include "transaction_adapters.h"
+
+namespace fdms {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const char kReconcileErrorResponseCode[] = "95";
+
+// Jobs of one terminal, run in order by one worker
+typedef std::vector<std::size_t> TerminalJobs;
+
+// Terminals of one host, taken in order by the workers of that host
+struct HostJobs {
+  HostJobs()
+      : next(0) {
+  }
+
+  std::vector<TerminalJobs> terminals;
+  std::map<std::pair<std::string, std::string>, std::size_t> terminal_of;
+  std::size_t next;
+  std::mutex mutex;
+};
+
+const char* StatusName(HostSwitch::Status status) {
+  switch (status) {
+    case HostSwitch::Status::COMPLETED:
+      return "COMPLETED";
+    case HostSwitch::Status::TRANSIENT_FAILURE:
+      return "TRANSIENT_FAILURE";
+    default:
+      return "PERM_FAILURE";
+  }
+}
+
+std::chrono::milliseconds ElapsedSince(Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      Clock::now() - start);
+}
+
+}
+
+SettlementOrchestrator::SettlementOrchestrator(
+    SwitchFactory factory, const SettlementOrchestratorConfig& config)
+    : factory_(factory),
+      config_(config) {
+}
+
+SettlementReport SettlementOrchestrator::Run(std::vector<SettlementJob>& jobs) {
+  Clock::time_point start = Clock::now();
+  SettlementReport report;
+  report.outcomes.resize(jobs.size());
+
+  std::map<unsigned int, HostJobs> hosts;
+  for (std::size_t i = 0; i < jobs.size(); i++) {
+    HostJobs& host_jobs = hosts[jobs[i].host_index];
+    std::pair<std::string, std::string> terminal(jobs[i].settle_msg.tid,
+                                                 jobs[i].settle_msg.mid);
+    std::map<std::pair<std::string, std::string>, std::size_t>::iterator it =
+        host_jobs.terminal_of.find(terminal);
+    if (it == host_jobs.terminal_of.end()) {
+      it = host_jobs.terminal_of.insert(
+          std::make_pair(terminal, host_jobs.terminals.size())).first;
+      host_jobs.terminals.push_back(TerminalJobs());
+    }
+    host_jobs.terminals[it->second].push_back(i);
+  }
+
+  std::vector<std::thread> workers;
+  for (std::map<unsigned int, HostJobs>::iterator it = hosts.begin();
+       it != hosts.end(); ++it) {
+    HostJobs& host_jobs = it->second;
+    std::size_t worker_count = std::min(std::max<std::size_t>(config_.max_per_host, 1),
+                                        host_jobs.terminals.size());
+    for (std::size_t i = 0; i < worker_count; i++) {
+      workers.push_back(std::thread([this, &host_jobs, &jobs, &report]() {
+        std::unique_ptr<HostSwitch> host_switch = factory_();
+        for (;;) {
+          const TerminalJobs* terminal;
+          {
+            std::lock_guard<std::mutex> lock(host_jobs.mutex);
+            if (host_jobs.next == host_jobs.terminals.size())
+              return;
+            terminal = &host_jobs.terminals[host_jobs.next++];
+          }
+          RunTerminal(*host_switch, *terminal, jobs, report);
+        }
+      }));
+    }
+  }
+
+  for (std::size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+
+  report.elapsed = ElapsedSince(start);
+  return report;
+}
+
+// Jobs with a currency carry the summary of that currency, so the batch
+// totals ledger is kept out of their batch until its last currency settled
+void SettlementOrchestrator::RunTerminal(HostSwitch& host_switch,
+                                         const std::vector<std::size_t>& terminal,
+                                         std::vector<SettlementJob>& jobs,
+                                         SettlementReport& report) const {
+  std::map<unsigned int, unsigned int> currencies;  // by batch number
+  for (std::size_t job : terminal) {
+    if (!jobs[job].currency.empty())
+      currencies[jobs[job].settle_msg.batch_number]++;
+  }
+  for (std::size_t job : terminal) {
+    const SettlementData& settle_msg = jobs[job].settle_msg;
+    if (currencies.count(settle_msg.batch_number))
+      BeginCurrencySettlement(settle_msg, currencies[settle_msg.batch_number]);
+  }
+
+  for (std::size_t job : terminal)
+    report.outcomes[job] = RunJob(host_switch, jobs[job]);
+
+  for (std::size_t job : terminal) {
+    if (!jobs[job].currency.empty())
+      EndCurrencySettlement(jobs[job].settle_msg);
+  }
+}
+
+SettlementOutcome SettlementOrchestrator::RunJob(HostSwitch& host_switch,
+                                                 SettlementJob& job) const {
+  Clock::time_point start = Clock::now();
+  SettlementOutcome outcome;
+  std::chrono::milliseconds retry_delay = config_.retry_delay;
+
+  while (outcome.attempts < config_.max_attempts) {
+    if (outcome.attempts > 0) {
+      std::this_thread::sleep_for(retry_delay);
+      retry_delay *= 2;
+    }
+    outcome.attempts++;
+
+    if (!host_switch.PreConnect(job.host_index)
+        || !host_switch.WaitForConnection()) {
+      outcome.status = HostSwitch::Status::TRANSIENT_FAILURE;
+      continue;
+    }
+
+    unsigned int stan = NextAppCounter(&GetNextStanNo);
+    job.settle_msg.stan = stan;
+    if (job.diners_batch && job.reconciler) {
+      outcome.status = host_switch.PerformDinersReconciledSettlement(
+          job.settle_msg, *job.diners_batch, *job.reconciler);
+      // The settlement after an upload has a STAN of its own
+      if (job.settle_msg.stan != stan)
+        outcome.batch_uploaded = true;
+    } else {
+      outcome.status = host_switch.PerformSettlement(job.settle_msg, false);
+      if (outcome.status == HostSwitch::Status::COMPLETED
+          && job.settle_msg.response_code == kReconcileErrorResponseCode) {
+        outcome.status = host_switch.PerformBatchUpload(job.transactions);
+        if (outcome.status == HostSwitch::Status::COMPLETED) {
+          outcome.batch_uploaded = true;
+          job.settle_msg.stan = NextAppCounter(&GetNextStanNo);
+          outcome.status = host_switch.PerformSettlement(job.settle_msg, true);
+        }
+      }
+    }
+    host_switch.Disconnect();
+
+    if (outcome.status != HostSwitch::Status::TRANSIENT_FAILURE)
+      break;
+  }
+
+  outcome.response_code = job.settle_msg.response_code;
+  outcome.elapsed = ElapsedSince(start);
+  if (outcome.status != HostSwitch::Status::COMPLETED)
+    logger::error(("SETTLEMENT - Batch " + utils::ToString(job.settle_msg.batch_number)
+        + " of " + job.settle_msg.tid + " failed").c_str());
+  return outcome;
+}
+
+std::string FormatSettlementReport(const std::vector<SettlementJob>& jobs,
+                                   const SettlementReport& report) {
+  std::ostringstream out;
+  for (std::size_t i = 0; i < jobs.size() && i < report.outcomes.size(); i++) {
+    const SettlementData& settle_msg = jobs[i].settle_msg;
+    const SettlementOutcome& outcome = report.outcomes[i];
+    out << "host=" << jobs[i].host_index
+        << " tid=" << settle_msg.tid
+        << " mid=" << settle_msg.mid
+        << " batch=" << settle_msg.batch_number
+        << " currency=" << (jobs[i].currency.empty() ? "-" : jobs[i].currency)
+        << " status=" << StatusName(outcome.status)
+        << " rc=" << (outcome.response_code.empty() ? "-" : outcome.response_code)
+        << " attempts=" << outcome.attempts
+        << " uploaded=" << (outcome.batch_uploaded ? "yes" : "no")
+        << " ms=" << outcome.elapsed.count() << "\n";
+  }
+  out << "total_ms=" << report.elapsed.count() << "\n";
+  return out.str();
+}
+
+}
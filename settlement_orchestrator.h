@@ -0,0 +1,127 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef FDMS__SETTLEMENT_ORCHESTRATOR_H_
+#define FDMS__SETTLEMENT_ORCHESTRATOR_H_
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fdms/host_switch.h>
+
+namespace diners {
+class BatchReconciler;
+class BatchStore;
+}
+
+namespace fdms {
+
+// One MID/TID batch to close on one host. A batch with several currencies
+// is one job per currency, each with the totals of its currency (see
+// diners::BatchStore::ComputeCurrencyTotals()). The totals of a job with a
+// currency are sent as they are, not taken from the batch totals ledger.
+struct SettlementJob {
+  SettlementJob()
+      : host_index(0),
+        diners_batch(NULL),
+        reconciler(NULL) {
+  }
+
+  unsigned int host_index;  // as passed to HostSwitch::PreConnect()
+  std::string currency;     // ISO 4217 alpha code, empty for the whole batch
+  SettlementData settle_msg;
+  std::vector<Transaction> transactions;  // uploaded if the totals disagree
+
+  // Diners batch and its reconciler, both or neither. With them, only the
+  // records the reconciler picks are uploaded, and 'transactions' is unused.
+  const diners::BatchStore* diners_batch;
+  diners::BatchReconciler* reconciler;
+};
+
+struct SettlementOutcome {
+  SettlementOutcome()
+      : status(HostSwitch::Status::PERM_FAILURE),
+        attempts(0),
+        batch_uploaded(false),
+        elapsed(0) {
+  }
+
+  HostSwitch::Status status;
+  std::string response_code;
+  unsigned int attempts;
+  bool batch_uploaded;
+  std::chrono::milliseconds elapsed;
+};
+
+struct SettlementReport {
+  std::vector<SettlementOutcome> outcomes;  // in job order
+  std::chrono::milliseconds elapsed;
+};
+
+struct SettlementOrchestratorConfig {
+  SettlementOrchestratorConfig()
+      : max_per_host(4),
+        max_attempts(3),
+        retry_delay(5000) {
+  }
+
+  std::size_t max_per_host;  // connections open at once to one host
+  unsigned int max_attempts;
+  std::chrono::milliseconds retry_delay;  // doubled after each attempt
+};
+
+// Closes independent batches in parallel. Each worker has a HostSwitch of
+// its own, so a connection and the host selected by PreConnect() are never
+// shared. Jobs of one host run on at most max_per_host workers; hosts do
+// not wait for each other. Jobs of the same host, TID and MID, e.g. the
+// currencies of one batch, run one after another in job order.
+//
+// A job connects, settles, and on a reconcile error (95) uploads its
+// transactions and settles again after batch upload; a Diners job with a
+// reconciler goes through HostSwitch::PerformDinersReconciledSettlement()
+// instead. Every settlement request gets a new STAN. A transient failure
+// retries the whole sequence on a new connection.
+class SettlementOrchestrator {
+ public:
+  typedef std::function<std::unique_ptr<HostSwitch>()> SwitchFactory;
+
+  SettlementOrchestrator(SwitchFactory factory,
+                         const SettlementOrchestratorConfig& config =
+                             SettlementOrchestratorConfig());
+
+  // Returns when every job is done. The settlement data of each job holds
+  // the last host response.
+  SettlementReport Run(std::vector<SettlementJob>& jobs);
+
+ private:
+  void RunTerminal(HostSwitch& host_switch, const std::vector<std::size_t>& terminal,
+                   std::vector<SettlementJob>& jobs, SettlementReport& report) const;
+  SettlementOutcome RunJob(HostSwitch& host_switch, SettlementJob& job) const;
+
+  SwitchFactory factory_;
+  SettlementOrchestratorConfig config_;
+};
+
+// One line per job, e.g.
+//   host=2 tid=12345678 mid=000000000123456 batch=17 currency=SGD status=COMPLETED rc=00 attempts=1 uploaded=no ms=2350
+std::string FormatSettlementReport(const std::vector<SettlementJob>& jobs,
+                                   const SettlementReport& report);
+
+}
+
+#endif
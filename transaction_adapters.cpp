@@ -0,0 +1,364 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#include "transaction_adapters.h"
+#include <utility>
+#include "app_counter.h"
+
+namespace fdms {
+
+std::mutex& AppCounterMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+namespace {
+
+amex::AmexTransactionType ConvertTxToAmexTxType(TransactionType tx_type) {
+  amex::AmexTransactionType amex_tx_type = amex::AmexTransactionType::SALE;
+  switch (tx_type) {
+    case TransactionType::REFUND:
+      amex_tx_type = amex::AmexTransactionType::REFUND;
+      break;
+
+    case TransactionType::PREAUTH:
+      amex_tx_type = amex::AmexTransactionType::PREAUTH;
+      break;
+
+    case TransactionType::PREAUTH_COMPLETION_ONLINE:
+      amex_tx_type = amex::AmexTransactionType::PREAUTH_COMPLETION_ONLINE;
+      break;
+
+    case TransactionType::OFFLINE_SALE:
+      amex_tx_type = amex::AmexTransactionType::OFFLINE_SALE;
+      break;
+
+    case TransactionType::SALE:
+      default:     // TODO: other types
+      amex_tx_type = amex::AmexTransactionType::SALE;
+      break;
+  }
+
+  return amex_tx_type;
+}
+
+diners::DinersTransactionType ConvertTxToDinersTxType(TransactionType tx_type) {
+  diners::DinersTransactionType diners_tx_type = diners::DinersTransactionType::SALE;
+  switch (tx_type) {
+    case TransactionType::REFUND:
+      diners_tx_type = diners::DinersTransactionType::REFUND;
+      break;
+
+    case TransactionType::PREAUTH:
+      diners_tx_type = diners::DinersTransactionType::PREAUTH;
+      break;
+
+    case TransactionType::AUTHORIZATION:
+      diners_tx_type = diners::DinersTransactionType::AUTHORIZATION;
+      break;
+
+    case TransactionType::OFFLINE_SALE:
+      diners_tx_type = diners::DinersTransactionType::OFFLINE_SALE;
+      break;
+
+    case TransactionType::PREAUTH_COMPLETION_OFFLINE:
+      diners_tx_type = diners::DinersTransactionType::PREAUTH_COMPLETION_OFFLINE;
+      break;
+
+    default:     // TODO: other types
+      diners_tx_type = diners::DinersTransactionType::SALE;
+      break;
+  }
+
+  return diners_tx_type;
+}
+
+diners::DinersTransactionStatus ConvertTxToDinersTxStatus(TransactionStatus tx_status) {
+  diners::DinersTransactionStatus diners_tx_status = diners::DinersTransactionStatus::IN_PROGRESS;
+  switch (tx_status) {
+    case TransactionStatus::IN_PROGRESS:
+      diners_tx_status = diners::DinersTransactionStatus::IN_PROGRESS;
+      break;
+
+    case TransactionStatus::APPROVED:
+      diners_tx_status = diners::DinersTransactionStatus::APPROVED;
+      break;
+
+    case TransactionStatus::DECLINED:
+      diners_tx_status = diners::DinersTransactionStatus::DECLINED;
+      break;
+
+    case TransactionStatus::NOT_ALLOWED:
+      diners_tx_status = diners::DinersTransactionStatus::NOT_ALLOWED;
+      break;
+
+    case TransactionStatus::TO_ADVISE:
+      diners_tx_status = diners::DinersTransactionStatus::TO_ADVISE;
+      break;
+
+    case TransactionStatus::CANCELLED:
+    default:     // TODO: other transaction status
+      diners_tx_status = diners::DinersTransactionStatus::DECLINED;
+      break;
+  }
+
+  return diners_tx_status;
+}
+
+diners::DinersInProgressStatus ConvertTxToDinersInProgressStatus(InProgressStatus in_progress_status){
+  diners::DinersInProgressStatus diners_in_status;
+  switch(in_progress_status){
+  case InProgressStatus::IN_PROGRESS_NONE:
+    diners_in_status = diners::DinersInProgressStatus::IN_PROGRESS_NONE;
+    break;
+
+  case InProgressStatus::IN_PROGRESS_VOID:
+    diners_in_status = diners::DinersInProgressStatus::IN_PROGRESS_VOID;
+    break;
+
+  case InProgressStatus::IN_PROGRESS_PREAUTH_COMPLETION:
+    diners_in_status = diners::DinersInProgressStatus::IN_PROGRESS_SALE_COMPLETION;
+    break;
+
+  default:     // TODO: other status
+    diners_in_status = diners::DinersInProgressStatus::IN_PROGRESS_NONE;
+    break;
+  }
+
+  return diners_in_status;
+}
+
+}
+
+/**************************************
+ * AMEX
+ **************************************/
+AmexTransactionAdapter::AmexTransactionAdapter(Transaction& tx, bool write_back_results)
+    : tx_(tx),
+      write_back_results_(write_back_results) {
+  amex_tx_.pan = tx.pan;
+  amex_tx_.processing_code = tx.processing_code;
+  amex_tx_.amount = tx.amount;
+
+  amex_tx_.stan = tx.stan;
+  amex_tx_.expiration_date = tx.expiration_date;
+  amex_tx_.pos_entry_mode = tx.pos_entry_mode;
+  amex_tx_.nii = tx.nii;
+  amex_tx_.pos_condition_code = tx.pos_condition_code;
+
+  if (tx.track2_equivalent_data) {
+    amex_tx_.track2 = tx.track2_equivalent_data->GetData();
+  }
+
+  amex_tx_.tid = tx.tid;
+  amex_tx_.mid = tx.mid;
+
+  // borrowed, handed back in the destructor
+  if (!tx.track1_data.empty()) {
+    amex_tx_.track1_data = std::move(tx.track1_data);
+  }
+
+  if (!tx.pin_data.empty()) {
+    amex_tx_.pin_block = std::move(tx.pin_data);
+  }
+
+  amex_tx_.additional_amount = tx.secondary_amount;
+  amex_tx_.icc_data = std::move(tx.icc_data);
+  amex_tx_.transaction_type = ConvertTxToAmexTxType(tx.transaction_type);
+  amex_tx_.tpdu = tx.tpdu;
+
+  amex_tx_.tx_datetime = tx.tx_datetime;
+  amex_tx_.rrn = tx.rrn;
+  amex_tx_.auth_id_response = tx.auth_id_response;
+  amex_tx_.response_code = tx.response_code;
+  amex_tx_.issuer_emv_response = std::move(tx.issuer_emv_response);
+
+  amex_tx_.invoice_number = tx.invoice_num;
+  amex_tx_.amex_4dbc = std::move(tx.cvv);
+  amex_tx_.preauth_amount = tx.preauth_amount;
+}
+
+AmexTransactionAdapter::~AmexTransactionAdapter() {
+  tx_.track1_data = std::move(amex_tx_.track1_data);
+  if (amex_tx_.pin_block) {
+    tx_.pin_data = std::move(*amex_tx_.pin_block);
+  }
+  tx_.icc_data = std::move(amex_tx_.icc_data);
+  tx_.issuer_emv_response = std::move(amex_tx_.issuer_emv_response);
+  tx_.cvv = std::move(amex_tx_.amex_4dbc);
+
+  if (!write_back_results_)
+    return;
+
+  // host results
+  tx_.processing_code = std::move(amex_tx_.processing_code);
+  tx_.tx_datetime = amex_tx_.tx_datetime;  // TODO: check that. Shall we have a host datetime somewhere?
+  tx_.rrn = std::move(amex_tx_.rrn);
+  tx_.auth_id_response = std::move(amex_tx_.auth_id_response);
+  tx_.response_code = std::move(amex_tx_.response_code);
+}
+
+amex::AmexSettlementData BuildAmexSettlementData(const SettlementData & settle_data){
+  amex::AmexSettlementData amex_settle;
+  amex_settle.tx_datetime = settle_data.tx_datetime;
+  amex_settle.batch_number = settle_data.batch_number;
+  amex_settle.nii = settle_data.nii;
+  amex_settle.tpdu = settle_data.tpdu;
+  amex_settle.tid = settle_data.tid;
+  amex_settle.mid = settle_data.mid;
+  amex_settle.rrn = settle_data.rrn;
+  amex_settle.stan = settle_data.stan;
+
+  amex_settle.batch_summary.credit_total.count = settle_data.batch_summary.refunds_total.count;
+  amex_settle.batch_summary.credit_total.total = settle_data.batch_summary.refunds_total.total;
+  amex_settle.batch_summary.debit_total.count = settle_data.batch_summary.sales_total.count;
+  amex_settle.batch_summary.debit_total.total = settle_data.batch_summary.sales_total.total;
+  amex_settle.batch_summary.currency = settle_data.batch_summary.currency;
+
+  amex_settle.invoice_num = NextAppCounter(&GetNextInvoiceNo);  //TODO: check / clarify amex requirement
+
+  return amex_settle;
+}
+
+void FillSettlementDataWithAmexSettlementData(SettlementData & settle_data, const amex::AmexSettlementData& amex_settle_data) {
+  settle_data.processing_code = amex_settle_data.processing_code;
+  settle_data.tx_datetime = amex_settle_data.tx_datetime;
+  settle_data.rrn = amex_settle_data.rrn;
+  settle_data.response_code = amex_settle_data.response_code;
+  settle_data.stan = amex_settle_data.stan;
+  settle_data.nii = amex_settle_data.nii;
+  settle_data.tid = amex_settle_data.tid;
+}
+
+/**************************************
+ * DINERS
+ **************************************/
+DinersTransactionAdapter::DinersTransactionAdapter(Transaction& tx, bool write_back_results)
+    : tx_(tx),
+      write_back_results_(write_back_results) {
+  diners_tx_.pan = tx.pan;
+  diners_tx_.processing_code = tx.processing_code;
+  diners_tx_.amount = tx.amount;
+
+  diners_tx_.stan = tx.stan;
+  diners_tx_.expiration_date = tx.expiration_date;
+  diners_tx_.pos_entry_mode = tx.pos_entry_mode;
+  diners_tx_.nii = tx.nii;
+  diners_tx_.pos_condition_code = tx.pos_condition_code;
+
+  if (tx.track2_equivalent_data) {
+    diners_tx_.track2 = tx.track2_equivalent_data->GetData();
+  }
+
+  if (tx.aid) {
+    diners_tx_.aid = tx.aid;
+  }
+
+  diners_tx_.tid = tx.tid;
+  diners_tx_.mid = tx.mid;
+
+  // borrowed, handed back in the destructor
+  diners_tx_.cvv = tx.cvv;
+  tx.cvv.clear();
+
+  if (!tx.track1_data.empty()) {
+    diners_tx_.track1_data = tx.track1_data;
+    tx.track1_data.clear();
+  }
+
+  if (!tx.pin_data.empty()) {
+    diners_tx_.pin_block = tx.pin_data;
+    tx.pin_data.clear();
+  }
+
+  diners_tx_.additional_amount = tx.secondary_amount;
+  diners_tx_.original_additional_amount = tx.original_secondary_amount;
+  diners_tx_.icc_data = std::move(tx.icc_data);
+  diners_tx_.transaction_type = ConvertTxToDinersTxType(tx.transaction_type);
+  diners_tx_.in_progress_status = ConvertTxToDinersInProgressStatus(tx.in_progress_status);
+  diners_tx_.transaction_status = ConvertTxToDinersTxStatus(tx.transaction_status);
+  diners_tx_.previous_transaction_status = ConvertTxToDinersTxStatus(tx.previous_transaction_status);
+  diners_tx_.tpdu = tx.tpdu;
+
+  diners_tx_.tx_datetime = tx.tx_datetime;
+  diners_tx_.rrn = tx.rrn;
+  diners_tx_.auth_id_response = tx.auth_id_response;
+  diners_tx_.response_code = tx.response_code;
+  diners_tx_.issuer_emv_response = std::move(tx.issuer_emv_response);
+
+  diners_tx_.invoice_number = tx.invoice_num;
+  diners_tx_.batch_number = tx.batch_num;
+  diners_tx_.preauth_amount = tx.preauth_amount;
+  diners_tx_.cardholder_name = tx.card_holder_name;
+  if (tx.pan_sequence_number) {
+    diners_tx_.pan_sequence_number = tx.pan_sequence_number;
+  }
+
+  diners_tx_.is_preauth_completed = tx.is_preauth_completed;
+  diners_tx_.is_adjusted = tx.is_adjusted;
+}
+
+DinersTransactionAdapter::~DinersTransactionAdapter() {
+  tx_.cvv = diners_tx_.cvv;
+  tx_.track1_data = diners_tx_.track1_data;
+  if (!diners_tx_.pin_block.empty()) {
+    tx_.pin_data = diners_tx_.pin_block;
+  }
+  tx_.icc_data = std::move(diners_tx_.icc_data);
+  tx_.issuer_emv_response = std::move(diners_tx_.issuer_emv_response);
+
+  if (!write_back_results_)
+    return;
+
+  // host results
+  tx_.processing_code = diners_tx_.processing_code;
+  tx_.tx_datetime = diners_tx_.tx_datetime;  // TODO: check that. Shall we have a host datetime somewhere?
+  tx_.rrn = diners_tx_.rrn;
+  tx_.auth_id_response = diners_tx_.auth_id_response;
+  tx_.response_code = diners_tx_.response_code;
+}
+
+diners::DinersSettlementData BuildDinersSettlementData(const SettlementData & settle_data){
+	diners::DinersSettlementData diners_settle;
+    diners_settle.tx_datetime = settle_data.tx_datetime; //To check
+    diners_settle.batch_number = settle_data.batch_number;
+    diners_settle.nii = settle_data.nii;
+    diners_settle.tpdu = settle_data.tpdu;
+    diners_settle.tid = settle_data.tid;
+    diners_settle.mid = settle_data.mid;
+    diners_settle.rrn = settle_data.rrn;
+    diners_settle.stan = settle_data.stan;
+
+    diners_settle.batch_summary.refunds_total.count = settle_data.batch_summary.refunds_total.count;
+    diners_settle.batch_summary.refunds_total.total = settle_data.batch_summary.refunds_total.total;
+    diners_settle.batch_summary.sales_total.count = settle_data.batch_summary.sales_total.count;
+    diners_settle.batch_summary.sales_total.total = settle_data.batch_summary.sales_total.total;
+    diners_settle.batch_summary.currency = settle_data.batch_summary.currency;
+
+    diners_settle.invoice_num = NextAppCounter(&GetNextInvoiceNo);  //TODO: check
+    return diners_settle;
+}
+
+void FillSettlementDataWithDinersSettlementData(SettlementData & settle_data, const diners::DinersSettlementData& diners_settle_data) {
+	settle_data.processing_code = diners_settle_data.processing_code;
+    settle_data.tx_datetime = diners_settle_data.tx_datetime;
+    settle_data.rrn = diners_settle_data.rrn;
+    settle_data.response_code = diners_settle_data.response_code;
+    settle_data.stan = diners_settle_data.stan;
+    settle_data.nii = diners_settle_data.nii;
+    settle_data.tid = diners_settle_data.tid;
+}
+
+}
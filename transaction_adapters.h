@@ -0,0 +1,90 @@
+/*
+ ------------------------------------------------------------------------------
+ INGENICO Technical Software Department
+ ------------------------------------------------------------------------------
+ Copyright (c) 2017 INGENICO S.A.
+ 28-32 boulevard de Grenelle 75015 Paris, France.
+ All rights reserved.
+ This source program is the property of the INGENICO Company mentioned above
+ and may not be copied in any form or by any means, whether in part or in whole,
+ except under license expressly granted by such INGENICO company.
+ All copies of this source program, whether in part or in whole, and
+ whether modified or not, must display this and all other
+ embedded copyright and ownership notices in full.
+ ------------------------------------------------------------------------------
+ */
+#ifndef FDMS__TRANSACTION_ADAPTERS_H_
+#define FDMS__TRANSACTION_ADAPTERS_H_
+
+#include <mutex>
+#include <fdms/host_switch.h>
+#include <amex/amex_host.h>
+#include <diners/diners_host.h>
+
+namespace fdms {
+
+// Presents a Transaction to the Amex host for the duration of one call.
+// Scalars are copied; bulk data (ICC data, PIN block, track 1, CVV, issuer
+// EMV response) is moved out of the Transaction and moved back, together
+// with the host results, when the adapter goes out of scope. The
+// Transaction must not be used while the adapter is alive. Batch upload
+// passes write_back_results = false so batch records keep their values.
+class AmexTransactionAdapter {
+ public:
+  explicit AmexTransactionAdapter(Transaction& tx, bool write_back_results = true);
+  ~AmexTransactionAdapter();
+
+  amex::AmexTransaction& get() {
+    return amex_tx_;
+  }
+
+ private:
+  AmexTransactionAdapter(const AmexTransactionAdapter&);
+  AmexTransactionAdapter& operator=(const AmexTransactionAdapter&);
+
+  Transaction& tx_;
+  bool write_back_results_;
+  amex::AmexTransaction amex_tx_;
+};
+
+// Same as AmexTransactionAdapter, for the Diners host.
+class DinersTransactionAdapter {
+ public:
+  explicit DinersTransactionAdapter(Transaction& tx, bool write_back_results = true);
+  ~DinersTransactionAdapter();
+
+  diners::DinersTransaction& get() {
+    return diners_tx_;
+  }
+
+ private:
+  DinersTransactionAdapter(const DinersTransactionAdapter&);
+  DinersTransactionAdapter& operator=(const DinersTransactionAdapter&);
+
+  Transaction& tx_;
+  bool write_back_results_;
+  diners::DinersTransaction diners_tx_;
+};
+
+// The application counters (app_counter.h) are not thread safe, and
+// settlements may run on several threads (see SettlementOrchestrator).
+// Calls made from HostSwitch go through NextAppCounter(&GetNextStanNo).
+std::mutex& AppCounterMutex();
+
+template<typename Counter>
+auto NextAppCounter(Counter counter) -> decltype(counter()) {
+  std::lock_guard<std::mutex> lock(AppCounterMutex());
+  return counter();
+}
+
+amex::AmexSettlementData BuildAmexSettlementData(const SettlementData& settle_data);
+void FillSettlementDataWithAmexSettlementData(SettlementData& settle_data,
+                                              const amex::AmexSettlementData& amex_settle_data);
+
+diners::DinersSettlementData BuildDinersSettlementData(const SettlementData& settle_data);
+void FillSettlementDataWithDinersSettlementData(SettlementData& settle_data,
+                                                const diners::DinersSettlementData& diners_settle_data);
+
+}
+
+#endif